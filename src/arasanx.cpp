@@ -13,12 +13,15 @@
 #include "attacks.h"
 #include "globals.h"
 #include "log.h"
+#include "memusage.h"
 #include "calctime.h"
 #include "eco.h"
 #include "learn.h"
 #include "boardio.h"
 #include "legal.h"
 #include "bitprobe.h"
+#include "output.h"
+#include "trace.h"
 #ifdef UNIT_TESTS
 #include "unit.h"
 #endif
@@ -563,6 +566,12 @@ static void do_help() {
    cout << "   - run an EPD testsuite" << endl;
    cout << "eval <file>:     evaluate a FEN position." << endl;
    cout << "perft <depth>:   compute perft value for a given depth" << endl;
+   cout << "wakeup <n>:      measure thread wakeup latency over n signals" << endl;
+   cout << "trace on|off:    start or stop tracing search events" << endl;
+   cout << "trace <file>:    write traced events to a file (Chrome trace format)" << endl;
+   cout << "memory:          show memory usage by subsystem" << endl;
+   cout << "savehash <file>: save the hash table to a file" << endl;
+   cout << "loadhash <file>: load the hash table from a file" << endl;
 }
 
 
@@ -701,7 +710,7 @@ uint64_t nodes, uint64_t tb_hits, const string &best_line_image, int multipv) {
       s << " pv ";
       s << best_line_image;
    }
-   cout << s.str() << endl;
+   outputQueue.write(s.str());
    if (doTrace) {
       theLog->write(s.str().c_str()); theLog->write_eol();
    }
@@ -747,17 +756,13 @@ static void CDECL post_output(const Statistics &stats) {
    }
    else if (post) {
       // "post" output for Winboard
-#ifdef _WIN32
-      printf("%2u%c %6d %6ld %8I64u %s\n",
-#else
-      printf("%2u%c %6d %6ld %8llu %s\n",
-#endif
-         stats.depth,' ',
-         int((score*100)/Params::PAWN_VALUE), // score in centipawns
-         (long)stats.elapsed_time/10, // time in centiseconds
-         (unsigned long long)stats.num_nodes,
-         stats.best_line_image.c_str());
-         fflush(stdout);
+      stringstream s;
+      s << setw(2) << stats.depth << "  " <<
+         setw(6) << int((score*100)/Params::PAWN_VALUE) << ' ' << // score in centipawns
+         setw(6) << (long)stats.elapsed_time/10 << ' ' << // time in centiseconds
+         setw(8) << stats.num_nodes << ' ' <<
+         stats.best_line_image;
+      outputQueue.write(s.str());
    }
 }
 
@@ -1146,6 +1151,8 @@ static int isDraw(const Board &board, Statistics &last_stats, string &reason) {
 
 static void send_move(Board &board, Move &move, Statistics
                       &stats) {
+    // make sure search output precedes the move
+    outputQueue.flush();
     // In case of multi-pv, make sure the high-scoring move is
     // sent as best move.
     if (stats.multipv_limit > 1) {
@@ -1514,11 +1521,14 @@ static int check_pending(Board &board) {
 }
 
 static void analyze_output(const Statistics &stats) {
-    // output search status
-    cout << "stat01: " <<
+    // output search status (queued, because a search may be
+    // writing output)
+    stringstream s;
+    s << "stat01: " <<
         stats.elapsed_time << " " << stats.num_nodes << " " <<
         stats.depth << " " <<
-        stats.mvleft << " " << stats.mvtot << endl;
+        stats.mvleft << " " << stats.mvtot;
+    outputQueue.write(s.str());
 }
 
 static void analyze(Board &board)
@@ -2307,6 +2317,31 @@ static uint64_t perft(Board &board, int depth) {
    return nodes;
 }
 
+// Measure the average time (in microseconds) from signalling a
+// waiting thread until it runs, using the given spin count. Two
+// threads signal each other back and forth, so each round trip is
+// two wakeups.
+static double wakeupLatency(int spinCount, int iterations) {
+   const int savedSpinCount = ThreadControl::getSpinCount();
+   ThreadControl::setSpinCount(spinCount);
+   ThreadControl ping, pong;
+   std::thread responder([&]() {
+      for (int i = 0; i < iterations; i++) {
+         ping.wait();
+         pong.signal();
+      }
+   });
+   const auto start = std::chrono::high_resolution_clock::now();
+   for (int i = 0; i < iterations; i++) {
+      ping.signal();
+      pong.wait();
+   }
+   const auto end = std::chrono::high_resolution_clock::now();
+   responder.join();
+   ThreadControl::setSpinCount(savedSpinCount);
+   return std::chrono::duration<double,std::micro>(end-start).count()/(2.0*iterations);
+}
+
 static void loadgame(Board &board,ifstream &file) {
     vector<ChessIO::Header> hdrs(20);
     long first;
@@ -2385,6 +2420,10 @@ static bool do_command(const string &cmd, Board &board) {
         // Learning is disabled because we don't have full game history w/ scores
         options.learning.position_learning = 0;
         cout << "id name " << "Arasan " << Arasan_Version;
+#ifdef CPU_DISPATCH
+        // report the CPU-specific code selected at startup
+        cout << " (" << Attacks::implementation() << ")";
+#endif
         cout << endl;
         cout << "id author Jon Dart" << endl;
         cout << "option name Hash type spin default " <<
@@ -2394,6 +2433,19 @@ static bool do_command(const string &cmd, Board &board) {
 #else
             "2000" << endl;
 #endif
+        cout << "option name Memory budget type spin default " <<
+            options.search.memory_budget/(1024L*1024L) << " min 0 max " <<
+#ifdef _64BIT
+            "64000" << endl;
+#else
+            "2000" << endl;
+#endif
+        cout << "option name Hash file type string default " <<
+            (options.search.hash_file.length() ?
+             options.search.hash_file : "<empty>") << endl;
+        cout << "option name Shared hash name type string default " <<
+            (options.search.hash_shared_name.length() ?
+             options.search.hash_shared_name : "<empty>") << endl;
         cout << "option name Ponder type check default true" << endl;
         cout << "option name Contempt type spin default 0 min -200 max 200" << endl;
 #if defined(GAVIOTA_TBS) || defined(NALIMOV_TBS) || defined(SYZYGY_TBS)
@@ -2433,6 +2485,8 @@ static bool do_command(const string &cmd, Board &board) {
         cout << "option name SyzygyProbeDepth type spin default " <<
             options.search.syzygy_probe_depth <<
            " min 0 max 64" << endl;
+        cout << "option name SyzygyLockTables type check default " <<
+            (options.search.syzygy_lock_tables ? "true" : "false") << endl;
 #endif
 #endif
         cout << "option name MultiPV type spin default 1 min 1 max " << Statistics::MAX_PV << endl;
@@ -2442,6 +2496,13 @@ static bool do_command(const string &cmd, Board &board) {
         cout << "option name Threads type spin default " <<
             options.search.ncpus << " min 1 max " <<
             Constants::MaxCPUs << endl;
+        cout << "option name Thread spin count type spin default " <<
+            options.search.thread_spin_count << " min 0 max 100000" << endl;
+        cout << "option name Search statistics type check default " <<
+            (options.search.search_stats ? "true" : "false") << endl;
+        cout << "option name Search statistics file type string default " <<
+            (options.search.search_stats_file.length() ?
+             options.search.search_stats_file : "<empty>") << endl;
         cout << "option name UCI_LimitStrength type check default false" << endl;
         cout << "option name UCI_Elo type spin default " <<
             1000+options.search.strength*16 << " min 1000 max 2600" << endl;
@@ -2492,6 +2553,33 @@ static bool do_command(const string &cmd, Board &board) {
                 }
             }
         }
+        else if (uciOptionCompare(name,"Memory budget")) {
+            // size is in megabytes; 0 means no budget
+            stringstream buf(value);
+            int size;
+            buf >> size;
+            if (buf.fail() || size < 0) {
+                cout << "info problem setting memory budget to " << buf.str() << endl;
+            }
+            else if ((size_t)size*1024L*1024L != options.search.memory_budget) {
+                options.search.memory_budget = (size_t)size*1024L*1024L;
+                searcher->applyMemoryBudget();
+            }
+        }
+        else if (uciOptionCompare(name,"Hash file") ||
+                 uciOptionCompare(name,"Shared hash name")) {
+            if (value == "<empty>") value.clear();
+            string &opt = uciOptionCompare(name,"Hash file") ?
+                options.search.hash_file : options.search.hash_shared_name;
+            if (value != opt) {
+                opt = value;
+                searcher->resizeHash(options.search.hash_table_size);
+                // an existing hash file or shared table determines the
+                // table size
+                options.search.hash_table_size =
+                    searcher->hashTable.getHashSize()*sizeof(HashEntry);
+            }
+        }
         else if (uciOptionCompare(name,"Ponder")) {
             easy = !(value == "true");
         }
@@ -2565,6 +2653,9 @@ static bool do_command(const string &cmd, Board &board) {
         else if (uciOptionCompare(name,"SyzygyProbeDepth")) {
            Options::setOption<int>(value,options.search.syzygy_probe_depth);
         }
+        else if (uciOptionCompare(name,"SyzygyLockTables")) {
+           options.search.syzygy_lock_tables = (value == "true");
+        }
 #endif
         else if (uciOptionCompare(name,"OwnBook")) {
             options.book.book_enabled = (value == "true");
@@ -2591,6 +2682,20 @@ static bool do_command(const string &cmd, Board &board) {
                 searcher->setThreadCount(options.search.ncpus);
             }
         }
+        else if (uciOptionCompare(name,"Thread spin count")) {
+            int count;
+            if (Options::setOption<int>(value,count) && count >= 0) {
+                options.search.thread_spin_count = count;
+                searcher->updateSpinCount();
+            }
+        }
+        else if (uciOptionCompare(name,"Search statistics")) {
+            options.search.search_stats = (value == "true");
+        }
+        else if (uciOptionCompare(name,"Search statistics file")) {
+            if (value == "<empty>") value.clear();
+            options.search.search_stats_file = value;
+        }
         else if (uciOptionCompare(name,"UCI_LimitStrength")) {
             uciStrengthOpts.limitStrength = (value == "true");
             if (uciStrengthOpts.limitStrength) {
@@ -2645,7 +2750,7 @@ static bool do_command(const string &cmd, Board &board) {
     }
     else if (uci && cmd == "isready") {
         delayedInit();
-        cout << "readyok" << endl;
+        outputQueue.write("readyok");
 #ifdef UCI_LOG
         ucilog << "readyok" << endl;
 #endif
@@ -2812,6 +2917,54 @@ static bool do_command(const string &cmd, Board &board) {
           cerr << "usage: perft <depth>" << endl;
        }
     }
+    else if (cmd_word == "trace") {
+       if (cmd_args == "on" || cmd_args == "off") {
+          EventTrace::enable(cmd_args == "on");
+       }
+       else if (cmd_args.length() == 0) {
+          cerr << "usage: trace on|off|<file>" << endl;
+       }
+       else if (!EventTrace::dump(cmd_args)) {
+          outputQueue.write(string(uci ? "info string " : "# ") +
+             "error writing trace to " + cmd_args);
+       }
+    }
+    else if (cmd_word == "wakeup") {
+       stringstream ss(cmd_args);
+       int iterations = 10000;
+       if (cmd_args.length() && ((ss >> iterations).fail() || iterations <= 0)) {
+          cerr << "usage: wakeup <iterations>" << endl;
+       }
+       else {
+          // the configured count, which may be turned off in the pool
+          const int spinCount = options.search.thread_spin_count;
+          stringstream s;
+          s << (uci ? "info string " : "") << "wakeup latency: " <<
+             wakeupLatency(spinCount,iterations) << " usec (spin count " <<
+             spinCount << "), " << wakeupLatency(0,iterations) <<
+             " usec (no spin)";
+          outputQueue.write(s.str());
+       }
+    }
+    else if (cmd_word == "savehash" || cmd_word == "loadhash") {
+       if (cmd_args.length() == 0) {
+          cerr << "usage: " << cmd_word << " <file>" << endl;
+       }
+       else if (cmd_word == "savehash") {
+          if (!searcher->hashTable.saveHash(cmd_args)) {
+             outputQueue.write(string(uci ? "info string " : "# ") +
+                "error saving hash table to " + cmd_args);
+          }
+       }
+       else if (searcher->hashTable.loadHash(cmd_args)) {
+          options.search.hash_table_size =
+             searcher->hashTable.getHashSize()*sizeof(HashEntry);
+       }
+       else {
+          outputQueue.write(string(uci ? "info string " : "# ") +
+             "error loading hash table from " + cmd_args);
+       }
+    }
     else if (cmd_word == "eval") {
         string filename;
         if (cmd_args.length()) {
@@ -3328,6 +3481,16 @@ static bool do_command(const string &cmd, Board &board) {
            }
         }
     }
+    else if (cmd_word == "memory" && cmd_args.empty()) {
+        // report memory usage, queued so it is not interleaved with
+        // output from a search in progress
+        stringstream s;
+        MemoryUsage::report(s, uci ? "info string memory " : "");
+        string line;
+        while (getline(s,line)) {
+           outputQueue.write(line);
+        }
+    }
     else if (cmd_word == "memory") {
         // Setting -H on the Arasan command line takes precedence over
         // what the GUI sets
@@ -3556,6 +3719,7 @@ int CDECL main(int argc, char **argv) {
         exit(-1);
     }
     atexit(cleanupGlobals);
+    outputQueue.start();
 
 #ifdef _WIN32
     // setup polling thread for input from engine
@@ -3698,5 +3862,6 @@ int CDECL main(int argc, char **argv) {
     pthread_join(pollingThreadHandle,&value_ptr);
 #endif
     delete game_file;
+    outputQueue.stop();
     return 0;
 }
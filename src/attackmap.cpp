@@ -0,0 +1,71 @@
+// Copyright 2017 by Jon Dart. All Rights Reserved.
+
+#include "attackmap.h"
+#include "debug.h"
+
+void CheckInfo::compute(const Board &board)
+{
+   const ColorType side = board.sideToMove();
+   okp = board.kingSquare(board.oppositeSide());
+   disc = board.getPinned(okp,side,side);
+   checkSq[Empty] = checkSq[King] = checkSq[7] = 0;
+   checkSq[Pawn] = Attacks::pawn_attacks[okp][side];
+   checkSq[Knight] = Attacks::knight_attacks[okp];
+   checkSq[Bishop] = board.bishopAttacks(okp);
+   checkSq[Rook] = board.rookAttacks(okp);
+   checkSq[Queen] = checkSq[Bishop] | checkSq[Rook];
+   key = board.hashCode();
+}
+
+template <ColorType side>
+void AttackMap::computeSide(const Board &board)
+{
+   Bitboard *types = byType[side];
+   Square sq;
+   types[Empty] = 0;
+   types[Pawn] = board.allPawnAttacks(side);
+   Bitboard b;
+   Bitboard knights(board.knight_bits[side]);
+   while (knights.iterate(sq)) {
+      b |= (from[sq] = Attacks::knight_attacks[sq]);
+   }
+   types[Knight] = b;
+   b = 0;
+   Bitboard bishops(board.bishop_bits[side]);
+   while (bishops.iterate(sq)) {
+      b |= (from[sq] = board.bishopAttacks(sq));
+   }
+   types[Bishop] = b;
+   b = 0;
+   Bitboard rooks(board.rook_bits[side]);
+   while (rooks.iterate(sq)) {
+      b |= (from[sq] = board.rookAttacks(sq));
+   }
+   types[Rook] = b;
+   b = 0;
+   Bitboard queens(board.queen_bits[side]);
+   while (queens.iterate(sq)) {
+      b |= (from[sq] = board.queenAttacks(sq));
+   }
+   types[Queen] = b;
+   const Square kp = board.kingSquare(side);
+   types[King] = from[kp] = Attacks::king_attacks[kp];
+   types[7] = 0;
+   all[side] = types[Pawn] | types[Knight] | types[Bishop] |
+      types[Rook] | types[Queen] | types[King];
+   pins[side] = board.getPinned(kp,OppositeColor(side),side);
+}
+
+void AttackMap::compute(const Board &board)
+{
+   computeSide<White>(board);
+   computeSide<Black>(board);
+   checks = board.calcAttacks(board.kingSquare(board.sideToMove()),
+                              board.oppositeSide());
+   key = board.hashCode();
+#ifdef _DEBUG
+   for (int i = 0; i < 2; i++) {
+      ASSERT(all[i] == board.allAttacks((ColorType)i));
+   }
+#endif
+}
@@ -0,0 +1,174 @@
+// Copyright 2017 by Jon Dart. All Rights Reserved.
+
+#ifndef _ATTACKMAP_H
+#define _ATTACKMAP_H
+
+#include "board.h"
+#include "debug.h"
+#include <cstdlib>
+
+// Information used to determine whether moves give check, for the
+// side to move in a single position. This is much cheaper to compute
+// than the full attack map, and reduces the check tests done for each
+// move in the search to a few bitboard operations.
+class CheckInfo
+{
+ public:
+
+   CheckInfo() : key(0) {
+   }
+
+   int isValid(const Board &board) const {
+      return key == board.hashCode();
+   }
+
+   void compute(const Board &board);
+
+   // Pieces of the side to move that would uncover check on the
+   // opposing King if moved off the line to it.
+   const Bitboard &discoveredCheckCandidates() const {
+      return disc;
+   }
+
+   // Squares from which a piece of type "p" belonging to the side to
+   // move would attack the opposing King.
+   const Bitboard &checkSquares(PieceType p) const {
+      return checkSq[p];
+   }
+
+   // True if "move" uncovers check by another piece.
+   int isDiscoveredCheck(Move move) const {
+      const Square start = StartSquare(move);
+      return disc.isSet(start) &&
+         std::abs(Attacks::directions[start][okp]) !=
+         std::abs(Attacks::directions[DestSquare(move)][okp]);
+   }
+
+   // Same result as Board::wouldCheck, which it replaces in the
+   // search.
+   CheckStatusType wouldCheck(const Board &board, Move move) const {
+      ASSERT(isValid(board));
+      if (isDiscoveredCheck(move)) {
+         return InCheck;
+      }
+      if (TypeOfMove(move) != Normal) {
+         // castling, en passant and promotions are rare: use the
+         // full test.
+         return board.wouldCheck(move);
+      }
+      const PieceType p = PieceMoved(move);
+      const Bitboard &targets = (p == King) ?
+         Attacks::king_attacks[okp] : checkSq[p];
+      const CheckStatusType result = targets.isSet(DestSquare(move)) ?
+         InCheck : NotInCheck;
+      ASSERT(result == board.wouldCheck(move));
+      return result;
+   }
+
+ private:
+
+   hash_t key;
+   Square okp;
+   Bitboard disc;
+   Bitboard checkSq[8];
+};
+
+// Cache of attack information for a single position. One instance is
+// kept in each entry of the search node stack. It is computed on first
+// use and then shared by the evaluator, SEE and the move generator, so
+// that the slider attack lookups for a position are done only once.
+//
+// The map is tagged with the hash code of the position it was computed
+// for, so a stale map (from a sibling node, or a different thread's
+// use of the stack entry) is detected and recomputed.
+class AttackMap
+{
+ public:
+
+   AttackMap() : key(0) {
+   }
+
+   // true if the map is current for "board".
+   int isValid(const Board &board) const {
+      return key == board.hashCode();
+   }
+
+   // compute the map if it is not current for "board".
+   const AttackMap &update(const Board &board) {
+      if (!isValid(board)) {
+         compute(board);
+      }
+      return *this;
+   }
+
+   void compute(const Board &board);
+
+   void invalidate() {
+      key = 0;
+   }
+
+   // Squares attacked by pieces of type "p" and color "side".
+   const Bitboard &attacks(ColorType side, PieceType p) const {
+      return byType[side][p];
+   }
+
+   // All squares attacked by "side".
+   const Bitboard &attacks(ColorType side) const {
+      return all[side];
+   }
+
+   // Return true if any piece of color "side" attacks "sq".
+   int attacked(Square sq, ColorType side) const {
+      return all[side].isSet(sq);
+   }
+
+   // Squares attacked by the piece on "sq". Only valid for squares
+   // occupied by Knights, Bishops, Rooks, Queens and Kings.
+   const Bitboard &attacksFrom(Square sq) const {
+      return from[sq];
+   }
+
+   // Diagonal attacks of the Bishop or Queen on "sq".
+   Bitboard diagAttacksFrom(Square sq) const {
+      return from[sq] & Attacks::diag_mask[sq];
+   }
+
+   // Rank and file attacks of the Rook or Queen on "sq".
+   Bitboard rankFileAttacksFrom(Square sq) const {
+      return from[sq] & Attacks::rank_file_mask[sq];
+   }
+
+   // Pieces of color "side" that are pinned against their own King.
+   const Bitboard &pinned(ColorType side) const {
+      return pins[side];
+   }
+
+   // Pieces giving check to the side to move.
+   const Bitboard &checkers() const {
+      return checks;
+   }
+
+   // Check information for "board". This is kept separately from
+   // the rest of the map and computed on demand.
+   const CheckInfo &checkInfo(const Board &board) {
+      if (!check.isValid(board)) {
+         check.compute(board);
+      }
+      return check;
+   }
+
+ private:
+
+   template <ColorType side>
+   void computeSide(const Board &board);
+
+   hash_t key;
+   Bitboard byType[2][8];
+   Bitboard all[2];
+   Bitboard pins[2];
+   Bitboard checks;
+   Bitboard from[64];
+   CheckInfo check;
+};
+
+#endif
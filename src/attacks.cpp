@@ -2,6 +2,9 @@
 //
 #include "attacks.h"
 #include "debug.h"
+#include "memusage.h"
+#include <chrono>
+#include <vector>
 
 const CACHE_ALIGN int Attacks::directions[64][64] =
 {
@@ -5207,391 +5210,102 @@ const Bitboard Attacks::ep_mask[8][2] =
 {Bitboard(0x40000000ULL), Bitboard(0x4000000000ULL)}
 };
 
-#if defined (_64BIT) && !defined(BMI2)
-const CACHE_ALIGN unsigned Attacks::r_shift[64]=
-{
-	52, 53, 53, 53, 53, 53, 53, 52,
-	53, 54, 54, 54, 54, 54, 54, 53,
-	53, 54, 54, 54, 54, 54, 54, 53,
-	53, 54, 54, 54, 54, 54, 54, 53,
-	53, 54, 54, 54, 54, 54, 54, 53,
-	53, 54, 54, 54, 54, 54, 54, 53,
-	53, 54, 54, 54, 54, 54, 54, 53,
-	53, 54, 54, 53, 53, 53, 53, 53
-};
-
-const CACHE_ALIGN Bitboard Attacks::r_magic[64]=
-{
-   Bitboard(0x0080001020400080ULL), Bitboard(0x0040001000200040ULL), Bitboard(0x0080081000200080ULL), Bitboard(0x0080040800100080ULL),
-	Bitboard(0x0080020400080080ULL), Bitboard(0x0080010200040080ULL), Bitboard(0x0080008001000200ULL), Bitboard(0x0080002040800100ULL),
-	Bitboard(0x0000800020400080ULL), Bitboard(0x0000400020005000ULL), Bitboard(0x0000801000200080ULL), Bitboard(0x0000800800100080ULL),
-	Bitboard(0x0000800400080080ULL), Bitboard(0x0000800200040080ULL), Bitboard(0x0000800100020080ULL), Bitboard(0x0000800040800100ULL),
-	Bitboard(0x0000208000400080ULL), Bitboard(0x0000404000201000ULL), Bitboard(0x0000808010002000ULL), Bitboard(0x0000808008001000ULL),
-	Bitboard(0x0000808004000800ULL), Bitboard(0x0000808002000400ULL), Bitboard(0x0000010100020004ULL), Bitboard(0x0000020000408104ULL),
-	Bitboard(0x0000208080004000ULL), Bitboard(0x0000200040005000ULL), Bitboard(0x0000100080200080ULL), Bitboard(0x0000080080100080ULL),
-	Bitboard(0x0000040080080080ULL), Bitboard(0x0000020080040080ULL), Bitboard(0x0000010080800200ULL), Bitboard(0x0000800080004100ULL),
-	Bitboard(0x0000204000800080ULL), Bitboard(0x0000200040401000ULL), Bitboard(0x0000100080802000ULL), Bitboard(0x0000080080801000ULL),
-	Bitboard(0x0000040080800800ULL), Bitboard(0x0000020080800400ULL), Bitboard(0x0000020001010004ULL), Bitboard(0x0000800040800100ULL),
-	Bitboard(0x0000204000808000ULL), Bitboard(0x0000200040008080ULL), Bitboard(0x0000100020008080ULL), Bitboard(0x0000080010008080ULL),
-	Bitboard(0x0000040008008080ULL), Bitboard(0x0000020004008080ULL), Bitboard(0x0000010002008080ULL), Bitboard(0x0000004081020004ULL),
-	Bitboard(0x0000204000800080ULL), Bitboard(0x0000200040008080ULL), Bitboard(0x0000100020008080ULL), Bitboard(0x0000080010008080ULL),
-	Bitboard(0x0000040008008080ULL), Bitboard(0x0000020004008080ULL), Bitboard(0x0000800100020080ULL), Bitboard(0x0000800041000080ULL),
-	Bitboard(0x00FFFCDDFCED714AULL), Bitboard(0x007FFCDDFCED714AULL), Bitboard(0x003FFFCDFFD88096ULL), Bitboard(0x0000040810002101ULL),
-	Bitboard(0x0001000204080011ULL), Bitboard(0x0001000204000801ULL), Bitboard(0x0001000082000401ULL), Bitboard(0x0001FFFAABFAD1A2ULL)
-};
-#elif !defined(_64BIT) // 32 bit
-const CACHE_ALIGN unsigned Attacks::r_shift[64] = {
-20, 21, 21, 21, 21, 21, 21, 20,
-21, 22, 22, 22, 22, 22, 22, 21,
-21, 22, 22, 22, 22, 22, 22, 21,
-21, 22, 22, 22, 22, 22, 22, 21,
-21, 22, 22, 22, 22, 22, 22, 21,
-21, 22, 22, 22, 22, 22, 22, 21,
-21, 22, 22, 22, 22, 22, 22, 21,
-20, 21, 21, 21, 21, 21, 21, 20
-};
-const CACHE_ALIGN Bitboard Attacks::r_magic[64]=
-{
-  Bitboard(0xa0588002001205ULL),
-  Bitboard(0x2410004001400220ULL),
-  Bitboard(0x110040220600408ULL),
-  Bitboard(0x1003100810080082ULL),
-  Bitboard(0x2200100220404204ULL),
-  Bitboard(0x300088311000204ULL),
-  Bitboard(0x121000401000092ULL),
-  Bitboard(0x80308001800941ULL),
-  Bitboard(0x1024090000080208ULL),
-  Bitboard(0x30402c0000004010ULL),
-  Bitboard(0x44a200042004018ULL),
-  Bitboard(0x2008401200181001ULL),
-  Bitboard(0x102001004020818ULL),
-  Bitboard(0x100c0000420202ULL),
-  Bitboard(0x5120008010201ULL),
-  Bitboard(0x410412e010020101ULL),
-  Bitboard(0x40314000a081002ULL),
-  Bitboard(0xa12400400182020ULL),
-  Bitboard(0x4080110000b20208ULL),
-  Bitboard(0x22004020080204ULL),
-  Bitboard(0x4a1408800040404ULL),
-  Bitboard(0x200440010c80b01ULL),
-  Bitboard(0x2091080200240c02ULL),
-  Bitboard(0x2482024000800101ULL),
-  Bitboard(0x480002010504501ULL),
-  Bitboard(0x48a2003020004582ULL),
-  Bitboard(0xb02104404242282ULL),
-  Bitboard(0x200421020445a22ULL),
-  Bitboard(0x341006000801280eULL),
-  Bitboard(0x2010c0200045096ULL),
-  Bitboard(0x204210000200a81ULL),
-  Bitboard(0x4800408200000101ULL),
-  Bitboard(0x3804020048400880ULL),
-  Bitboard(0x40412c020204009ULL),
-  Bitboard(0x1004028209012095ULL),
-  Bitboard(0x300082440032010ULL),
-  Bitboard(0x100049040202a01ULL),
-  Bitboard(0x40020008030144ULL),
-  Bitboard(0x820204002812002ULL),
-  Bitboard(0x42040403408040bULL),
-  Bitboard(0x40402901841062ULL),
-  Bitboard(0x2002101400004805ULL),
-  Bitboard(0x10101200020064ULL),
-  Bitboard(0x20201000802c82ULL),
-  Bitboard(0x4600480010010042ULL),
-  Bitboard(0xa000c10101082ULL),
-  Bitboard(0x441003400800803ULL),
-  Bitboard(0x4010200406903ULL),
-  Bitboard(0xc0204020862801ULL),
-  Bitboard(0xc8202012480204fULL),
-  Bitboard(0x90410004422001ULL),
-  Bitboard(0x2012005008444aULL),
-  Bitboard(0x104004000004c0aULL),
-  Bitboard(0x508200822045489ULL),
-  Bitboard(0x922010100400c05ULL),
-  Bitboard(0x2800040010000c1ULL),
-  Bitboard(0x180136100001045ULL),
-  Bitboard(0x50208101010040ULL),
-  Bitboard(0x3092100a00502042ULL),
-  Bitboard(0x4010002100040409ULL),
-  Bitboard(0x1210040700490408ULL),
-  Bitboard(0x844108101400803ULL),
-  Bitboard(0x105240010c1200c5ULL),
-  Bitboard(0x4010244701080481ULL)
-};
-#endif
-
-#if defined(_64BIT) && !defined(BMI2)
-const CACHE_ALIGN unsigned Attacks::b_shift[64]=
-{
-	58, 59, 59, 59, 59, 59, 59, 58,
-	59, 59, 59, 59, 59, 59, 59, 59,
-	59, 59, 57, 57, 57, 57, 59, 59,
-	59, 59, 57, 55, 55, 57, 59, 59,
-	59, 59, 57, 55, 55, 57, 59, 59,
-	59, 59, 57, 57, 57, 57, 59, 59,
-	59, 59, 59, 59, 59, 59, 59, 59,
-	58, 59, 59, 59, 59, 59, 59, 58
-};
-const Bitboard Attacks::b_magic[64]=
-{
-	Bitboard(0x0002020202020200ULL), Bitboard(0x0002020202020000ULL), Bitboard(0x0004010202000000ULL), Bitboard(0x0004040080000000ULL),
-	Bitboard(0x0001104000000000ULL), Bitboard(0x0000821040000000ULL), Bitboard(0x0000410410400000ULL), Bitboard(0x0000104104104000ULL),
-	Bitboard(0x0000040404040400ULL), Bitboard(0x0000020202020200ULL), Bitboard(0x0000040102020000ULL), Bitboard(0x0000040400800000ULL),
-	Bitboard(0x0000011040000000ULL), Bitboard(0x0000008210400000ULL), Bitboard(0x0000004104104000ULL), Bitboard(0x0000002082082000ULL),
-	Bitboard(0x0004000808080800ULL), Bitboard(0x0002000404040400ULL), Bitboard(0x0001000202020200ULL), Bitboard(0x0000800802004000ULL),
-	Bitboard(0x0000800400A00000ULL), Bitboard(0x0000200100884000ULL), Bitboard(0x0000400082082000ULL), Bitboard(0x0000200041041000ULL),
-	Bitboard(0x0002080010101000ULL), Bitboard(0x0001040008080800ULL), Bitboard(0x0000208004010400ULL), Bitboard(0x0000404004010200ULL),
-	Bitboard(0x0000840000802000ULL), Bitboard(0x0000404002011000ULL), Bitboard(0x0000808001041000ULL), Bitboard(0x0000404000820800ULL),
-	Bitboard(0x0001041000202000ULL), Bitboard(0x0000820800101000ULL), Bitboard(0x0000104400080800ULL), Bitboard(0x0000020080080080ULL),
-	Bitboard(0x0000404040040100ULL), Bitboard(0x0000808100020100ULL), Bitboard(0x0001010100020800ULL), Bitboard(0x0000808080010400ULL),
-	Bitboard(0x0000820820004000ULL), Bitboard(0x0000410410002000ULL), Bitboard(0x0000082088001000ULL), Bitboard(0x0000002011000800ULL),
-	Bitboard(0x0000080100400400ULL), Bitboard(0x0001010101000200ULL), Bitboard(0x0002020202000400ULL), Bitboard(0x0001010101000200ULL),
-	Bitboard(0x0000410410400000ULL), Bitboard(0x0000208208200000ULL), Bitboard(0x0000002084100000ULL), Bitboard(0x0000000020880000ULL),
-	Bitboard(0x0000001002020000ULL), Bitboard(0x0000040408020000ULL), Bitboard(0x0004040404040000ULL), Bitboard(0x0002020202020000ULL),
-	Bitboard(0x0000104104104000ULL), Bitboard(0x0000002082082000ULL), Bitboard(0x0000000020841000ULL), Bitboard(0x0000000000208800ULL),
-	Bitboard(0x0000000010020200ULL), Bitboard(0x0000000404080200ULL), Bitboard(0x0000040404040400ULL), Bitboard(0x0002020202020200ULL)
-};
-#elif !defined(_64BIT) // 32 bit
-const CACHE_ALIGN unsigned Attacks::b_shift[64] = {
-26, 27, 27, 27, 27, 27, 27, 26,
-27, 27, 27, 27, 27, 27, 27, 27,
-27, 27, 25, 25, 25, 25, 27, 27,
-27, 27, 25, 23, 23, 25, 27, 27,
-27, 27, 25, 23, 23, 25, 27, 27,
-27, 27, 25, 25, 25, 25, 27, 27,
-27, 27, 27, 27, 27, 27, 27, 27,
-26, 27, 27, 27, 27, 27, 27, 26
-};
-const CACHE_ALIGN Bitboard Attacks::b_magic[64]=
-{
-  Bitboard(0x41084004c2022eULL),
-  Bitboard(0x101410160023014ULL),
-  Bitboard(0x221010004900312ULL),
-  Bitboard(0x1000061800080e89ULL),
-  Bitboard(0x43110020460610ULL),
-  Bitboard(0x4001110000110482ULL),
-  Bitboard(0x610141004042402ULL),
-  Bitboard(0x1028440020011255ULL),
-  Bitboard(0x80a00c000031223ULL),
-  Bitboard(0x104770010000803ULL),
-  Bitboard(0x500286160204314ULL),
-  Bitboard(0x88000508411904ULL),
-  Bitboard(0x900000230001112ULL),
-  Bitboard(0x61d8480c01000481ULL),
-  Bitboard(0x8200c8200900086ULL),
-  Bitboard(0x811041400840082ULL),
-  Bitboard(0x2444008100220240ULL),
-  Bitboard(0x40800c0400a0930ULL),
-  Bitboard(0x20410008102c56ULL),
-  Bitboard(0x108200000014198ULL),
-  Bitboard(0x1018002004852614ULL),
-  Bitboard(0x4200a0440002c01ULL),
-  Bitboard(0x9004d502420081ULL),
-  Bitboard(0x4405440000082125ULL),
-  Bitboard(0x2882522024201010ULL),
-  Bitboard(0x600801c008014840ULL),
-  Bitboard(0x3000208010414400ULL),
-  Bitboard(0xc00420000120820ULL),
-  Bitboard(0x10402100101100ULL),
-  Bitboard(0x3d90100100055441ULL),
-  Bitboard(0x612110000412480ULL),
-  Bitboard(0x41404c1000210a00ULL),
-  Bitboard(0x9cb022304021090ULL),
-  Bitboard(0x1010420420085128ULL),
-  Bitboard(0x631014018001406ULL),
-  Bitboard(0x20220000002858ULL),
-  Bitboard(0x9a0101000084254ULL),
-  Bitboard(0x1081008014022442ULL),
-  Bitboard(0x124441400162081ULL),
-  Bitboard(0x58c300880101ULL),
-  Bitboard(0x6000649400021220ULL),
-  Bitboard(0x2082160000405202ULL),
-  Bitboard(0x2040148400020101ULL),
-  Bitboard(0xc08008004230094ULL),
-  Bitboard(0x3400118000c00181ULL),
-  Bitboard(0xa0018c005040488ULL),
-  Bitboard(0x5040610001a00204ULL),
-  Bitboard(0x530008008502106ULL),
-  Bitboard(0x100800bc24004210ULL),
-  Bitboard(0x4224040109842104ULL),
-  Bitboard(0x91080001110042ULL),
-  Bitboard(0x8484200100a0901ULL),
-  Bitboard(0x242000d10002012ULL),
-  Bitboard(0x4a0a040004024518ULL),
-  Bitboard(0x881040a10404508ULL),
-  Bitboard(0x143140008080648ULL),
-  Bitboard(0x8228000482008aULL),
-  Bitboard(0x4822000400a18a2ULL),
-  Bitboard(0x8411002a601026ULL),
-  Bitboard(0x2084042000021508ULL),
-  Bitboard(0x1052020260021049ULL),
-  Bitboard(0x1004012012045040ULL),
-  Bitboard(0x1c2950c200001220ULL),
-  Bitboard(0x820423001200484ULL)
-};
-#endif
-
-CACHE_ALIGN Attacks::MagicData Attacks::bishopMagicData[64];
-CACHE_ALIGN Attacks::MagicData Attacks::rookMagicData[64];
-
-#ifdef BMI2
-CACHE_ALIGN uint16_t Attacks::magicmovesdb[107648];
+#ifdef CPU_DISPATCH
+// Time a fixed set of slider attack lookups using either the PEXT
+// or the magic method, and return the elapsed time.
+template <bool pextLookup>
+static std::chrono::nanoseconds timeLookups(const vector<uint64_t> &occs) {
+    const auto start = std::chrono::steady_clock::now();
+    uint64_t sum = 0;
+    for (uint64_t occ : occs) {
+        for (Square sq = 0; sq < 64; sq++) {
+            if (pextLookup) {
+                sum += Attacks::rookAttacksPext(sq,occ) ^
+                    Attacks::bishopAttacksPext(sq,occ);
+            } else {
+                sum += Attacks::rookAttacksMagic(sq,occ) ^
+                    Attacks::bishopAttacksMagic(sq,occ);
+            }
+        }
+    }
+    // keep the compiler from discarding the lookups
+#ifdef _MSC_VER
+    static volatile uint64_t sink;
+    sink = sum;
+    (void)sink;
 #else
-CACHE_ALIGN Bitboard Attacks::magicmovesbdb[5248];
-CACHE_ALIGN Bitboard Attacks::magicmovesrdb[102400];
+    asm volatile("" :: "r"(sum));
 #endif
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+}
 
-struct MoveInfo {
-    int dir;
-    Bitboard edges;
-};
-
-static const MoveInfo ROOK_INFO[4] = {
-    {1,Bitboard(0x8080808080808080ULL)},
-    {-1,Bitboard(0x101010101010101ULL)},
-    {8,Bitboard(0xff00000000000000ULL)},
-    {-8,Bitboard(0xffULL)}};
-
-static const MoveInfo BISHOP_INFO[4] = {
-    {7,Bitboard(0xff01010101010101ULL)},
-    {-7,Bitboard(0x80808080808080ffULL)},
-    {9,Bitboard(0xff80808080808080ULL)},
-    {-9,Bitboard(0x1010101010101ffULL)}};
-
-static Bitboard generateSlidingMoves(Square sq, const Bitboard &occ,
-                                     const MoveInfo * const limits,
-                                     bool excludeEdge = false) {
-    Bitboard moves;
-    for (int i = 0; i < 4; i++) {
-        const int dir = limits[i].dir;
-        Square dest = sq;
-        Bitboard limit(occ | limits[i].edges);
-        if (!limits[i].edges.isSet(dest)) {
-            do {
-                dest += dir;
-                ASSERT(OnBoard(dest));
-                if (!excludeEdge ||
-                    !limits[i].edges.isSet(dest)) moves.set(dest);
-            } while (!limit.isSet(dest));
+// Return true if the PEXT lookup is faster than the magic lookup on
+// this machine. PEXT is slow (microcoded) on some processors that
+// support it, so we measure rather than assume.
+static bool pextIsFaster() {
+    // pseudo-random occupancies with a realistic number of pieces
+    vector<uint64_t> occs;
+    uint64_t seed = 0x9E3779B97F4A7C15ULL;
+    for (int i = 0; i < 256; i++) {
+        uint64_t occ = ~0ULL;
+        for (int j = 0; j < 2; j++) {
+            seed = seed*6364136223846793005ULL + 1442695040888963407ULL;
+            occ &= seed ^ (seed >> 29);
         }
+        occs.push_back(occ);
     }
-    return moves;
-}
-
-static Bitboard generateMask(Square sq, const MoveInfo *limits) {
-    return generateSlidingMoves(sq,Bitboard(0),limits,true);
-}
-
-// Generate possible Rook moves from "sq" given board occupancy "occ"
-static Bitboard generateRookMoves(Square sq, const Bitboard &occ) {
-    return generateSlidingMoves(sq,occ,ROOK_INFO);
-}
-
-// Generate possible Rook moves excluding edges
-static Bitboard generateRookMask(Square sq) {
-    return generateMask(sq,ROOK_INFO);
+    std::chrono::nanoseconds magicTime(std::chrono::nanoseconds::max()),
+        pextTime(std::chrono::nanoseconds::max());
+    // take the best of several runs to reduce noise
+    for (int i = 0; i < 3; i++) {
+        magicTime = std::min(magicTime,timeLookups<false>(occs));
+        pextTime = std::min(pextTime,timeLookups<true>(occs));
+    }
+    return pextTime < magicTime;
 }
 
-// Generate possible Bishop moves from "sq" given board occupancy "occ"
-static Bitboard generateBishopMoves(Square sq, const Bitboard &occ) {
-    return generateSlidingMoves(sq,occ,BISHOP_INFO);
-}
+bool Attacks::usePext = false;
+#endif
 
-// Generate possible Bishop moves excluding edges
-static Bitboard generateBishopMask(Square sq) {
-    return generateMask(sq,BISHOP_INFO);
+void Attacks::init() {
+#ifdef CPU_DISPATCH
+  usePext = Bitboard::cpuBmi2 && pextIsFaster();
+#endif
+  // the tables are part of the program image and are never freed
+  MemoryUsage::add(MemoryUsage::StaticTables,tableSize());
 }
 
-// Select, out of the set of n (generaly non-contiguous) bits in "squares",
-// that subset that have their corresponding (0..n-1) bit set in "index".
-static Bitboard generateOccupancy(const Bitboard &squares, const Bitboard &index) {
-    Bitboard tmp(squares);
-    Square sq;
-    Bitboard occ;
-    int n = 0;
-    while (tmp.iterate(sq)) {
-        if (index.isSet(n)) occ.set(sq);
-        n++;
-    }
-    return occ;
+size_t Attacks::tableSize() {
+  size_t size = sizeof(directions) + sizeof(betweenSquares);
+#ifndef BMI2
+  // sliding piece move tables
+  for (int sq = 0; sq < 64; sq++) {
+     size += sizeof(uint64_t)*((1ULL << (64-rookMagicData[sq].shift)) +
+                               (1ULL << (64-bishopMagicData[sq].shift)));
+  }
+#endif
+  return size;
 }
 
-void Attacks::initMagicData() {
-    int b_index = 0;
-    for (Square sq=0; sq<64; sq++)  {
-#ifdef BMI2
-        bishopMagicData[sq].data = magicmovesdb+b_index;
-        Bitboard mask1 = bishopMagicData[sq].mask1 = generateBishopMask(sq);
-        const int numSquares = mask1.bitCount();
-
-        for (uint64_t occBits = 0; occBits < (1ULL)<<numSquares; occBits++) {
-            Bitboard occ = generateOccupancy(mask1,Bitboard(occBits));
-            Bitboard atcks = generateBishopMoves(sq,occ);
-            if (occBits == 0) {
-               bishopMagicData[sq].mask2 = atcks;
-            }
-            ASSERT(b_index<107648);
-            magicmovesdb[b_index++] = uint16_t(_pext_u64(atcks, bishopMagicData[sq].mask2));
-        }
+const char *Attacks::implementation() {
+#if defined(BMI2)
+   return "popcnt pext";
+#elif defined(CPU_DISPATCH)
+   // checked before USE_POPCNT: a POPCNT build still chooses between
+   // PEXT and magic lookups at startup
+#if defined(_MSC_VER) || defined(USE_POPCNT)
+   // MSVC and POPCNT builds always use the POPCNT instruction
+   return usePext ? "popcnt pext" : "popcnt magic";
 #else
-        const Bitboard mask(generateBishopMask(sq));
-        const int numSquares = mask.bitCount();
-        bishopMagicData[sq].moves = magicmovesbdb+b_index;
-        bishopMagicData[sq].shift = b_shift[sq];
-        bishopMagicData[sq].mask = mask;
-        bishopMagicData[sq].magic = b_magic[sq];
-        // iterate through each possible combination of squares
-        // that can be occupied and generate the attacks.
-        for (uint64_t occBits = 0; occBits < (1ULL)<<numSquares; occBits++) {
-            Bitboard occ = generateOccupancy(mask,occBits);
-            setBishopAttacks(sq,occ,generateBishopMoves(sq,occ));
-            b_index++;
-        }
-        if (b_index > 5248) cout << "error" << endl;
-#endif
-    }
-#ifdef BMI2
-    int r_index = b_index;
-#else
-    int r_index = 0;
+   if (Bitboard::cpuPopcnt) {
+      return usePext ? "popcnt pext" : "popcnt magic";
+   } else {
+      return usePext ? "pext" : "magic";
+   }
 #endif
-    for (Square sq=0; sq < 64; sq++) {
-#ifdef BMI2
-        rookMagicData[sq].data = magicmovesdb+r_index;
-        Bitboard mask1 = rookMagicData[sq].mask1 = generateRookMask(sq);
-        const int numSquares = mask1.bitCount();
-
-        for (uint64_t occBits = 0; occBits < (1ULL)<<numSquares; occBits++) {
-            Bitboard occ = generateOccupancy(mask1,Bitboard(occBits));
-            Bitboard atcks = generateRookMoves(sq,occ);
-            if (occBits == 0) {
-               rookMagicData[sq].mask2 = atcks;
-            }
-            ASSERT(b_index<107648);
-            magicmovesdb[r_index++] = uint16_t(_pext_u64(atcks, rookMagicData[sq].mask2));
-        }
+#elif defined(USE_POPCNT)
+   return "popcnt magic";
 #else
-        // This is the set of possible squares reachable by a Rook
-        // on "sq":
-        const Bitboard mask(generateRookMask(sq));
-        const int numSquares = mask.bitCount();
-        rookMagicData[sq].moves = magicmovesrdb+r_index;
-        rookMagicData[sq].shift = r_shift[sq];
-        rookMagicData[sq].mask = mask;
-        rookMagicData[sq].magic = r_magic[sq];
-        // iterate through each possible combination of squares
-        // that can be occupied and generate the attacks.
-        for (uint64_t occBits = 0; occBits < (1ULL)<<numSquares; occBits++) {
-            Bitboard occ = generateOccupancy(mask,occBits);
-            setRookAttacks(sq,occ,generateRookMoves(sq,occ));
-            r_index++;
-        }
-        if (r_index > 102400) cout << "error" << endl;
+   return "magic";
 #endif
-    }
 }
-
-
-void Attacks::init() {
-  initMagicData();
-}
-
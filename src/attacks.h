@@ -7,7 +7,7 @@
 #include "chess.h"
 #include "bitboard.h"
 
-#ifdef BMI2
+#if defined(BMI2) || (defined(CPU_DISPATCH) && defined(_MSC_VER))
 extern "C" {
 #include <immintrin.h>
 };
@@ -48,76 +48,127 @@ class Attacks
      // mask for e.p. checking
      static const Bitboard ep_mask[8][2];
 
-     // arrays for "magic" attack generator
+     // Tables for the slider attack lookups. These are constant data,
+     // generated by util/makemagic.cpp (see magicdata.cpp).
 
-#ifdef BMI2
-     struct MagicData {
-         uint16_t *data;
-         Bitboard mask1;
-         Bitboard mask2;
+#if defined(BMI2) || defined(CPU_DISPATCH)
+     // PEXT/PDEP-based lookup
+     struct PextData {
+         const uint16_t *data;
+         uint64_t mask1;
+         uint64_t mask2;
      };
 
-     static CACHE_ALIGN uint16_t magicmovesdb[107648];
+     static const CACHE_ALIGN PextData bishopPextData[64];
+     static const CACHE_ALIGN PextData rookPextData[64];
+#endif
 
-#else
+#ifndef BMI2
      struct MagicData {
-         Bitboard mask;
-         Bitboard magic;
-         Bitboard *moves;
+         uint64_t mask;
+         uint64_t magic;
+         const uint64_t *moves;
          unsigned shift;
      };
 
-     static CACHE_ALIGN Bitboard magicmovesbdb[5248];
-     static CACHE_ALIGN Bitboard magicmovesrdb[102400];
-
-     // constants, used for initialization:
-     static const CACHE_ALIGN Bitboard b_magic[64];
-     static const CACHE_ALIGN unsigned b_shift[64];
-     static const CACHE_ALIGN Bitboard r_magic[64];
-     static const CACHE_ALIGN unsigned r_shift[64];
-
+     static const CACHE_ALIGN MagicData bishopMagicData[64];
+     static const CACHE_ALIGN MagicData rookMagicData[64];
 #endif
 
-     static CACHE_ALIGN MagicData bishopMagicData[64];
-     static CACHE_ALIGN MagicData rookMagicData[64];
+#ifdef CPU_DISPATCH
+     // true if the PEXT lookup is used: set by init() if the CPU
+     // supports BMI2 and PEXT is faster than the magic lookup.
+     static bool usePext;
+#endif
 
      FORCEINLINE static Bitboard fileMask(Square sq) {
        return file_mask[Files[sq]-1];
      }
-     
+
+#if defined(BMI2) || defined(CPU_DISPATCH)
+     FORCEINLINE static uint64_t pext(uint64_t x, uint64_t mask) {
+#if defined(BMI2) || defined(_MSC_VER)
+         return _pext_u64(x,mask);
+#else
+         // not compiled with -mbmi2, so the intrinsic is unavailable
+         uint64_t ret;
+         __asm__ ("pextq %[mask], %[x], %[ret]"
+                  :[ret] "=r" (ret)
+                  :[x] "r" (x), [mask] "rm" (mask));
+         return ret;
+#endif
+     }
+
+     FORCEINLINE static uint64_t pdep(uint64_t x, uint64_t mask) {
+#if defined(BMI2) || defined(_MSC_VER)
+         return _pdep_u64(x,mask);
+#else
+         uint64_t ret;
+         __asm__ ("pdepq %[mask], %[x], %[ret]"
+                  :[ret] "=r" (ret)
+                  :[x] "r" (x), [mask] "rm" (mask));
+         return ret;
+#endif
+     }
+
+     FORCEINLINE static const Bitboard rookAttacksPext(Square sq,
+                                                       const Bitboard &occupied) {
+         return pdep(rookPextData[sq].data[pext(occupied,rookPextData[sq].mask1)], rookPextData[sq].mask2);
+     }
+
+     FORCEINLINE static const Bitboard bishopAttacksPext(Square sq,
+                                                         const Bitboard &occupied) {
+         return pdep(bishopPextData[sq].data[pext(occupied,bishopPextData[sq].mask1)], bishopPextData[sq].mask2);
+     }
+#endif
+
+#ifndef BMI2
+     FORCEINLINE static const Bitboard rookAttacksMagic(Square sq,
+                                                        const Bitboard &occupied) {
+         const MagicData &m = rookMagicData[sq];
+#ifdef _64BIT
+         return m.moves[((occupied & m.mask)*m.magic)>>m.shift];
+#else
+         const Bitboard b(occupied & m.mask);
+         return m.moves[((b.lovalue()*(uint32_t)m.magic) ^
+                         (b.hivalue()*(uint32_t)(m.magic>>32)))>>m.shift];
+#endif
+     }
+
+     FORCEINLINE static const Bitboard bishopAttacksMagic(Square sq,
+                                                          const Bitboard &occupied) {
+         const MagicData &m = bishopMagicData[sq];
+#ifdef _64BIT
+         return m.moves[((occupied & m.mask)*m.magic)>>m.shift];
+#else
+         const Bitboard b(occupied & m.mask);
+         return m.moves[((b.lovalue()*(uint32_t)m.magic) ^
+                         (b.hivalue()*(uint32_t)(m.magic>>32)))>>m.shift];
+#endif
+     }
+#endif
+
      FORCEINLINE static const Bitboard rookAttacks(Square sq,
                                                    const Bitboard &occupied) {
-#ifdef _64BIT
 #ifdef BMI2
-         return _pdep_u64(rookMagicData[sq].data[_pext_u64(occupied,rookMagicData[sq].mask1)], rookMagicData[sq].mask2);
+         return rookAttacksPext(sq,occupied);
 #else
-         return *(rookMagicData[sq].moves+(int)
-                (((occupied & rookMagicData[sq].mask)*rookMagicData[sq].magic)>>rookMagicData[sq].shift));
+#ifdef CPU_DISPATCH
+         if (usePext) return rookAttacksPext(sq,occupied);
 #endif
-#else
-         Bitboard b(rookMagicData[sq].mask & occupied);
-         return *(rookMagicData[sq].moves+(int)(
-                ((b.lovalue()*rookMagicData[sq].magic.lovalue()) ^
-                (b.hivalue()*rookMagicData[sq].magic.hivalue()))>>
-                rookMagicData[sq].shift));
+         return rookAttacksMagic(sq,occupied);
 #endif
      }
 
    FORCEINLINE static const Bitboard bishopAttacks(Square sq, 
 					  const Bitboard &occupied) {
-#ifdef _64BIT
 #ifdef BMI2
-      return _pdep_u64(bishopMagicData[sq].data[_pext_u64(occupied,bishopMagicData[sq].mask1)], bishopMagicData[sq].mask2);
+      return bishopAttacksPext(sq,occupied);
 #else
-      return *(bishopMagicData[sq].moves+(int)
-	      (((occupied & bishopMagicData[sq].mask)*bishopMagicData[sq].magic)>>bishopMagicData[sq].shift));
+#ifdef CPU_DISPATCH
+      if (usePext) return bishopAttacksPext(sq,occupied);
 #endif
-#else
-      Bitboard b(bishopMagicData[sq].mask & occupied);
-      return *(bishopMagicData[sq].moves+(int)(
-             ((b.lovalue()*bishopMagicData[sq].magic.lovalue()) ^
-             (b.hivalue()*bishopMagicData[sq].magic.hivalue()))>>
-             bishopMagicData[sq].shift));
+      return bishopAttacksMagic(sq,occupied);
 #endif
    }
 
@@ -126,43 +177,16 @@ class Attacks
      return (rookAttacks(sq,occupied) & bishopAttacks(sq,occupied));
    }
 
-     // Initialize the bitmaps.  Call before using this class.
+     // Select the slider attack method. Call before using this class.
      static void init();
 
- private:
-#ifndef BMI2
-     static void setRookAttacks(Square sq,
-                                const Bitboard &occupied, const Bitboard &value) {
-#ifdef _64BIT
-         *(Bitboard*)(rookMagicData[sq].moves+(int)
-            (((occupied & rookMagicData[sq].mask)*
-            rookMagicData[sq].magic)>>rookMagicData[sq].shift)) = value;
-#else
-         Bitboard b(rookMagicData[sq].mask & occupied);
-         *(rookMagicData[sq].moves+(int)(
-            ((b.lovalue()*rookMagicData[sq].magic.lovalue()) ^
-            (b.hivalue()*rookMagicData[sq].magic.hivalue()))>>
-            rookMagicData[sq].shift)) = value;
-#endif
-     }
+     // Description of the slider attack lookup and bit count method
+     // in use, for example "magic" or "popcnt pext".
+     static const char *implementation();
 
-     static void setBishopAttacks(Square sq,
-		       const Bitboard &occupied, const Bitboard &value) {
-#ifdef _64BIT
-         *(Bitboard*)(bishopMagicData[sq].moves+(int)
-            (((occupied & bishopMagicData[sq].mask)*
-            bishopMagicData[sq].magic)>>bishopMagicData[sq].shift)) = value;
-#else
-         Bitboard b(bishopMagicData[sq].mask & occupied);
-         *(bishopMagicData[sq].moves+(int)(
-            ((b.lovalue()*bishopMagicData[sq].magic.lovalue()) ^
-            (b.hivalue()*bishopMagicData[sq].magic.hivalue()))>>
-            bishopMagicData[sq].shift)) = value;
-#endif
-     }
-#endif
+     // Size in bytes of the attack lookup tables.
+     static size_t tableSize();
 
-     static void initMagicData(void);
 };
 
 #endif
@@ -1,6 +1,9 @@
 // Copyright 1994, 1996, 2005, 2008 by Jon Dart
 
 #include "bitboard.h"
+#if defined(CPU_DISPATCH) && defined(__GNUC__)
+#include <cpuid.h>
+#endif
 
 static int done_init = 0;
 
@@ -78,6 +81,34 @@ int Bitboard::MagicTable64[64];
 #endif
 int Bitboard::msbTable[256];
 
+#ifdef CPU_DISPATCH
+bool Bitboard::cpuPopcnt = false;
+bool Bitboard::cpuBmi2 = false;
+
+static void cpuid(unsigned leaf, unsigned regs[4])
+{
+#ifdef _MSC_VER
+   __cpuidex((int*)regs,(int)leaf,0);
+#else
+   __cpuid_count(leaf,0,regs[0],regs[1],regs[2],regs[3]);
+#endif
+}
+
+static void detectCpuFeatures(bool &popcnt, bool &bmi2)
+{
+   unsigned regs[4];
+   cpuid(0,regs);
+   const unsigned maxLeaf = regs[0];
+   cpuid(1,regs);
+   popcnt = (regs[2] & (1<<23)) != 0;
+   bmi2 = false;
+   if (maxLeaf >= 7) {
+      cpuid(7,regs);
+      bmi2 = (regs[1] & (1<<8)) != 0;
+   }
+}
+#endif
+
 void Bitboard::init()
 {
    int i;
@@ -106,6 +137,9 @@ void Bitboard::init()
        mask >>=1; msb--;
      }
    }
+#ifdef CPU_DISPATCH
+   detectCpuFeatures(cpuPopcnt,cpuBmi2);
+#endif
    done_init++;
 }
 
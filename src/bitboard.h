@@ -282,6 +282,16 @@ class Bitboard
       // GCC only uses POPCNT instruction if -msse4.2. Otherwise
       // it uses a relatively slow algorithm.
       return __builtin_popcountll(data);
+#elif defined(CPU_DISPATCH) && defined(__GNUC__)
+      if (cpuPopcnt) {
+         // not compiled with -msse4.2, so use asm rather than the builtin
+         uint64_t ret;
+         __asm__ ("popcntq %[data], %[ret]"
+                  :[ret] "=r" (ret)
+                  :[data] "rm" (data));
+         return (unsigned)ret;
+      }
+      return genericPopcnt(data);
 #else
       return genericPopcnt(data);
 #endif
@@ -566,6 +576,11 @@ class Bitboard
     static CACHE_ALIGN int MagicTable64[64];
 #endif
     static CACHE_ALIGN const uint64_t mask[64];
+
+#ifdef CPU_DISPATCH
+    // CPU features, detected by init()
+    static bool cpuPopcnt, cpuBmi2;
+#endif
     
     uint64_t data;
 
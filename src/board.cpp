@@ -11,8 +11,9 @@
 #include <memory.h>
 #include <assert.h>
 #include <cstddef>
+#include <cstdlib>
+#include <algorithm>
 #include <iostream>
-#include <unordered_set>
 
 using namespace std;
 
@@ -29,8 +30,77 @@ const hash_t rep_codes[3] =
 
 static Board *initialBoard = nullptr;
 
+// Cuckoo hash tables used to detect upcoming repetitions (algorithm
+// due to Marcel van Kervinck). For every move of a non-pawn piece
+// between two squares on an empty board, cuckooKeys holds the
+// difference in position hash codes caused by the move, and
+// cuckooSquares holds the two squares.
+static const int CUCKOO_SIZE = 8192;
+
+static hash_t cuckooKeys[CUCKOO_SIZE];
+
+static Square cuckooSquares[CUCKOO_SIZE][2];
+
+static inline int cuckooH1(hash_t h) {
+   return int(h & (CUCKOO_SIZE-1));
+}
+
+static inline int cuckooH2(hash_t h) {
+   return int((h >> 16) & (CUCKOO_SIZE-1));
+}
+
+// true if a piece of type "p" can move from "s1" to "s2" on an empty board
+static int emptyBoardMove(PieceType p, Square s1, Square s2) {
+   const int df = std::abs(File(s1)-File(s2));
+   const int dr = std::abs(Rank<White>(s1)-Rank<White>(s2));
+   switch(p) {
+   case Knight:
+      return (df == 1 && dr == 2) || (df == 2 && dr == 1);
+   case Bishop:
+      return df == dr;
+   case Rook:
+      return df == 0 || dr == 0;
+   case Queen:
+      return df == dr || df == 0 || dr == 0;
+   case King:
+      return df <= 1 && dr <= 1;
+   default:
+      return 0;
+   }
+}
+
+static void initCuckoo() {
+   int count = 0;
+   for (int side = White; side <= Black; side++) {
+      for (int p = Knight; p <= King; p++) {
+         const Piece piece = MakePiece((PieceType)p,(ColorType)side);
+         for (Square s1 = 0; s1 < 64; s1++) {
+            for (Square s2 = s1+1; s2 < 64; s2++) {
+               if (!emptyBoardMove((PieceType)p,s1,s2)) continue;
+               // A move always changes the side to move, which is
+               // stored in the high bit of the hash code.
+               hash_t key = BoardHash::setSideToMove(
+                  hash_codes[s1][piece] ^ hash_codes[s2][piece], White);
+               Square sq1 = s1, sq2 = s2;
+               int i = cuckooH1(key);
+               for (;;) {
+                  std::swap(cuckooKeys[i],key);
+                  std::swap(cuckooSquares[i][0],sq1);
+                  std::swap(cuckooSquares[i][1],sq2);
+                  if (key == 0) break;
+                  i = (i == cuckooH1(key)) ? cuckooH2(key) : cuckooH1(key);
+               }
+               count++;
+            }
+         }
+      }
+   }
+   ASSERT(count == 3668);
+}
+
 void Board::setupInitialBoard() {
-   initialBoard = (Board*)malloc(sizeof(Board));
+   initCuckoo();
+   initialBoard = new Board(NO_INIT);
    static PieceType pieces[] =
    {
       Rook,
@@ -62,9 +132,7 @@ void Board::setupInitialBoard() {
    initialBoard->state.enPassantSq = InvalidSquare;
    initialBoard->state.castleStatus[White] = initialBoard->state.castleStatus[Black] = CanCastleEitherSide;
    initialBoard->state.moveCount = 0;
-   initialBoard->repListHead = initialBoard->repList;
    initialBoard->setSecondaryVars();
-   *(initialBoard->repListHead)++ = initialBoard->hashCode();
 }
 
 void Board::setSecondaryVars()
@@ -161,33 +229,29 @@ Board::Board()
 
 Board::Board(const Board &b)
 {
-   // Copy all contents except the repetition list
-   memcpy(&contents,&b.contents,(byte*)repList-(byte*)&contents);
-   // Copy the repetition table
-   int rep_entries = (int)(b.repListHead - b.repList);
-   ASSERT(rep_entries>=0 && rep_entries<RepListSize);
-   if (rep_entries) {
-     memcpy(repList,b.repList,sizeof(hash_t)*rep_entries);
-   }
-   repListHead = repList + rep_entries;
+   // Copy all contents except the history, then only the part of
+   // the history that repetition checks can reach
+   memcpy(&contents,&b.contents,(byte*)&repList-(byte*)&contents);
+   repList.assign(b.repListEnd()-b.repListEntries(),b.repListEnd());
 }
 
 Board &Board::operator = (const Board &b)
 {
    if (&b != this)
    {
-      // Copy all contents except the repetition list
-      memcpy(&contents,&b.contents,(byte*)repList-(byte*)&contents);
-      // Copy the repetition table
-      int rep_entries = (int)(b.repListHead - b.repList);
-      if (rep_entries) {
-          memcpy(repList,b.repList,sizeof(hash_t)*rep_entries);
-      }
-      repListHead = repList + rep_entries;
+      memcpy(&contents,&b.contents,(byte*)&repList-(byte*)&contents);
+      // reuses the storage of the existing history, if large enough
+      repList.assign(b.repListEnd()-b.repListEntries(),b.repListEnd());
    }
    return *this;
 }
 
+void Board::swap(Board &b)
+{
+   std::swap_ranges((byte*)&contents,(byte*)&repList,(byte*)&b.contents);
+   repList.swap(b.repList);
+}
+
 Board::~Board()
 {
 }
@@ -250,6 +314,7 @@ static FORCEINLINE void Xor(hash_t &h,Square sq,Piece piece) {
 
 void Board::doNull()
 {
+   repList.push_back(state.hashCode);
    state.checkStatus = CheckUnknown;
    state.moveCount++;
    if (state.enPassantSq != InvalidSquare)
@@ -260,15 +325,38 @@ void Board::doNull()
    state.enPassantSq = InvalidSquare;
    side = oppositeSide();
    state.hashCode = BoardHash::setSideToMove(state.hashCode,side);
-   *repListHead++ = state.hashCode;
-   ASSERT(repListHead-repList < (int)RepListSize);
    ASSERT(state.hashCode == BoardHash::hashCode(*this));
 }
 
+template <ColorType color>
+static FORCEINLINE CastleType UpdateCastleStatus(CastleType cs, Square sq)
+{
+   return color == White ? UpdateCastleStatusW(cs,sq) : UpdateCastleStatusB(cs,sq);
+}
+
 void Board::doMove( Move move )
 {
+   if (side == White)
+      doMove<White>(move);
+   else
+      doMove<Black>(move);
+}
+
+template <ColorType color>
+void Board::doMove( Move move )
+{
+   const ColorType ocolor = color == White ? Black : White;
+   ASSERT(side == color);
    ASSERT(!IsNull(move));
    ASSERT(state.hashCode == BoardHash::hashCode(*this));
+   const hash_t *castleCodes = color == White ? w_castle_status : b_castle_status;
+   const hash_t *oppCastleCodes = color == White ? b_castle_status : w_castle_status;
+   hash_t &pawnHashCode = color == White ? pawnHashCodeW : pawnHashCodeB;
+   hash_t &oppPawnHashCode = color == White ? pawnHashCodeB : pawnHashCodeW;
+   const Piece myPawn = MakePiece(Pawn,color);
+   const Piece myRook = MakePiece(Rook,color);
+   const Piece myKing = MakePiece(King,color);
+   repList.push_back(state.hashCode);
    state.checkStatus = CheckUnknown;
    ++state.moveCount;
    if (state.enPassantSq != InvalidSquare)
@@ -288,477 +376,244 @@ void Board::doMove( Move move )
 #ifdef _DEBUG
    if (Capture(move) != Empty) {
            if (TypeOfMove(move) == EnPassant) {
-                   ASSERT(contents[old_epsq] == MakePiece(Pawn,OppositeColor(side)));
+                   ASSERT(contents[old_epsq] == MakePiece(Pawn,ocolor));
            } else {
-                   ASSERT(contents[dest] == MakePiece(Capture(move),OppositeColor(side)));
+                   ASSERT(contents[dest] == MakePiece(Capture(move),ocolor));
            }
    }
 #endif
-   if (side == White)
+   if (moveType == KCastle)
    {
-      if (moveType == KCastle)
-      {
-         state.moveCount = 0;
-
-         // update the hash code
-         const Square kp = kingSquare(White);
-         Xor(state.hashCode, kp+3, WhiteRook);
-         Xor(state.hashCode, kp, WhiteKing);
-         Xor(state.hashCode, kp+1, WhiteRook);
-         Xor(state.hashCode, kp+2, WhiteKing);
-         state.hashCode ^= w_castle_status[(int)state.castleStatus[White]];
-         state.hashCode ^= w_castle_status[(int)CastledKSide];
-
-         const int newkp = kp + 2;
-         kingPos[White] = newkp;
-         state.castleStatus[White] = CastledKSide;
-         // find old square of rook
-         Square oldrooksq = kp + 3;
-         Square newrooksq = kp + 1;
-         contents[kp] = contents[oldrooksq] = EmptyPiece;
-         contents[newrooksq] = WhiteRook;
-         contents[newkp] = WhiteKing;
-         rook_bits[White].clear(oldrooksq);
-         rook_bits[White].set(newrooksq);
-         clearAll(White,kp);
-         clearAll(White,oldrooksq);
-         setAll(White,newkp);
-         setAll(White,newrooksq);
-      }
-      else if (moveType == QCastle)
-      {
+      state.moveCount = 0;
+
+      // update the hash code
+      const Square kp = kingSquare(color);
+      Xor(state.hashCode, kp+3, myRook);
+      Xor(state.hashCode, kp, myKing);
+      Xor(state.hashCode, kp+1, myRook);
+      Xor(state.hashCode, kp+2, myKing);
+      state.hashCode ^= castleCodes[(int)state.castleStatus[color]];
+      state.hashCode ^= castleCodes[(int)CastledKSide];
+
+      const int newkp = kp + 2;
+      kingPos[color] = newkp;
+      state.castleStatus[color] = CastledKSide;
+      // find old square of rook
+      Square oldrooksq = kp + 3;
+      Square newrooksq = kp + 1;
+      contents[kp] = contents[oldrooksq] = EmptyPiece;
+      contents[newrooksq] = myRook;
+      contents[newkp] = myKing;
+      rook_bits[color].clear(oldrooksq);
+      rook_bits[color].set(newrooksq);
+      clearAll(color,kp);
+      clearAll(color,oldrooksq);
+      setAll(color,newkp);
+      setAll(color,newrooksq);
+   }
+   else if (moveType == QCastle)
+   {
+      state.moveCount = 0;
+
+      // update the hash code
+      const Square kp = kingSquare(color);
+      Xor(state.hashCode, kp-4, myRook);
+      Xor(state.hashCode, kp, myKing);
+      Xor(state.hashCode, kp-1, myRook);
+      Xor(state.hashCode, kp-2, myKing);
+      state.hashCode ^= castleCodes[(int)state.castleStatus[color]];
+      state.hashCode ^= castleCodes[(int)CastledQSide];
+
+      const int newkp = kp - 2;
+      kingPos[color] = newkp;
+      state.castleStatus[color] = CastledQSide;
+      // find old square of rook
+      Square oldrooksq = kp - 4;
+      Square newrooksq = kp - 1;
+      contents[kp] = contents[oldrooksq] = EmptyPiece;
+      contents[newrooksq] = myRook;
+      contents[newkp] = myKing;
+      rook_bits[color].clear(oldrooksq);
+      rook_bits[color].set(newrooksq);
+      clearAll(color,kp);
+      clearAll(color,oldrooksq);
+      setAll(color,newkp);
+      setAll(color,newrooksq);
+   }
+   else // not castling
+   {
+      ASSERT(contents[start] != EmptyPiece);
+      const Bitboard bits(Bitboard::mask[start] |
+                          Bitboard::mask[dest]);
+      Square target = dest; // where we captured
+      Piece capture = contents[dest]; // what we captured
+      switch (TypeOfPiece(contents[StartSquare(move)])) {
+      case Empty: break;
+      case Pawn:
          state.moveCount = 0;
-
-         // update the hash code
-         const Square kp = kingSquare(White);
-         Xor(state.hashCode, kp-4, WhiteRook);
-         Xor(state.hashCode, kp, WhiteKing);
-         Xor(state.hashCode, kp-1, WhiteRook);
-         Xor(state.hashCode, kp-2, WhiteKing);
-         state.hashCode ^= w_castle_status[(int)state.castleStatus[White]];
-         state.hashCode ^= w_castle_status[(int)CastledQSide];
-
-         const int newkp = kp - 2;
-         kingPos[White] = newkp;
-         state.castleStatus[White] = CastledQSide;
-         // find old square of rook
-         Square oldrooksq = kp - 4;
-         Square newrooksq = kp - 1;
-         contents[kp] = contents[oldrooksq] = Piece();
-         contents[newrooksq] = WhiteRook;
-         contents[kp-2] = WhiteKing;
-         rook_bits[White].clear(oldrooksq);
-         rook_bits[White].set(newrooksq);
-         clearAll(White,kp);
-         clearAll(White,oldrooksq);
-         setAll(White,newkp);
-         setAll(White,newrooksq);
-      }
-      else // not castling
-      {
-         ASSERT(contents[start] != EmptyPiece);
-         const Bitboard bits(Bitboard::mask[start] |
-                             Bitboard::mask[dest]);
-         Square target = dest; // where we captured
-         Piece capture = contents[dest]; // what we captured
-         switch (TypeOfPiece(contents[StartSquare(move)])) {
-         case Empty: break;
-         case Pawn:
-            state.moveCount = 0;
-            switch (moveType)
+         switch (moveType)
+         {
+         case EnPassant:
+            // update hash code
+            Xor(state.hashCode, start, myPawn);
+            Xor(state.hashCode, dest, myPawn);
+            Xor(pawnHashCode, start, myPawn);
+            Xor(pawnHashCode, dest, myPawn);
+            ASSERT(dest - (color == White ? 8 : -8) == old_epsq);
+            target = old_epsq;
+            capture = MakePiece(Pawn,ocolor);
+            contents[dest] = myPawn;
+            pawn_bits[color].set(dest);
+            break;
+         case Promotion:
+            // update hash code
+            Xor(state.hashCode, start, myPawn);
+            Xor(state.hashCode, dest, MakePiece(PromoteTo(move),color));
+            Xor(pawnHashCode, start, myPawn);
+            contents[dest] = MakePiece(PromoteTo(move),color);
+            material[color].removePawn();
+            material[color].addPiece(PromoteTo(move));
+            switch (PromoteTo(move))
             {
-            case EnPassant:
-               // update hash code
-               Xor(state.hashCode, start, WhitePawn);
-               Xor(state.hashCode, dest, WhitePawn);
-               Xor(pawnHashCodeW, start, WhitePawn);
-               Xor(pawnHashCodeW, dest, WhitePawn);
-               ASSERT(dest - 8 == old_epsq);
-               target = old_epsq;
-               capture = BlackPawn;
-               contents[dest] = WhitePawn;
-               pawn_bits[White].set(dest);
+            case Knight:
+               knight_bits[color].set(dest);
                break;
-            case Promotion:
-               // update hash code
-               Xor(state.hashCode, start, WhitePawn);
-               Xor(state.hashCode, dest, MakeWhitePiece(PromoteTo(move)));
-               Xor(pawnHashCodeW, start, WhitePawn);
-               contents[dest] = MakeWhitePiece(PromoteTo(move));
-               material[White].removePawn();
-               material[White].addPiece(PromoteTo(move));
-               switch (PromoteTo(move))
-               {
-               case Knight:
-                  knight_bits[White].set(dest);
-                  break;
-               case Bishop:
-                  bishop_bits[White].set(dest);
-                  break;
-               case Rook:
-                  rook_bits[White].set(dest);
-                  break;
-               case Queen:
-                  queen_bits[White].set(dest);
-                  break;
-               default:
-                  break;
-               }
+            case Bishop:
+               bishop_bits[color].set(dest);
+               break;
+            case Rook:
+               rook_bits[color].set(dest);
+               break;
+            case Queen:
+               queen_bits[color].set(dest);
                break;
             default:
-               Xor(state.hashCode, start, WhitePawn );
-               Xor(state.hashCode, dest, WhitePawn );
-               Xor(pawnHashCodeW, start, WhitePawn);
-               Xor(pawnHashCodeW, dest, WhitePawn);
-               contents[dest] = WhitePawn;
-               if (dest - start == 16) // 2-square pawn advance
-               {
-                  if (TEST_MASK(Attacks::ep_mask[File(dest)-1][(int)White],pawn_bits[Black])) {
-                    state.enPassantSq = dest;
-                    state.hashCode ^= ep_codes[0];
-                    state.hashCode ^= ep_codes[dest];
-                  }
-               }
-               pawn_bits[White].set(dest);
                break;
             }
-            pawn_bits[White].clear(start);
-            break;
-         case Knight:
-            Xor(state.hashCode, start, WhiteKnight);
-            Xor(state.hashCode, dest, WhiteKnight);
-            contents[dest] = WhiteKnight;
-            knight_bits[White].setClear(bits);
             break;
-         case Bishop:
-            Xor(state.hashCode, start, WhiteBishop);
-            Xor(state.hashCode, dest, WhiteBishop);
-            contents[dest] = WhiteBishop;
-            bishop_bits[White].setClear(bits);
-            break;
-         case Rook:
-            Xor(state.hashCode, start, WhiteRook );
-            Xor(state.hashCode, dest, WhiteRook );
-            contents[dest] = WhiteRook;
-            rook_bits[White].setClear(bits);
-            if ((int)state.castleStatus[White]<3) {
-               state.hashCode ^= w_castle_status[(int)state.castleStatus[White]];
-               state.castleStatus[White] = UpdateCastleStatusW(state.castleStatus[White],start);
-               state.hashCode ^= w_castle_status[(int)state.castleStatus[White]];
-            }
-            break;
-         case Queen:
-            Xor(state.hashCode, start, WhiteQueen);
-            Xor(state.hashCode, dest, WhiteQueen);
-            contents[dest] = WhiteQueen;
-            queen_bits[White].setClear(bits);
-            break;
-         case King:
-            Xor(state.hashCode, start, WhiteKing );
-            Xor(state.hashCode, dest, WhiteKing );
-            contents[dest] = WhiteKing;
-            kingPos[White] = dest;
-            if ((castleStatus(White) != CastledQSide) &&
-                (castleStatus(White) != CastledKSide))
+         default:
+            Xor(state.hashCode, start, myPawn );
+            Xor(state.hashCode, dest, myPawn );
+            Xor(pawnHashCode, start, myPawn);
+            Xor(pawnHashCode, dest, myPawn);
+            contents[dest] = myPawn;
+            if (dest - start == (color == White ? 16 : -16)) // 2-square pawn advance
             {
-               state.hashCode ^= w_castle_status[(int)castleStatus(White)];
-               state.hashCode ^= w_castle_status[(int)CantCastleEitherSide];
-               state.castleStatus[White] = CantCastleEitherSide;
+               if (TEST_MASK(Attacks::ep_mask[File(dest)-1][(int)color],pawn_bits[ocolor])) {
+                 state.enPassantSq = dest;
+                 state.hashCode ^= ep_codes[0];
+                 state.hashCode ^= ep_codes[dest];
+               }
             }
+            pawn_bits[color].set(dest);
             break;
          }
-         contents[start] = EmptyPiece;
-         if (capture != EmptyPiece)
+         pawn_bits[color].clear(start);
+         break;
+      case Knight:
+         Xor(state.hashCode, start, MakePiece(Knight,color));
+         Xor(state.hashCode, dest, MakePiece(Knight,color));
+         contents[dest] = MakePiece(Knight,color);
+         knight_bits[color].setClear(bits);
+         break;
+      case Bishop:
+         Xor(state.hashCode, start, MakePiece(Bishop,color));
+         Xor(state.hashCode, dest, MakePiece(Bishop,color));
+         contents[dest] = MakePiece(Bishop,color);
+         bishop_bits[color].setClear(bits);
+         break;
+      case Rook:
+         Xor(state.hashCode, start, myRook );
+         Xor(state.hashCode, dest, myRook );
+         contents[dest] = myRook;
+         rook_bits[color].setClear(bits);
+         if ((int)state.castleStatus[color]<3) {
+            state.hashCode ^= castleCodes[(int)state.castleStatus[color]];
+            state.castleStatus[color] = UpdateCastleStatus<color>(state.castleStatus[color],start);
+            state.hashCode ^= castleCodes[(int)state.castleStatus[color]];
+         }
+         break;
+      case Queen:
+         Xor(state.hashCode, start, MakePiece(Queen,color));
+         Xor(state.hashCode, dest, MakePiece(Queen,color));
+         contents[dest] = MakePiece(Queen,color);
+         queen_bits[color].setClear(bits);
+         break;
+      case King:
+         Xor(state.hashCode, start, myKing );
+         Xor(state.hashCode, dest, myKing );
+         contents[dest] = myKing;
+         kingPos[color] = dest;
+         if ((castleStatus(color) != CastledQSide) &&
+             (castleStatus(color) != CastledKSide))
          {
-            state.moveCount = 0;
-            ASSERT(target != InvalidSquare);
-            occupied[Black].clear(target);
-            Xor(state.hashCode, target, capture);
-            switch (TypeOfPiece(capture))
-            {
-            case Empty: break;
-            case Pawn:
-               ASSERT(pawn_bits[Black].isSet(target));
-               pawn_bits[Black].clear(target);
-               Xor(pawnHashCodeB, target, capture);
-               if (moveType == EnPassant)
-               {
-                  contents[target] = EmptyPiece;
-                  clearAll(Black,target);
-               }
-               material[Black].removePawn();
-               break;
-            case Rook:
-               rook_bits[Black].clear(target);
-               material[Black].removePiece(Rook);
-               if ((int)state.castleStatus[Black]<3) {
-                  state.hashCode ^= b_castle_status[(int)state.castleStatus[Black]];
-                  state.castleStatus[Black] = UpdateCastleStatusB(state.castleStatus[Black],dest);
-                  state.hashCode ^= b_castle_status[(int)state.castleStatus[Black]];
-               }
-               break;
-            case Knight:
-               knight_bits[Black].clear(target);
-               material[Black].removePiece(Knight);
-               break;
-            case Bishop:
-               bishop_bits[Black].clear(target);
-               material[Black].removePiece(Bishop);
-               break;
-            case Queen:
-               queen_bits[Black].clear(target);
-               material[Black].removePiece(Queen);
-               break;
-            case King:
-               ASSERT(0);
-               kingPos[Black] = InvalidSquare;
-               state.castleStatus[Black] = CantCastleEitherSide;
-               material[Black].removePiece(King);
-               break;
-            default:
-               break;
-            }
+            state.hashCode ^= castleCodes[(int)castleStatus(color)];
+            state.hashCode ^= castleCodes[(int)CantCastleEitherSide];
+            state.castleStatus[color] = CantCastleEitherSide;
          }
+         break;
       }
-      setAll(White,dest);
-      clearAll(White,start);
-
-   }
-   else // side == Black
-   {
-      if (moveType == KCastle)
-      {
-         state.moveCount = 0;
-         const Square kp = kingSquare(Black);
-
-         // update the hash code
-         Xor(state.hashCode, kp+3, BlackRook);
-         Xor(state.hashCode, kp, BlackKing);
-         Xor(state.hashCode, kp+1, BlackRook);
-         Xor(state.hashCode, kp+2, BlackKing);
-         state.hashCode ^= b_castle_status[(int)state.castleStatus[Black]];
-         state.hashCode ^= b_castle_status[(int)CastledKSide];
-
-         const int newkp = kp + 2;
-         kingPos[Black] = newkp;
-         state.castleStatus[Black] = CastledKSide;
-         // find old square of rook
-         Square oldrooksq = kp + 3;
-         Square newrooksq = kp + 1;
-         contents[kp] = contents[oldrooksq] = EmptyPiece;
-         contents[newrooksq] = BlackRook;
-         contents[kp+2] = BlackKing;
-         rook_bits[Black].clear(oldrooksq);
-         rook_bits[Black].set(newrooksq);
-         clearAll(Black,kp);
-         clearAll(Black,oldrooksq);
-         setAll(Black,newkp);
-         setAll(Black,newrooksq);
-      }
-      else if (moveType == QCastle)
+      contents[start] = EmptyPiece;
+      if (capture != EmptyPiece)
       {
          state.moveCount = 0;
-         const Square kp = kingSquare(Black);
-
-         // update the hash code
-         Xor(state.hashCode, kp-4, BlackRook);
-         Xor(state.hashCode, kp, BlackKing);
-         Xor(state.hashCode, kp-1, BlackRook);
-         Xor(state.hashCode, kp-2, BlackKing);
-         state.hashCode ^= b_castle_status[(int)state.castleStatus[Black]];
-         state.hashCode ^= b_castle_status[(int)CastledQSide];
-
-         const int newkp = kp - 2;
-         kingPos[Black] = newkp;
-         state.castleStatus[Black] = CastledQSide;
-         // find old square of rook
-         Square oldrooksq = kp - 4;
-         Square newrooksq = kp - 1;
-         contents[kp] = contents[oldrooksq] = EmptyPiece;
-         contents[newrooksq] = BlackRook;
-         contents[kp-2] = BlackKing;
-         rook_bits[Black].clear(oldrooksq);
-         rook_bits[Black].set(newrooksq);
-         clearAll(Black,kp);
-         clearAll(Black,oldrooksq);
-         setAll(Black,newkp);
-         setAll(Black,newrooksq);
-      }
-      else // not castling
-      {
-         ASSERT(contents[start] != EmptyPiece);
-         const Bitboard bits(Bitboard::mask[start] |
-                           Bitboard::mask[dest]);
-         Square target = dest; // where we captured
-         Piece capture = contents[dest]; // what we captured
-         switch (TypeOfPiece(contents[StartSquare(move)])) {
+         ASSERT(target != InvalidSquare);
+         occupied[ocolor].clear(target);
+         Xor(state.hashCode, target, capture);
+         switch (TypeOfPiece(capture))
+         {
          case Empty: break;
          case Pawn:
-            state.moveCount = 0;
-            switch (moveType)
+            ASSERT(pawn_bits[ocolor].isSet(target));
+            pawn_bits[ocolor].clear(target);
+            Xor(oppPawnHashCode, target, capture);
+            if (moveType == EnPassant)
             {
-            case EnPassant:
-               // update hash code
-               Xor(state.hashCode, start, BlackPawn);
-               Xor(state.hashCode, dest, BlackPawn);
-               Xor(pawnHashCodeB, start, BlackPawn);
-               Xor(pawnHashCodeB, dest, BlackPawn);
-               ASSERT(dest + 8 == old_epsq);
-               target = old_epsq;
-               capture = WhitePawn;
-               contents[dest] = BlackPawn;
-               pawn_bits[Black].set(dest);
-               break;
-            case Promotion:
-               // update hash code
-               Xor(state.hashCode, start, BlackPawn);
-               Xor(state.hashCode, dest, MakeBlackPiece(PromoteTo(move)));
-               Xor(pawnHashCodeB, start, BlackPawn);
-               contents[dest] = MakeBlackPiece(PromoteTo(move));
-               material[Black].removePawn();
-               material[Black].addPiece(PromoteTo(move));
-               switch (PromoteTo(move))
-               {
-               case Knight:
-                  knight_bits[Black].set(dest);
-                  break;
-               case Bishop:
-                  bishop_bits[Black].set(dest);
-                  break;
-               case Rook:
-                  rook_bits[Black].set(dest);
-                  break;
-               case Queen:
-                  queen_bits[Black].set(dest);
-                  break;
-               default:
-                  break;
-               }
-               break;
-            default:
-               Xor(state.hashCode, start, BlackPawn );
-               Xor(state.hashCode, dest, BlackPawn );
-               Xor(pawnHashCodeB, start, BlackPawn);
-               Xor(pawnHashCodeB, dest, BlackPawn);
-               contents[dest] = BlackPawn;
-               if (start - dest == 16) // 2-square pawn advance
-               {
-                  if (TEST_MASK(Attacks::ep_mask[File(dest)-1][(int)Black],pawn_bits[White])) {
-                    state.enPassantSq = dest;
-                    state.hashCode ^= ep_codes[0];
-                    state.hashCode ^= ep_codes[dest];
-                  }
-               }
-               pawn_bits[Black].set(dest);
-               break;
+               contents[target] = EmptyPiece;
+               clearAll(ocolor,target);
+            }
+            material[ocolor].removePawn();
+            break;
+         case Rook:
+            rook_bits[ocolor].clear(target);
+            material[ocolor].removePiece(Rook);
+            if ((int)state.castleStatus[ocolor]<3) {
+               state.hashCode ^= oppCastleCodes[(int)state.castleStatus[ocolor]];
+               state.castleStatus[ocolor] = UpdateCastleStatus<ocolor>(state.castleStatus[ocolor],dest);
+               state.hashCode ^= oppCastleCodes[(int)state.castleStatus[ocolor]];
             }
-            pawn_bits[Black].clear(start);
             break;
          case Knight:
-            Xor(state.hashCode, start, BlackKnight);
-            Xor(state.hashCode, dest, BlackKnight);
-            contents[dest] = BlackKnight;
-            knight_bits[Black].setClear(bits);
+            knight_bits[ocolor].clear(target);
+            material[ocolor].removePiece(Knight);
             break;
          case Bishop:
-            Xor(state.hashCode, start, BlackBishop);
-            Xor(state.hashCode, dest, BlackBishop);
-            contents[dest] = BlackBishop;
-            bishop_bits[Black].setClear(bits);
-            break;
-         case Rook:
-            Xor(state.hashCode, start, BlackRook );
-            Xor(state.hashCode, dest, BlackRook );
-            contents[dest] = BlackRook;
-            rook_bits[Black].setClear(bits);
-            if ((int)state.castleStatus[Black]<3) {
-                state.hashCode ^= b_castle_status[(int)state.castleStatus[Black]];
-                state.castleStatus[Black] = UpdateCastleStatusB(state.castleStatus[Black],start);
-                state.hashCode ^= b_castle_status[(int)state.castleStatus[Black]];
-            }
+            bishop_bits[ocolor].clear(target);
+            material[ocolor].removePiece(Bishop);
             break;
          case Queen:
-            Xor(state.hashCode, start, BlackQueen);
-            Xor(state.hashCode, dest, BlackQueen);
-            contents[dest] = BlackQueen;
-            queen_bits[Black].setClear(bits);
+            queen_bits[ocolor].clear(target);
+            material[ocolor].removePiece(Queen);
             break;
          case King:
-            Xor(state.hashCode, start, BlackKing );
-            Xor(state.hashCode, dest, BlackKing );
-            contents[dest] = BlackKing;
-            kingPos[Black] = dest;
-            if ((castleStatus(Black) != CastledQSide) &&
-                (castleStatus(Black) != CastledKSide))
-            {
-               state.hashCode ^= b_castle_status[(int)castleStatus(Black)];
-               state.hashCode ^= b_castle_status[(int)CantCastleEitherSide];
-               state.castleStatus[Black] = CantCastleEitherSide;
-            }
+            ASSERT(0);
+            kingPos[ocolor] = InvalidSquare;
+            state.castleStatus[ocolor] = CantCastleEitherSide;
+            material[ocolor].removePiece(King);
+            break;
+         default:
             break;
          }
-         contents[start] = EmptyPiece;
-         if (capture != EmptyPiece)
-         {
-            state.moveCount = 0;
-            ASSERT(target != InvalidSquare);
-            occupied[White].clear(target);
-            Xor(state.hashCode, target, capture);
-            switch (TypeOfPiece(capture)) {
-            case Empty: break;
-            case Pawn:
-                   ASSERT(pawn_bits[White].isSet(target));
-               pawn_bits[White].clear(target);
-               Xor(pawnHashCodeW, target, capture);
-               if (moveType == EnPassant)
-               {
-                  contents[target] = EmptyPiece;
-                  clearAll(White,target);
-               }
-               material[White].removePawn();
-               break;
-            case Rook:
-               rook_bits[White].clear(target);
-               material[White].removePiece(Rook);
-               if ((int)state.castleStatus[White]<3) {
-                  state.hashCode ^= w_castle_status[(int)state.castleStatus[White]];
-                  state.castleStatus[White] = UpdateCastleStatusW(state.castleStatus[White],dest);
-                  state.hashCode ^= w_castle_status[(int)state.castleStatus[White]];
-               }
-               break;
-            case Knight:
-               knight_bits[White].clear(target);
-               material[White].removePiece(Knight);
-               break;
-            case Bishop:
-               bishop_bits[White].clear(target);
-               material[White].removePiece(Bishop);
-               break;
-            case Queen:
-               queen_bits[White].clear(target);
-               material[White].removePiece(Queen);
-               break;
-            case King:
-               ASSERT(0);
-               kingPos[White] = InvalidSquare;
-               state.castleStatus[White] = CantCastleEitherSide;
-               material[White].removePiece(King);
-               break;
-            default:
-               break;
-            }
-         }
-         setAll(Black,dest);
-         clearAll(Black,start);
       }
+      setAll(color,dest);
+      clearAll(color,start);
    }
 
    // changing side to move so flip those bits
-   state.hashCode = BoardHash::setSideToMove(state.hashCode,oppositeSide());
-   *repListHead++ = state.hashCode;
+   state.hashCode = BoardHash::setSideToMove(state.hashCode,ocolor);
    //ASSERT(pawn_hash(White) == BoardHash::pawnHash(*this),White);
    ASSERT(getMaterial(sideToMove()).pawnCount() == (int)pawn_bits[side].bitCount());
-   side = oppositeSide();
+   side = ocolor;
    ASSERT(getMaterial(sideToMove()).pawnCount() == (int)pawn_bits[side].bitCount());
    allOccupied = occupied[White] | occupied[Black];
    ASSERT(state.hashCode == BoardHash::hashCode(*this));
@@ -1024,7 +879,20 @@ void Board::undoCastling(Square kp, Square oldkingsq, Square newrooksq,
 
 void Board::undoMove( Move move, const BoardState &old_state )
 {
-   side = OppositeColor(side);
+   // the side that made the move is the one not now on move
+   if (side == Black)
+      undoMove<White>(move,old_state);
+   else
+      undoMove<Black>(move,old_state);
+}
+
+template <ColorType color>
+void Board::undoMove( Move move, const BoardState &old_state )
+{
+   const ColorType ocolor = color == White ? Black : White;
+   hash_t &pawnHashCode = color == White ? pawnHashCodeW : pawnHashCodeB;
+   hash_t &oppPawnHashCode = color == White ? pawnHashCodeB : pawnHashCodeW;
+   side = color;
    if (!IsNull(move))
    {
       const MoveType moveType = TypeOfMove(move);
@@ -1032,7 +900,7 @@ void Board::undoMove( Move move, const BoardState &old_state )
       const Square dest = DestSquare(move);
       if (moveType == KCastle)
       {
-         Square kp = kingSquare(side);
+         Square kp = kingSquare(color);
          Square oldrooksq = kp+1;
          Square newrooksq = kp-1;
          Square oldkingsq = kp-2;
@@ -1040,13 +908,13 @@ void Board::undoMove( Move move, const BoardState &old_state )
       }
       else if (moveType == QCastle)
       {
-         Square kp = kingSquare(side);
+         Square kp = kingSquare(color);
          Square oldrooksq = kp-2;
          Square newrooksq = kp+1;
          Square oldkingsq = kp+2;
          undoCastling(kp,oldkingsq,newrooksq,oldrooksq);
       }
-      else if (side == White)
+      else
       {
          const Bitboard bits(Bitboard::mask[start] |
                            Bitboard::mask[dest]);
@@ -1055,224 +923,109 @@ void Board::undoMove( Move move, const BoardState &old_state )
          // fix up start square:
          if (moveType == Promotion || moveType == EnPassant)
          {
-            contents[start] = WhitePawn;
+            contents[start] = MakePiece(Pawn,color);
          }
          else
          {
             contents[start] = contents[dest];
          }
-         setAll(White,start);
+         setAll(color,start);
          switch (TypeOfPiece(contents[start])) {
          case Empty: break;
          case Pawn:
-            Xor(pawnHashCodeW,start,WhitePawn);
+            Xor(pawnHashCode,start,MakePiece(Pawn,color));
             switch (moveType) {
             case Promotion:
-               material[White].addPawn();
-               material[White].removePiece(PromoteTo(move));
+               material[color].addPawn();
+               material[color].removePiece(PromoteTo(move));
                switch (PromoteTo(move))
                {
                case Knight:
-                  knight_bits[White].clear(dest);
+                  knight_bits[color].clear(dest);
                   break;
                case Bishop:
-                  bishop_bits[White].clear(dest);
+                  bishop_bits[color].clear(dest);
                   break;
                case Rook:
-                  rook_bits[White].clear(dest);
+                  rook_bits[color].clear(dest);
                   break;
                case Queen:
-                  queen_bits[White].clear(dest);
+                  queen_bits[color].clear(dest);
                   break;
                default:
                   break;
                }
                break;
             case EnPassant:
-               target = dest - 8;
+               target = color == White ? dest - 8 : dest + 8;
                ASSERT(OnBoard(target));
                ASSERT(contents[target]==EmptyPiece);
                // note: falls through to normal case
             case Normal:
-               pawn_bits[White].clear(dest);
-               Xor(pawnHashCodeW,dest,WhitePawn);
-            default:
-               break;
-            }
-            pawn_bits[White].set(start);
-            break;
-         case Knight:
-            knight_bits[White].setClear(bits);
-            break;
-         case Bishop:
-            bishop_bits[White].setClear(bits);
-            break;
-         case Rook:
-            rook_bits[White].setClear(bits);
-            break;
-         case Queen:
-            queen_bits[White].setClear(bits);
-            break;
-         case King:
-            kingPos[White] = start;
-            break;
-         default:
-            break;
-         }
-         // fix up dest square
-         clearAll(White,dest);
-         contents[dest] = EmptyPiece;
-         contents[target] = MakePiece(Capture(move),Black);
-         if (Capture(move) != Empty)
-         {
-            switch (Capture(move))
-            {
-            case Pawn:
-                           ASSERT(!pawn_bits[Black].isSet(target));
-               pawn_bits[Black].set(target);
-               Xor(pawnHashCodeB,target,BlackPawn);
-               material[Black].addPawn();
-               break;
-            case Knight:
-               knight_bits[Black].set(target);
-               material[Black].addPiece(Knight);
-               break;
-            case Bishop:
-               bishop_bits[Black].set(target);
-               material[Black].addPiece(Bishop);
-               break;
-            case Rook:
-               rook_bits[Black].set(target);
-               material[Black].addPiece(Rook);
-               break;
-            case Queen:
-               queen_bits[Black].set(target);
-               material[Black].addPiece(Queen);
-               break;
-            case King:
-               kingPos[Black] = target;
-               material[Black].addPiece(King);
-               break;
-            default:
-               break;
-            }
-            setAll(Black,target);
-         }
-      }
-      else // side == Black
-      {
-         const Bitboard bits(Bitboard::mask[start] |
-                           Bitboard::mask[dest]);
-         // not castling
-         Square target = dest;
-         // fix up start square:
-         if (moveType == Promotion || moveType == EnPassant)
-         {
-            contents[start] = BlackPawn;
-         }
-         else
-         {
-            contents[start] = contents[dest];
-         }
-         setAll(Black,start);
-         switch (TypeOfPiece(contents[start])) {
-         case Empty: break;
-         case Pawn:
-            Xor(pawnHashCodeB,start,BlackPawn);
-            switch (moveType) {
-            case Promotion:
-            {
-               material[Black].addPawn();
-               material[Black].removePiece(PromoteTo(move));
-               switch (PromoteTo(move))
-               {
-               case Knight:
-                  knight_bits[Black].clear(dest);
-                  break;
-               case Bishop:
-                  bishop_bits[Black].clear(dest);
-                  break;
-               case Rook:
-                  rook_bits[Black].clear(dest);
-                  break;
-               case Queen:
-                  queen_bits[Black].clear(dest);
-                  break;
-               default:
-                  break;
-               }
-               break;
-            }
-            case EnPassant:
-               target = dest + 8;
-               ASSERT(OnBoard(target));
-               ASSERT(contents[target]== EmptyPiece);
-               // note: falls through to normal case
-            case Normal:
-               pawn_bits[Black].clear(dest);
-               Xor(pawnHashCodeB,dest,BlackPawn);
+               pawn_bits[color].clear(dest);
+               Xor(pawnHashCode,dest,MakePiece(Pawn,color));
                break;
             default:
                break;
             }
-            pawn_bits[Black].set(start);
+            pawn_bits[color].set(start);
             break;
          case Knight:
-            knight_bits[Black].setClear(bits);
+            knight_bits[color].setClear(bits);
             break;
          case Bishop:
-            bishop_bits[Black].setClear(bits);
+            bishop_bits[color].setClear(bits);
             break;
          case Rook:
-            rook_bits[Black].setClear(bits);
+            rook_bits[color].setClear(bits);
             break;
          case Queen:
-            queen_bits[Black].setClear(bits);
+            queen_bits[color].setClear(bits);
             break;
          case King:
-            kingPos[Black] = start;
+            kingPos[color] = start;
             break;
          default:
             break;
          }
          // fix up dest square
-         clearAll(Black,dest);
+         clearAll(color,dest);
          contents[dest] = EmptyPiece;
-         contents[target] = MakePiece(Capture(move),White);
+         contents[target] = MakePiece(Capture(move),ocolor);
          if (Capture(move) != Empty)
          {
             switch (Capture(move))
             {
             case Pawn:
-                           ASSERT(!pawn_bits[White].isSet(target));
-               pawn_bits[White].set(target);
-               Xor(pawnHashCodeW,target,WhitePawn);
-               material[White].addPawn();
+               ASSERT(!pawn_bits[ocolor].isSet(target));
+               pawn_bits[ocolor].set(target);
+               Xor(oppPawnHashCode,target,MakePiece(Pawn,ocolor));
+               material[ocolor].addPawn();
                break;
             case Knight:
-               knight_bits[White].set(target);
-               material[White].addPiece(Knight);
+               knight_bits[ocolor].set(target);
+               material[ocolor].addPiece(Knight);
                break;
             case Bishop:
-               bishop_bits[White].set(target);
-               material[White].addPiece(Bishop);
+               bishop_bits[ocolor].set(target);
+               material[ocolor].addPiece(Bishop);
                break;
             case Rook:
-               rook_bits[White].set(target);
-               material[White].addPiece(Rook);
+               rook_bits[ocolor].set(target);
+               material[ocolor].addPiece(Rook);
                break;
             case Queen:
-               queen_bits[White].set(target);
-               material[White].addPiece(Queen);
+               queen_bits[ocolor].set(target);
+               material[ocolor].addPiece(Queen);
                break;
             case King:
-               kingPos[White] = target;
-               material[White].addPiece(King);
+               kingPos[ocolor] = target;
+               material[ocolor].addPiece(King);
                break;
             default:
                break;
             }
-            setAll(White,target);
+            setAll(ocolor,target);
          }
       }
    }
@@ -1280,7 +1033,7 @@ void Board::undoMove( Move move, const BoardState &old_state )
    ASSERT(getMaterial(sideToMove()).pawnCount() == (int)pawn_bits[side].bitCount());
    ASSERT(getMaterial(oppositeSide()).pawnCount() == (int)pawn_bits[oppositeSide()].bitCount());
 
-   --repListHead;
+   repList.pop_back();
    allOccupied = Bitboard(occupied[White] | occupied[Black]);
    ASSERT(state.hashCode == BoardHash::hashCode(*this));
 #if defined(_DEBUG) && defined(FULL_DEBUG)
@@ -1866,15 +1619,15 @@ static void set_bad( istream &i )
 
 int Board::repCount(int target) const
 {
-    int entries = state.moveCount - 2;
+    int entries = repListEntries() - 2;
     if (entries <= 0) return 0;
     hash_t to_match = hashCode();
     int count = 0;
-    for (hash_t *repList=repListHead-3;
+    for (const hash_t *rep=repListEnd()-2;
        entries>=0;
-       repList-=2,entries-=2)
+       rep-=2,entries-=2)
     {
-      if (*repList == to_match)
+      if (*rep == to_match)
       {
          count++;
          if (count >= target)
@@ -1888,17 +1641,58 @@ int Board::repCount(int target) const
 
 int Board::anyRep() const
 {
-   int entries = state.moveCount;
+   const int entries = repListEntries();
    // If only 2 entries side to move is different so the
    // hash codes cannot match:
    if (entries < 3) return 0;
-   unordered_set<hash_t> codes;
-   for (hash_t *repList=repListHead-1;
-      entries>0;
-      repList--,entries--) {
-      if (!codes.emplace(*repList).second) {
+   // Only positions with the same side to move can match, and the
+   // history is bounded by the 50-move counter, so a direct scan
+   // is cheap.
+   const hash_t *repListHead = repListEnd();
+   const hash_t *first = repListHead-(entries-1);
+   // the current position is not in the history
+   for (const hash_t *q = repListHead-2; q >= first; q -= 2) {
+      if (*q == hashCode()) return 1;
+   }
+   for (const hash_t *p = repListHead-1; p-2 >= first; p--) {
+      for (const hash_t *q = p-2; q >= first; q -= 2) {
+         if (*p == *q) return 1;
+      }
+   }
+   return 0;
+}
+
+int Board::upcomingRep(int ply) const
+{
+   const int end = repListEntries();
+   if (end < 3) return 0;
+   const hash_t *repListHead = repListEnd();
+   const hash_t current = hashCode();
+   for (int i = 3; i <= end; i += 2) {
+      const hash_t prior = *(repListHead-i);
+      const hash_t moveKey = current ^ prior;
+      int j = cuckooH1(moveKey);
+      if (cuckooKeys[j] != moveKey) {
+         j = cuckooH2(moveKey);
+         if (cuckooKeys[j] != moveKey) continue;
+      }
+      const Square s1 = cuckooSquares[j][0];
+      const Square s2 = cuckooSquares[j][1];
+      if (!(Attacks::betweenSquares[s1][s2] & allOccupied).isClear()) {
+         continue;
+      }
+      if (ply > i) {
+         // the repetition would occur within the search tree
          return 1;
       }
+      // For positions at or before the root, the move must be one
+      // the side to move can make, and the target position must
+      // itself have occurred before, to count as a draw.
+      const Square from = contents[s1] == EmptyPiece ? s2 : s1;
+      if (PieceColor(contents[from]) != sideToMove()) continue;
+      for (int k = i+2; k <= end; k += 2) {
+         if (*(repListHead-k) == prior) return 1;
+      }
    }
    return 0;
 }
@@ -10,6 +10,8 @@
 #include "bitboard.h"
 #include "attacks.h"
 #include "material.h"
+#include <algorithm>
+#include <vector>
 
 class Board;
 
@@ -51,6 +53,10 @@ public:
    Board(const Board &);
    Board &operator = (const Board &);
 
+   // Exchange positions and histories with another board (without
+   // copying the histories)
+   void swap(Board &);
+
    // resets board to initial position
    void reset();
 
@@ -177,7 +183,7 @@ public:
    // undoes a previous null move.
    void undoNull(const BoardState &oldState) {
       state = oldState;
-       --repListHead;
+      repList.pop_back();
       side = OppositeColor(side);
    }
 
@@ -353,6 +359,13 @@ public:
    // move that reset the 50-move counter.
    int anyRep() const;
 
+   // Return true if the side to move has a reversible move that
+   // reaches a position that occurred earlier (since the last move
+   // that reset the 50-move counter). "ply" is the distance from the
+   // search root: for earlier positions at or before the root, the
+   // position must have occurred twice.
+   int upcomingRep(int ply) const;
+
    // Return true if current position is material draw
    int materialDraw() const;
 
@@ -366,8 +379,6 @@ public:
 
    private:
 
-   static const int RepListSize = 1024;
-           
    ALIGN_VAR(16) Piece contents[64];
    Square kingPos[2];
    Material material[2];
@@ -389,16 +400,49 @@ public:
        return pawn_bits[White] | pawn_bits[Black];
    }
 
-   hash_t repList[RepListSize]; //  move history for repetition detection
-   hash_t *repListHead; // head of history list
+   // Return a pointer just past the most recent entry in the
+   // repetition history. The current position is not in the history:
+   // the position one ply earlier is at repListEnd()[-1].
+   const hash_t *repListEnd() const {
+      return repList.data() + repList.size();
+   }
+
+   // Return the number of earlier positions in the repetition
+   // history that may be scanned: those since the last move that
+   // reset the 50-move counter.
+   int repListEntries() const {
+      return std::min<int>(state.moveCount,(int)repList.size());
+   }
 
 private:
 
+   // Move history for repetition detection: the hash codes of the
+   // positions before the current one, the most recent last. It is
+   // held outside the Board object, so a Board is small. A copy gets
+   // its own history, holding only the entries repetition checks can
+   // reach (see repListEntries). It must be the last data member (see
+   // the copy constructor).
+   std::vector<hash_t> repList;
+
+   enum NoInit {NO_INIT};
+
+   // construct without setting up a position
+   Board(NoInit) {
+   }
+
    static void setupInitialBoard();
 
    // calculate the check status
    CheckStatusType getCheckStatus() const;
 
+   // per-side versions of doMove and undoMove ("color" is the
+   // side making the move)
+   template <ColorType color>
+   void doMove(Move m);
+
+   template <ColorType color>
+   void undoMove(Move rmove, const BoardState &stat);
+
    void undoCastling(Square kp, Square oldkingsq,
            Square newrooksq, Square oldrooksq);
 
@@ -2,7 +2,10 @@
 
 #include "globals.h"
 #include "hash.h"
+#include "learn.h"
+#include "memusage.h"
 #include "bitprobe.h"
+#include "rbitbase.h"
 #include "scoring.h"
 #include "bitbase.cpp"
 #ifdef GAVIOTA_TBS
@@ -27,6 +30,16 @@ static map<Options::TbType,bool> tb_init_map =
 static map<Options::TbType,bool> tb_init_map;
 #endif
 
+// size of the tablebase cache counted in MemoryUsage
+static size_t tbCacheSize = 0;
+
+static void setTbCacheSize(size_t size)
+{
+   MemoryUsage::remove(MemoryUsage::Tablebases,tbCacheSize);
+   tbCacheSize = size;
+   MemoryUsage::add(MemoryUsage::Tablebases,tbCacheSize);
+}
+
 bool tb_init_done(const Options::TbType type)
 {
    auto done = tb_init_map.find(type);
@@ -47,7 +60,9 @@ LockDefine(input_lock);
 Tune tune_params;
 #endif
 
-static const char * LEARN_FILE_NAME = "arasan.lrn";
+static const char * LEARN_FILE_NAME = "arasan.lrb";
+// learning file in the text format used by earlier versions
+static const char * TEXT_LEARN_FILE_NAME = "arasan.lrn";
 
 static const char * DEFAULT_BOOK_NAME = "book.bin";
 
@@ -107,6 +122,7 @@ void CDECL cleanupGlobals(void) {
    delete theLog;
    LockFree(input_lock);
    Scoring::cleanup();
+   RuntimeBitbases::cleanup();
 #ifdef UCI_LOG
     ucilog.close();
 #endif
@@ -129,6 +145,9 @@ void initOptions(const char *pathName) {
     }
 #endif
     learnFileName = derivePath(LEARN_FILE_NAME);
+    if (options.learning.position_learning) {
+       convertLearnFile(derivePath(TEXT_LEARN_FILE_NAME),learnFileName);
+    }
 }
 
 void delayedInit() {
@@ -148,6 +167,7 @@ void delayedInit() {
                               options.search.gtb_scheme,
                               options.search.gtb_cache_size);
             tb_init_map[Options::TbType::GaviotaTb] = true;
+            setTbCacheSize(EGTBMenCount ? options.search.gtb_cache_size : 0);
        }
 #endif
 #ifdef NALIMOV_TBS
@@ -162,6 +182,7 @@ void delayedInit() {
                              (char*)options.search.nalimov_path.c_str(),
                              options.search.nalimov_cache_size);
             tb_init_map[Options::TbType::NalimovTb] = true;
+            setTbCacheSize(EGTBMenCount ? options.search.nalimov_cache_size : 0);
        }
 #endif
 #ifdef SYZYGY_TBS
@@ -179,6 +200,10 @@ void delayedInit() {
              Options::tbTypeToString(options.search.tablebase_type) << " tablebases in directory " << path << endl;
     }
 #endif
+    if (options.search.use_bitbases) {
+       RuntimeBitbases::init(options.search.bitbase_path,
+                             options.search.ncpus);
+    }
     // also initialize the book here
     if (options.book.book_enabled && !openingBook.is_open()) {
         openingBook.open(derivePath(DEFAULT_BOOK_NAME).c_str());
@@ -197,6 +222,7 @@ void unloadTb(Options::TbType type)
       }
 #endif
       tb_init_map[type] = false;
+      setTbCacheSize(0);
    }
 }
 
@@ -32,9 +32,6 @@ extern CACHE_ALIGN const byte baseKPKW[24576];
 extern CACHE_ALIGN const byte baseKPKB[24576];
 
 #include <iostream>
-#ifdef _THREAD_TRACE
-#include <stdio.h>
-#endif
 
 extern bool tb_init_done(const Options::TbType);
 
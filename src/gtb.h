@@ -18,6 +18,8 @@ struct GaviotaTb {
     // Probe the tablebases. Return 1 if score was obtained,
     // 0 if not. If 'hard' is set do a hard probe (read disk),
     // otherwise do a soft probe (read cache only).
+    // May be called concurrently from multiple search threads (the
+    // Gaviota code locks its cache internally).
     static int probe_tb(const Board &b, int &score, int ply, bool hard);
 
     // unload the TBs, free memory
@@ -6,22 +6,106 @@
 #include "globals.h"
 #include "legal.h"
 #include "learn.h"
+#include "memusage.h"
 #include "scoring.h"
-extern "C"
-{
 #if !defined(_MAC) && !defined(__clang__) && !defined(__FreeBSD__)
 #include <malloc.h>
 #endif
 #include <memory.h>
 #include <stddef.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <atomic>
+#include <fstream>
+
+// Header of saved and memory-mapped hash files. The table entries
+// (including the rehash area past the end of the table) follow it.
+struct HashFileHeader {
+   char magic[8];
+   uint32_t version;
+   uint32_t entrySize;
+   uint64_t entries;
 };
 
+static const char HASH_FILE_MAGIC[8] = {'A','r','a','s','a','n','T','T'};
+
+static const uint32_t HASH_FILE_VERSION = 1;
+
+// Entries start at this offset, so they are as aligned as a table
+// from ALIGNED_MALLOC.
+static const size_t HASH_FILE_HEADER_SIZE = 128;
+
+#ifndef _WIN32
+// The lock file of a shared table has two locks: SETUP_LOCK is held
+// (exclusively) by a process setting up, attaching to or detaching
+// from the table, and USERS_LOCK is read-locked by each process using
+// it. The locks are released by the system if a process exits.
+static const off_t SETUP_LOCK = 0, USERS_LOCK = 1;
+
+static int lockByte(int fd, short type, off_t offset, bool wait)
+{
+   struct flock fl;
+   memset(&fl,'\0',sizeof(fl));
+   fl.l_type = type;
+   fl.l_whence = SEEK_SET;
+   fl.l_start = offset;
+   fl.l_len = 1;
+   int result;
+   while ((result = fcntl(fd,wait ? F_SETLKW : F_SETLK,&fl)) == -1 &&
+          errno == EINTR) ;
+   return result == 0;
+}
+#endif
+
+// The magic number is written last, so a table whose setup did not
+// finish has no valid header.
+static void initHeader(HashFileHeader &header, size_t entries)
+{
+   memset(&header,'\0',sizeof(HashFileHeader));
+   header.version = HASH_FILE_VERSION;
+   header.entrySize = (uint32_t)sizeof(HashEntry);
+   header.entries = entries;
+   std::atomic_thread_fence(std::memory_order_release);
+   memcpy(header.magic,HASH_FILE_MAGIC,sizeof(HASH_FILE_MAGIC));
+}
+
+static int validHeader(const HashFileHeader &header)
+{
+   if (memcmp(header.magic,HASH_FILE_MAGIC,sizeof(HASH_FILE_MAGIC))) {
+      return 0;
+   }
+   std::atomic_thread_fence(std::memory_order_acquire);
+   return header.version == HASH_FILE_VERSION &&
+      header.entrySize == sizeof(HashEntry) &&
+      header.entries > 0 &&
+      (header.entries & (header.entries-1)) == 0;
+}
+
+static size_t hashFileSize(size_t entries, int rehash)
+{
+   return HASH_FILE_HEADER_SIZE + sizeof(HashEntry)*(entries+rehash);
+}
+
 Hash::Hash() {
    hashTable = nullptr;
    hashSize = 0;
    hashMask = 0x0ULL;
    hashFree = 0;
    hash_init_done = 0;
+   mapBase = nullptr;
+   mapSize = 0;
+#ifdef _WIN32
+   mapFile = mapHandle = shareMutex = nullptr;
+#else
+   shareLockFd = -1;
+#endif
 }
 
 void Hash::initHash(size_t bytes)
@@ -40,17 +124,46 @@ void Hash::initHash(size_t bytes)
             break;
         }
       }
-      hashSize = (size_t)1 << hashPower;
-      hashMask = (uint64_t)(hashSize-1);
-      size_t hashSizePlus = hashSize + MaxRehash;
-      ALIGNED_MALLOC(hashTable,
-         HashEntry,
-         sizeof(HashEntry)*hashSizePlus,128);
+      setSize((size_t)1 << hashPower);
+      int reuse = 0;
+      if (options.search.hash_shared_name.length()) {
+         hashTable = mapSharedHash(options.search.hash_shared_name,reuse);
+         if (hashTable == nullptr) {
+            cerr << "warning: could not attach to shared hash table " <<
+               options.search.hash_shared_name << endl;
+         }
+      }
+      else if (options.search.hash_file.length()) {
+         hashTable = mapHashFile(options.search.hash_file,reuse);
+         if (hashTable == nullptr) {
+            cerr << "warning: could not map hash file " <<
+               options.search.hash_file << endl;
+         }
+      }
+      if (hashTable == nullptr) {
+         ALIGNED_MALLOC(hashTable,
+            HashEntry,
+            sizeof(HashEntry)*(hashSize + MaxRehash),128);
+      }
       if (hashTable == nullptr) {
           cerr << "hash table allocation failed!" << endl;
           hashSize = 0;
       }
-      clearHash();
+      else {
+          MemoryUsage::add(MemoryUsage::HashTable,
+                           sizeof(HashEntry)*(hashSize + MaxRehash));
+      }
+      if (reuse) {
+         countFree();
+      } else {
+         clearHash();
+         if (mapBase) {
+            // table is ready: mark it valid for later use
+            initHeader(*(HashFileHeader*)mapBase,hashSize);
+         }
+      }
+      // let other processes attach to a shared table
+      endSharedSetup();
       hash_init_done++;
    }
 }
@@ -64,7 +177,16 @@ void Hash::resizeHash(size_t bytes)
 
 void Hash::freeHash()
 {
-   ALIGNED_FREE(hashTable);
+   if (hashTable) {
+      MemoryUsage::remove(MemoryUsage::HashTable,
+                          sizeof(HashEntry)*(hashSize + MaxRehash));
+   }
+   if (mapBase) {
+      unmapHashFile();
+   } else {
+      ALIGNED_FREE(hashTable);
+   }
+   hashTable = nullptr;
    hash_init_done = 0;
 }
 
@@ -83,25 +205,325 @@ void Hash::clearHash()
 }
 
 
+void Hash::countFree()
+{
+   HashEntry empty;
+   hashFree = 0;
+   for (size_t i = 0; i < hashSize; i++) {
+      if (hashTable[i].empty() ||
+          memcmp(&hashTable[i],&empty,sizeof(HashEntry)) == 0) {
+         ++hashFree;
+      }
+   }
+}
+
+
+int Hash::saveHash(const string &fileName) const
+{
+   if (hashSize == 0) return 0;
+   ofstream out(fileName.c_str(),ios::out | ios::binary | ios::trunc);
+   HashFileHeader header;
+   initHeader(header,hashSize);
+   char pad[HASH_FILE_HEADER_SIZE];
+   memset(pad,'\0',HASH_FILE_HEADER_SIZE);
+   memcpy(pad,&header,sizeof(HashFileHeader));
+   out.write(pad,HASH_FILE_HEADER_SIZE);
+   out.write((const char*)hashTable,sizeof(HashEntry)*(hashSize+MaxRehash));
+   out.close();
+   return !out.fail();
+}
+
+
+int Hash::loadHash(const string &fileName)
+{
+   ifstream in(fileName.c_str(),ios::in | ios::binary);
+   char pad[HASH_FILE_HEADER_SIZE];
+   if (!in.read(pad,HASH_FILE_HEADER_SIZE)) {
+      return 0;
+   }
+   HashFileHeader header;
+   memcpy(&header,pad,sizeof(HashFileHeader));
+   if (!validHeader(header)) {
+      return 0;
+   }
+   if (header.entries != hashSize) {
+      // A mapped table is sized by its own file.
+      if (isMapped()) return 0;
+      freeHash();
+      initHash(header.entries*sizeof(HashEntry));
+      if (hashSize != header.entries) return 0;
+   }
+   if (!in.read((char*)hashTable,sizeof(HashEntry)*(hashSize+MaxRehash))) {
+      clearHash();
+      return 0;
+   }
+   countFree();
+   return 1;
+}
+
+
+// Returns 1 if a table of "entries" entries, found in hash file
+// "fileName", can be reused. A table of another size is discarded,
+// so that the file is resized to the configured size.
+int Hash::checkFileSize(const string &fileName, size_t entries) const
+{
+   if (entries == hashSize) return 1;
+   cerr << "warning: hash file " << fileName << " holds a " <<
+      (hashFileSize(entries,MaxRehash)/(1024*1024)) << "MB table, not " <<
+      (hashFileSize(hashSize,MaxRehash)/(1024*1024)) <<
+      "MB as configured: the file is resized and its contents discarded" << endl;
+   return 0;
+}
+
+
+HashEntry *Hash::mapHashFile(const string &fileName, int &reuse)
+{
+   HashFileHeader header;
+   reuse = 0;
+#ifdef _WIN32
+   HANDLE file = CreateFileA(fileName.c_str(),GENERIC_READ | GENERIC_WRITE,
+                            FILE_SHARE_READ,NULL,OPEN_ALWAYS,
+                            FILE_ATTRIBUTE_NORMAL,NULL);
+   if (file == INVALID_HANDLE_VALUE) return nullptr;
+   DWORD bytesRead;
+   LARGE_INTEGER fileSize;
+   if (ReadFile(file,&header,sizeof(HashFileHeader),&bytesRead,NULL) &&
+       bytesRead == sizeof(HashFileHeader) &&
+       validHeader(header) &&
+       GetFileSizeEx(file,&fileSize) &&
+       (uint64_t)fileSize.QuadPart == hashFileSize(header.entries,MaxRehash)) {
+      reuse = checkFileSize(fileName,header.entries);
+   }
+   const size_t bytes = hashFileSize(hashSize,MaxRehash);
+   if (!reuse) {
+      // set the file size (creating the mapping would only extend it)
+      LARGE_INTEGER size;
+      size.QuadPart = bytes;
+      if (!SetFilePointerEx(file,size,NULL,FILE_BEGIN) ||
+          !SetEndOfFile(file)) {
+         CloseHandle(file);
+         return nullptr;
+      }
+   }
+   // creating the mapping sets the file size, if necessary
+   HANDLE mapping = CreateFileMappingA(file,NULL,PAGE_READWRITE,
+                                      (DWORD)((uint64_t)bytes >> 32),
+                                      (DWORD)(bytes & 0xffffffff),NULL);
+   if (mapping == NULL) {
+      CloseHandle(file);
+      return nullptr;
+   }
+   void *p = MapViewOfFile(mapping,FILE_MAP_ALL_ACCESS,0,0,bytes);
+   if (p == NULL) {
+      CloseHandle(mapping);
+      CloseHandle(file);
+      return nullptr;
+   }
+   mapFile = file;
+   mapHandle = mapping;
+#else
+   int fd = open(fileName.c_str(),O_RDWR | O_CREAT,0644);
+   if (fd == -1) return nullptr;
+   struct stat st;
+   if (read(fd,&header,sizeof(HashFileHeader)) == (ssize_t)sizeof(HashFileHeader) &&
+       validHeader(header) &&
+       fstat(fd,&st) == 0 &&
+       (uint64_t)st.st_size == hashFileSize(header.entries,MaxRehash)) {
+      reuse = checkFileSize(fileName,header.entries);
+   }
+   const size_t bytes = hashFileSize(hashSize,MaxRehash);
+   if (!reuse && ftruncate(fd,bytes) != 0) {
+      close(fd);
+      return nullptr;
+   }
+   void *p = mmap(nullptr,bytes,PROT_READ | PROT_WRITE,MAP_SHARED,fd,0);
+   close(fd);
+   if (p == MAP_FAILED) return nullptr;
+#endif
+   mapBase = p;
+   mapSize = bytes;
+   return (HashEntry*)((char*)p + HASH_FILE_HEADER_SIZE);
+}
+
+
+HashEntry *Hash::mapSharedHash(const string &name, int &reuse)
+{
+   reuse = 0;
+   void *p = nullptr;
+   size_t bytes = 0;
+   int creator = 0;
+#ifdef _WIN32
+   const string mapName("Local\\" + name);
+   // Set up or attach to the table while holding this mutex. It is
+   // released by endSharedSetup once the table is ready. (A mapping
+   // is removed by Windows when its last user closes it.)
+   HANDLE mutex = CreateMutexA(NULL,FALSE,(mapName + "_setup").c_str());
+   if (mutex == NULL) return nullptr;
+   const DWORD wait = WaitForSingleObject(mutex,INFINITE);
+   if (wait != WAIT_OBJECT_0 && wait != WAIT_ABANDONED) {
+      CloseHandle(mutex);
+      return nullptr;
+   }
+   bytes = hashFileSize(hashSize,MaxRehash);
+   HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE,NULL,
+                                      PAGE_READWRITE,
+                                      (DWORD)((uint64_t)bytes >> 32),
+                                      (DWORD)(bytes & 0xffffffff),
+                                      mapName.c_str());
+   creator = mapping != NULL && GetLastError() != ERROR_ALREADY_EXISTS;
+   // map the whole object, whatever size its creator gave it
+   p = mapping == NULL ? NULL : MapViewOfFile(mapping,FILE_MAP_ALL_ACCESS,0,0,0);
+   if (p != NULL && !creator) {
+      MEMORY_BASIC_INFORMATION info;
+      VirtualQuery(p,&info,sizeof(info));
+      bytes = info.RegionSize;
+      const HashFileHeader *header = (const HashFileHeader*)p;
+      if (!validHeader(*header) ||
+          hashFileSize(header->entries,MaxRehash) > bytes) {
+         // its creator exited before the table was ready: set it up
+         // again, if it is large enough
+         if (hashFileSize(hashSize,MaxRehash) <= bytes) {
+            creator = 1;
+         } else {
+            UnmapViewOfFile(p);
+            p = NULL;
+         }
+      }
+   }
+   if (p == NULL) {
+      if (mapping != NULL) CloseHandle(mapping);
+      ReleaseMutex(mutex);
+      CloseHandle(mutex);
+      return nullptr;
+   }
+   mapHandle = mapping;
+   shareMutex = mutex;
+#else
+   // POSIX shared memory names start with a slash
+   const string shmName(name[0] == '/' ? name : "/" + name);
+   const string lockName("/tmp" + shmName + ".lock");
+   const int lockFd = open(lockName.c_str(),O_RDWR | O_CREAT,0644);
+   if (lockFd == -1) return nullptr;
+   // Set up or attach to the table while holding the setup lock. It
+   // is released by endSharedSetup once the table is ready.
+   if (!lockByte(lockFd,F_WRLCK,SETUP_LOCK,true)) {
+      close(lockFd);
+      return nullptr;
+   }
+   const int fd = shm_open(shmName.c_str(),O_RDWR | O_CREAT,0644);
+   struct stat st;
+   if (fd == -1 || fstat(fd,&st) != 0) {
+      if (fd != -1) close(fd);
+      close(lockFd);
+      return nullptr;
+   }
+   if ((size_t)st.st_size > HASH_FILE_HEADER_SIZE) {
+      bytes = (size_t)st.st_size;
+      p = mmap(nullptr,bytes,PROT_READ | PROT_WRITE,MAP_SHARED,fd,0);
+      if (p == MAP_FAILED) {
+         p = nullptr;
+      }
+      else {
+         const HashFileHeader *header = (const HashFileHeader*)p;
+         if (!validHeader(*header) ||
+             hashFileSize(header->entries,MaxRehash) > bytes) {
+            // Its creator exited before the table was ready. No
+            // process can be using it, so set it up again.
+            munmap(p,bytes);
+            p = nullptr;
+         }
+      }
+   }
+   if (p == nullptr) {
+      creator = 1;
+      bytes = hashFileSize(hashSize,MaxRehash);
+      if (ftruncate(fd,bytes) == 0) {
+         p = mmap(nullptr,bytes,PROT_READ | PROT_WRITE,MAP_SHARED,fd,0);
+      }
+      if (p == nullptr || p == MAP_FAILED) {
+         // leave the (unfinished) object for its next user to set up
+         close(fd);
+         close(lockFd);
+         return nullptr;
+      }
+   }
+   close(fd);
+   // register as a user, until unmapHashFile
+   lockByte(lockFd,F_RDLCK,USERS_LOCK,true);
+   shareLockFd = lockFd;
+   shareName = shmName;
+#endif
+   mapBase = p;
+   mapSize = bytes;
+   if (!creator) {
+      // the table keeps the size it was created with
+      setSize(((const HashFileHeader*)p)->entries);
+      reuse++;
+   }
+   return (HashEntry*)((char*)p + HASH_FILE_HEADER_SIZE);
+}
+
+
+void Hash::endSharedSetup()
+{
+#ifdef _WIN32
+   if (shareMutex) {
+      ReleaseMutex((HANDLE)shareMutex);
+   }
+#else
+   if (shareLockFd != -1) {
+      lockByte(shareLockFd,F_UNLCK,SETUP_LOCK,false);
+   }
+#endif
+}
+
+
+void Hash::unmapHashFile()
+{
+#ifdef _WIN32
+   UnmapViewOfFile(mapBase);
+   CloseHandle((HANDLE)mapHandle);
+   if (mapFile) CloseHandle((HANDLE)mapFile);
+   mapFile = mapHandle = nullptr;
+   if (shareMutex) {
+      CloseHandle((HANDLE)shareMutex);
+      shareMutex = nullptr;
+   }
+#else
+   munmap(mapBase,mapSize);
+   if (shareLockFd != -1) {
+      // Remove a shared table when its last user detaches. Holding
+      // the setup lock keeps other processes from attaching meanwhile.
+      if (lockByte(shareLockFd,F_WRLCK,SETUP_LOCK,true) &&
+          lockByte(shareLockFd,F_WRLCK,USERS_LOCK,false)) {
+         shm_unlink(shareName.c_str());
+      }
+      // releases this process's locks
+      close(shareLockFd);
+      shareLockFd = -1;
+   }
+#endif
+   mapBase = nullptr;
+   mapSize = 0;
+}
+
+
 void Hash::loadLearnInfo()
 {
    if (hashSize && options.learning.position_learning) {
-      ifstream plog;
-      plog.open(learnFileName.c_str(),ios_base::in);
-      while (plog.good() && !plog.eof()) {
-         LearnRecord rec;
-         if (getLearnRecord(plog,rec)) {
-            Move best = NullMove;
-            if (rec.start != InvalidSquare)
-               best = CreateMove(rec.start,rec.dest,rec.promotion);
-            storeHash(rec.hashcode,rec.depth*DEPTH_INCREMENT,
-                      0,                                 /* age */
-                      HashEntry::Valid,
-                      rec.score,
-                      Constants::INVALID_SCORE, // TBD
-                      HashEntry::LEARNED_MASK,
-                      best);
-         }
+      vector<LearnRecord> records;
+      readLearnFile(learnFileName,records);
+      for (const LearnRecord &rec : records) {
+         Move best = NullMove;
+         if (rec.start != InvalidSquare)
+            best = CreateMove(rec.start,rec.dest,rec.promotion);
+         storeHash(rec.hashcode,rec.depth*DEPTH_INCREMENT,
+                   0,                                 /* age */
+                   HashEntry::Valid,
+                   rec.score,
+                   Constants::INVALID_SCORE, // TBD
+                   HashEntry::LEARNED_MASK,
+                   best);
       }
    }
 }
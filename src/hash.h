@@ -183,6 +183,22 @@ class Hash {
 
     void clearHash();
 
+    // Write the table contents to a file. Returns 1 on success.
+    int saveHash(const string &fileName) const;
+
+    // Replace the table contents with those saved in a file. The
+    // table is resized if necessary to match the saved table (entries
+    // cannot be moved to a table of a different size). Returns 1 on
+    // success.
+    int loadHash(const string &fileName);
+
+    // true if the table is kept in a memory-mapped file or shared
+    // memory, so its contents persist across runs and may be in use
+    // by other processes.
+    int isMapped() const {
+        return mapBase != nullptr;
+    }
+
     // put info from the external permanent hash table into the
     // in-memory hash table
     void loadLearnInfo();
@@ -296,11 +312,49 @@ private:
         return score_t((std::abs((int)pos.age()-(int)age)<<12) - pos.depth());
     }
 
+    // Map the table from a file. Sets "reuse" if the file already
+    // holds a table of the configured size, whose contents can be
+    // used. Returns nullptr if mapping fails.
+    HashEntry *mapHashFile(const string &fileName, int &reuse);
+
+    int checkFileSize(const string &fileName, size_t entries) const;
+
+    // Attach to a named shared memory table, creating it if it does
+    // not exist. A table created by another process keeps the size
+    // it was given at creation (reuse is set in that case). Setup is
+    // serialized between processes: other processes wait to attach
+    // until endSharedSetup is called.
+    HashEntry *mapSharedHash(const string &name, int &reuse);
+
+    void endSharedSetup();
+
+    void unmapHashFile();
+
+    // recompute hashFree after the table is filled from a file
+    void countFree();
+
+    void setSize(size_t entries) {
+        hashSize = entries;
+        hashMask = (uint64_t)(hashSize-1);
+    }
+
     HashEntry *hashTable;
     size_t hashSize, hashFree;
     hash_t hashMask;
     static const int MaxRehash = 4;
     int hash_init_done;
+    // start and size of the mapped region, if any (includes header)
+    void *mapBase;
+    size_t mapSize;
+#ifdef _WIN32
+    void *mapFile, *mapHandle;
+    // mutex serializing setup of a shared table
+    void *shareMutex;
+#else
+    // lock file of a shared table (see mapSharedHash), or -1
+    int shareLockFd;
+    string shareName;
+#endif
 };
 
 #endif
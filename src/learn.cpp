@@ -4,12 +4,138 @@
 #include "learn.h"
 #include "globals.h"
 #include "scoring.h"
+#include <algorithm>
 #include <cstddef>
+#include <cstdio>
+#include <fstream>
 #include <sstream>
 
 // max ply for position learning
 #define POSITION_MAX_PLY 60
 
+// Learning file format. All values are in native byte order; records
+// are a fixed size so that the file can be read (or mapped) as an
+// array.
+struct LearnFileHeader {
+   char magic[8];
+   uint32_t version;
+   uint32_t count;
+};
+
+struct LearnFileRecord {
+   uint64_t hashcode;
+   int16_t score;
+   uint8_t depth;
+   uint8_t in_check;
+   int8_t start, dest, promotion;
+   int8_t unused;
+};
+
+static const char LEARN_FILE_MAGIC[8] = {'A','r','a','s','a','n','L','N'};
+
+static const uint32_t LEARN_FILE_VERSION = 1;
+
+int readLearnFile(const string &fileName, vector<LearnRecord> &records)
+{
+   records.clear();
+   ifstream in(fileName.c_str(),ios::in | ios::binary);
+   LearnFileHeader header;
+   if (!in.read((char*)&header,sizeof(LearnFileHeader)) ||
+       memcmp(header.magic,LEARN_FILE_MAGIC,sizeof(LEARN_FILE_MAGIC)) ||
+       header.version != LEARN_FILE_VERSION) {
+      return 0;
+   }
+   // do not trust the count in a truncated or corrupt file
+   const std::streampos start = in.tellg();
+   in.seekg(0,ios::end);
+   const std::streamoff available = in.tellg() - start;
+   in.seekg(start);
+   if (!in || available < 0 ||
+       (uint64_t)header.count*sizeof(LearnFileRecord) > (uint64_t)available) {
+      return 0;
+   }
+   vector<LearnFileRecord> data(header.count);
+   if (header.count &&
+       !in.read((char*)data.data(),header.count*sizeof(LearnFileRecord))) {
+      return 0;
+   }
+   records.resize(header.count);
+   for (uint32_t i = 0; i < header.count; i++) {
+      const LearnFileRecord &r = data[i];
+      LearnRecord &rec = records[i];
+      rec.hashcode = r.hashcode;
+      rec.in_check = r.in_check;
+      rec.score = score_t(r.score);
+      rec.depth = r.depth;
+      rec.start = Square(r.start);
+      rec.dest = Square(r.dest);
+      rec.promotion = PieceType(r.promotion);
+   }
+   return 1;
+}
+
+int writeLearnFile(const string &fileName, vector<LearnRecord> &records)
+{
+   // stable sort, so the last of several records for a position
+   // is still last
+   std::stable_sort(records.begin(),records.end(),
+                    [](const LearnRecord &a, const LearnRecord &b) {
+                       return a.hashcode < b.hashcode;
+                    });
+   vector<LearnFileRecord> data;
+   data.reserve(records.size());
+   for (const LearnRecord &rec : records) {
+      if (data.size() && data.back().hashcode == rec.hashcode) {
+         data.pop_back();
+      }
+      LearnFileRecord r;
+      r.hashcode = rec.hashcode;
+      r.score = int16_t(rec.score);
+      r.depth = uint8_t(std::max<int>(0,std::min<int>(255,rec.depth)));
+      r.in_check = uint8_t(rec.in_check != 0);
+      r.start = int8_t(rec.start);
+      r.dest = int8_t(rec.dest);
+      r.promotion = int8_t(rec.promotion);
+      r.unused = 0;
+      data.push_back(r);
+   }
+   LearnFileHeader header;
+   memcpy(header.magic,LEARN_FILE_MAGIC,sizeof(LEARN_FILE_MAGIC));
+   header.version = LEARN_FILE_VERSION;
+   header.count = (uint32_t)data.size();
+   // Write a new file and then replace the old one, so that
+   // readers never see a partially written file.
+   const string tmpName(fileName + ".tmp");
+   ofstream out(tmpName.c_str(),ios::out | ios::binary | ios::trunc);
+   out.write((const char*)&header,sizeof(LearnFileHeader));
+   out.write((const char*)data.data(),data.size()*sizeof(LearnFileRecord));
+   out.close();
+   if (out.fail()) {
+      remove(tmpName.c_str());
+      return 0;
+   }
+#ifdef _WIN32
+   remove(fileName.c_str());
+#endif
+   return rename(tmpName.c_str(),fileName.c_str()) == 0;
+}
+
+int convertLearnFile(const string &textFileName, const string &fileName)
+{
+   ifstream test(fileName.c_str(),ios::in | ios::binary);
+   if (test.good()) return 0;
+   ifstream text(textFileName.c_str(),ios::in);
+   if (!text.good()) return 0;
+   vector<LearnRecord> records;
+   while (text.good() && !text.eof()) {
+      LearnRecord rec;
+      if (getLearnRecord(text,rec)) {
+         records.push_back(rec);
+      }
+   }
+   return writeLearnFile(fileName,records);
+}
+
 void learn(const Board &board, int rep_count)
 {
    // Do position learning. If our score has dropped or
@@ -51,17 +177,20 @@ void learn(const Board &board, int rep_count)
          if (last_depth > options.learning.position_learning_minDepth &&
              (diff1 > score_threshold || diff2 > score_threshold)) {
             // last 2 or more moves were not from book, and score has changed
-            // significantly. Append to the learn file.
-            stringstream s;
-            s << (hex) << board.hashCode(rep_count);
-            s << ' ' << (dec) << (board.checkStatus() == InCheck) << 
-               ' ' << last_score << ' ' << last_depth << ' ';
-            MoveImage(last_entry.move(),s);
-            s << '\n';
-            ofstream log;
-            log.open(learnFileName.c_str(),ios_base::out | ios_base::app);
-            log << s.str();
-            log.close();
+            // significantly. Add to the learn file.
+            LearnRecord rec;
+            rec.hashcode = board.hashCode(rep_count);
+            rec.in_check = board.checkStatus() == InCheck;
+            rec.score = last_score;
+            rec.depth = last_depth;
+            const Move move = last_entry.move();
+            rec.start = IsNull(move) ? InvalidSquare : StartSquare(move);
+            rec.dest = IsNull(move) ? InvalidSquare : DestSquare(move);
+            rec.promotion = IsNull(move) ? Empty : PromoteTo(move);
+            vector<LearnRecord> records;
+            readLearnFile(learnFileName,records);
+            records.push_back(rec);
+            writeLearnFile(learnFileName,records);
             stringstream str;
             str << "learning position, score = ";
             Scoring::printScore(last_score,str);
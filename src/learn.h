@@ -8,6 +8,8 @@
 #include "board.h"
 #include "log.h"
 #include <istream>
+#include <string>
+#include <vector>
 
 // Activate the book learning feature. Call after a move
 // has been added to the log. Board is the position before the move.
@@ -22,7 +24,24 @@ struct LearnRecord {
   PieceType promotion;
 };
 
-// Retrieve position learning info
+// Retrieve position learning info from a file in the old text format
 extern int getLearnRecord(istream &learnFile, LearnRecord &);
 
+// The position learning file is binary: a header followed by
+// fixed-size records sorted by hash code, with one record per
+// position. Read all records from the file. Returns 0 if the
+// file does not exist or is not a valid learning file.
+extern int readLearnFile(const string &fileName, vector<LearnRecord> &);
+
+// Write records to the learning file, replacing its contents. The
+// records are sorted, and where a position occurs more than once,
+// only the last record for it is kept. Returns 1 on success.
+extern int writeLearnFile(const string &fileName, vector<LearnRecord> &);
+
+// Convert a text format learning file to the binary format. Does
+// nothing (and returns 0) if the binary file already exists or the
+// text file does not.
+extern int convertLearnFile(const string &textFileName,
+                            const string &fileName);
+
 #endif
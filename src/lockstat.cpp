@@ -0,0 +1,64 @@
+// Copyright 2017 by Jon Dart. All Rights Reserved.
+
+#include "types.h"
+
+#ifdef LOCK_STATS
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <mutex>
+#include <vector>
+
+static std::mutex &registryLock() {
+   static std::mutex m;
+   return m;
+}
+
+static std::vector<LockStats *> &registry() {
+   static std::vector<LockStats *> r;
+   return r;
+}
+
+LockStats *LockStats::get(const char *name) {
+   std::unique_lock<std::mutex> lk(registryLock());
+   for (LockStats *s : registry()) {
+      if (strcmp(s->name,name) == 0) return s;
+   }
+   LockStats *s = new LockStats;
+   s->name = name;
+   s->acquisitions = s->contended = s->waitCycles = 0;
+   registry().push_back(s);
+   return s;
+}
+
+void LockStats::clear() {
+   std::unique_lock<std::mutex> lk(registryLock());
+   for (LockStats *s : registry()) {
+      s->acquisitions = s->contended = s->waitCycles = 0;
+   }
+}
+
+void LockStats::report(std::ostream &out) {
+   std::unique_lock<std::mutex> lk(registryLock());
+   std::vector<LockStats *> used;
+   for (LockStats *s : registry()) {
+      if (s->acquisitions) used.push_back(s);
+   }
+   std::sort(used.begin(),used.end(),[](const LockStats *a, const LockStats *b) {
+         return a->waitCycles > b->waitCycles; });
+   out << "lock statistics:" << endl;
+   out << setw(20) << std::left << "name" << std::right <<
+      setw(14) << "acquired" << setw(14) << "contended" <<
+      setw(8) << "pct" << setw(16) << "wait cycles" <<
+      setw(12) << "avg wait" << endl;
+   for (const LockStats *s : used) {
+      const uint64_t acq = s->acquisitions, cont = s->contended,
+         wait = s->waitCycles;
+      out << setw(20) << std::left << s->name << std::right <<
+         setw(14) << acq << setw(14) << cont <<
+         setw(7) << std::fixed << std::setprecision(2) <<
+         100.0*cont/acq << '%' << setw(16) << wait <<
+         setw(12) << (cont ? wait/cont : 0) << endl;
+   }
+}
+#endif
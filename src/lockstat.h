@@ -0,0 +1,102 @@
+// Copyright 2017 by Jon Dart. All Rights Reserved.
+
+#ifndef _LOCKSTAT_H
+#define _LOCKSTAT_H
+
+// Lock contention statistics, for finding SMP bottlenecks. Only
+// compiled in if LOCK_STATS is defined, in which case all locks
+// declared with LockDefine/lock_t are InstrumentedLocks wrapping the
+// configured lock type (see types.h). This file is included from
+// types.h and so must not include it.
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+
+// Counters for all locks with the same name. For example all split
+// point locks share one LockStats instance.
+struct LockStats {
+   const char *name;
+   std::atomic<uint64_t> acquisitions;
+   // acquisitions that found the lock held
+   std::atomic<uint64_t> contended;
+   // cycles spent waiting in contended acquisitions
+   std::atomic<uint64_t> waitCycles;
+
+   // Get the counters for "name", creating them if necessary. The
+   // counters are never freed, so they outlive the locks using them.
+   static LockStats *get(const char *name);
+
+   // Zero all counters.
+   static void clear();
+
+   // Print the counters for all locks that have been acquired since
+   // the last clear(), most waited-on first.
+   static void report(std::ostream &);
+};
+
+#ifdef _WIN32
+// CRITICAL_SECTION, with the lock interface InstrumentedLock uses.
+class CriticalSectionLock {
+   CRITICAL_SECTION cs;
+
+ public:
+   CriticalSectionLock() {
+      InitializeCriticalSection(&cs);
+   }
+
+   ~CriticalSectionLock() {
+      DeleteCriticalSection(&cs);
+   }
+
+   bool try_lock() {
+      return TryEnterCriticalSection(&cs) != 0;
+   }
+
+   void lock() {
+      EnterCriticalSection(&cs);
+   }
+
+   void unlock() {
+      LeaveCriticalSection(&cs);
+   }
+};
+#endif
+
+// Wraps the lock type that is used when LOCK_STATS is not defined
+// ("LockType", which must provide lock, try_lock and unlock), so that
+// the statistics reflect that lock's behavior.
+template <class LockType>
+class InstrumentedLock {
+   LockType impl;
+   LockStats *stats;
+
+ public:
+   InstrumentedLock() : stats(nullptr) {
+   }
+
+   void init(const char *name) {
+      stats = LockStats::get(name);
+   }
+
+   void lock() {
+      if (impl.try_lock()) {
+         if (stats) stats->acquisitions.fetch_add(1,std::memory_order_relaxed);
+         return;
+      }
+      const uint64_t start = getCycleCount();
+      impl.lock();
+      if (stats) {
+         stats->acquisitions.fetch_add(1,std::memory_order_relaxed);
+         stats->contended.fetch_add(1,std::memory_order_relaxed);
+         stats->waitCycles.fetch_add(getCycleCount()-start,std::memory_order_relaxed);
+      }
+   }
+
+   void unlock() {
+      impl.unlock();
+   }
+};
+
+#endif
@@ -20,3 +20,8 @@ const int32_t Material::masks2[8] =
 const int32_t Material::levels[8] =
 { 0, 0, 3, 3, 5, 9, 0, 0};
 
+// Weights for key(): a mixed-radix number with digits for pawns
+// (0-8), knights, bishops, rooks (0-2) and queens (0-1).
+const uint32_t Material::keys[8] =
+{ 0, 1, 9, 27, 81, 243, 0, 0};
+
@@ -12,7 +12,7 @@ class Material
     friend class Board;
  public:
  Material():
-    info(0), total(0), level(0), count(0)
+    info(0), total(0), level(0), count(0), matkey(0)
       {
       }
 	
@@ -34,12 +34,16 @@ class Material
     enum {KQB = 0x110100};
 
     enum {PieceMask = 0x1ffff0};
+
+    // Number of distinct values of key()
+    enum {KeyRange = 486};
         
     FORCEINLINE void addPiece(const PieceType p)
     {
         info += masks[(int)p];
         total += (stored_score_t)Params::PieceValue(p);
         level += levels[(int)p];
+        matkey += keys[(int)p];
         count++;
         ASSERT(level >=0);
     }
@@ -49,6 +53,7 @@ class Material
         info -= masks[(int)p];
         total -= (stored_score_t)Params::PieceValue(p);
         level -= levels[(int)p];
+        matkey -= keys[(int)p];
         count--;
         ASSERT(level >=0);
     }
@@ -57,6 +62,7 @@ class Material
     {
         info += masks[(int)Pawn];
         total += (stored_score_t)Params::PAWN_VALUE;
+        matkey += keys[(int)Pawn];
         ++count; 
     }
 
@@ -64,6 +70,7 @@ class Material
     {
         info -= masks[(int)Pawn];
         total -= (stored_score_t)Params::PAWN_VALUE;
+        matkey -= keys[(int)Pawn];
         --count;
     }
 
@@ -103,6 +110,7 @@ class Material
         
     void clearPawns()
     {
+        matkey -= keys[(int)Pawn]*pawnCount();
         info &= ~0xf;
     }
         
@@ -199,9 +207,24 @@ class Material
         return (level > 31) ? 31 : level;
     }
 
+    // Compact signature of the material, in the range 0 to
+    // KeyRange-1. Only valid if keyInRange() is true.
+    uint32_t key() const {
+        return matkey;
+    }
+
+    // True if there is at most one queen and at most two rooks,
+    // bishops and knights (any number of pawns is allowed). Adding
+    // 6 to the queen count and 5 to the other counts sets the high
+    // bit of a count's nibble if the count is out of range.
+    bool keyInRange() const {
+        return ((info + 0x65550) & 0x88880) == 0;
+    }
+
  private:
     void clear() {
         info = level = count = 0;
+        matkey = 0;
 		total = 0;
     }
 
@@ -209,9 +232,11 @@ class Material
 	stored_score_t total;
 	uint32_t level;
     int count;
+    uint32_t matkey;
     static const int32_t masks[8];
     static const int32_t masks2[8];
     static const int32_t levels[8];
+    static const uint32_t keys[8];
 };
 
 #endif
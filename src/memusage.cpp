@@ -0,0 +1,53 @@
+// Copyright 2017 by Jon Dart. All Rights Reserved.
+
+#include "memusage.h"
+#include <iomanip>
+
+atomic<int64_t> MemoryUsage::usage[MemoryUsage::NumCategories];
+
+static const char *CATEGORY_NAMES[MemoryUsage::NumCategories] = {
+   "hash table",
+   "search threads",
+   "pawn hash",
+   "history",
+   "counter move history",
+   "thread stacks",
+   "tablebase cache",
+   "tablebases",
+   "bitbases",
+   "static tables"
+};
+
+size_t MemoryUsage::total() {
+   size_t sum = 0;
+   for (int i = 0; i < NumCategories; i++) {
+      sum += get((Category)i);
+   }
+   return sum;
+}
+
+static void printSize(ostream &out, size_t bytes) {
+   std::ios_base::fmtflags original_flags = out.flags();
+   out << std::fixed << setprecision(2);
+   if (bytes >= 1024L*1024L) {
+      out << bytes/(1024.0*1024.0) << "M";
+   }
+   else {
+      out << bytes/1024.0 << "K";
+   }
+   out.flags(original_flags);
+}
+
+void MemoryUsage::report(ostream &out, const string &prefix) {
+   for (int i = 0; i < NumCategories; i++) {
+      const size_t bytes = get((Category)i);
+      if (bytes) {
+         out << prefix << CATEGORY_NAMES[i] << ": ";
+         printSize(out,bytes);
+         out << endl;
+      }
+   }
+   out << prefix << "total: ";
+   printSize(out,total());
+   out << endl;
+}
@@ -0,0 +1,57 @@
+// Copyright 2017 by Jon Dart. All Rights Reserved.
+
+#ifndef _MEMUSAGE_H
+#define _MEMUSAGE_H
+
+#include "types.h"
+#include <string>
+
+// Accounting of the memory used by the program, by subsystem. Each
+// subsystem adds the size of its data when it allocates it and
+// removes it when it frees it. Small and short-lived allocations are
+// not counted.
+class MemoryUsage {
+
+ public:
+
+   enum Category {
+      HashTable,          // main hash table
+      SearchThreads,      // per-thread Search instances (other than
+                          // the categories below)
+      PawnHash,           // per-thread pawn and king/pawn hash tables
+      History,            // per-thread killer, history and refutation
+                          // tables
+      CounterMoveHistory, // per-thread counter move history
+      ThreadStacks,       // stacks of the search threads (reserved
+                          // address space); these hold the node stacks
+      TbCache,            // cache of tablebase probe results
+      Tablebases,         // tablebase caches and locked tablebase files
+      Bitbases,           // endgame bitbases
+      StaticTables,       // attack and evaluation tables
+      NumCategories
+   };
+
+   static void add(Category c, size_t bytes) {
+      usage[c] += (int64_t)bytes;
+   }
+
+   static void remove(Category c, size_t bytes) {
+      usage[c] -= (int64_t)bytes;
+   }
+
+   static size_t get(Category c) {
+      return (size_t)usage[c].load();
+   }
+
+   static size_t total();
+
+   // Output the usage of each category in use, and the total. Each
+   // line of output starts with "prefix".
+   static void report(ostream &out, const string &prefix);
+
+ private:
+
+   static atomic<int64_t> usage[NumCategories];
+};
+
+#endif
@@ -12,8 +12,6 @@
 #include <cmath>
 using namespace std;
 
-extern const int Direction[2];
-
 const int MoveGenerator::EASY_PLIES = 3;
 
 static FORCEINLINE void swap( Move moves[], int scores[], int i, int j)
@@ -428,30 +426,55 @@ int MoveGenerator::getBatch(Move *&batch,int &index)
 }
 
 
+// Add the promotions of a pawn moving from "start" to "dest".
+// Under-promotions to rook or bishop are only generated if "all" is
+// set.
+static FORCEINLINE int addPromotions(Move *moves, Square start, Square dest,
+                                     PieceType capture, bool all)
+{
+   int n = 0;
+   moves[n++] = CreateMove(start,dest,Pawn,capture,Queen,Promotion);
+   moves[n++] = CreateMove(start,dest,Pawn,capture,Knight,Promotion);
+   if (all) {
+      moves[n++] = CreateMove(start,dest,Pawn,capture,Rook,Promotion);
+      moves[n++] = CreateMove(start,dest,Pawn,capture,Bishop,Promotion);
+   }
+   return n;
+}
+
+// Advance pawns of "side" one rank.
+template <ColorType side>
+static FORCEINLINE void pawnPush(Bitboard &pawns)
+{
+   if (side == White) pawns.shl8(); else pawns.shr8();
+}
+
 int MoveGenerator::generateNonCaptures(Move *moves)
 {
+   return board.sideToMove() == White ? generateNonCaptures<White>(moves) :
+      generateNonCaptures<Black>(moves);
+}
+
+template <ColorType side>
+int MoveGenerator::generateNonCaptures(Move *moves)
+{
+   const ColorType oside = OppositeColor(side);
    int numMoves = 0;
+   const AttackMap *map = validAttacks();
    // castling moves
-   const ColorType side = board.sideToMove();
    CastleType CS = board.castleStatus(side);
    if ((CS == CanCastleEitherSide) ||
    (CS == CanCastleKSide)) {
       const Square kp = board.kingSquare(side);
-#ifdef _DEBUG
-      if (side == White) {
-         ASSERT(kp == chess::E1);
-         ASSERT(board[kp+3] == WhiteRook);
-      }
-      else {
-         ASSERT(kp == chess::E8);
-         ASSERT(board[kp+3] == BlackRook);
-      }
-#endif
+      ASSERT(kp == (side == White ? chess::E1 : chess::E8));
+      ASSERT(board[kp+3] == MakePiece(Rook,side));
       if (board[kp + 1] == EmptyPiece &&
          board[kp + 2] == EmptyPiece &&
          board.checkStatus() == NotInCheck &&
-         !board.anyAttacks(kp + 1,OppositeColor(side)) &&
-         !board.anyAttacks(kp + 2,OppositeColor(side)))
+         (map ? !map->attacked(kp + 1,oside) &&
+                !map->attacked(kp + 2,oside) :
+          !board.anyAttacks(kp + 1,oside) &&
+          !board.anyAttacks(kp + 2,oside)))
          // can castle
          moves[numMoves++] = CreateMove(kp, kp+2, King, Empty,
             Empty, KCastle);
@@ -463,8 +486,10 @@ int MoveGenerator::generateNonCaptures(Move *moves)
          board[kp - 2] == EmptyPiece &&
          board[kp - 3] == EmptyPiece &&
          board.checkStatus() == NotInCheck  &&
-         !board.anyAttacks(kp - 1,OppositeColor(side)) &&
-         !board.anyAttacks(kp - 2,OppositeColor(side)))
+         (map ? !map->attacked(kp - 1,oside) &&
+                !map->attacked(kp - 2,oside) :
+          !board.anyAttacks(kp - 1,oside) &&
+          !board.anyAttacks(kp - 2,oside)))
          // can castle
          moves[numMoves++] = CreateMove(kp, kp-2, King, Empty,
             Empty, QCastle);
@@ -482,14 +507,14 @@ int MoveGenerator::generateNonCaptures(Move *moves)
    }
    start = board.kingSquare(side);
    dests = Attacks::king_attacks[start] & ~board.allOccupied &
-               ~Attacks::king_attacks[board.kingSquare(board.oppositeSide())];
+               ~Attacks::king_attacks[board.kingSquare(oside)];
    while (dests.iterate(dest)) {
       moves[numMoves++] =
         CreateMove(start,dest,King);
    }
    Bitboard bishops(board.bishop_bits[side] | board.queen_bits[side]);
    while (bishops.iterate(start)) {
-      Bitboard dests(board.bishopAttacks(start) & ~board.allOccupied);
+      Bitboard dests((map ? map->diagAttacksFrom(start) : board.bishopAttacks(start)) & ~board.allOccupied);
       while (dests.iterate(dest)) {
          moves[numMoves++] =
             CreateMove(start,dest,TypeOfPiece(board[start]));
@@ -497,36 +522,23 @@ int MoveGenerator::generateNonCaptures(Move *moves)
    }
    Bitboard rooks(board.rook_bits[side] | board.queen_bits[side]);
    while (rooks.iterate(start)) {
-      Bitboard dests(board.rookAttacks(start) & ~board.allOccupied);
+      Bitboard dests((map ? map->rankFileAttacksFrom(start) : board.rookAttacks(start)) & ~board.allOccupied);
       while (dests.iterate(dest)) {
           moves[numMoves++] =
             CreateMove(start,dest,TypeOfPiece(board[start]));
       }
    }
    // pawn moves
-   if (board.sideToMove() == White) {
-      Bitboard pawns(board.pawn_bits[White]);
-      pawns.shl8();
-        // exclude promotions
-      pawns &= ~(board.allOccupied | Attacks::rank_mask[7]);
-      Square sq;
-      while (pawns.iterate(sq)) {
-         moves[numMoves++] = CreateMove(sq-8,sq,Pawn);
-         if (Rank<White>(sq)==3 && board[sq+8] == EmptyPiece)
-            moves[numMoves++] = CreateMove(sq-8,sq+8,Pawn);
-      }
-   }
-   else {
-      Bitboard pawns(board.pawn_bits[Black]);
-      pawns.shr8();
-        // exclude promotions
-      pawns &= ~(board.allOccupied | Attacks::rank_mask[0]);     
-      Square sq;
-      while (pawns.iterate(sq)) {
-         moves[numMoves++] = CreateMove(sq+8,sq,Pawn);
-         if (Rank<Black>(sq)==3 && board[sq-8] == EmptyPiece)
-            moves[numMoves++] = CreateMove(sq+8,sq-8,Pawn);
-      }
+   const int forward = side == White ? 8 : -8;
+   Bitboard pawns(board.pawn_bits[side]);
+   pawnPush<side>(pawns);
+   // exclude promotions
+   pawns &= ~(board.allOccupied | Attacks::rank_mask[side == White ? 7 : 0]);
+   Square sq;
+   while (pawns.iterate(sq)) {
+      moves[numMoves++] = CreateMove(sq-forward,sq,Pawn);
+      if (Rank<side>(sq)==3 && board[sq+forward] == EmptyPiece)
+         moves[numMoves++] = CreateMove(sq-forward,sq+forward,Pawn);
    }
    return numMoves;
 }
@@ -534,181 +546,70 @@ int MoveGenerator::generateNonCaptures(Move *moves)
 
 int MoveGenerator::generateCaptures(Move * moves, const Bitboard &targets)
 {
+   return board.sideToMove() == White ? generateCaptures<White>(moves,targets) :
+      generateCaptures<Black>(moves,targets);
+}
+
+template <ColorType side>
+int MoveGenerator::generateCaptures(Move * moves, const Bitboard &targets)
+{
+   const ColorType oside = OppositeColor(side);
    int numMoves = 0;
+   const AttackMap *map = validAttacks();
 
-   if (board.sideToMove() == White) {
-      Bitboard pawns(board.pawn_bits[White]);
-      Bitboard pawns1 = pawns;
-      pawns1.shl(7);
-      pawns1 &= ~0x8080808080808080ULL;
-      pawns1 &= board.occupied[Black];
-      Square dest;
+   const int forward = side == White ? 8 : -8;
+   const Bitboard &pawns = board.pawn_bits[side];
+   Square dest;
+   // Pawn captures, first toward the h-file for White (a-file for
+   // Black), then toward the other side. "delta" is the distance
+   // between the start and destination squares.
+   for (int delta = 7; delta <= 9; delta += 2) {
+      Bitboard pawns1(pawns);
+      if (side == White) pawns1.shl(delta); else pawns1.shr(delta);
+      // remove captures that wrapped around the board edge
+      pawns1 &= ((side == White) == (delta == 7)) ? ~0x8080808080808080ULL :
+         ~0x0101010101010101ULL;
+      pawns1 &= board.occupied[oside];
       while (pawns1.iterate(dest)) {
-         Square start = dest-7;
-         if (Rank<White>(start) == 7) {
-            moves[numMoves++] =
-               CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]),Queen,Promotion);
-            moves[numMoves++] =
-               CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]),Knight,Promotion);
-            if (ply == 0) {
-               moves[numMoves++] =
-                  CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]),Rook,Promotion);
-               moves[numMoves++] =
-                  CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]),Bishop,Promotion);
-            }
+         const Square start = side == White ? dest-delta : dest+delta;
+         if (Rank<side>(start) == 7) {
+            numMoves += addPromotions(moves+numMoves,start,dest,
+                                      TypeOfPiece(board[dest]),ply == 0);
          }
          else if (targets.isSet(dest)) {
             moves[numMoves++] =
                CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]));
          }
       }
-      pawns1 = pawns;
-      pawns1.shl(9);
-      pawns1 &= ~0x0101010101010101ULL;
-      pawns1 &= board.occupied[Black];
-      while (pawns1.iterate(dest)) {
-         Square start = dest-9;
-         if (Rank<White>(start) == 7) {
-            moves[numMoves++] =
-               CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]),Queen,Promotion);
-            moves[numMoves++] =
-               CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]),Knight,Promotion);
-            if (ply == 0) {
-               moves[numMoves++] =
-                  CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]),Rook,Promotion);
-               moves[numMoves++] =
-                  CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]),Bishop,Promotion);
-            }
-         }
-         else if (targets.isSet(dest)) {
-            moves[numMoves++] =
-               CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]));
-         }
-      }
-      pawns1 = pawns;
-      pawns1 &= Attacks::rank_mask[6];
-      pawns1.shl8();
-      pawns1 &= ~board.allOccupied;
-      while (pawns1.iterate(dest)) {
-         Square start = dest - 8;
-         moves[numMoves++] =
-            CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]),Queen,Promotion);
-         moves[numMoves++] =
-            CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]),Knight,Promotion);
-         if (ply == 0) {
-            moves[numMoves++] =
-               CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]),Rook,Promotion);
-            moves[numMoves++] =
-               CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]),Bishop,Promotion);
-         }
-      }
-      Square epsq = board.enPassantSq();
-      if (!IsInvalid(epsq) && targets.isSet(epsq)) {
-         ASSERT(TypeOfPiece(board[epsq])==Pawn);
-         if (File(epsq) != 8 && board[epsq + 1] == WhitePawn) {
-            dest = epsq + 8;
-            if (board[dest] == EmptyPiece)
-               moves[numMoves++] =
-                  CreateMove(epsq+1,dest,Pawn,Pawn,Empty,
-                  EnPassant);
-         }
-         if (File(epsq) != 1 && board[epsq - 1] == WhitePawn) {
-            dest = epsq + 8;
-            if (board[dest] == EmptyPiece)
-               moves[numMoves++] =
-                  CreateMove(epsq-1,dest,Pawn,Pawn,Empty,
-                  EnPassant);
-         }
-      }
    }
-   else {
-      Bitboard pawns(board.pawn_bits[Black]);
-      Bitboard pawns1 = pawns;
-      pawns1.shr(7);
-      pawns1 &= ~0x0101010101010101ULL;
-      pawns1 &= board.occupied[White];
-      Square dest;
-      while (pawns1.iterate(dest)) {
-         Square start = dest+7;
-         if (Rank<Black>(start) == 7) {
-            moves[numMoves++] =
-               CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]),Queen,Promotion);
-            moves[numMoves++] =
-               CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]),Knight,Promotion);
-            if (ply == 0) {
-               moves[numMoves++] =
-                  CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]),Rook,Promotion);
-               moves[numMoves++] =
-                  CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]),Bishop,Promotion);
-            }
-         }
-         else if (targets.isSet(dest)) {
+   // non-capturing promotions
+   Bitboard pawns1(pawns & Attacks::rank_mask[side == White ? 6 : 1]);
+   pawnPush<side>(pawns1);
+   pawns1 &= ~board.allOccupied;
+   while (pawns1.iterate(dest)) {
+      numMoves += addPromotions(moves+numMoves,dest-forward,dest,
+                                TypeOfPiece(board[dest]),ply == 0);
+   }
+   const Square epsq = board.enPassantSq();
+   if (!IsInvalid(epsq) && targets.isSet(epsq)) {
+      ASSERT(TypeOfPiece(board[epsq])==Pawn);
+      const Piece myPawn = MakePiece(Pawn,side);
+      dest = epsq + forward;
+      if (File(epsq) != 8 && board[epsq + 1] == myPawn) {
+         if (board[dest] == EmptyPiece)
             moves[numMoves++] =
-               CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]));
-         }
+               CreateMove(epsq+1,dest,Pawn,Pawn,Empty,
+               EnPassant);
       }
-      pawns1 = pawns;
-      pawns1.shr(9);
-      pawns1 &= ~0x8080808080808080ULL;
-      pawns1 &= board.occupied[White];
-      while (pawns1.iterate(dest)) {
-         Square start = dest+9;
-         if (Rank<Black>(start) == 7) {
-            moves[numMoves++] =
-               CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]),Queen,Promotion);
+      if (File(epsq) != 1 && board[epsq - 1] == myPawn) {
+         if (board[dest] == EmptyPiece)
             moves[numMoves++] =
-               CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]),Knight,Promotion);
-            if (ply == 0) {
-               moves[numMoves++] =
-                  CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]),Rook,Promotion);
-               moves[numMoves++] =
-                  CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]),Bishop,Promotion);
-            }
-         }
-         else if (targets.isSet(dest)) {
-            moves[numMoves++] =
-               CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]));
-         }
-      }
-      pawns1 = pawns;
-      pawns1 &= Attacks::rank_mask[1];
-      pawns1.shr8();
-      pawns1 &= ~board.allOccupied;
-      while (pawns1.iterate(dest)) {
-         Square start = dest + 8;
-         moves[numMoves++] =
-            CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]),Queen,Promotion);
-         moves[numMoves++] =
-            CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]),Knight,Promotion);
-         if (ply == 0) {
-            moves[numMoves++] =
-               CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]),Rook,Promotion);
-            moves[numMoves++] =
-               CreateMove(start,dest,Pawn,TypeOfPiece(board[dest]),Bishop,Promotion);
-         }
-      }
-      Square epsq = board.enPassantSq();
-      if (!IsInvalid(epsq) && targets.isSet(epsq)) {
-         ASSERT(TypeOfPiece(board[epsq])==Pawn);
-         if (File(epsq) != 8 && board[epsq + 1] == BlackPawn) {
-            dest = epsq - 8;
-            if (board[dest] == EmptyPiece)
-               moves[numMoves++] =
-                  CreateMove(epsq+1,dest,Pawn,Pawn,Empty,
-                  EnPassant);
-         }
-         if (File(epsq) != 1 && board[epsq - 1] == BlackPawn) {
-            dest = epsq - 8;
-            if (board[dest] == EmptyPiece)
-               moves[numMoves++] =
-                  CreateMove(epsq-1,dest,Pawn,Pawn,Empty,
-                  EnPassant);
-         }
+               CreateMove(epsq-1,dest,Pawn,Pawn,Empty,
+               EnPassant);
       }
    }
-   const ColorType side = board.sideToMove();
    Bitboard knights(board.knight_bits[side]);
-   Square start, dest;
+   Square start;
    while (knights.iterate(start)) {
       Bitboard dests(Attacks::knight_attacks[start] & targets);
       while (dests.iterate(dest)) {
@@ -718,8 +619,7 @@ int MoveGenerator::generateCaptures(Move * moves, const Bitboard &targets)
    }
    Bitboard bishops(board.bishop_bits[side] | board.queen_bits[side]);
    while (bishops.iterate(start)) {
-      Bitboard dests(board.bishopAttacks(start) & targets);
-      Square dest;
+      Bitboard dests((map ? map->diagAttacksFrom(start) : board.bishopAttacks(start)) & targets);
       while (dests.iterate(dest)) {
          moves[numMoves++] =
            CreateMove(start,dest,TypeOfPiece(board[start]),TypeOfPiece(board[dest]));
@@ -727,8 +627,7 @@ int MoveGenerator::generateCaptures(Move * moves, const Bitboard &targets)
    }
    Bitboard rooks(board.rook_bits[side] | board.queen_bits[side]);
    while (rooks.iterate(start)) {
-      Bitboard dests(board.rookAttacks(start) & targets);
-      Square dest;
+      Bitboard dests((map ? map->rankFileAttacksFrom(start) : board.rookAttacks(start)) & targets);
       while (dests.iterate(dest)) {
           moves[numMoves++] =
              CreateMove(start,dest,
@@ -736,7 +635,7 @@ int MoveGenerator::generateCaptures(Move * moves, const Bitboard &targets)
       }
    }
    start = board.kingSquare(side);
-   Bitboard dests(Attacks::king_attacks[start] & targets & ~Attacks::king_attacks[board.kingSquare(board.oppositeSide())]);
+   Bitboard dests(Attacks::king_attacks[start] & targets & ~Attacks::king_attacks[board.kingSquare(oside)]);
    while (dests.iterate(dest)) {
       moves[numMoves++] =
          CreateMove(start,dest,King,TypeOfPiece(board[dest]));
@@ -748,7 +647,7 @@ int MoveGenerator::generateCaptures(Move * moves, const Bitboard &targets)
 MoveGenerator::MoveGenerator( const Board &ABoard,
 SearchContext *s,
 unsigned curr_ply, Move pvMove, Move prvMove,
-int trace)
+int trace, AttackMap *attackMap)
 :
 board(ABoard),
 context(s),
@@ -762,7 +661,9 @@ forced(0),
 phase(START_PHASE),
 hashMove(pvMove),
 prevMove(prvMove),
-master(trace)
+master(trace),
+attacks(attackMap),
+seeBatch(ABoard)
 {
    // Verify hash move before use
    if (!validMove(board,hashMove)) hashMove = NullMove;
@@ -771,16 +672,25 @@ master(trace)
 
 int MoveGenerator::generateEvasions(Move * moves)
 {
-   int n = generateEvasionsCaptures(moves);
-   n += generateEvasionsNonCaptures(moves+n);
+   return board.sideToMove() == White ? generateEvasions<White>(moves) :
+      generateEvasions<Black>(moves);
+}
+
+
+template <ColorType side>
+int MoveGenerator::generateEvasions(Move * moves)
+{
+   int n = generateEvasionsCaptures<side>(moves);
+   n += generateEvasionsNonCaptures<side>(moves+n);
    return n;
 }
 
 
+template <ColorType side>
 int MoveGenerator::generateEvasionsNonCaptures(Move * moves)
 {
    int num_moves = 0;
-   const Square kp = board.kingSquare(board.sideToMove());
+   const Square kp = board.kingSquare(side);
    if (num_attacks == 1) {
       // try to interpose a piece
       if (Sliding(board[source])) {
@@ -788,81 +698,44 @@ int MoveGenerator::generateEvasionsNonCaptures(Move * moves)
          board.between(source,kp,btwn_squares);
          if (!btwn_squares.isClear()) {
             // blocking pawn moves
-            if (board.sideToMove() == White) {
-               Bitboard pawns(board.pawn_bits[White]);
-               pawns.shl8();
-               pawns &= ~board.allOccupied;
-               Bitboard pawns1(pawns);
-               pawns &= btwn_squares;
-               Square sq;
-               while (pawns.iterate(sq)) {
-                  if (!board.isPinned(board.sideToMove(), sq-8, sq)) {
-                     if (Rank<White>(sq) == 8) {
-                        // interposition is a promotion
-                        moves[num_moves++] = CreateMove(
-                           sq-8, sq, Pawn, Empty, Queen, Promotion);
-                        moves[num_moves++] = CreateMove(
-                           sq-8, sq, Pawn, Empty, Rook, Promotion);
-                        moves[num_moves++] = CreateMove(
-                           sq-8, sq, Pawn, Empty, Knight, Promotion);
-                        moves[num_moves++] = CreateMove(
-                           sq-8, sq, Pawn, Empty, Bishop, Promotion);
-                     }
-                     else {
-                        moves[num_moves++] = CreateMove(sq-8, sq, Pawn, Empty);
-                     }
+            const int forward = side == White ? 8 : -8;
+            Bitboard pawns(board.pawn_bits[side]);
+            pawnPush<side>(pawns);
+            pawns &= ~board.allOccupied;
+            Bitboard pawns1(pawns);
+            pawns &= btwn_squares;
+            Square sq;
+            while (pawns.iterate(sq)) {
+               if (!board.isPinned(side, sq-forward, sq)) {
+                  if (Rank<side>(sq) == 8) {
+                     // interposition is a promotion
+                     moves[num_moves++] = CreateMove(
+                        sq-forward, sq, Pawn, Empty, Queen, Promotion);
+                     moves[num_moves++] = CreateMove(
+                        sq-forward, sq, Pawn, Empty, Rook, Promotion);
+                     moves[num_moves++] = CreateMove(
+                        sq-forward, sq, Pawn, Empty, Knight, Promotion);
+                     moves[num_moves++] = CreateMove(
+                        sq-forward, sq, Pawn, Empty, Bishop, Promotion);
                   }
-               }
-               pawns1 &= Attacks::rank_mask[2];
-               if (!pawns1.isClear()) {
-                  pawns1.shl8();
-                  pawns1 &= ~board.allOccupied;
-                  pawns1 &= btwn_squares;
-                  while (pawns1.iterate(sq)) {
-                     if (!board.isPinned(White, sq-16, sq))
-                        moves[num_moves++] = CreateMove(sq-16,sq,Pawn,Empty);
+                  else {
+                     moves[num_moves++] = CreateMove(sq-forward, sq, Pawn, Empty);
                   }
                }
             }
-            else {
-               Bitboard pawns(board.pawn_bits[Black]);
-               pawns.shr8();
-               pawns &= ~board.allOccupied;
-               Bitboard pawns1(pawns);
-               pawns &= btwn_squares;
-               Square sq;
-               while (pawns.iterate(sq)) {
-                  if (!board.isPinned(Black, sq+8, sq)) {
-                     if (Rank<Black>(sq) == 8) {
-                        // interposition is a promotion
-                        moves[num_moves++] = CreateMove(
-                           sq+8, sq, Pawn, Empty, Queen, Promotion);
-                        moves[num_moves++] = CreateMove(
-                           sq+8, sq, Pawn, Empty, Rook, Promotion);
-                        moves[num_moves++] = CreateMove(
-                           sq+8, sq, Pawn, Empty, Knight, Promotion);
-                        moves[num_moves++] = CreateMove(
-                           sq+8, sq, Pawn, Empty, Bishop, Promotion);
-                     }
-                     else {
-                        moves[num_moves++] = CreateMove(sq+8, sq, Pawn, Empty);
-                     }
-                  }
-               }
-               pawns1 &= Attacks::rank_mask[5];
-               if (!pawns1.isClear()) {
-                  pawns1.shr8();
-                  pawns1 &= ~board.allOccupied;
-                  pawns1 &= btwn_squares;
-                  while (pawns1.iterate(sq)) {
-                     if (!board.isPinned(board.sideToMove(), sq+16, sq))
-                        moves[num_moves++] = CreateMove(sq+16,sq,Pawn,Empty);
-                  }
+            pawns1 &= Attacks::rank_mask[side == White ? 2 : 5];
+            if (!pawns1.isClear()) {
+               pawnPush<side>(pawns1);
+               pawns1 &= ~board.allOccupied;
+               pawns1 &= btwn_squares;
+               while (pawns1.iterate(sq)) {
+                  if (!board.isPinned(side, sq-2*forward, sq))
+                     moves[num_moves++] = CreateMove(sq-2*forward,sq,Pawn,Empty);
                }
             }
             // other blocking pieces
-            Bitboard pieces(board.occupied[board.sideToMove()]);
-            pieces &= ~board.pawn_bits[board.sideToMove()];
+            Bitboard pieces(board.occupied[side]);
+            pieces &= ~board.pawn_bits[side];
             Square loc;
             while (pieces.iterate(loc)) {
                switch (TypeOfPiece(board[loc])) {
@@ -874,7 +747,7 @@ int MoveGenerator::generateEvasionsNonCaptures(Move * moves)
                     Bitboard dests(Attacks::knight_attacks[loc] & btwn_squares);
                      Square sq;
                      while (dests.iterate(sq)) {
-                        if (!board.isPinned(board.sideToMove(), loc, sq))
+                        if (!board.isPinned(side, loc, sq))
                            moves[num_moves++] =
                               CreateMove(loc,sq,Knight,TypeOfPiece(board[sq]));
                      }
@@ -886,7 +759,7 @@ int MoveGenerator::generateEvasionsNonCaptures(Move * moves)
                      Bitboard dests(board.bishopAttacks(loc) & btwn_squares);
                      while (dests.iterate(dest)) {
                         if (board.clear(loc,dest) &&
-                           !board.isPinned(board.sideToMove(), loc, dest))
+                           !board.isPinned(side, loc, dest))
                            moves[num_moves++] =
                               CreateMove(loc,dest,Bishop,TypeOfPiece(board[dest]));
                      }
@@ -897,7 +770,7 @@ int MoveGenerator::generateEvasionsNonCaptures(Move * moves)
                      Square dest;
                      Bitboard dests(board.rookAttacks(loc) & btwn_squares);
                      while (dests.iterate(dest)) {
-                        if (board.clear(loc,dest) && !board.isPinned(board.sideToMove(), loc, dest)) {
+                        if (board.clear(loc,dest) && !board.isPinned(side, loc, dest)) {
                            moves[num_moves++] =
                               CreateMove(loc,dest,Rook,TypeOfPiece(board[dest]));
                         }
@@ -911,7 +784,7 @@ int MoveGenerator::generateEvasionsNonCaptures(Move * moves)
                      dests &= btwn_squares;
                      while (dests.iterate(dest)) {
                         if (board.clear(loc,dest) &&
-                           !board.isPinned(board.sideToMove(), loc, dest))
+                           !board.isPinned(side, loc, dest))
                            moves[num_moves++] =
                               CreateMove(loc,dest,Queen,TypeOfPiece(board[dest]));
                      }
@@ -925,16 +798,19 @@ int MoveGenerator::generateEvasionsNonCaptures(Move * moves)
       }
    }
    // generate evasive moves that do not capture
-   num_moves += generateEvasions(moves+num_moves,~board.allOccupied);
+   num_moves += generateEvasions<side>(moves+num_moves,~board.allOccupied);
    return num_moves;
 }
 
 
+template <ColorType side>
 int MoveGenerator::generateEvasionsCaptures(Move * moves)
 {
+   const ColorType oside = OppositeColor(side);
    int num_moves = 0;
-   const Square kp = board.kingSquare(board.sideToMove());
-   king_attacks = board.calcAttacks(kp, board.oppositeSide());
+   const Square kp = board.kingSquare(side);
+   const AttackMap *map = validAttacks();
+   king_attacks = map ? map->checkers() : board.calcAttacks(kp, oside);
    if (king_attacks.isClear()) {
       cout << board << endl;
       ASSERT(0);
@@ -945,7 +821,7 @@ int MoveGenerator::generateEvasionsCaptures(Move * moves)
       source = (Square)king_attacks.firstOne();
 
       ASSERT(source != InvalidSquare);
-      Bitboard atcks(board.calcAttacks(source,board.sideToMove()));
+      Bitboard atcks(board.calcAttacks(source,side));
       Square sq;
       const PieceType sourcePiece = TypeOfPiece(board[source]);
       while (atcks.iterate(sq)) {
@@ -955,15 +831,16 @@ int MoveGenerator::generateEvasionsCaptures(Move * moves)
             // checking us is undefended.  But always allow a
             // capture *of* the king - for illegal move detection.
             if (TypeOfPiece(board[source]) == King ||
-            !board.anyAttacks(source, board.oppositeSide())) {
+            !(map ? map->attacked(source, oside) :
+              board.anyAttacks(source, oside))) {
                moves[num_moves++] = CreateMove(sq, source,
                   King, sourcePiece);
             }
          }
          else {
-            if (!board.isPinned(board.sideToMove(), sq, source)) {
+            if (!board.isPinned(side, sq, source)) {
                if (capturingPiece == Pawn &&
-                   Rank(source,board.sideToMove()) == 8) {
+                   Rank<side>(source) == 8) {
                   moves[num_moves++] = CreateMove(
                      sq, source, Pawn, sourcePiece, Queen, Promotion);
                   moves[num_moves++] = CreateMove(
@@ -982,13 +859,13 @@ int MoveGenerator::generateEvasionsCaptures(Move * moves)
       // Attacks::calcAttacks does not return en passant captures, so try
       // this as a special case
       if (board.enPassantSq() == source) {
-         Square dest = source + 8 * Direction[board.sideToMove()];
-         Piece myPawn = MakePiece(Pawn,board.sideToMove());
+         Square dest = source + (side == White ? 8 : -8);
+         Piece myPawn = MakePiece(Pawn,side);
          if (File(source) != 8 && board[source + 1] == myPawn) {
             Piece tmp = board[source];
             Piece &place = (Piece &)board[source];
             place = EmptyPiece;                   // imagine me gone
-            if (!board.isPinned(board.sideToMove(), source + 1, dest))
+            if (!board.isPinned(side, source + 1, dest))
                moves[num_moves++] = CreateMove(source + 1, dest, Pawn,
                   Pawn, Empty, EnPassant);
             place = tmp;
@@ -997,7 +874,7 @@ int MoveGenerator::generateEvasionsCaptures(Move * moves)
             Piece tmp = board[source];
             Piece &place = (Piece &)board[source];
             place = EmptyPiece;                   // imagine me gone
-            if (!board.isPinned(board.sideToMove(), source - 1, dest))
+            if (!board.isPinned(side, source - 1, dest))
                moves[num_moves++] = CreateMove(source - 1, dest, Pawn, Pawn,
                   Empty, EnPassant);
             place = tmp;
@@ -1005,21 +882,23 @@ int MoveGenerator::generateEvasionsCaptures(Move * moves)
       }
    }
    // try evasions that capture pieces beside the attacker
-   num_moves += generateEvasions(moves+num_moves,
-      board.occupied[board.oppositeSide()]);
+   num_moves += generateEvasions<side>(moves+num_moves,
+      board.occupied[oside]);
 
    return num_moves;
 }
 
 
+template <ColorType side>
 int MoveGenerator::generateEvasions(Move * moves,
 const Bitboard &mask)
 {
+   const ColorType oside = OppositeColor(side);
    int num_moves = 0;
-   Square kp = board.kingSquare(board.sideToMove());
+   Square kp = board.kingSquare(side);
    Bitboard b(Attacks::king_attacks[kp]);
-   b &= ~board.allPawnAttacks(board.oppositeSide());
-   b &= ~Attacks::king_attacks[board.kingSquare(board.oppositeSide())];
+   b &= ~board.allPawnAttacks(oside);
+   b &= ~Attacks::king_attacks[board.kingSquare(oside)];
    b &= mask;
    Square sq;
    while (b.iterate(sq)) {
@@ -1043,7 +922,7 @@ const Bitboard &mask)
                }
             }
          }
-         if (!illegal && !board.anyAttacks(sq, board.oppositeSide())) {
+         if (!illegal && !board.anyAttacks(sq, oside)) {
             moves[num_moves++] = CreateMove(kp, sq, King, TypeOfPiece(board[sq]));
          }
       }
@@ -1052,12 +931,23 @@ const Bitboard &mask)
 }
 
 
+int MoveGenerator::generateChecks(Move * moves, const Bitboard &discoveredCheckCandidates) {
+   return board.sideToMove() == White ?
+      generateChecks<White>(moves,discoveredCheckCandidates) :
+      generateChecks<Black>(moves,discoveredCheckCandidates);
+}
+
+
+template <ColorType side>
 int MoveGenerator::generateChecks(Move * moves, const Bitboard &discoveredCheckCandidates) {
    // Note: doesn't at present generate castling moves that check
    ASSERT(board.checkStatus() == NotInCheck);
-   const Square kp = board.kingSquare(board.oppositeSide());
+   const Square kp = board.kingSquare(OppositeColor(side));
+   const int forward = side == White ? 8 : -8;
    Square loc;
    int numMoves = 0;
+   const AttackMap *map = validAttacks();
+   const CheckInfo *check = attacks ? &attacks->checkInfo(board) : nullptr;
 
    // Discovered checks first.
    Bitboard disc(discoveredCheckCandidates);
@@ -1068,11 +958,10 @@ int MoveGenerator::generateChecks(Move * moves, const Bitboard &discoveredCheckC
             ASSERT(dir);
             if (std::abs(dir) != 8) {
                // Pawn does not move in direction of pin
-               const int step = (board.sideToMove() == White) ? 8 : -8;
-               if (board[loc+step] == EmptyPiece && Rank(loc,board.sideToMove()) < 7) {
-                  moves[numMoves++] = CreateMove(loc,loc+step,Pawn);
-                  if (Rank(loc,board.sideToMove()) == 2 && board[loc+2*step] == EmptyPiece) {
-                     moves[numMoves++] = CreateMove(loc,loc+2*step,Pawn);
+               if (board[loc+forward] == EmptyPiece && Rank<side>(loc) < 7) {
+                  moves[numMoves++] = CreateMove(loc,loc+forward,Pawn);
+                  if (Rank<side>(loc) == 2 && board[loc+2*forward] == EmptyPiece) {
+                     moves[numMoves++] = CreateMove(loc,loc+2*forward,Pawn);
                   }
                }
             }
@@ -1117,8 +1006,8 @@ int MoveGenerator::generateChecks(Move * moves, const Bitboard &discoveredCheckC
    }
 
    // Now non-discovered checks
-   Bitboard pieces(board.occupied[board.sideToMove()]);
-   pieces &= ~board.pawn_bits[board.sideToMove()];
+   Bitboard pieces(board.occupied[side]);
+   pieces &= ~board.pawn_bits[side];
    while (pieces.iterate(loc) && !discoveredCheckCandidates.isSet(loc)) {
       switch(TypeOfPiece(board[loc])) {
          case Knight:
@@ -1137,8 +1026,8 @@ int MoveGenerator::generateChecks(Move * moves, const Bitboard &discoveredCheckC
             break;
          case Bishop:
          {
-            Bitboard dests(board.bishopAttacks(loc) & ~board.allOccupied);
-            Bitboard dests2(board.bishopAttacks(kp) & ~board.allOccupied);
+            Bitboard dests((map ? map->attacksFrom(loc) : board.bishopAttacks(loc)) & ~board.allOccupied);
+            Bitboard dests2((check ? check->checkSquares(Bishop) : board.bishopAttacks(kp)) & ~board.allOccupied);
             dests &= dests2;
             Square dest;
             while (dests.iterate(dest)) {
@@ -1149,8 +1038,8 @@ int MoveGenerator::generateChecks(Move * moves, const Bitboard &discoveredCheckC
          }
          case Rook:
          {
-            Bitboard dests(board.rookAttacks(loc) & ~board.allOccupied);
-            Bitboard dests2(board.rookAttacks(kp) & ~board.allOccupied);
+            Bitboard dests((map ? map->attacksFrom(loc) : board.rookAttacks(loc)) & ~board.allOccupied);
+            Bitboard dests2((check ? check->checkSquares(Rook) : board.rookAttacks(kp)) & ~board.allOccupied);
             dests &= dests2;
             Square dest;
             while (dests.iterate(dest)) {
@@ -1161,11 +1050,15 @@ int MoveGenerator::generateChecks(Move * moves, const Bitboard &discoveredCheckC
          }
          case Queen:
          {
-            Bitboard dests(board.rookAttacks(loc) | board.bishopAttacks(loc));
+            Bitboard dests(map ? map->attacksFrom(loc) : board.rookAttacks(loc) | board.bishopAttacks(loc));
             dests &= ~board.allOccupied;
-            Bitboard dests2(board.bishopAttacks(kp) & ~board.allOccupied);
-            Bitboard dests3(board.rookAttacks(kp) & ~board.allOccupied);
-            dests &= (dests2 | dests3);
+            if (check) {
+               dests &= check->checkSquares(Queen);
+            } else {
+               Bitboard dests2(board.bishopAttacks(kp) & ~board.allOccupied);
+               Bitboard dests3(board.rookAttacks(kp) & ~board.allOccupied);
+               dests &= (dests2 | dests3);
+            }
             Square dest;
             while (dests.iterate(dest)) {
                   moves[numMoves++] =
@@ -1178,39 +1071,20 @@ int MoveGenerator::generateChecks(Move * moves, const Bitboard &discoveredCheckC
       }
    }
    // pawn moves
-   if (board.sideToMove() == White) {
-      Square sq;
-      Bitboard pawns(board.pawn_bits[White]);
-      pawns.shl8();
-      pawns &= ~(board.allOccupied | Attacks::rank_mask[7]);
-      Bitboard pawns1(pawns & Attacks::pawn_attacks[kp][White]);
-      while (pawns1.iterate(sq)) {
-         moves[numMoves++] = CreateMove(sq-8,sq,Pawn);
-      }
-      pawns &= Attacks::rank_mask[2];
-      pawns.shl8();
-      pawns &= ~board.allOccupied;
-      pawns &= Attacks::pawn_attacks[kp][White];
-      while (pawns.iterate(sq)) {
-         moves[numMoves++] = CreateMove(sq-16,sq,Pawn);
-      }
+   Square sq;
+   Bitboard pawns(board.pawn_bits[side]);
+   pawnPush<side>(pawns);
+   pawns &= ~(board.allOccupied | Attacks::rank_mask[side == White ? 7 : 0]);
+   Bitboard pawns1(pawns & Attacks::pawn_attacks[kp][side]);
+   while (pawns1.iterate(sq)) {
+      moves[numMoves++] = CreateMove(sq-forward,sq,Pawn);
    }
-   else {
-      Square sq;
-      Bitboard pawns(board.pawn_bits[Black]);
-      pawns.shr8();
-      pawns &= ~(board.allOccupied | Attacks::rank_mask[0]);
-      Bitboard pawns1(pawns & Attacks::pawn_attacks[kp][Black]);
-      while (pawns1.iterate(sq)) {
-         moves[numMoves++] = CreateMove(sq+8,sq,Pawn);
-      }
-      pawns &= Attacks::rank_mask[2];
-      pawns.shl8();
-      pawns &= ~board.allOccupied;
-      pawns &= Attacks::pawn_attacks[kp][Black];
-      while (pawns.iterate(sq)) {
-         moves[numMoves++] = CreateMove(sq+16,sq,Pawn);
-      }
+   pawns &= Attacks::rank_mask[side == White ? 2 : 5];
+   pawnPush<side>(pawns);
+   pawns &= ~board.allOccupied;
+   pawns &= Attacks::pawn_attacks[kp][side];
+   while (pawns.iterate(sq)) {
+      moves[numMoves++] = CreateMove(sq-2*forward,sq,Pawn);
    }
    return numMoves;
 }
@@ -1308,6 +1182,18 @@ Move MoveGenerator::nextEvasion(SplitPoint *s,int &ord)
       return nextEvasion(ord);
 }
 
+Move RootMoveGenerator::nextMove(SplitPoint *s,int &order)
+{
+   if (s) {
+      s->lock();
+      Move m = nextMove(order);
+      s->unlock();
+      return m;
+   }
+   else
+      return nextMove(order);
+}
+
 uint64_t RootMoveGenerator::perft(Board &b, int depth) {
    if (depth == 0) return 1;
 
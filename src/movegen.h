@@ -7,6 +7,7 @@
 #include "constant.h"
 #include "params.h"
 #include "see.h"
+#include "attackmap.h"
 #include <set>
 #include <vector>
 using namespace std;
@@ -31,11 +32,17 @@ class MoveGenerator
          unsigned ply = 0,
          Move pvMove = NullMove,
          Move prevMove = NullMove,                     
-         int trace = 0);
+         int trace = 0,
+         AttackMap *attacks = nullptr);
 
       // Generate the next move, in sorted order, NullMove if none left
       // "ord" is updated with the index of the move.
-      virtual Move nextMove(int &ord) {
+      //
+      // Note: nextMove, nextEvasion and generateAllMoves are not
+      // virtual. RootMoveGenerator hides them with its own versions,
+      // so callers that may have either kind of generator (at a
+      // split point) must dispatch on the ply.
+      Move nextMove(int &ord) {
          if (index >= batch_count) {
             if ((batch_count = getBatch(batch,index)) == 0)
                return NullMove;
@@ -50,7 +57,7 @@ class MoveGenerator
                      continue;
                  }
                  if (Params::Gain(move)-Params::PieceValue(Capture(move))<=0) {
-                    if (seeSign(board,move,0)) {
+                    if (seeBatch.seeSign(move,0,validAttacks())) {
                          SetPhase(move,WINNING_CAPTURE_PHASE);
                          ord = order++;
                          ASSERT(ord<Constants::MaxMoves);
@@ -74,16 +81,23 @@ class MoveGenerator
          return batch[index++];
       }
 
-      virtual ~MoveGenerator() {
+      ~MoveGenerator() {
       }
 
       // Generate the next check evasion, NullMove if none left
-      virtual Move nextEvasion(int &order);
+      Move nextEvasion(int &order);
+
+      // SEE test for a move from this generator's position. Attackers
+      // and results are shared with the capture ordering done in
+      // nextMove.
+      score_t seeSign(Move move, score_t threshold) {
+         return seeBatch.seeSign(move,threshold,validAttacks());
+      }
 
-      virtual Move nextMove(SplitPoint *,int &order);
-      virtual Move nextEvasion(SplitPoint *, int &order);
+      Move nextMove(SplitPoint *,int &order);
+      Move nextEvasion(SplitPoint *, int &order);
 
-      virtual int generateAllMoves(NodeInfo *, SplitPoint *);
+      int generateAllMoves(NodeInfo *, SplitPoint *);
 
       // Generate only non-capturing moves.
       int generateNonCaptures(Move *moves);
@@ -154,11 +168,36 @@ class MoveGenerator
 
       int getBatch(Move *&batch,int &index);
 
+      // Move generation for each side to move. The functions above
+      // without a template parameter call these.
+      template <ColorType side>
+      int generateNonCaptures(Move *moves);
+
+      template <ColorType side>
+      int generateCaptures(Move *moves, const Bitboard &targets);
+
+      template <ColorType side>
+      int generateEvasions(Move *moves);
+
+      template <ColorType side>
+      int generateChecks(Move *moves, const Bitboard &discoveredCheckCandidates);
+
+      template <ColorType side>
       int generateEvasionsCaptures(Move * moves);
+
+      template <ColorType side>
       int generateEvasionsNonCaptures(Move * moves);
+
+      template <ColorType side>
       int generateEvasions(Move * moves,
          const Bitboard &mask);
 
+      // Return the attack map if one was supplied and it is
+      // current for the board, otherwise nullptr.
+      const AttackMap *validAttacks() const {
+         return (attacks && attacks->isValid(board)) ? attacks : nullptr;
+      }
+
       const Board &board;
       SearchContext *context;
       int ply;
@@ -175,6 +214,8 @@ class MoveGenerator
       Move moves[Constants::MaxMoves];
       Move killer1,killer2;
       int master;
+      AttackMap *attacks;
+      SeeBatch seeBatch;
 
       inline void setMove( Square source, Square dest,
          PieceType promotion,
@@ -194,7 +235,7 @@ class RootMoveGenerator : public MoveGenerator
          int trace = 0);
 
       // Generate the next move, in sorted order, NullMove if none left
-      virtual Move nextMove(int &ord) {
+      Move nextMove(int &ord) {
          ASSERT(index<=batch_count);
          if (index < batch_count) {
             ord = order++;
@@ -207,13 +248,17 @@ class RootMoveGenerator : public MoveGenerator
       }
 
       // Generate the next check evasion, NullMove if none left
-      virtual Move nextEvasion(int &order) {
+      Move nextEvasion(int &order) {
          return nextMove(order);
       }
 
-      using MoveGenerator::nextMove;
-      using MoveGenerator::nextEvasion;
-      virtual int generateAllMoves(NodeInfo *, SplitPoint *);
+      Move nextMove(SplitPoint *,int &order);
+
+      Move nextEvasion(SplitPoint *s, int &order) {
+         return nextMove(s,order);
+      }
+
+      int generateAllMoves(NodeInfo *, SplitPoint *);
 
       void reorder(Move pvMove, int depth, bool initial = false);
 
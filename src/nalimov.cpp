@@ -8,6 +8,7 @@
 #include "constant.h"
 #include "globals.h"
 #include "debug.h"
+#include <mutex>
 extern "C" {
 #ifndef _MAC
 #include <malloc.h>
@@ -17,7 +18,14 @@ extern "C" {
 
 #include "egtb.cpp"
 
+// The Nalimov code keeps one cache of decompressed blocks for all
+// callers, and does not lock it. Probes from different search
+// threads are therefore serialized.
+static LockDefine(probeLock);
+static std::once_flag probeLockInit;
+
 int NalimovTb::initTB(char *tbpath,uint64 tb_cache_size) {
+    std::call_once(probeLockInit,[]() { LockInit(probeLock); });
     TB_CRC_CHECK = 0;
     int EGTBMenCount = IInitializeTb(tbpath);
     if(EGTBMenCount != 0) {
@@ -96,7 +104,9 @@ int NalimovTb::probe_tb(const Board &board, int &score, int ply) {
     Square epsq = board.enPassantSq();
     ep  = (epsq == InvalidSquare) ? XX : MakeSquare(File(epsq),6,board.sideToMove());
     index = PfnIndCalcFun(iTB, color) (wp, bp, ep, invert);
+    Lock(probeLock);
     value = L_TbtProbeTable(iTB, color, index);
+    Unlock(probeLock);
     if(value == bev_broken) {
         // illegal position
         cout << "tb probe: illegal position" << endl;
@@ -9,7 +9,8 @@ struct NalimovTb {
     static int initTB(char *,uint64_t cache_size);
 
     // probe the tablebases. Return 1 if score was obtained,
-    // 0 if not.
+    // 0 if not. May be called from multiple threads, but probes
+    // are serialized.
     static int probe_tb(const Board &b, int &score, int ply);
 };
 
@@ -9,6 +9,7 @@
 #include <iterator>
 
 #include "constant.h"
+#include "threadc.h"
 
 #include <cmath>
 
@@ -81,6 +82,7 @@ string Options::tbPath(Options::TbType type) const
 Options::SearchOptions::SearchOptions() :
       checks_in_qsearch(1),
       hash_table_size(32*1024*1024),
+      memory_budget(0),
       can_resign(1),
       resign_threshold(-500),
 #if defined(NALIMOV_TBS) || defined(GAVIOTA_TBS) || defined(SYZYGY_TBS)
@@ -101,10 +103,14 @@ Options::SearchOptions::SearchOptions() :
       syzygy_path("syzygy"),
       syzygy_50_move_rule(1),
       syzygy_probe_depth(4),
+      syzygy_lock_tables(0),
 #endif
+      use_bitbases(0),
       strength(100),
       multipv(1),
       ncpus(1),
+      thread_spin_count(ThreadControl::DEFAULT_SPIN_COUNT),
+      search_stats(0),
       easy_plies(3),
       easy_threshold(200)
 #ifdef NUMA
@@ -218,6 +224,15 @@ void Options::set_option(const string &name, const string &value) {
   else if (name == "search.hash_table_size") {
     setMemoryOption(search.hash_table_size,value);
   }
+  else if (name == "search.memory_budget") {
+    setMemoryOption(search.memory_budget,value);
+  }
+  else if (name == "search.hash_file") {
+    search.hash_file = value;
+  }
+  else if (name == "search.hash_shared_name") {
+    search.hash_shared_name = value;
+  }
 #if defined(GAVIOTA_TBS) || defined(NALIMOV_TBS) || defined(SYZYGY_TBS)
   else if (name == "search.use_tablebases") {
     set_boolean_option(name,value,search.use_tablebases);
@@ -260,13 +275,31 @@ void Options::set_option(const string &name, const string &value) {
   else if (name == "search.syzygy_probe_depth") {
     setOption<int>(name,value,search.syzygy_probe_depth);
   }
+  else if (name == "search.syzygy_lock_tables") {
+    set_boolean_option(name,value,search.syzygy_lock_tables);
+  }
 #endif
+  else if (name == "search.use_bitbases") {
+    set_boolean_option(name,value,search.use_bitbases);
+  }
+  else if (name == "search.bitbase_path") {
+    search.bitbase_path = value;
+  }
   else if (name == "search.strength") {
     set_strength_option(name,search.strength,value);
   }
   else if (name == "search.ncpus") {
     setOption<int>(name,value,search.ncpus);
   }
+  else if (name == "search.thread_spin_count") {
+    setOption<int>(name,value,search.thread_spin_count);
+  }
+  else if (name == "search.search_stats") {
+    set_boolean_option(name,value,search.search_stats);
+  }
+  else if (name == "search.search_stats_file") {
+    search.search_stats_file = value;
+  }
 #ifdef NUMA
   else if (name == "search.set_processor_affinity") {
     set_boolean_option(name,value,search.set_processor_affinity);
@@ -35,6 +35,11 @@ class Options
 
    int checks_in_qsearch;
    size_t hash_table_size;
+   // If nonzero, total memory for the hash table and other tables
+   // (overrides hash_table_size)
+   size_t memory_budget;
+   string hash_file; // if set, hash table is kept in this file
+   string hash_shared_name; // if set, name of shared memory hash table
    int can_resign;
    int resign_threshold;
 #if defined(NALIMOV_TBS) || defined(GAVIOTA_TBS) || defined(SYZYGY_TBS)
@@ -55,10 +60,16 @@ class Options
    string syzygy_path;
    int syzygy_50_move_rule;
    int syzygy_probe_depth;
+   int syzygy_lock_tables;
 #endif
+   int use_bitbases; // generate endgame bitbases at startup
+   string bitbase_path; // if set, directory to cache bitbases in
    int strength; // 0 .. 100
    int multipv; // for UCI only
    int ncpus;
+   int thread_spin_count; // spin iterations before an idle thread blocks
+   int search_stats; // collect and output detailed search statistics
+   string search_stats_file; // if set, statistics are appended to this file
    int easy_plies; // do wide search for "easy move" detection
    int easy_threshold; // wide search width in centipawns
 #ifdef NUMA
@@ -0,0 +1,105 @@
+// Copyright 2017 by Jon Dart. All Rights Reserved.
+
+#include "output.h"
+#include <algorithm>
+#include <vector>
+
+OutputQueue outputQueue(cout);
+
+OutputQueue::OutputQueue(ostream &o)
+   : out(o), head(nullptr), added(0), written(0), running(false)
+{
+}
+
+OutputQueue::~OutputQueue()
+{
+   stop();
+}
+
+void OutputQueue::start()
+{
+   if (!running) {
+      running = true;
+      writer = std::thread(&OutputQueue::writeLoop,this);
+   }
+}
+
+void OutputQueue::stop()
+{
+   {
+      std::lock_guard<std::mutex> l(lock);
+      if (!running) return;
+      running = false;
+   }
+   ready.notify_one();
+   writer.join();
+}
+
+void OutputQueue::write(const string &text, Kind kind)
+{
+   if (!running) {
+      out << text << endl;
+      return;
+   }
+   Line *line = new Line(text,kind);
+   Line *prev = head.load();
+   do {
+      line->next = prev;
+   } while (!head.compare_exchange_weak(prev,line));
+   ++added;
+   if (prev == nullptr) {
+      // The writer may be waiting. Taking the lock ensures it is
+      // either waiting or has not yet checked the queue, so the
+      // wakeup is not lost.
+      { std::lock_guard<std::mutex> l(lock); }
+      ready.notify_one();
+   }
+}
+
+void OutputQueue::flush()
+{
+   if (!running) {
+      out.flush();
+      return;
+   }
+   const uint64_t target = added;
+   std::unique_lock<std::mutex> l(lock);
+   done.wait(l,[this,target] { return written >= target; });
+}
+
+void OutputQueue::writeLoop()
+{
+   vector<Line *> batch;
+   for (;;) {
+      {
+         std::unique_lock<std::mutex> l(lock);
+         ready.wait(l,[this] { return head.load() != nullptr || !running; });
+         if (!running && head.load() == nullptr) break;
+      }
+      Line *line = head.exchange(nullptr);
+      // the list is newest first: collect it in output order
+      batch.clear();
+      for (; line; line = line->next) {
+         batch.push_back(line);
+      }
+      std::reverse(batch.begin(),batch.end());
+      // find the last line of each kind, so earlier ones can be dropped
+      size_t last[3] = {0, 0, 0};
+      for (size_t i = 0; i < batch.size(); i++) {
+         last[batch[i]->kind] = i;
+      }
+      for (size_t i = 0; i < batch.size(); i++) {
+         const Line *line = batch[i];
+         if (line->kind == Normal || last[line->kind] == i) {
+            out << line->text << '\n';
+         }
+         delete line;
+      }
+      out.flush();
+      {
+         std::lock_guard<std::mutex> l(lock);
+         written += batch.size();
+      }
+      done.notify_all();
+   }
+}
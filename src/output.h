@@ -0,0 +1,77 @@
+// Copyright 2017 by Jon Dart. All Rights Reserved.
+
+#ifndef _OUTPUT_H
+#define _OUTPUT_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+using namespace std;
+
+// Queue for engine output to the GUI. Lines are formatted by the
+// caller and written to the console by a separate thread, so that a
+// search thread never blocks when the GUI is slow to read its output.
+// Adding a line is lock-free, except for a brief lock to wake the
+// writer when the queue was empty.
+//
+// Until start() is called, lines are written directly by the caller.
+class OutputQueue
+{
+ public:
+
+   // Kinds of output. A Normal line is always written. A line of the
+   // other kinds is dropped if it is superseded by a later line of the
+   // same kind before the writer gets to it.
+   enum Kind { Normal, CurrMove, Status };
+
+   OutputQueue(ostream &out);
+
+   ~OutputQueue();
+
+   // start the writer thread
+   void start();
+
+   // write any queued output and end the writer thread
+   void stop();
+
+   // queue a line for output (no trailing newline)
+   void write(const string &line, Kind kind = Normal);
+
+   // Wait until all lines queued so far have been written and
+   // flushed. Call this before writing directly to the console
+   // output, when ordering matters (e.g. before "bestmove").
+   void flush();
+
+ private:
+
+   struct Line {
+      Line(const string &s, Kind k)
+         : text(s), kind(k), next(nullptr) {
+      }
+      string text;
+      Kind kind;
+      Line *next;
+   };
+
+   void writeLoop();
+
+   ostream &out;
+   // most recently added line: lines are linked newest to oldest
+   atomic<Line *> head;
+   // count of lines added, and count written (or dropped)
+   atomic<uint64_t> added;
+   uint64_t written;
+   // read without the lock by write() and flush()
+   atomic<bool> running;
+   std::thread writer;
+   std::mutex lock;
+   std::condition_variable ready, done;
+};
+
+extern OutputQueue outputQueue;
+
+#endif
@@ -0,0 +1,863 @@
+// Copyright 2017 by Jon Dart. All Rights Reserved.
+
+#include "rbitbase.h"
+#include "attacks.h"
+#include "memusage.h"
+#include "threadc.h"
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Tables in the order they are built. Each table only converts (by
+// captures and promotions) to tables earlier in the list, which are
+// probed while it is generated.
+static const char * const TABLE_NAMES[] = {
+   "KQK", "KRK", "KBK", "KNK", "KPK",
+   "KQKP", "KRKP", "KRKB", "KRKN", "KBNK", "KPKP"
+};
+
+static const int TABLE_COUNT = 11;
+
+static const int MAX_MEN = 4;
+
+static const uint32_t FILE_MAGIC = 0x42425241; // "ARBB"
+static const uint32_t FILE_VERSION = 1;
+
+// Values in the work array used during generation. A stored value
+// is the same code, with UNRESOLVED positions becoming draws.
+enum {UNRESOLVED, WIN, LOSS, UNKNOWN};
+
+// Values of moves are given from the perspective of the side to move
+// after the move, using the codes above plus DRAW for conversions to
+// known draws.
+static const int DRAW = 4;
+
+
+// Position flags used during generation: a move converts to an
+// unknown result, or a double pawn push allows an en passant capture
+// (so the value of that move is not just the value of the position
+// after it).
+static const uint8_t UNKNOWN_MOVE = 1;
+static const uint8_t EP_MOVE = 2;
+
+// A position: kings are always in slots 0 (White) and 1 (Black), the
+// other pieces follow in table order.
+struct Pos {
+   int men;
+   ColorType color[MAX_MEN];
+   PieceType type[MAX_MEN];
+   Square sq[MAX_MEN];
+   ColorType stm;
+};
+
+struct Table {
+   string name;
+   int men;
+   ColorType color[MAX_MEN];
+   PieceType type[MAX_MEN];
+   int range[MAX_MEN];
+   bool pawns;
+   // material signature, and the signature with colors reversed
+   uint32_t key, swappedKey;
+   // positions per side to move
+   size_t size;
+   // 2 bits per position and side to move
+   vector<uint8_t> data;
+   std::atomic<bool> ready;
+
+   size_t index(const Square *sq) const;
+
+   void decode(size_t index, Square *sq) const;
+
+   int get(size_t entry) const {
+      return (data[entry >> 2] >> ((entry & 3) << 1)) & 3;
+   }
+};
+
+static Table tables[TABLE_COUNT];
+
+static std::once_flag setupFlag;
+
+static std::thread genThread;
+
+static std::atomic<bool> stopping(false);
+static std::atomic<bool> generating(false);
+
+// Squares for the white king in pawnless tables: a1-d1-d4
+static int kingTriIndex[64];
+static Square kingTriSquare[10];
+// Symmetries that map a square into the a1-d1-d4 triangle (2 for
+// squares on a diagonal, else 1).
+static int kingXforms[64][2];
+static int kingXformCount[64];
+
+// Apply one of the 8 board symmetries (bit 2: reflect in the a1-h8
+// diagonal, bit 0: mirror files, bit 1: mirror ranks).
+static inline Square xform(Square sq, int t) {
+   if (t & 4) sq = ((sq & 7) << 3) | (sq >> 3);
+   if (t & 1) sq ^= 7;
+   if (t & 2) sq ^= 56;
+   return sq;
+}
+
+static uint32_t materialKey(ColorType color, PieceType type) {
+   return 1U << (3*(6*color + type - 1));
+}
+
+size_t Table::index(const Square *sq) const {
+   size_t best = 0;
+   if (pawns) {
+      // mirror the board so the white king is on the a-d files
+      const int t = (sq[0] & 7) >= 4;
+      const Square k = xform(sq[0],t);
+      best = (k >> 3)*4 + (k & 7);
+      for (int i = 1; i < men; i++) {
+         const Square s = xform(sq[i],t);
+         best = best*range[i] + (type[i] == Pawn ? s - 8 : s);
+      }
+   }
+   else {
+      for (int n = 0; n < kingXformCount[sq[0]]; n++) {
+         const int t = kingXforms[sq[0]][n];
+         size_t idx = kingTriIndex[xform(sq[0],t)];
+         for (int i = 1; i < men; i++) {
+            idx = idx*range[i] + xform(sq[i],t);
+         }
+         if (n == 0 || idx < best) best = idx;
+      }
+   }
+   return best;
+}
+
+void Table::decode(size_t idx, Square *sq) const {
+   for (int i = men-1; i > 0; i--) {
+      const int s = (int)(idx % range[i]);
+      idx /= range[i];
+      sq[i] = type[i] == Pawn ? s + 8 : s;
+   }
+   if (pawns) {
+      sq[0] = (Square)((idx/4)*8 + idx%4);
+   } else {
+      sq[0] = kingTriSquare[idx];
+   }
+}
+
+static void setup() {
+   int n = 0;
+   for (Square sq = 0; sq < 64; sq++) {
+      const int file = sq & 7, rank = sq >> 3;
+      kingTriIndex[sq] = -1;
+      if (file <= 3 && rank <= file) {
+         kingTriSquare[n] = sq;
+         kingTriIndex[sq] = n++;
+      }
+   }
+   for (Square sq = 0; sq < 64; sq++) {
+      kingXformCount[sq] = 0;
+      for (int t = 0; t < 8; t++) {
+         if (kingTriIndex[xform(sq,t)] != -1) {
+            kingXforms[sq][kingXformCount[sq]++] = t;
+         }
+      }
+   }
+   for (int i = 0; i < TABLE_COUNT; i++) {
+      Table &t = tables[i];
+      t.name = TABLE_NAMES[i];
+      t.men = 2;
+      t.color[0] = White; t.type[0] = King;
+      t.color[1] = Black; t.type[1] = King;
+      t.key = t.swappedKey = 0;
+      t.pawns = false;
+      ColorType side = White;
+      for (size_t j = 1; j < t.name.size(); j++) {
+         PieceType type = Empty;
+         switch (t.name[j]) {
+         case 'K': side = Black; continue;
+         case 'Q': type = Queen; break;
+         case 'R': type = Rook; break;
+         case 'B': type = Bishop; break;
+         case 'N': type = Knight; break;
+         case 'P': type = Pawn; break;
+         }
+         t.color[t.men] = side;
+         t.type[t.men++] = type;
+         t.key += materialKey(side,type);
+         t.swappedKey += materialKey(OppositeColor(side),type);
+         if (type == Pawn) t.pawns = true;
+      }
+      t.range[0] = t.pawns ? 32 : 10;
+      t.size = t.range[0];
+      for (int j = 1; j < t.men; j++) {
+         t.range[j] = t.type[j] == Pawn ? 48 : 64;
+         t.size *= t.range[j];
+      }
+      t.ready = false;
+   }
+}
+
+static inline uint64_t bit(Square sq) {
+   return 1ULL << sq;
+}
+
+static uint64_t occupancy(const Pos &pos) {
+   uint64_t occ = 0;
+   for (int i = 0; i < pos.men; i++) occ |= bit(pos.sq[i]);
+   return occ;
+}
+
+static uint64_t attacks(PieceType type, ColorType color, Square sq,
+                        uint64_t occ) {
+   switch (type) {
+   case Pawn:
+      // pawn_attacks[sq][side] holds the squares from which a pawn of
+      // "side" attacks sq
+      return Attacks::pawn_attacks[sq][OppositeColor(color)];
+   case Knight:
+      return Attacks::knight_attacks[sq];
+   case Bishop:
+      return Attacks::bishopAttacks(sq,occ);
+   case Rook:
+      return Attacks::rookAttacks(sq,occ);
+   case Queen:
+      return Attacks::rookAttacks(sq,occ) | Attacks::bishopAttacks(sq,occ);
+   default:
+      return Attacks::king_attacks[sq];
+   }
+}
+
+static bool attacked(const Pos &pos, Square target, ColorType by,
+                     uint64_t occ) {
+   for (int i = 0; i < pos.men; i++) {
+      if (pos.color[i] == by &&
+          (attacks(pos.type[i],by,pos.sq[i],occ) & bit(target))) {
+         return true;
+      }
+   }
+   return false;
+}
+
+static bool inCheck(const Pos &pos) {
+   return attacked(pos,pos.sq[pos.stm],OppositeColor(pos.stm),
+                   occupancy(pos));
+}
+
+static void removePiece(Pos &pos, int i) {
+   for (int j = i; j < pos.men-1; j++) {
+      pos.color[j] = pos.color[j+1];
+      pos.type[j] = pos.type[j+1];
+      pos.sq[j] = pos.sq[j+1];
+   }
+   --pos.men;
+}
+
+// Call f(child, conversion, doublePush) for each legal move in "pos".
+// "conversion" is true for captures and promotions, which change the
+// material. Stops early if f returns false.
+template <class F>
+static void forEachMove(const Pos &pos, F f) {
+   const ColorType side = pos.stm;
+   const ColorType opp = OppositeColor(side);
+   const uint64_t occ = occupancy(pos);
+   uint64_t own = 0;
+   for (int i = 0; i < pos.men; i++) {
+      if (pos.color[i] == side) own |= bit(pos.sq[i]);
+   }
+   // try one move: returns false to stop
+   auto tryMove = [&](int i, Square to, PieceType promotion,
+                      bool doublePush) -> bool {
+      Pos child(pos);
+      child.stm = opp;
+      child.sq[i] = to;
+      bool conversion = false;
+      if (promotion != Empty) {
+         child.type[i] = promotion;
+         conversion = true;
+      }
+      if (occ & bit(to)) {
+         for (int j = 0; j < pos.men; j++) {
+            if (j != i && pos.sq[j] == to) {
+               removePiece(child,j);
+               break;
+            }
+         }
+         conversion = true;
+      }
+      if (attacked(child,child.sq[side],opp,occupancy(child))) {
+         return true;
+      }
+      return f(child,conversion,doublePush);
+   };
+   for (int i = 0; i < pos.men; i++) {
+      if (pos.color[i] != side) continue;
+      const Square from = pos.sq[i];
+      if (pos.type[i] == Pawn) {
+         const int dir = side == White ? 8 : -8;
+         Bitboard targets(attacks(Pawn,side,from,occ) & occ & ~own);
+         if (!(occ & bit(from+dir))) {
+            targets.set(from+dir);
+            const int rank = from >> 3;
+            if ((side == White ? rank == 1 : rank == 6) &&
+                !(occ & bit(from+2*dir))) {
+               if (!tryMove(i,from+2*dir,Empty,true)) return;
+            }
+         }
+         Square to;
+         while (targets.iterate(to)) {
+            if ((to >> 3) == 0 || (to >> 3) == 7) {
+               static const PieceType PROMOTIONS[4] = {Queen, Rook, Bishop, Knight};
+               for (int p = 0; p < 4; p++) {
+                  if (!tryMove(i,to,PROMOTIONS[p],false)) return;
+               }
+            }
+            else if (!tryMove(i,to,Empty,false)) {
+               return;
+            }
+         }
+      }
+      else {
+         Bitboard targets(attacks(pos.type[i],side,from,occ) & ~own);
+         Square to;
+         while (targets.iterate(to)) {
+            if (!tryMove(i,to,Empty,false)) return;
+         }
+      }
+   }
+}
+
+// Call f(pred, doublePush) for each position from which the side not
+// to move in "pos" could have moved into "pos" without capturing or
+// promoting.
+template <class F>
+static void forEachUnmove(const Pos &pos, F f) {
+   const ColorType side = OppositeColor(pos.stm);
+   const uint64_t occ = occupancy(pos);
+   for (int i = 0; i < pos.men; i++) {
+      if (pos.color[i] != side) continue;
+      const Square to = pos.sq[i];
+      Pos pred(pos);
+      pred.stm = side;
+      if (pos.type[i] == Pawn) {
+         const int dir = side == White ? 8 : -8;
+         const Square from = to - dir;
+         if (from < 8 || from > 55 || (occ & bit(from))) continue;
+         pred.sq[i] = from;
+         f(pred,false);
+         const int rank = to >> 3;
+         if ((side == White ? rank == 3 : rank == 4) &&
+             !(occ & bit(from-dir))) {
+            pred.sq[i] = from - dir;
+            f(pred,true);
+         }
+      }
+      else {
+         Bitboard sources(attacks(pos.type[i],side,to,occ) & ~occ);
+         Square from;
+         while (sources.iterate(from)) {
+            pred.sq[i] = from;
+            f(pred,false);
+         }
+      }
+   }
+}
+
+// Look up a position in the tables that are ready.
+static RuntimeBitbases::Result lookup(const Pos &pos) {
+   if (pos.men == 2) {
+      return RuntimeBitbases::Draw;
+   }
+   uint32_t key = 0;
+   for (int i = 2; i < pos.men; i++) {
+      key += materialKey(pos.color[i],pos.type[i]);
+   }
+   for (int n = 0; n < TABLE_COUNT; n++) {
+      const Table &t = tables[n];
+      if (!t.ready.load(std::memory_order_acquire)) continue;
+      if (key != t.key && key != t.swappedKey) continue;
+      // positions with the colors reversed are looked up with the
+      // board flipped vertically
+      const bool swapped = key != t.key;
+      Square sq[MAX_MEN];
+      for (int j = 0; j < t.men; j++) {
+         const ColorType color = swapped ? OppositeColor(t.color[j]) : t.color[j];
+         for (int i = 0; i < pos.men; i++) {
+            if (pos.color[i] == color && pos.type[i] == t.type[j]) {
+               sq[j] = swapped ? pos.sq[i] ^ 56 : pos.sq[i];
+               break;
+            }
+         }
+      }
+      const ColorType stm = swapped ? OppositeColor(pos.stm) : pos.stm;
+      return (RuntimeBitbases::Result)t.get(t.index(sq)*2 + stm);
+   }
+   return RuntimeBitbases::Unknown;
+}
+
+// Generates one table by retrograde analysis.
+class Generator {
+
+ public:
+
+   Generator(Table &t, int threads, bool background)
+      : table(t), threads(threads), background(background), entries(t.size*2),
+        state(new std::atomic<uint8_t>[t.size*2]),
+        counts(new std::atomic<uint8_t>[t.size*2]),
+        flags(new uint8_t[t.size*2]),
+        resolved(threads) {
+   }
+
+   ~Generator() {
+      delete [] state;
+      delete [] counts;
+      delete [] flags;
+   }
+
+   int run();
+
+ private:
+
+   // Call f(i, thread) for i in 0..n-1, using all threads.
+   template <class F>
+   void parallelFor(size_t n, F f);
+
+   Pos position(size_t entry) const {
+      Pos pos;
+      pos.men = table.men;
+      for (int i = 0; i < table.men; i++) {
+         pos.color[i] = table.color[i];
+         pos.type[i] = table.type[i];
+      }
+      table.decode(entry/2,pos.sq);
+      pos.stm = (ColorType)(entry & 1);
+      return pos;
+   }
+
+   size_t entry(const Pos &pos) const {
+      return table.index(pos.sq)*2 + pos.stm;
+   }
+
+   bool valid(const Pos &pos, size_t e) const;
+
+   int childValue(const Pos &child, bool conversion, bool doublePush) const;
+
+   // Value of "pos" given the values known so far. If "lossOnly" is
+   // set, only test for a loss (all moves lose).
+   int evaluate(const Pos &pos, bool lossOnly) const;
+
+   // Set up the count and flags for a position, and return its value
+   // if it is already decided (by mate, or by conversion).
+   int initialize(const Pos &pos, size_t e);
+
+   // Propagate the values of the positions resolved in the previous
+   // pass to their predecessors, until no more are resolved. If
+   // "taint" is set, mark unresolved predecessors as unknown.
+   void propagate(bool taint);
+
+   // Set the value of an unresolved position, and queue it to be
+   // propagated in the next pass.
+   void resolve(size_t e, uint8_t value, int thread) {
+      uint8_t expected = UNRESOLVED;
+      if (state[e].compare_exchange_strong(expected,value,std::memory_order_relaxed)) {
+         resolved[thread].push_back((uint32_t)e);
+      }
+   }
+
+   // Gather the positions queued by resolve()
+   void collect(vector<uint32_t> &list);
+
+   Table &table;
+   const int threads;
+   const bool background;
+   const size_t entries;
+   std::atomic<uint8_t> *state;
+   // For each position, the number of distinct positions reachable
+   // by moves that do not convert, plus one if a conversion does not
+   // lose. The position is lost when this reaches 0.
+   std::atomic<uint8_t> *counts;
+   uint8_t *flags;
+   // positions resolved in the current pass, per thread
+   vector< vector<uint32_t> > resolved;
+};
+
+template <class F>
+void Generator::parallelFor(size_t n, F f) {
+   static const size_t CHUNK = 4096;
+   std::atomic<size_t> next(0);
+   auto worker = [&](int thread) {
+      for (;;) {
+         const size_t start = next.fetch_add(CHUNK);
+         if (start >= n || stopping) break;
+         const size_t end = std::min<size_t>(n,start+CHUNK);
+         for (size_t i = start; i < end; i++) f(i,thread);
+      }
+   };
+   vector<std::thread> workers;
+   for (int i = 1; i < threads; i++) {
+      workers.push_back(std::thread([&worker,this,i]() {
+         if (background) ThreadControl::lowerPriority();
+         worker(i);
+      }));
+   }
+   worker(0);
+   for (auto &w : workers) w.join();
+}
+
+bool Generator::valid(const Pos &pos, size_t e) const {
+   const uint64_t occ = occupancy(pos);
+   if ((int)Bitboard(occ).bitCount() != pos.men) return false;
+   if (Attacks::king_attacks[pos.sq[White]] & bit(pos.sq[Black])) return false;
+   // only one of the symmetric images of a position is stored
+   if (entry(pos) != e) return false;
+   const ColorType opp = OppositeColor(pos.stm);
+   return !attacked(pos,pos.sq[opp],pos.stm,occ);
+}
+
+int Generator::childValue(const Pos &child, bool conversion,
+                          bool doublePush) const {
+   if (conversion) {
+      switch (lookup(child)) {
+      case RuntimeBitbases::Win: return WIN;
+      case RuntimeBitbases::Loss: return LOSS;
+      case RuntimeBitbases::Draw: return DRAW;
+      default: return UNKNOWN;
+      }
+   }
+   const int value = state[entry(child)].load(std::memory_order_relaxed);
+   if (!doublePush) {
+      return value;
+   }
+   // After a double pawn push the table value (which assumes no en
+   // passant rights) only applies if the pawn cannot be taken e.p.
+   const ColorType side = child.stm;
+   const int dir = side == White ? -8 : 8;
+   int pusher = 0;
+   for (int i = 2; i < child.men; i++) {
+      if (child.type[i] == Pawn && child.color[i] != side &&
+          (child.sq[i] >> 3) == (side == White ? 4 : 3)) {
+         pusher = i;
+      }
+   }
+   if (!pusher) return value;
+   int best = value;
+   for (int i = 2; i < child.men; i++) {
+      if (child.type[i] != Pawn || child.color[i] != side ||
+          (child.sq[i] >> 3) != (child.sq[pusher] >> 3) ||
+          std::abs((child.sq[i] & 7) - (child.sq[pusher] & 7)) != 1) continue;
+      Pos ep(child);
+      ep.sq[i] = child.sq[pusher] - dir;
+      ep.stm = OppositeColor(side);
+      removePiece(ep,pusher);
+      if (attacked(ep,ep.sq[side],ep.stm,occupancy(ep))) continue;
+      // value of the capture for the side to move in "child"
+      int capture;
+      switch (lookup(ep)) {
+      case RuntimeBitbases::Win: capture = LOSS; break;
+      case RuntimeBitbases::Loss: capture = WIN; break;
+      case RuntimeBitbases::Draw: capture = DRAW; break;
+      default: capture = UNKNOWN;
+      }
+      if (capture == WIN || best == WIN) best = WIN;
+      else if (capture == UNKNOWN) best = UNKNOWN;
+      else if (capture == DRAW && best != UNKNOWN) best = DRAW;
+   }
+   return best;
+}
+
+int Generator::evaluate(const Pos &pos, bool lossOnly) const {
+   bool win = false, allWin = true;
+   forEachMove(pos,[&](const Pos &child, bool conversion, bool doublePush) {
+      const int value = childValue(child,conversion,doublePush);
+      if (value == LOSS) {
+         win = true;
+         return false;
+      }
+      if (value != WIN) {
+         allWin = false;
+         if (lossOnly) return false;
+      }
+      return true;
+   });
+   // Positions are only evaluated here as predecessors of a resolved
+   // position, so they always have a move: stalemate never appears.
+   if (win) return WIN;
+   return allWin ? LOSS : UNRESOLVED;
+}
+
+int Generator::initialize(const Pos &pos, size_t e) {
+   int moves = 0, distinct = 0;
+   bool win = false, blocked = false;
+   uint8_t flag = 0;
+   size_t children[64];
+   forEachMove(pos,[&](const Pos &child, bool conversion, bool doublePush) {
+      ++moves;
+      if (doublePush) {
+         for (int i = 2; i < child.men; i++) {
+            if (child.type[i] == Pawn && child.color[i] == child.stm) flag |= EP_MOVE;
+         }
+      }
+      if (conversion) {
+         const int value = childValue(child,conversion,doublePush);
+         if (value == LOSS) {
+            win = true;
+            return false;
+         }
+         if (value == UNKNOWN) flag |= UNKNOWN_MOVE;
+         if (value != WIN) blocked = true;
+      }
+      else if (table.pawns) {
+         // no two moves lead to the same stored position
+         ++distinct;
+      }
+      else {
+         children[distinct++] = entry(child);
+      }
+      return true;
+   });
+   flags[e] = flag;
+   if (win) return WIN;
+   if (moves == 0) {
+      // stalemate remains unresolved, and so is scored as a draw
+      return inCheck(pos) ? LOSS : UNRESOLVED;
+   }
+   if (!table.pawns) {
+      // symmetric moves can lead to the same stored position
+      std::sort(children,children+distinct);
+      distinct = (int)(std::unique(children,children+distinct) - children);
+   }
+   counts[e].store(distinct + blocked,std::memory_order_relaxed);
+   return distinct + blocked ? UNRESOLVED : LOSS;
+}
+
+void Generator::collect(vector<uint32_t> &list) {
+   list.clear();
+   for (auto &r : resolved) {
+      list.insert(list.end(),r.begin(),r.end());
+      r.clear();
+   }
+}
+
+void Generator::propagate(bool taint) {
+   vector<uint32_t> current;
+   for (collect(current); !current.empty(); collect(current)) {
+      parallelFor(current.size(),[&](size_t i, int thread) {
+         const size_t e = current[i];
+         const int value = state[e].load(std::memory_order_relaxed);
+         if (value == WIN && !taint) {
+            // Each predecessor has one less move that does not lose.
+            size_t preds[64];
+            int n = 0;
+            forEachUnmove(position(e),[&](const Pos &pred, bool) {
+               preds[n++] = entry(pred);
+            });
+            if (!table.pawns) {
+               std::sort(preds,preds+n);
+               n = (int)(std::unique(preds,preds+n) - preds);
+            }
+            for (int j = 0; j < n; j++) {
+               const size_t p = preds[j];
+               if (state[p].load(std::memory_order_relaxed) != UNRESOLVED) continue;
+               if (flags[p] & EP_MOVE) {
+                  if (evaluate(position(p),true) == LOSS) resolve(p,LOSS,thread);
+               }
+               else if (counts[p].fetch_sub(1,std::memory_order_relaxed) == 1) {
+                  resolve(p,LOSS,thread);
+               }
+            }
+            return;
+         }
+         forEachUnmove(position(e),[&](const Pos &pred, bool doublePush) {
+            const size_t p = entry(pred);
+            if (state[p].load(std::memory_order_relaxed) != UNRESOLVED) return;
+            if (taint) {
+               // a draw that can reach an unknown result is unknown
+               resolve(p,UNKNOWN,thread);
+            }
+            else if (!doublePush) {
+               resolve(p,WIN,thread);
+            }
+            else if (evaluate(pred,false) == WIN) {
+               resolve(p,WIN,thread);
+            }
+         });
+      });
+   }
+}
+
+int Generator::run() {
+   for (size_t e = 0; e < entries; e++) {
+      state[e].store(UNRESOLVED,std::memory_order_relaxed);
+      counts[e].store(0,std::memory_order_relaxed);
+      flags[e] = 0;
+   }
+   // Mark illegal positions, and resolve mates and positions decided
+   // by conversion to other tables.
+   parallelFor(entries,[&](size_t e, int thread) {
+      const Pos pos(position(e));
+      if (!valid(pos,e)) {
+         state[e].store(UNKNOWN,std::memory_order_relaxed);
+         return;
+      }
+      const int result = initialize(pos,e);
+      if (result != UNRESOLVED) resolve(e,result,thread);
+   });
+   propagate(false);
+   // Positions still unresolved are draws, unless a draw can only be
+   // claimed by reaching a position with an unknown result.
+   parallelFor(entries,[&](size_t e, int thread) {
+      if ((flags[e] & UNKNOWN_MOVE) &&
+          state[e].load(std::memory_order_relaxed) == UNRESOLVED) {
+         resolve(e,UNKNOWN,thread);
+      }
+   });
+   propagate(true);
+   if (stopping) {
+      return 0;
+   }
+   table.data.assign((entries+3)/4,0);
+   parallelFor(table.data.size(),[&](size_t i, int) {
+      uint8_t byte = 0;
+      for (size_t e = 4*i; e < std::min<size_t>(entries,4*i+4); e++) {
+         byte |= state[e].load(std::memory_order_relaxed) << ((e & 3) << 1);
+      }
+      table.data[i] = byte;
+   });
+   return !stopping;
+}
+
+static string fileName(const string &path, const Table &t) {
+#ifdef _WIN32
+   return path + "\\" + t.name + ".rbb";
+#else
+   return path + "/" + t.name + ".rbb";
+#endif
+}
+
+static int load(const string &path, Table &t) {
+   ifstream in(fileName(path,t).c_str(),ios::in | ios::binary);
+   if (!in.good()) return 0;
+   uint32_t header[2];
+   uint64_t size;
+   in.read((char*)header,sizeof(header));
+   in.read((char*)&size,sizeof(size));
+   if (!in.good() || header[0] != FILE_MAGIC || header[1] != FILE_VERSION ||
+       size != (t.size*2+3)/4) {
+      return 0;
+   }
+   t.data.resize(size);
+   in.read((char*)t.data.data(),size);
+   if (!in.good()) {
+      t.data.clear();
+      return 0;
+   }
+   return 1;
+}
+
+static void save(const string &path, const Table &t) {
+   ofstream out(fileName(path,t).c_str(),ios::out | ios::binary | ios::trunc);
+   const uint32_t header[2] = {FILE_MAGIC, FILE_VERSION};
+   const uint64_t size = t.data.size();
+   out.write((const char*)header,sizeof(header));
+   out.write((const char*)&size,sizeof(size));
+   out.write((const char*)t.data.data(),size);
+   if (!out.good()) {
+      cerr << "warning: could not write bitbase file " << fileName(path,t) << endl;
+   }
+}
+
+static int build(Table &t, const string &path, int threads,
+                 bool background) {
+   if (t.ready) return 1;
+   if (path.empty() || !load(path,t)) {
+      Generator gen(t,std::max<int>(1,threads),background);
+      if (!gen.run()) return 0;
+      if (!path.empty()) save(path,t);
+   }
+   MemoryUsage::add(MemoryUsage::Bitbases,t.data.size());
+   t.ready.store(true,std::memory_order_release);
+   return 1;
+}
+
+void RuntimeBitbases::init(const string &path, int threads)
+{
+   std::call_once(setupFlag,setup);
+   if (genThread.joinable()) return;
+   stopping = false;
+   generating = true;
+   genThread = std::thread([path,threads]() {
+      ThreadControl::lowerPriority();
+      for (int i = 0; i < TABLE_COUNT && !stopping; i++) {
+         if (!build(tables[i],path,threads,true)) break;
+      }
+      generating = false;
+   });
+}
+
+bool RuntimeBitbases::building()
+{
+   return generating;
+}
+
+void RuntimeBitbases::cleanup()
+{
+   if (genThread.joinable()) {
+      stopping = true;
+      genThread.join();
+   }
+   for (int i = 0; i < TABLE_COUNT; i++) {
+      if (tables[i].ready) {
+         MemoryUsage::remove(MemoryUsage::Bitbases,tables[i].data.size());
+      }
+      tables[i].ready = false;
+      vector<uint8_t>().swap(tables[i].data);
+   }
+}
+
+int RuntimeBitbases::generate(const string &name, int threads)
+{
+   std::call_once(setupFlag,setup);
+   for (int i = 0; i < TABLE_COUNT; i++) {
+      if (!build(tables[i],"",threads,false)) return 0;
+      if (tables[i].name == name) return 1;
+   }
+   return 0;
+}
+
+RuntimeBitbases::Result RuntimeBitbases::probe(const Board &board)
+{
+   const Material &wMat = board.getMaterial(White);
+   const Material &bMat = board.getMaterial(Black);
+   if (wMat.men() + bMat.men() > MAX_MEN ||
+       board.enPassantSq() != InvalidSquare ||
+       board.castleStatus(White) <= CanCastleQSide ||
+       board.castleStatus(Black) <= CanCastleQSide) {
+      return Unknown;
+   }
+   Pos pos;
+   pos.men = 2;
+   pos.stm = board.sideToMove();
+   for (int side = White; side <= Black; side++) {
+      const ColorType color = (ColorType)side;
+      pos.color[side] = color;
+      pos.type[side] = King;
+      pos.sq[side] = board.kingSquare(color);
+   }
+   for (int side = White; side <= Black; side++) {
+      const ColorType color = (ColorType)side;
+      const Bitboard *bits[5] = {&board.pawn_bits[color], &board.knight_bits[color],
+                                 &board.bishop_bits[color], &board.rook_bits[color],
+                                 &board.queen_bits[color]};
+      for (int type = Pawn; type <= Queen; type++) {
+         Bitboard b(*bits[type-Pawn]);
+         Square sq;
+         while (b.iterate(sq)) {
+            pos.color[pos.men] = color;
+            pos.type[pos.men] = (PieceType)type;
+            pos.sq[pos.men++] = sq;
+         }
+      }
+   }
+   return lookup(pos);
+}
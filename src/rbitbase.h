@@ -0,0 +1,49 @@
+// Copyright 2017 by Jon Dart. All Rights Reserved.
+
+#ifndef _RBITBASE_H
+#define _RBITBASE_H
+
+#include "board.h"
+#include <string>
+
+// Win/draw/loss bitbases for small endgames (KQKP, KRKP, KPKP, KBNK,
+// KRKB, KRKN and the 3-man endings they convert to), generated at
+// runtime by retrograde analysis rather than stored in the program
+// or read from tablebase files.
+//
+// Tables are built by a background thread after startup (or read from
+// a cache directory, if one is configured). Until a table is ready,
+// probes of it return Unknown. Positions whose value depends on a
+// conversion to an endgame with no table (for example a pawn
+// promoting in KQKP) are also stored as Unknown.
+class RuntimeBitbases {
+
+ public:
+
+   // Result for the side to move
+   enum Result {Draw, Win, Loss, Unknown};
+
+   // Start building the tables in the background, using up to
+   // "threads" threads. If "path" is not empty, tables are loaded
+   // from that directory if present there, and saved to it after
+   // they are generated.
+   static void init(const string &path, int threads);
+
+   // Stop any generation in progress and free the tables.
+   static void cleanup();
+
+   // Returns true while the tables are being built in the background.
+   static bool building();
+
+   // Probe the tables. Returns Unknown if the material has no table,
+   // the table is not ready, or the position has castling or en
+   // passant rights.
+   static Result probe(const Board &board);
+
+   // Build the table with the given name (for example "KRKP")
+   // immediately, together with the tables it depends on. Returns 1
+   // if successful.
+   static int generate(const string &name, int threads);
+};
+
+#endif
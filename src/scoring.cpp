@@ -6,7 +6,9 @@
 #include "hash.h"
 #include "globals.h"
 #include "material.h"
+#include "memusage.h"
 #include "movegen.h"
+#include "rbitbase.h"
 #ifdef TUNE
 #include "tune.h"
 #endif
@@ -37,9 +39,16 @@ const int Params::ENDGAME_THRESHOLD = 23;
 #define PARAM(x) Params::x
 #define APARAM(x,index) Params::x[index]
 
+#if !defined(TUNE) && !defined(EVAL_DEBUG)
+// Use the precomputed material table. Not done when tuning, because
+// the parameters it depends on change, or when tracing the evaluation.
+#define USE_MATERIAL_TABLE
+#endif
+
 CACHE_ALIGN Bitboard Scoring::kingProximity[2][64];
 CACHE_ALIGN Bitboard Scoring::kingNearProximity[64];
 CACHE_ALIGN Bitboard Scoring::kingPawnProximity[2][64];
+Scoring::MaterialInfo Scoring::materialTable[Material::KeyRange*Material::KeyRange];
 
 static score_t VAL(double x) { return score_t(Params::PAWN_VALUE*x); }
 
@@ -316,16 +325,164 @@ void Scoring::init() {
 #ifdef TUNE
    tune_params.applyParams();
 #endif
+   initMaterialTable();
+#ifdef USE_MATERIAL_TABLE
+   MemoryUsage::add(MemoryUsage::StaticTables,sizeof(materialTable));
+#endif
+}
+
+// Set "mat" to the material with key "key"
+static void materialFromKey(uint32_t key, Material &mat)
+{
+   static const PieceType types[5] = {Pawn, Knight, Bishop, Rook, Queen};
+   static const uint32_t radix[5] = {9, 3, 3, 3, 2};
+   mat.addPiece(King);
+   for (int i = 0; i < 5; i++) {
+      for (uint32_t n = key % radix[i]; n > 0; n--) {
+         mat.addPiece(types[i]);
+      }
+      key /= radix[i];
+   }
+}
+
+void Scoring::initMaterialTable() {
+#ifdef USE_MATERIAL_TABLE
+   for (uint32_t w = 0; w < Material::KeyRange; w++) {
+      Material white;
+      materialFromKey(w,white);
+      ASSERT(white.keyInRange() && white.key() == w);
+      for (uint32_t b = 0; b < Material::KeyRange; b++) {
+         Material black;
+         materialFromKey(b,black);
+         calcMaterialInfo(white,black,materialTable[w*Material::KeyRange+b]);
+      }
+   }
+#endif
+}
+
+Scoring::MaterialInfo Scoring::materialInfo(const Material &white,
+                                            const Material &black) {
+#ifdef USE_MATERIAL_TABLE
+   if (white.keyInRange() && black.keyInRange()) {
+      return materialTable[white.key()*Material::KeyRange + black.key()];
+   }
+#endif
+   MaterialInfo info;
+   calcMaterialInfo(white,black,info);
+   return info;
+}
+
+void Scoring::calcMaterialInfo(const Material &white, const Material &black,
+                               MaterialInfo &info)
+{
+   score_t adjust = 0;
+   bool kbpWhite = false, kbpBlack = false;
+   if (white.infobits() != black.infobits()) {
+      if (white.noPawns() && black.noPawns()) {
+         adjust = adjustMaterialScoreNoPawns(white,black) -
+            adjustMaterialScoreNoPawns(black,white);
+      }
+      else {
+         adjust = adjustMaterialScore(white,black,White,kbpWhite) -
+            adjustMaterialScore(black,white,Black,kbpBlack);
+      }
+   }
+#ifdef TUNE
+   info.adjust = adjust;
+#else
+   ASSERT(adjust >= INT16_MIN && adjust <= INT16_MAX);
+   info.adjust = (int16_t)adjust;
+#endif
+   int flags = 0;
+   if (kbpWhite) flags |= MaterialInfo::KBP_ADJUST_WHITE;
+   if (kbpBlack) flags |= MaterialInfo::KBP_ADJUST_BLACK;
+   // insufficient material: see Board::materialDraw
+   if (white.noPawns() && black.noPawns() &&
+       white.value() <= Params::KING_VALUE + Params::BISHOP_VALUE &&
+       black.value() <= Params::KING_VALUE + Params::BISHOP_VALUE) {
+      if (white.kingOnly() || black.kingOnly()) {
+         flags |= MaterialInfo::MATERIAL_DRAW;
+      }
+      else if (white.infobits() != Material::KN ||
+               black.infobits() != Material::KN) {
+         flags |= MaterialInfo::MATERIAL_DRAW_CHECK;
+      }
+   }
+   // theoretical draws: see theoreticalDraw<side>
+   if (white.value() != black.value()) {
+      const Material &strong = white.value() > black.value() ? white : black;
+      const Material &weak = white.value() > black.value() ? black : white;
+      if (strong.value() <= Params::KING_VALUE + (Params::KNIGHT_VALUE * 2) &&
+          weak.kingOnly()) {
+         if (strong.infobits() == Material::KP ||
+             strong.pieceBits() == Material::KB) {
+            flags |= MaterialInfo::THEORETICAL_DRAW_CHECK;
+         }
+         else if (strong.infobits() == Material::KNN) {
+            flags |= MaterialInfo::THEORETICAL_DRAW;
+         }
+      }
+   }
+   info.flags = (uint8_t)flags;
+   info.endgames = (uint8_t)(endgameType(white,black) |
+                             (endgameType(black,white) << 4));
 }
 
 void Scoring::cleanup() {
+#ifdef USE_MATERIAL_TABLE
+   MemoryUsage::remove(MemoryUsage::StaticTables,sizeof(materialTable));
+#endif
 }
 
+unsigned Scoring::pawnHashEntries = Scoring::PAWN_HASH_SIZE;
+
+unsigned Scoring::kingPawnHashEntries = Scoring::KING_PAWN_HASH_SIZE;
+
 Scoring::Scoring() {
-   clearHashTables();
+   allocHashTables();
 }
 
 Scoring::~Scoring() {
+   freeHashTables();
+}
+
+void Scoring::setHashSizes(unsigned pawnEntries, unsigned kingPawnEntries) {
+   ASSERT(pawnEntries && (pawnEntries & (pawnEntries-1)) == 0);
+   ASSERT(kingPawnEntries && (kingPawnEntries & (kingPawnEntries-1)) == 0);
+   pawnHashEntries = pawnEntries;
+   kingPawnHashEntries = kingPawnEntries;
+}
+
+size_t Scoring::hashTableBytes(unsigned pawnEntries, unsigned kingPawnEntries) {
+   return sizeof(PawnHashEntry)*pawnEntries +
+      2*sizeof(KingPawnHashEntry)*kingPawnEntries;
+}
+
+void Scoring::resizeHashTables() {
+   if (pawnHashSize != pawnHashEntries ||
+       kingPawnHashSize != kingPawnHashEntries) {
+      freeHashTables();
+      allocHashTables();
+   }
+}
+
+void Scoring::allocHashTables() {
+   pawnHashSize = pawnHashEntries;
+   kingPawnHashSize = kingPawnHashEntries;
+   pawnHashTable = new PawnHashEntry[pawnHashSize];
+   kingPawnHashTable[White] = new KingPawnHashEntry[kingPawnHashSize];
+   kingPawnHashTable[Black] = new KingPawnHashEntry[kingPawnHashSize];
+   MemoryUsage::add(MemoryUsage::PawnHash,
+                    hashTableBytes(pawnHashSize,kingPawnHashSize));
+   clearHashTables();
+}
+
+void Scoring::freeHashTables() {
+   MemoryUsage::remove(MemoryUsage::PawnHash,
+                       hashTableBytes(pawnHashSize,kingPawnHashSize));
+   delete [] pawnHashTable;
+   delete [] kingPawnHashTable[White];
+   delete [] kingPawnHashTable[Black];
 }
 
 int Scoring::tradeDownIndex(const Material &ourmat, const Material &oppmat)
@@ -339,10 +496,10 @@ int Scoring::tradeDownIndex(const Material &ourmat, const Material &oppmat)
    return index;
 }
 
-score_t Scoring::adjustMaterialScore(const Board &board, ColorType side) const
+score_t Scoring::adjustMaterialScore(const Material &ourmat,
+                                     const Material &oppmat,
+                                     ColorType side, bool &kbpCheck)
 {
-    const Material &ourmat = board.getMaterial(side);
-    const Material &oppmat = board.getMaterial(OppositeColor(side));
     score_t score = 0;
 #ifdef EVAL_DEBUG
     score_t tmp = score;
@@ -374,14 +531,11 @@ score_t Scoring::adjustMaterialScore(const Board &board, ColorType side) const
             }
         }
         else if (pieces == Material::KB && ourmat.pawnCount() == 1) {
-            int wrongBishop = (side == White) ? KBPDraw<White>(board) : KBPDraw<Black>(board);
-            if (wrongBishop) {
-                // We have the configuration of "wrong color bishop"
-                // and rook pawn. Opponent may or may not have
-                // pawns. We likely can't do better than draw, so
-                // reduce score.
-                score -= Params::BISHOP_VALUE;
-            }
+            // If we have the configuration of "wrong color bishop"
+            // and rook pawn, we likely can't do better than draw
+            // (opponent may or may not have pawns). The caller
+            // checks this and reduces the score.
+            kbpCheck = true;
         }
 #ifdef EVAL_DEBUG
         cout << "minor piece adjustment (" << ColorImage(side) << ") = " << score << endl;
@@ -483,11 +637,10 @@ score_t Scoring::adjustMaterialScore(const Board &board, ColorType side) const
 }
 
 
-score_t Scoring::adjustMaterialScoreNoPawns( const Board &board, ColorType side ) const
+score_t Scoring::adjustMaterialScoreNoPawns(const Material &ourmat,
+                                            const Material &oppmat)
 {
     // pawnless endgames. Generally drawish in many cases.
-    const Material &ourmat = board.getMaterial(side);
-    const Material &oppmat = board.getMaterial(OppositeColor(side));
     const score_t mdiff = ourmat.value()-oppmat.value();
     score_t score = 0;
     if (ourmat.infobits() == Material::KQ) {
@@ -847,6 +1000,7 @@ void Scoring::scoreBishopAndPawns(const Board &board,ColorType ourSide,const Paw
 
 template<ColorType side>
 void Scoring::pieceScore(const Board &board,
+               const AttackMap *attacks,
                const PawnHashEntry::PawnData &ourPawnData,
                const PawnHashEntry::PawnData &oppPawnData,
                score_t oppCover,
@@ -920,7 +1074,7 @@ void Scoring::pieceScore(const Board &board,
             scores.mid += PARAM(BISHOP_PST)[Midgame][scoreSq];
             scores.end += PARAM(BISHOP_PST)[Endgame][scoreSq];
 
-            const Bitboard battacks(board.bishopAttacks(sq));
+            const Bitboard battacks(attacks ? attacks->attacksFrom(sq) : board.bishopAttacks(sq));
             allAttacks |= battacks;
             minorAttacks |= battacks;
             if (!deep_endgame) {
@@ -973,7 +1127,7 @@ void Scoring::pieceScore(const Board &board,
          {
             scores.mid += PARAM(ROOK_PST)[Midgame][scoreSq];
             scores.end += PARAM(ROOK_PST)[Endgame][scoreSq];
-            const Bitboard rattacks(board.rookAttacks(sq));
+            const Bitboard rattacks(attacks ? attacks->attacksFrom(sq) : board.rookAttacks(sq));
             const int r = Rank(sq, side);
             if (r == 7 && (Rank(okp,side) == 8 || (board.pawn_bits[oside] & Attacks::rank7mask[side]))) {
 #ifdef EVAL_DEBUG
@@ -1038,7 +1192,7 @@ void Scoring::pieceScore(const Board &board,
             scores.mid += PARAM(QUEEN_PST)[Midgame][scoreSq];
             scores.end += PARAM(QUEEN_PST)[Endgame][scoreSq];
             int qmobl = 0;
-            Bitboard battacks(board.bishopAttacks(sq));
+            Bitboard battacks(attacks ? attacks->diagAttacksFrom(sq) : board.bishopAttacks(sq));
             allAttacks |= battacks;
             Bitboard qmobility(battacks);
             Bitboard kattacks;
@@ -1047,7 +1201,7 @@ void Scoring::pieceScore(const Board &board,
                pin_count++;
             }
 
-            Bitboard rattacks(board.rookAttacks(sq));
+            Bitboard rattacks(attacks ? attacks->rankFileAttacksFrom(sq) : board.rookAttacks(sq));
             qmobility |= rattacks;
             allAttacks |= qmobility;
             if (!deep_endgame) {
@@ -1713,6 +1867,10 @@ void Scoring::calcPawnEntry(const Board &board, PawnHashEntry &pawnEntry) {
 }
 
 score_t Scoring::materialScore(const Board &board) const {
+    return materialScore(board,materialInfo(board));
+}
+
+score_t Scoring::materialScore(const Board &board, const MaterialInfo &info) const {
     const ColorType side = board.sideToMove();
     const Material &ourmat = board.getMaterial(side);
     const Material &oppmat = board.getMaterial(OppositeColor(side));
@@ -1721,16 +1879,16 @@ score_t Scoring::materialScore(const Board &board) const {
     cout << "mdiff=" << mdiff << endl;
 
 #endif
-    score_t adjust = 0;
-    if (ourmat.infobits() != oppmat.infobits()) {
-        if (ourmat.noPawns() && oppmat.noPawns()) {
-            adjust += adjustMaterialScoreNoPawns(board,side) -
-               adjustMaterialScoreNoPawns(board,OppositeColor(side));
-        }
-        else {
-            adjust += adjustMaterialScore(board,side) -
-               adjustMaterialScore(board,OppositeColor(side));
-        }
+    score_t adjust = info.adjust;
+    // "wrong color bishop" adjustments depend on the position
+    if ((info.flags & MaterialInfo::KBP_ADJUST_WHITE) && KBPDraw<White>(board)) {
+        adjust -= Params::BISHOP_VALUE;
+    }
+    if ((info.flags & MaterialInfo::KBP_ADJUST_BLACK) && KBPDraw<Black>(board)) {
+        adjust += Params::BISHOP_VALUE;
+    }
+    if (side == Black) {
+        adjust = -adjust;
     }
 #ifdef EVAL_DEBUG
     if (adjust) cout << "material score adjustment = " << adjust << endl;
@@ -1744,18 +1902,31 @@ score_t Scoring::materialScore(const Board &board) const {
 
 
 score_t Scoring::evalu8(const Board &board, bool useCache) {
+   return evaluate(board, nullptr, useCache);
+}
+
+score_t Scoring::evalu8(const Board &board, AttackMap &attacks, bool useCache) {
+   return evaluate(board, &attacks, useCache);
+}
+
+score_t Scoring::evaluate(const Board &board, AttackMap *attacks, bool useCache) {
 
    score_t score;
     
    if ((score = tryBitbase(board)) != Constants::INVALID_SCORE) {
        return score;
    }
+   const RuntimeBitbases::Result bitbaseResult = RuntimeBitbases::probe(board);
+   if (bitbaseResult == RuntimeBitbases::Draw) {
+       return 0;
+   }
 
-   const score_t matScore = materialScore(board);
+   const MaterialInfo matInfo = materialInfo(board);
+   const score_t matScore = materialScore(board,matInfo);
 
    const hash_t pawnHash = board.pawnHashCodeW ^ board.pawnHashCodeB;
 
-   PawnHashEntry &pawnEntry = pawnHashTable[pawnHash % PAWN_HASH_SIZE];
+   PawnHashEntry &pawnEntry = pawnHashTable[pawnHash & (pawnHashSize-1)];
 
    if (!useCache || pawnEntry.hc != pawnHash) {
       // Not found in table, need to calculate
@@ -1780,8 +1951,9 @@ score_t Scoring::evalu8(const Board &board, bool useCache) {
 #ifdef EVAL_DEBUG
       int tmp = wScores.end;
 #endif
-      if (specialCaseEndgame<White>(board,board.getMaterial(White),
-                                    board.getMaterial(Black),wScores)) {
+      const int endgame = matInfo.endgame(White);
+      if (endgame != NoEndgame) {
+          endgameEvaluators[White][endgame](board,wScores);
           posEval = false;
       }
       else {
@@ -1800,8 +1972,9 @@ score_t Scoring::evalu8(const Board &board, bool useCache) {
 #ifdef EVAL_DEBUG
       int tmp = bScores.end;
 #endif
-      if (specialCaseEndgame<Black>(board,board.getMaterial(Black),
-                                    board.getMaterial(White),bScores)) {
+      const int endgame = matInfo.endgame(Black);
+      if (endgame != NoEndgame) {
+          endgameEvaluators[Black][endgame](board,bScores);
           posEval = false;
       }
       else {
@@ -1816,8 +1989,9 @@ score_t Scoring::evalu8(const Board &board, bool useCache) {
 
    if (posEval) {
        // compute positional scores
-       positionalScore<White>(board, pawnEntry, whiteCover, blackCover, wScores, bScores);
-       positionalScore<Black>(board, pawnEntry, blackCover, whiteCover, bScores, wScores);
+       if (attacks) attacks->update(board);
+       positionalScore<White>(board, attacks, pawnEntry, whiteCover, blackCover, wScores, bScores);
+       positionalScore<Black>(board, attacks, pawnEntry, blackCover, whiteCover, bScores, wScores);
    }
 
 #ifdef EVAL_DEBUG
@@ -1851,6 +2025,18 @@ score_t Scoring::evalu8(const Board &board, bool useCache) {
       score = -score;
    }
 
+   // A known win scores above any heuristic value. Part of the
+   // heuristic score is kept, so the search can still make progress
+   // (for example toward mate in KBNK, or toward a conversion).
+   if (bitbaseResult == RuntimeBitbases::Win) {
+      score = Constants::BITBASE_WIN +
+         std::min<score_t>(500,std::max<score_t>(0,score)/4);
+   }
+   else if (bitbaseResult == RuntimeBitbases::Loss) {
+      score = -Constants::BITBASE_WIN -
+         std::min<score_t>(500,std::max<score_t>(0,-score)/4);
+   }
+
 #ifdef _DEBUG
 #ifdef TUNE
    if (fabs(score) >= Constants::MATE) {
@@ -2052,11 +2238,30 @@ void Scoring::pawnScore(const Board &board, ColorType side, const PawnHashEntry:
 #endif
 }
 
-score_t Scoring::kingDistanceScore(const Board &board) const
+score_t Scoring::kingDistanceScore(const Board &board)
 {
    return PARAM(KING_DISTANCE_BASIS) - PARAM(KING_DISTANCE_MULT)*distance(board.kingSquare(White), board.kingSquare(Black));
 }
 
+int Scoring::endgameType(const Material &ourMaterial,
+                         const Material &oppMaterial)
+{
+   if (oppMaterial.kingOnly()) {
+      // some special-case endgames, piece vs bare King
+      switch (ourMaterial.infobits()) {
+      case Material::KBN:
+         return KBNKEndgame;
+      case Material::KR:
+         return KRKEndgame;
+      case Material::KQ:
+         return KQKEndgame;
+      default:
+         break;
+      }
+   }
+   return NoEndgame;
+}
+
 // returns 1 if we evaluated a special-case endgame
 template <ColorType side>
 int Scoring::specialCaseEndgame(const Board &board,
@@ -2064,81 +2269,103 @@ int Scoring::specialCaseEndgame(const Board &board,
                                 const Material &oppMaterial,
                                 Scores &scores)
 {
-   if (oppMaterial.kingOnly()) {
-      // code for some special-case endgames, pawn or piece vs bare King
-      const ColorType oside = OppositeColor(side);
-      if (ourMaterial.infobits() == Material::KBN) {
-         // KBNK endgame, special case.
-         Square oppkp = board.kingSquare(oside);
-         Bitboard bishops(board.bishop_bits[side]);
-         Square sq = bishops.firstOne();
-
-         // try to force king to a corner where mate is possible.
-         if (SquareColor(sq) == Black) {
-            scores.end += KBNKScores[Flip[oppkp]];
-         }
-         else {
-            scores.end += KBNKScores[oppkp];
-         }
+   const int endgame = endgameType(ourMaterial,oppMaterial);
+   if (endgame == NoEndgame) {
+      return 0;
+   }
+   endgameEvaluators[side][endgame](board,scores);
+   return 1;
+}
 
-         // keep the kings close
-         scores.end += kingDistanceScore(board);
-         return 1;
-      } else if (ourMaterial.infobits() == Material::KR) {
-         // keep the kings close
-         scores.end += kingDistanceScore(board);
-         Square oppkp = board.kingSquare(oside);
-         // drive opposing king to the edge
-         scores.end -= KRScores[oppkp];
-         Square rookSq = board.rook_bits[side].firstOne();
-         int krank = Rank(oppkp,White);
-         int rrank = Rank(rookSq,White);
-         // Place the Rook so as to restrict the opposing King
-         if (krank >= 4) {
-             if (rrank == krank - 1) scores.end += Params::PAWN_VALUE*(8+(4-krank))/128;
-         } else {
-             if (rrank == krank + 1) scores.end += Params::PAWN_VALUE*(8+(krank-4))/128;
-         }
-         int kfile = File(oppkp);
-         int rfile = File(rookSq);
-         if (kfile >= 4) {
-             if (rfile == kfile-1) scores.end += Params::PAWN_VALUE*(8+(4-kfile))/128;
-         } else {
-             if (rfile == kfile+1) scores.end += Params::PAWN_VALUE*(8+(kfile-4))/128;
-         }
-         return 1;
-      } else if (ourMaterial.infobits() == Material::KQ) {
-         // keep the kings close
-         scores.end += kingDistanceScore(board);
-         Square oppkp = board.kingSquare(oside);
-         Square ourkp = board.kingSquare(side);
-         int krank = Rank(oppkp,White);
-         int kfile = File(oppkp);
-         if (InCorner(oppkp)) {
-            const int kingDistance = distance(board.kingSquare(White), board.kingSquare(Black));
-            if (kingDistance == 2) {
-               scores.end += Params::PAWN_VALUE/10;
-            }
-         } else if (OnEdge(oppkp)) {
-             // position King appropriately
-             if (kfile == chess::AFILE) {
-                 if (Attacks::king_attacks[ourkp].isSet(oppkp + 1)) scores.end += Params::PAWN_VALUE/10;
-             } else if (kfile == chess::HFILE) {
-                 if (Attacks::king_attacks[ourkp].isSet(oppkp - 1)) scores.end += Params::PAWN_VALUE/10;
-             } else if (krank == 1) {
-                 if (Attacks::king_attacks[ourkp].isSet(oppkp+8)) scores.end += Params::PAWN_VALUE/10;
-             } else if (krank == 8) {
-                 if (Attacks::king_attacks[ourkp].isSet(oppkp-8)) scores.end += Params::PAWN_VALUE/10;
-             }
-         }
-         // drive opposing king to the edge
-         scores.end -= KRScores[oppkp];
-         return 1;
-      }
+// instantiate for the tuner (evalu8 uses the material table instead)
+template int Scoring::specialCaseEndgame<White>(const Board &, const Material &, const Material &, Scores &);
+template int Scoring::specialCaseEndgame<Black>(const Board &, const Material &, const Material &, Scores &);
+
+template <ColorType side>
+void Scoring::scoreKBNK(const Board &board, Scores &scores)
+{
+   // KBNK endgame, special case.
+   const ColorType oside = OppositeColor(side);
+   Square oppkp = board.kingSquare(oside);
+   Bitboard bishops(board.bishop_bits[side]);
+   Square sq = bishops.firstOne();
+
+   // try to force king to a corner where mate is possible.
+   if (SquareColor(sq) == Black) {
+      scores.end += KBNKScores[Flip[oppkp]];
+   }
+   else {
+      scores.end += KBNKScores[oppkp];
+   }
+
+   // keep the kings close
+   scores.end += kingDistanceScore(board);
+}
+
+template <ColorType side>
+void Scoring::scoreKRK(const Board &board, Scores &scores)
+{
+   const ColorType oside = OppositeColor(side);
+   // keep the kings close
+   scores.end += kingDistanceScore(board);
+   Square oppkp = board.kingSquare(oside);
+   // drive opposing king to the edge
+   scores.end -= KRScores[oppkp];
+   Square rookSq = board.rook_bits[side].firstOne();
+   int krank = Rank(oppkp,White);
+   int rrank = Rank(rookSq,White);
+   // Place the Rook so as to restrict the opposing King
+   if (krank >= 4) {
+       if (rrank == krank - 1) scores.end += Params::PAWN_VALUE*(8+(4-krank))/128;
+   } else {
+       if (rrank == krank + 1) scores.end += Params::PAWN_VALUE*(8+(krank-4))/128;
+   }
+   int kfile = File(oppkp);
+   int rfile = File(rookSq);
+   if (kfile >= 4) {
+       if (rfile == kfile-1) scores.end += Params::PAWN_VALUE*(8+(4-kfile))/128;
+   } else {
+       if (rfile == kfile+1) scores.end += Params::PAWN_VALUE*(8+(kfile-4))/128;
    }
-   return 0;
 }
 
+template <ColorType side>
+void Scoring::scoreKQK(const Board &board, Scores &scores)
+{
+   const ColorType oside = OppositeColor(side);
+   // keep the kings close
+   scores.end += kingDistanceScore(board);
+   Square oppkp = board.kingSquare(oside);
+   Square ourkp = board.kingSquare(side);
+   int krank = Rank(oppkp,White);
+   int kfile = File(oppkp);
+   if (InCorner(oppkp)) {
+      const int kingDistance = distance(board.kingSquare(White), board.kingSquare(Black));
+      if (kingDistance == 2) {
+         scores.end += Params::PAWN_VALUE/10;
+      }
+   } else if (OnEdge(oppkp)) {
+       // position King appropriately
+       if (kfile == chess::AFILE) {
+           if (Attacks::king_attacks[ourkp].isSet(oppkp + 1)) scores.end += Params::PAWN_VALUE/10;
+       } else if (kfile == chess::HFILE) {
+           if (Attacks::king_attacks[ourkp].isSet(oppkp - 1)) scores.end += Params::PAWN_VALUE/10;
+       } else if (krank == 1) {
+           if (Attacks::king_attacks[ourkp].isSet(oppkp+8)) scores.end += Params::PAWN_VALUE/10;
+       } else if (krank == 8) {
+           if (Attacks::king_attacks[ourkp].isSet(oppkp-8)) scores.end += Params::PAWN_VALUE/10;
+       }
+   }
+   // drive opposing king to the edge
+   scores.end -= KRScores[oppkp];
+}
+
+const Scoring::EndgameEvaluator Scoring::endgameEvaluators[2][4] =
+{
+   {NULL, scoreKBNK<White>, scoreKRK<White>, scoreKQK<White>},
+   {NULL, scoreKBNK<Black>, scoreKRK<Black>, scoreKQK<Black>}
+};
+
 void Scoring::calcKingEndgamePosition(const Board &board, ColorType side,                                            const PawnHashEntry::PawnData &ourPawnData,
                                       const PawnHashEntry::PawnData &oppPawnData,
                                       KingPawnHashEntry &entry)
@@ -2248,7 +2475,7 @@ void Scoring::scoreEndgame(const Board &board,score_t k_pos,Scores &scores) {
 
 Scoring::PawnHashEntry & Scoring::pawnEntry (const Board &board, bool useCache) {
    hash_t pawnHash = board.pawnHashCodeW ^ board.pawnHashCodeB;
-   PawnHashEntry &pawnEntry = pawnHashTable[pawnHash % PAWN_HASH_SIZE];
+   PawnHashEntry &pawnEntry = pawnHashTable[pawnHash & (pawnHashSize-1)];
    if (!useCache || pawnEntry.hc != pawnHash) {
       calcPawnEntry(board, pawnEntry);
    }
@@ -2262,7 +2489,7 @@ Scoring::KingPawnHashEntry &Scoring::getKPEntry(const Board &board,
 bool useCache)
 {
    hash_t kphash = BoardHash::kingPawnHash(board,side);
-   KingPawnHashEntry &entry = kingPawnHashTable[side][kphash % KING_PAWN_HASH_SIZE];
+   KingPawnHashEntry &entry = kingPawnHashTable[side][kphash & (kingPawnHashSize-1)];
    int mLevel = board.getMaterial(OppositeColor(side)).materialLevel();
    bool needCover = mLevel >= PARAM(MIDGAME_THRESHOLD);
    bool needEndgame = mLevel <= PARAM(ENDGAME_THRESHOLD);
@@ -2310,7 +2537,7 @@ bool useCache)
 
 
 template<ColorType side>
-void Scoring::positionalScore(const Board &board, const PawnHashEntry &pawnEntry, score_t ownCover, score_t oppCover, Scores &scores, Scores &oppScores) {
+void Scoring::positionalScore(const Board &board, const AttackMap *attacks, const PawnHashEntry &pawnEntry, score_t ownCover, score_t oppCover, Scores &scores, Scores &oppScores) {
    const ColorType oside = OppositeColor(side);
 
 #ifdef EVAL_DEBUG
@@ -2348,7 +2575,7 @@ void Scoring::positionalScore(const Board &board, const PawnHashEntry &pawnEntry
    // add penalty for damaged king cover
    scores.mid += ownCover;
 
-   pieceScore<side> (board, pawnEntry.pawnData(side),
+   pieceScore<side> (board, attacks, pawnEntry.pawnData(side),
                      pawnEntry.pawnData(oside), oppCover, scores, oppScores,
                      board.getMaterial(side).materialLevel() <= PARAM(ENDGAME_THRESHOLD),
                      board.getMaterial(side).materialLevel() <= PARAM(MIDGAME_THRESHOLD));
@@ -2391,7 +2618,23 @@ int Scoring::KBPDraw(const Board &board) {
    return 0;
 }
 
+int Scoring::materialDraw(const Board &board) {
+    const int flags = materialInfo(board).flags;
+    if (flags & MaterialInfo::MATERIAL_DRAW) {
+        return 1;
+    }
+    // KB vs KB: depends on the bishop colors
+    return (flags & MaterialInfo::MATERIAL_DRAW_CHECK) ? board.materialDraw() : 0;
+}
+
 int Scoring::theoreticalDraw(const Board &board) {
+    const int flags = materialInfo(board).flags;
+    if (flags & MaterialInfo::THEORETICAL_DRAW) {
+        return 1;
+    }
+    else if (!(flags & MaterialInfo::THEORETICAL_DRAW_CHECK)) {
+        return 0;
+    }
     if (board.getMaterial(White).value() >
         board.getMaterial(Black).value())
         return theoreticalDraw<White>(board);
@@ -2440,23 +2683,23 @@ int Scoring::repetitionDraw(const Board &board) {
 }
 
 int Scoring::isLegalDraw(const Board &board) {
-   return repetitionDraw(board) || board.materialDraw();
+   return repetitionDraw(board) || materialDraw(board);
 }
 
 int Scoring::isDraw(const Board &board) {
-   return(repetitionDraw(board) || board.materialDraw() || theoreticalDraw(board));
+   return(repetitionDraw(board) || materialDraw(board) || theoreticalDraw(board));
 }
 
 int Scoring::isDraw(const Board &board, int &rep_count, int ply) {
 
    // First check for draw by repetition
-   int entries = board.state.moveCount - 2;
+   int entries = board.repListEntries() - 2;
    rep_count = 0;
 
    // follow rule Crafty uses: 2 repeats if ply<=2, 1 otherwise:
    if (entries >= 0) {
       const int target = (ply <= 2) ? 2 : 1;
-      for(hash_t * rep_list = board.repListHead - 3; entries >= 0; rep_list -= 2, entries -= 2) {
+      for(const hash_t * rep_list = board.repListEnd() - 2; entries >= 0; rep_list -= 2, entries -= 2) {
          if (*rep_list == board.hashCode()) {
             rep_count++;
             if (rep_count >= target) {
@@ -2553,10 +2796,10 @@ score_t Scoring::tryBitbase(const Board &board) {
 }
 
 void Scoring::clearHashTables() {
-   for (int i = 0; i < PAWN_HASH_SIZE; i++) {
+   for (unsigned i = 0; i < pawnHashSize; i++) {
       pawnHashTable[i].hc = (hash_t)0xababababababababULL;
    }
-   for (int i = 0; i < KING_PAWN_HASH_SIZE; i++) {
+   for (unsigned i = 0; i < kingPawnHashSize; i++) {
       kingPawnHashTable[White][i].hc = (hash_t)0;
       kingPawnHashTable[Black][i].hc = (hash_t)0;
    }
@@ -6,6 +6,7 @@
 #include "board.h"
 #include "hash.h"
 #include "attacks.h"
+#include "attackmap.h"
 #include "params.h"
 
 #include <iostream>
@@ -26,10 +27,18 @@ class Scoring
     Scoring();
 
     ~Scoring();
+
+    Scoring(const Scoring &) = delete;
+
+    Scoring &operator = (const Scoring &) = delete;
         
     // evaluate "board" from the perspective of the side to move.
     score_t evalu8( const Board &board, bool useCache = true );
 
+    // evaluate "board", using and updating the cached attack
+    // information in "attacks".
+    score_t evalu8( const Board &board, AttackMap &attacks, bool useCache = true );
+
     // checks for legal draws plus certain other theoretically
     // draw positions
     static int isDraw(const Board &board);
@@ -40,9 +49,9 @@ class Scoring
 
     static int repetitionDraw( const Board &board );
 
-    static int materialDraw( const Board &board ) {
-        return board.materialDraw();
-    }
+    // checks for insufficient material (same result as
+    // Board::materialDraw)
+    static int materialDraw( const Board &board );
 
     // Check only for legal draws
     static int isLegalDraw(const Board &board);
@@ -69,6 +78,40 @@ class Scoring
     // return a material score
     score_t materialScore( const Board &board ) const;
 
+    // Evaluation data that depends only on the material of both
+    // sides. It is precomputed for every combination of material
+    // that Material::key() covers.
+    struct MaterialInfo {
+      static const int KBP_ADJUST_WHITE=1; // KBP draw adjustment may apply
+      static const int KBP_ADJUST_BLACK=2;
+      static const int MATERIAL_DRAW=4; // draw by insufficient material
+      static const int MATERIAL_DRAW_CHECK=8; // drawn if same-color bishops
+      static const int THEORETICAL_DRAW=16;
+      static const int THEORETICAL_DRAW_CHECK=32; // depends on position
+#ifdef TUNE
+      score_t adjust;
+#else
+      int16_t adjust; // material imbalance adjustment, from White's view
+#endif
+      uint8_t flags;
+      uint8_t endgames; // special-case endgame types (White in low 4 bits)
+
+      int endgame(ColorType side) const {
+        return (endgames >> (4*side)) & 0xf;
+      }
+    };
+
+    // Look up the material information for a position.
+    static MaterialInfo materialInfo(const Board &board) {
+      return materialInfo(board.getMaterial(White),board.getMaterial(Black));
+    }
+
+    static MaterialInfo materialInfo(const Material &white, const Material &black);
+
+    // Compute the material information directly (without the table).
+    static void calcMaterialInfo(const Material &white, const Material &black,
+                                 MaterialInfo &info);
+
     score_t outpost(const Board &board, Square sq, ColorType side) const;
 
     int outpost_defenders(const Board &board,
@@ -93,12 +136,32 @@ class Scoring
 
     typedef PawnDetail PawnDetails[8];
 
+    // Default number of entries in the pawn and king/pawn hash
+    // tables. Sizes must be powers of 2.
 #ifdef TUNE
-    static const int PAWN_HASH_SIZE = 8096;
+    static const unsigned PAWN_HASH_SIZE = 8192;
 #else
-    static const int PAWN_HASH_SIZE = 16384;
+    static const unsigned PAWN_HASH_SIZE = 16384;
 #endif
-    static const int KING_PAWN_HASH_SIZE = 8132;
+    static const unsigned KING_PAWN_HASH_SIZE = 8192;
+
+    // Set the number of entries in the pawn and king/pawn hash tables
+    // of instances created after this call, or that call
+    // resizeHashTables.
+    static void setHashSizes(unsigned pawnEntries, unsigned kingPawnEntries);
+
+    // Memory used by the pawn and king/pawn hash tables of one
+    // instance, with the given sizes.
+    static size_t hashTableBytes(unsigned pawnEntries, unsigned kingPawnEntries);
+
+    // Memory used by the hash tables of a new instance.
+    static size_t hashTableBytes() {
+       return hashTableBytes(pawnHashEntries,kingPawnHashEntries);
+    }
+
+    // Reallocate and clear the hash tables, if their size differs
+    // from that set by setHashSizes.
+    void resizeHashTables();
 
     static CACHE_ALIGN Bitboard kingProximity[2][64];
     static CACHE_ALIGN Bitboard kingNearProximity[64];
@@ -132,7 +195,7 @@ class Scoring
        const PawnData &pawnData(ColorType side) const {
 	 return (side==White) ? wPawnData : bPawnData;
        }
-    } pawnHashTable[PAWN_HASH_SIZE];
+    };
 
     struct KingPawnHashEntry {
        hash_t hc;
@@ -148,8 +211,6 @@ class Scoring
 #endif
     };
 
-    KingPawnHashEntry kingPawnHashTable[2][KING_PAWN_HASH_SIZE];
-
     PawnHashEntry &pawnEntry(const Board &board, bool useCache);
 
     template <ColorType side>
@@ -199,10 +260,52 @@ class Scoring
                              const Material &oppMaterial,
                              Scores &);
 
+    // Special-case endgame types (piece(s) vs. bare King)
+    enum {NoEndgame, KBNKEndgame, KRKEndgame, KQKEndgame};
+
+    static int endgameType(const Material &ourMaterial,
+                           const Material &oppMaterial);
+
  private:
 
+    PawnHashEntry *pawnHashTable;
+    KingPawnHashEntry *kingPawnHashTable[2];
+    unsigned pawnHashSize, kingPawnHashSize;
+
+    // sizes for new tables
+    static unsigned pawnHashEntries, kingPawnHashEntries;
+
+    void allocHashTables();
+
+    void freeHashTables();
+
+    // Common code for evalu8. Without an attack map ("attacks" null),
+    // attacks are computed from the board as they are needed.
+    score_t evaluate(const Board &board, AttackMap *attacks, bool useCache);
+
+    typedef void (*EndgameEvaluator)(const Board &, Scores &);
+
+    // evaluators for each side, indexed by endgame type
+    static const EndgameEvaluator endgameEvaluators[2][4];
+
+    static MaterialInfo materialTable[Material::KeyRange*Material::KeyRange];
+
+    static void initMaterialTable();
+
+    score_t materialScore(const Board &board, const MaterialInfo &info) const;
+
+    template <ColorType side>
+      static void scoreKBNK(const Board &, Scores &);
+
+    template <ColorType side>
+      static void scoreKRK(const Board &, Scores &);
+
+    template <ColorType side>
+      static void scoreKQK(const Board &, Scores &);
+
     template <ColorType side>
      void  positionalScore( const Board &board,
+                            const AttackMap *attacks,
                             const PawnHashEntry &pawnEntry,
                             score_t ownCover, score_t oppCover,
                             Scores &scores,
@@ -211,15 +314,21 @@ class Scoring
     template <ColorType side>
         static int theoreticalDraw(const Board &board);
 
-    score_t adjustMaterialScore(const Board &board, ColorType side) const;
+    // Material adjustment for "side". Sets kbpCheck if a KBP draw
+    // (which depends on the position) would lower the score.
+    static score_t adjustMaterialScore(const Material &ourmat,
+                                       const Material &oppmat,
+                                       ColorType side, bool &kbpCheck);
 
-    score_t adjustMaterialScoreNoPawns(const Board &board, ColorType side) const;
+    static score_t adjustMaterialScoreNoPawns(const Material &ourmat,
+                                              const Material &oppmat);
 
     template <ColorType bishopColor>
       void scoreBishopAndPawns(const Board &board,ColorType ourSide,const PawnHashEntry::PawnData &ourPawnData,const PawnHashEntry::PawnData &oppPawnData,Scores &scores,Scores &opp_scores);
 
    template <ColorType side>
     void pieceScore(const Board &board,
+                    const AttackMap *attacks,
                     const PawnHashEntry::PawnData &ourPawnData,
 		    const PawnHashEntry::PawnData &oppPawnData,
                     score_t cover, Scores &, Scores &opp_scores,
@@ -260,7 +369,7 @@ class Scoring
     template <ColorType side>
       void scoreEndgame(const Board &,score_t k_pos,Scores &);
 
-    score_t kingDistanceScore(const Board &) const;
+    static score_t kingDistanceScore(const Board &);
 
     template<ColorType side>
       static int KBPDraw(const Board &board);
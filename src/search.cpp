@@ -5,7 +5,11 @@
 #include "notation.h"
 #include "movegen.h"
 #include "hash.h"
+#include "memusage.h"
 #include "see.h"
+#include "output.h"
+#include "trace.h"
+#include "rbitbase.h"
 #ifdef GAVIOTA_TBS
 #include "gtb.h"
 #endif
@@ -105,7 +109,17 @@ static const int NODE_ACCUM_THRESHOLD = 16;
 static const int SAMPLE_INTERVAL = 10000/NODE_ACCUM_THRESHOLD;
 #endif
 
-static int Time_Check_Interval;
+// Count an event in this thread's detailed statistics, if enabled.
+#define SEARCH_COUNT(x) do { if (srcOpts.search_stats) ++counters.x; } while (0)
+
+// Interval (in units of NODE_ACCUM_THRESHOLD nodes) at which the search
+// updates elapsed time and other statistics. Time limits and stop
+// requests are enforced by the timer thread, not by this check.
+static const int Time_Check_Interval = 4096/NODE_ACCUM_THRESHOLD;
+
+// Maximum time the timer thread sleeps before re-checking the time
+// limit (milliseconds).
+static const uint64_t TIMER_INTERVAL = 100;
 
 static const int Illegal = Constants::INVALID_SCORE;
 static const int PRUNE = -Constants::MATE;
@@ -120,6 +134,21 @@ static void setCheckStatus(Board &board, CheckStatusType s)
    }
 }
 
+#if defined(GAVIOTA_TBS) || defined(NALIMOV_TBS) || defined(SYZYGY_TBS)
+// Key for the tablebase result cache. Besides the position, the
+// result depends on the type of tablebase and, for Syzygy, on the
+// 50-move counter and whether the 50-move rule is applied.
+static hash_t tbCacheKey(const Board &board, const Options::SearchOptions &opts) {
+    hash_t salt = (hash_t)opts.tablebase_type;
+#ifdef SYZYGY_TBS
+    if (opts.tablebase_type == Options::TbType::SyzygyTb) {
+        salt += 8*(board.state.moveCount + 1024*(opts.syzygy_50_move_rule != 0));
+    }
+#endif
+    return board.hashCode() ^ (salt*0x9E3779B97F4A7C15ULL);
+}
+#endif
+
 static int FORCEINLINE passedPawnPush(const Board &board, Move move) {
     return (PieceMoved(move) == Pawn &&
             Rank(DestSquare(move),board.sideToMove()) == 7);
@@ -147,12 +176,18 @@ SearchController::SearchController()
     talkLevel(Silent),
     stopped(false),
     contempt(0),
-    active(false) {
+    active(false),
+    timerActive(false),
+    timerBusy(false),
+    timerExit(false),
+    budgetedBitbaseBytes(0) {
 
 #ifdef SMP_STATS
     sample_counter = SAMPLE_INTERVAL;
 #endif
     LockInit(split_calc_lock);
+    // before the pool creates Search instances
+    setTableSizes();
     pool = new ThreadPool(this,options.search.ncpus);
     ThreadInfo *ti = pool->mainThread();
     ti->state = ThreadInfo::Working;
@@ -184,10 +219,18 @@ SearchController::SearchController()
       }
     }
 */
-    hashTable.initHash((size_t)(options.search.hash_table_size));
+    budgetedBitbaseBytes = MemoryUsage::get(MemoryUsage::Bitbases);
+    hashTable.initHash(hashTableSize());
+    timerThread = std::thread(&SearchController::timerLoop,this);
 }
 
 SearchController::~SearchController() {
+   {
+      std::lock_guard<std::mutex> lock(timerLock);
+      timerExit = true;
+   }
+   timerCv.notify_all();
+   timerThread.join();
    delete pool;
    hashTable.freeHash();
    LockFree(split_calc_lock);
@@ -255,17 +298,24 @@ Move SearchController::findBestMove(
     if (mat < 16) threadSplitDepth += DEPTH_INCREMENT/2;
     if (mat < 12) threadSplitDepth += DEPTH_INCREMENT;
 
-    Time_Check_Interval = 4096/NODE_ACCUM_THRESHOLD;
-    // reduce time check interval if time limit is very short (<1 sec)
-    if (srcType == TimeLimit) {
-       if (time_limit < 100) {
-          Time_Check_Interval = 1024/NODE_ACCUM_THRESHOLD;
-       } else if (time_limit < 1000) {
-          Time_Check_Interval = 2048/NODE_ACCUM_THRESHOLD;
-       }
-    }
     computerSide = board.sideToMove();
 
+    if (options.search.memory_budget && !RuntimeBitbases::building() &&
+        budgetedBitbaseBytes != MemoryUsage::get(MemoryUsage::Bitbases)) {
+       // The bitbases have been built since the budget was applied,
+       // so shrink the other tables to fit.
+       applyMemoryBudget();
+    }
+
+#ifdef SYZYGY_TBS
+    // start reading in the tables the search may soon need
+    if (options.search.use_tablebases &&
+        options.search.tablebase_type == Options::TbType::SyzygyTb) {
+       tbPrefetcher.update(board,options.search.syzygy_path,EGTBMenCount,
+                           options.search.syzygy_lock_tables != 0);
+    }
+#endif
+
 #ifdef NUMA
     if (pool->rebindMask.test(0)) {
        // rebind main thread
@@ -278,6 +328,10 @@ Move SearchController::findBestMove(
     pool->forEachSearch<&Search::setVariablesFromController>();
 
     stats->clear();
+    pool->forEachSearch<&Search::clearCounters>();
+#ifdef LOCK_STATS
+    LockStats::clear();
+#endif
 
     // Positions are stored in the hashtable with an "age" to identify
     // which search they came from. "Newer" positions can replace
@@ -291,7 +345,133 @@ Move SearchController::findBestMove(
     NodeStack rootStack;
     rootSearch->init(board,rootStack);
     startTime = last_time = getCurrentTime();
-    return rootSearch->ply0_search(exclude,include);
+    startTimer();
+    Move result = rootSearch->ply0_search(exclude,include);
+    stopTimer();
+    return result;
+}
+
+void SearchController::setTimeLimit(uint64_t limit,uint64_t xtra) {
+    {
+       std::lock_guard<std::mutex> lock(timerLock);
+       typeOfSearch = TimeLimit;
+       time_limit = time_target = limit;
+       xtra_time = xtra;
+    }
+    timerCv.notify_all();
+}
+
+void SearchController::stop() {
+    {
+       std::lock_guard<std::mutex> lock(timerLock);
+       stopped = true;
+    }
+    timerCv.notify_all();
+}
+
+void SearchController::notifyTimer() {
+    // Lock to ensure the timer is not between reading the limit
+    // and waiting, so the wakeup is not lost.
+    { std::lock_guard<std::mutex> lock(timerLock); }
+    timerCv.notify_all();
+}
+
+void SearchController::startTimer() {
+    {
+       std::lock_guard<std::mutex> lock(timerLock);
+       timerActive = true;
+    }
+    timerCv.notify_all();
+}
+
+void SearchController::stopTimer() {
+    std::unique_lock<std::mutex> lock(timerLock);
+    timerActive = false;
+    timerCv.notify_all();
+    // wait until the timer is done with this search (it may be
+    // terminating it), so it cannot act on the next one
+    timerCv.wait(lock,[this]{ return !timerBusy; });
+}
+
+void SearchController::timerLoop() {
+    std::unique_lock<std::mutex> lock(timerLock);
+    for (;;) {
+       // wait for the next search
+       timerCv.wait(lock,[this]{ return timerActive || timerExit; });
+       if (timerExit) break;
+       timerBusy = true;
+       bool terminate = false, timeout = false;
+       while (timerActive) {
+          if (stopped) {
+             terminate = true;
+             break;
+          }
+          uint64_t wait = TIMER_INTERVAL;
+          if (typeOfSearch != FixedDepth) {
+             const uint64_t elapsed = getElapsedTime(startTime,getCurrentTime());
+             if (timeUp(elapsed)) {
+                terminate = timeout = true;
+                break;
+             }
+             const uint64_t limit = (typeOfSearch == FixedTime) ?
+                time_target.load() : getTimeLimit();
+             if (limit > elapsed) {
+                wait = std::min<uint64_t>(wait,limit-elapsed);
+             }
+             // TimeLimit searches stop once the limit is exceeded
+             wait = std::max<uint64_t>(wait,1);
+          }
+          timerCv.wait_for(lock,std::chrono::milliseconds(wait));
+       }
+       if (terminate) {
+          // Stopping the search threads does not need the lock, and
+          // they may be waiting for it.
+          lock.unlock();
+          if (timeout && talkLevel == Trace) {
+             cout << "# terminating, time up" << endl;
+          }
+          terminateNow();
+          lock.lock();
+          // nothing more to do until the search ends
+          timerCv.wait(lock,[this]{ return !timerActive; });
+       }
+       timerBusy = false;
+       timerCv.notify_all();
+    }
+}
+
+int SearchController::timeUp(uint64_t elapsed) {
+    if (typeOfSearch == FixedTime) {
+       return elapsed >= time_target;
+    }
+    else if (typeOfSearch == TimeLimit) {
+       if (xtra_time > 0 &&
+           time_target != INFINITE_TIME &&
+           elapsed > getTimeLimit()) {
+          if (rootSearch->fail_high_root) {
+             // root move is failing high, extend time
+             // until fail-high is resolved.
+             time_added = xtra_time;
+             if (talkLevel == Trace) {
+                cout << "# adding time due to root fail high, new target=" << getTimeLimit() << endl;
+             }
+             // Set flag that we extended time.
+             rootSearch->fail_high_root_extend = true;
+          }
+          else if (stats->faillow) {
+             // root move is failing low, extend time until
+             // fail-low is resolved
+             time_added = xtra_time;
+             rootSearch->fail_low_root_extend = true;
+             if (talkLevel == Trace) {
+                cout << "# adding time due to root fail low, new target=" << getTimeLimit() << endl;
+             }
+          }
+       }
+       // check time limit after any time extensions have been made
+       return elapsed > getTimeLimit();
+    }
+    return 0;
 }
 
 void SearchController::setContempt(score_t c)
@@ -308,6 +488,14 @@ int SearchController::wasTerminated() const {
 
 void SearchController::setThreadCount(int threads) {
    pool->resize(threads,this);
+   if (options.search.memory_budget) {
+      // the per-thread share of the budget has changed
+      applyMemoryBudget();
+   }
+}
+
+void SearchController::updateSpinCount() {
+   pool->updateSpinCount();
 }
 
 int SearchController::getIterationDepth() const {
@@ -414,7 +602,15 @@ void SearchController::clearHashTables()
 {
     age = 0;
     pool->forEachSearch<&Search::clearHashTables>();
-    hashTable.clearHash();
+    // A table in a hash file or shared memory is meant to outlive a
+    // game or analysis session, so it is not cleared. Learned
+    // positions are loaded into it, as they would be after clearing.
+    if (hashTable.isMapped()) {
+       hashTable.loadLearnInfo();
+    } else {
+       hashTable.clearHash();
+    }
+    tbCache.clear();
 }
 
 void SearchController::stopAllThreads() {
@@ -439,11 +635,12 @@ void SearchController::setTalkLevel(TalkLevel t) {
 
 void SearchController::uciSendInfos(const Board &board, Move move, int move_index, int depth) {
    if (uci) {
-      cout << "info depth " << depth;
-      cout << " currmove ";
-      Notation::image(board,move,Notation::OutputFormat::UCI,cout);
-      cout << " currmovenumber " << move_index;
-      cout << endl << (flush);
+      stringstream s;
+      s << "info depth " << depth;
+      s << " currmove ";
+      Notation::image(board,move,Notation::OutputFormat::UCI,s);
+      s << " currmovenumber " << move_index;
+      outputQueue.write(s.str(),OutputQueue::CurrMove);
 #ifdef UCI_LOG
       ucilog << "info depth " << depth;
       ucilog << " currmove ";
@@ -454,8 +651,107 @@ void SearchController::uciSendInfos(const Board &board, Move move, int move_inde
    }
 }
 
+void SearchController::updateSearchCounters() {
+   SearchCounters &total = stats->counters;
+   total.clear();
+   pool->forEachSearch([&total](Search *s) { total += s->counters; });
+}
+
+#ifdef SMP_STATS
+void SearchController::updateSplitCount() {
+   uint64_t total = 0;
+   pool->forEachSearch([&total](Search *s) {
+      total += s->splitsJoined.load(std::memory_order_relaxed); });
+   stats->splits = total;
+}
+#endif
+
+void SearchController::reportSearchCounters() {
+   updateSearchCounters();
+   stringstream s;
+   s << "{\"depth\":" << stats->depth << ",\"time\":" << stats->elapsed_time <<
+      ",\"nodes\":" << stats->num_nodes << ",\"hashfull\":" <<
+      hashTable.pctFull() << ',';
+   stats->counters.printJSON(s);
+   s << '}';
+   if (options.search.search_stats_file.size()) {
+      ofstream out(options.search.search_stats_file.c_str(),ios::out | ios::app);
+      if (out.good()) {
+         out << s.str() << endl;
+      }
+   }
+   else if (uci) {
+      outputQueue.write("info string " + s.str());
+   }
+}
+
+// Largest power of 2 number of entries of size "entrySize" that fits
+// in "bytes", but at least minEntries and at most maxEntries.
+static unsigned tableEntries(size_t bytes, size_t entrySize,
+                             unsigned minEntries, unsigned maxEntries) {
+   unsigned entries = maxEntries;
+   while (entries > minEntries && entries*entrySize > bytes) {
+      entries /= 2;
+   }
+   return entries;
+}
+
+void SearchController::setTableSizes() {
+   const size_t budget = options.search.memory_budget;
+   if (budget) {
+      const size_t threads = std::max<int>(1,options.search.ncpus);
+      // Each thread's pawn hash gets up to 1/32 of the budget and its
+      // king/pawn hash 1/128, and the tablebase cache up to 1/64.
+      Scoring::setHashSizes(
+         tableEntries(budget/(32*threads),sizeof(Scoring::PawnHashEntry),
+                      256,Scoring::PAWN_HASH_SIZE),
+         tableEntries(budget/(256*threads),sizeof(Scoring::KingPawnHashEntry),
+                      256,Scoring::KING_PAWN_HASH_SIZE));
+      tbCache.resize(tableEntries(budget/64,TbCache::bytes(1),
+                                  1024,TbCache::DEFAULT_SIZE));
+   }
+   else {
+      Scoring::setHashSizes(Scoring::PAWN_HASH_SIZE,Scoring::KING_PAWN_HASH_SIZE);
+      tbCache.resize(TbCache::DEFAULT_SIZE);
+   }
+}
+
+size_t SearchController::hashTableSize() const {
+   const size_t budget = options.search.memory_budget;
+   if (!budget) {
+      return options.search.hash_table_size;
+   }
+   // Memory outside the hash table. Count all threads, including
+   // those that have not created their Search instance yet. Thread
+   // stacks are mostly reserved address space, and are not counted.
+   const size_t perThread = sizeof(Search) + sizeof(SearchContext::CmhMatrix) +
+      Scoring::hashTableBytes();
+   const size_t other = std::max<int>(1,options.search.ncpus)*perThread +
+      MemoryUsage::get(MemoryUsage::TbCache) +
+      MemoryUsage::get(MemoryUsage::Tablebases) +
+      MemoryUsage::get(MemoryUsage::Bitbases) +
+      MemoryUsage::get(MemoryUsage::StaticTables);
+   // leave the hash table at least 1 MB
+   const size_t minSize = 1024*1024;
+   return budget > other + minSize ? budget - other : minSize;
+}
+
+void SearchController::applyMemoryBudget() {
+   setTableSizes();
+   pool->forEachSearch([](Search *s) { s->scoring.resizeHashTables(); });
+   resizeHash(options.search.hash_table_size);
+}
+
 void SearchController::resizeHash(size_t newSize) {
+   if (options.search.memory_budget) {
+      budgetedBitbaseBytes = MemoryUsage::get(MemoryUsage::Bitbases);
+      newSize = hashTableSize();
+   }
+   EventTrace::record(EventTrace::ControllerThread,EventTrace::HashResize,
+                      EventTrace::Begin,(uint32_t)(newSize/(1024*1024)));
    hashTable.resizeHash(newSize);
+   EventTrace::record(EventTrace::ControllerThread,EventTrace::HashResize,
+                      EventTrace::End);
 }
 
 Search::Search(SearchController *c, ThreadInfo *threadInfo)
@@ -469,13 +765,19 @@ Search::Search(SearchController *c, ThreadInfo *threadInfo)
     threadSplitDepth(0),
     computerSide(White),
     contempt(0),
-    talkLevel(c->getTalkLevel()) {
+    talkLevel(c->getTalkLevel()),
+    splitsJoined(0) {
     LockInit(splitLock);
     // Note: context was cleared in its constructor
     setSearchOptions();
+    // scoring and context account for their own memory
+    MemoryUsage::add(MemoryUsage::SearchThreads,
+                     sizeof(*this) - sizeof(scoring) - sizeof(context));
 }
 
 Search::~Search() {
+    MemoryUsage::remove(MemoryUsage::SearchThreads,
+                        sizeof(*this) - sizeof(scoring) - sizeof(context));
     LockFree(splitLock);
 }
 
@@ -496,6 +798,9 @@ int Search::checkTime(const Board &board,int ply) {
         // Lock the stats structure since other threads may try to
         // modify it
         Lock(controller->split_calc_lock);
+#ifdef SMP_STATS
+        controller->updateSplitCount();
+#endif
         uint64_t interval;
         if ((interval=getElapsedTime(stats->last_split_time,current_time)) > 50 &&
             stats->splits-stats->last_split_sample > 0) {
@@ -515,48 +820,13 @@ int Search::checkTime(const Board &board,int ply) {
         }
         Unlock(controller->split_calc_lock);
     }
-    if (controller->typeOfSearch == FixedTime) {
-       if (stats->elapsed_time >= controller->time_target) {
-          return 1;
-       }
-    }
-    else if (controller->typeOfSearch == TimeLimit) {
-       if (controller->xtra_time > 0 &&
-           controller->time_target != INFINITE_TIME &&
-           stats->elapsed_time > controller->getTimeLimit()) {
-          if (root()->fail_high_root) {
-             // root move is failing high, extend time
-             // until fail-high is resolved.
-             controller->time_added = controller->xtra_time;
-             if (talkLevel == Trace) {
-                cout << "# adding time due to root fail high, new target=" << controller->getTimeLimit() << endl;
-             }
-             // Set flag that we extended time.
-             root()->fail_high_root_extend = true;
-          }
-          else if (stats->faillow) {
-             // root move is failing low, extend time until
-             // fail-low is resolved
-             controller->time_added = controller->xtra_time;
-             root()->fail_low_root_extend = true;
-             if (talkLevel == Trace) {
-                cout << "# adding time due to root fail low, new target=" << controller->getTimeLimit() << endl;
-             }
-          }
-       }
-       // check time limit after any time extensions have been made
-       if (stats->elapsed_time > controller->getTimeLimit()) {
-          if (talkLevel == Trace) {
-             cout << "# terminating, time up" << endl;
-          }
-          return 1;
-       }
-    }
     if (controller->uci && getElapsedTime(controller->last_time,current_time) >= 2000) {
-        cout << "info";
-        if (stats->elapsed_time>300) cout << " nps " <<
+        stringstream s;
+        s << "info";
+        if (stats->elapsed_time>300) s << " nps " <<
                 (long)((1000L*stats->num_nodes)/stats->elapsed_time);
-        cout << " nodes " << stats->num_nodes << " hashfull " << controller->hashTable.pctFull() << endl;
+        s << " nodes " << stats->num_nodes << " hashfull " << controller->hashTable.pctFull();
+        outputQueue.write(s.str(),OutputQueue::Status);
         controller->last_time = current_time;
     }
     return 0;
@@ -568,7 +838,10 @@ int failhigh,int complete)
     if (terminate)
         return;
     Statistics *stats = controller->stats;
-    stats->faillow = faillow;
+    {
+       std::lock_guard<std::mutex> lock(controller->timerLock);
+       stats->faillow = faillow;
+    }
     stats->failhigh = failhigh;
     int ply = stats->depth;
     stats->complete = complete;
@@ -607,6 +880,30 @@ int failhigh,int complete)
     }
 }
 
+int Search::upcomingRep(const Board &board, NodeInfo *node, int ply) {
+    // If the side to move can force a repetition, the score is at
+    // least the draw score: raise alpha, and return true if this
+    // causes a cutoff.
+    if (board.state.moveCount < 3) return 0;
+    const score_t draw = drawScore(board);
+    if (node->alpha < draw && board.upcomingRep(ply)) {
+        SEARCH_COUNT(upcoming_reps);
+        if (draw < node->beta) {
+            node->alpha = draw;
+        }
+        else if (board.wasLegal((node-1)->last_move)) {
+#ifdef _TRACE
+            if (master()) {
+                indent(ply); cout << "upcoming repetition: cutoff" << endl;
+            }
+#endif
+            node->alpha = draw;
+            return 1;
+        }
+    }
+    return 0;
+}
+
 score_t Search::drawScore(const Board & board) const {
     score_t score = 0;
 
@@ -703,7 +1000,10 @@ Move RootSearch::ply0_search(const vector<Move> &exclude,
                              const vector<Move> &include)
 {
    easy_adjust = false;
-   fail_high_root_extend = fail_low_root_extend = false;
+   {
+      std::lock_guard<std::mutex> lock(controller->timerLock);
+      fail_high_root_extend = fail_low_root_extend = false;
+   }
    last_score = -Constants::MATE;
    node->best = NullMove;
    if (scoring.isLegalDraw(board) && !controller->uci &&
@@ -819,8 +1119,6 @@ Move RootSearch::ply0_search(const vector<Move> &exclude,
            if (talkLevel == Trace) {
                cout << "# waitTime=" << waitTime << endl;
            }
-           // adjust time check interval since we are lowering nps
-           Time_Check_Interval = std::max<int>(1,Time_Check_Interval / (1+8*int(factor)));
            if (srcOpts.strength <= 95) {
                const double limit = pow(2.1,srcOpts.strength/25.0)-0.25;
                double int_limit;
@@ -858,6 +1156,7 @@ Move RootSearch::ply0_search(const vector<Move> &exclude,
    for (iteration_depth = 1;
         iteration_depth <= controller->ply_limit && !terminate;
         iteration_depth++) {
+      EventTrace::record(ti->index,EventTrace::Iteration,EventTrace::Begin,iteration_depth);
       vector<Move> excluded(exclude);
       controller->stats->multipv_count = 0;
       for (multipv_count=0; multipv_count < srcOpts.multipv && !terminate; multipv_count++) {
@@ -890,7 +1189,10 @@ Move RootSearch::ply0_search(const vector<Move> &exclude,
          bool failHigh = true;
          int fails = 0;
          int faillows = 0;
-         controller->stats->faillow = 0;
+         {
+            std::lock_guard<std::mutex> lock(controller->timerLock);
+            controller->stats->faillow = 0;
+         }
          controller->stats->failhigh = 0;
          while (!terminate && (failLow || failHigh)) {
             failHigh = failLow = false;
@@ -941,15 +1243,6 @@ Move RootSearch::ply0_search(const vector<Move> &exclude,
                controller->terminateNow();
                break;
             }
-            if (stats->elapsed_time > 200) {
-               Time_Check_Interval = int((20L*stats->num_nodes)/(stats->elapsed_time*NODE_ACCUM_THRESHOLD));
-               if ((int)controller->time_limit - (int)stats->elapsed_time < 100) {
-                  Time_Check_Interval /= 2;
-               }
-               if (talkLevel == Trace) {
-                  cout << "# time check interval=" << Time_Check_Interval << " elapsed_time=" << stats->elapsed_time << " target=" << controller->getTimeLimit() << endl;
-               }
-            }
             if (terminate) {
                break;
             }
@@ -1035,6 +1328,11 @@ Move RootSearch::ply0_search(const vector<Move> &exclude,
          // search value should now be in bounds (unless we are terminating)
          if (!terminate) {
             showStatus(board, node->best, 0, 0, 0);
+            if (srcOpts.search_stats) {
+               controller->reportSearchCounters();
+            }
+            // the timer thread sets the extensions, so lock
+            std::unique_lock<std::mutex> lock(controller->timerLock);
             if (fail_low_root_extend) {
                // We extended time to get the fail-low resolved. Now
                // we have a score.
@@ -1055,6 +1353,9 @@ Move RootSearch::ply0_search(const vector<Move> &exclude,
                   cout << "# resetting time_added - fail high is resolved" << endl;
                }
             }
+            lock.unlock();
+            // the time limit may have changed
+            controller->notifyTimer();
          }
 
          if (!MovesEqual(node->best,easyMove)) {
@@ -1102,7 +1403,12 @@ Move RootSearch::ply0_search(const vector<Move> &exclude,
                 if (talkLevel == Trace) {
                    cout << "# easy move, adjusting time lower" << endl;
                 }
-                controller->time_target /= 3;
+                {
+                   // may race with a time limit change (ponderhit)
+                   std::lock_guard<std::mutex> lock(controller->timerLock);
+                   controller->time_target = controller->time_target/3;
+                }
+                controller->notifyTimer();
             }
             if (value <= iteration_depth - Constants::MATE) {
                // We're either checkmated or we certainly will be, so
@@ -1129,6 +1435,7 @@ Move RootSearch::ply0_search(const vector<Move> &exclude,
             }
          }
       }
+      EventTrace::record(ti->index,EventTrace::Iteration,EventTrace::End,iteration_depth);
    }
 
 #ifdef UCI_LOG
@@ -1168,52 +1475,60 @@ Move RootSearch::ply0_search(const vector<Move> &exclude,
          stats->printNPS(cout);
          cout << " nodes/second." << endl;
       }
-#ifdef SEARCH_STATS
-      cout << (stats->num_nodes-stats->num_qnodes) << " regular nodes, " <<
-         stats->num_qnodes << " quiescence nodes." << endl;
-      cout << stats->hash_searches << " searches of hash table, " <<
-         stats->hash_hits << " successful";
-      if (stats->hash_searches != 0)
-         cout << " (" <<
-            (int)((100.0*(float)stats->hash_hits)/((float)stats->hash_searches)) <<
-            " percent).";
-      cout << endl;
-      cout << "hash table is " << setprecision(2) <<
-          1.0F*controller->hashTable.pctFull()/10.0F << "% full." << endl;
-#endif
-#ifdef MOVE_ORDER_STATS
-      cout << "move ordering: ";
-      static const char *labels[] = {"1st","2nd","3rd","4th"};
-      for (int i = 0; i < 4; i++) {
-         cout << setprecision(2) << labels[i] << " " <<
-            (100.0*stats->move_order[i])/(float)stats->move_order_count << "% " ;
+      if (srcOpts.search_stats) {
+         controller->updateSearchCounters();
+         const SearchCounters &c = stats->counters;
+         cout << c.reg_nodes << " regular nodes, " <<
+            c.num_qnodes << " quiescence nodes." << endl;
+         cout << c.hash_searches << " searches of hash table, " <<
+            c.hash_hits << " successful";
+         if (c.hash_searches != 0)
+            cout << " (" <<
+               (int)((100.0*(float)c.hash_hits)/((float)c.hash_searches)) <<
+               " percent).";
+         cout << endl;
+         cout << "hash table is " << setprecision(2) <<
+             1.0F*controller->hashTable.pctFull()/10.0F << "% full." << endl;
+         cout << "move ordering: ";
+         static const char *labels[] = {"1st","2nd","3rd","4th"};
+         for (int i = 0; i < 4; i++) {
+            cout << setprecision(2) << labels[i] << " " <<
+               (100.0*c.move_order[i])/(float)c.move_order_count << "% " ;
+         }
+         cout << endl;
+         cout << "pre-search pruning: " << endl;
+         cout << ' ' << setprecision(2) << 100.0*c.razored/c.reg_nodes << "% razoring" << endl;
+         cout << ' ' << setprecision(2) << 100.0*c.static_null_pruning/c.reg_nodes << "% static null pruning" << endl;
+         cout << ' ' << setprecision(2) << 100.0*c.null_cuts/c.reg_nodes << "% null cuts" << endl;
+         cout << ' ' << setprecision(2) << 100.0*c.upcoming_reps/(c.reg_nodes+c.num_qnodes) << "% upcoming repetition" << endl;
+         cout << "search pruning: " << endl;
+         cout << ' ' << setprecision(2) << 100.0*c.futility_pruning/c.moves_searched << "% futility" << endl;
+         cout << ' ' << setprecision(2) << 100.0*c.history_pruning/c.moves_searched << "% history" << endl;
+         cout << ' ' << setprecision(2) << 100.0*c.lmp/c.moves_searched << "% lmp" << endl;
+         cout << ' ' << setprecision(2) << 100.0*c.see_pruning/c.moves_searched << "% SEE" << endl;
+         cout << ' ' << setprecision(2) << 100.0*c.reduced/c.moves_searched << "% reduced" << endl;
+         cout << "extensions: " <<
+            100.0*c.check_extensions/c.moves_searched << "% check, " <<
+            100.0*c.evasion_extensions/c.moves_searched << "% evasions, " <<
+            100.0*c.capture_extensions/c.moves_searched << "% capture, " <<
+            100.0*c.pawn_extensions/c.moves_searched << "% pawn, " <<
+            100.0*c.singular_extensions/c.moves_searched << "% singular" << endl;
       }
-      cout << endl;
-#endif
-#ifdef SEARCH_STATS
-      cout << "pre-search pruning: " << endl;
-      cout << ' ' << setprecision(2) << 100.0*stats->razored/stats->reg_nodes << "% razoring" << endl;
-      cout << ' ' << setprecision(2) << 100.0*stats->static_null_pruning/stats->reg_nodes << "% static null pruning" << endl;
-      cout << ' ' << setprecision(2) << 100.0*stats->null_cuts/stats->reg_nodes << "% null cuts" << endl;
-      cout << "search pruning: " << endl;
-      cout << ' ' << setprecision(2) << 100.0*stats->futility_pruning/stats->moves_searched << "% futility" << endl;
-      cout << ' ' << setprecision(2) << 100.0*stats->history_pruning/stats->moves_searched << "% history" << endl;
-      cout << ' ' << setprecision(2) << 100.0*stats->lmp/stats->moves_searched << "% lmp" << endl;
-      cout << ' ' << setprecision(2) << 100.0*stats->see_pruning/stats->moves_searched << "% SEE" << endl;
-      cout << ' ' << setprecision(2) << 100.0*stats->reduced/stats->moves_searched << "% reduced" << endl;
-      cout << "extensions: " <<
-         100.0*stats->check_extensions/stats->moves_searched << "% check, " <<
-         100.0*stats->evasion_extensions/stats->moves_searched << "% evasions, " <<
-         100.0*stats->capture_extensions/stats->moves_searched << "% capture, " <<
-         100.0*stats->pawn_extensions/stats->moves_searched << "% pawn, " <<
-         100.0*stats->singular_extensions/stats->moves_searched << "% singular" << endl;
-
-#endif
       cout << stats->tb_probes << " tablebase probes, " <<
-         stats->tb_hits << " tablebase hits" << endl;
+         stats->tb_hits << " tablebase hits, " <<
+         stats->tb_cache_hits << " tablebase cache hits" << endl;
 #if defined(SMP_STATS)
+      controller->updateSplitCount();
       cout << stats->splits << " splits," <<
          " average thread usage=" << (float)(stats->threads)/(float)stats->samples << endl;
+      if (srcOpts.ncpus > 1 && stats->samples) {
+         cout << "idle time per thread=" <<
+            (int)(100.0*(1.0 - (double)stats->threads/((double)stats->samples*srcOpts.ncpus))) <<
+            "%" << endl;
+      }
+#endif
+#ifdef LOCK_STATS
+      LockStats::report(cout);
 #endif
       cout << (flush);
       cout.flags(original_flags);
@@ -1292,9 +1607,7 @@ score_t RootSearch::ply0_search(RootMoveGenerator &mg, score_t alpha, score_t be
     node->alpha = alpha;
     node->beta = beta;
     node->best_score = node->alpha;
-#ifdef MOVE_ORDER_STATS
     node->best_count = 0;
-#endif
     node->ply = 0;
     node->depth = depth;
     node->eval = Constants::INVALID_SCORE;
@@ -1325,7 +1638,7 @@ score_t RootSearch::ply0_search(RootMoveGenerator &mg, score_t alpha, score_t be
 #endif
         node->last_move = move;
         node->extensions = 0;
-        CheckStatusType in_check_after_move = board.wouldCheck(move);
+        CheckStatusType in_check_after_move = node->attacks.checkInfo(board).wouldCheck(board,move);
         int extend = calcExtensions(board,node,node,in_check_after_move,
                                     move_index,
                                     move);
@@ -1452,14 +1765,12 @@ score_t RootSearch::ply0_search(RootMoveGenerator &mg, score_t alpha, score_t be
         context.updateStats(board, node, node->best, 0,
            board.sideToMove());
     }
-#ifdef MOVE_ORDER_STATS
-    if (node->num_try && node->best_score > node->alpha) {
-        controller->stats->move_order_count++;
+    if (srcOpts.search_stats && node->num_try && node->best_score > node->alpha) {
+        counters.move_order_count++;
         if (node->best_count<4) {
-            controller->stats->move_order[node->best_count]++;
+            counters.move_order[node->best_count]++;
         }
     }
-#endif
     ASSERT(node->best_score >= -Constants::MATE && node->best_score <= Constants::MATE);
     controller->stats->num_nodes += nodeAccumulator;
     nodeAccumulator = 0;
@@ -1540,9 +1851,7 @@ score_t Search::quiesce(int ply,int depth)
       }
    }
    ASSERT(depth<=0);
-#ifdef SEARCH_STATS
-   controller->stats->num_qnodes++;
-#endif
+   SEARCH_COUNT(num_qnodes);
    int rep_count;
    if (terminate) return node->alpha;
    else if (ply >= Constants::MaxPly-1) {
@@ -1550,7 +1859,7 @@ score_t Search::quiesce(int ply,int depth)
          return -Illegal;
       }
       node->flags |= EXACT;
-      return scoring.evalu8(board);
+      return scoring.evalu8(board,node->attacks);
    }
    else if (Scoring::isDraw(board,rep_count,ply)) {
 	  // Verify previous move was legal
@@ -1565,6 +1874,9 @@ score_t Search::quiesce(int ply,int depth)
       node->flags |= EXACT;
       return drawScore(board);
    }
+   else if (upcomingRep(board,node,ply)) {
+      return node->alpha;
+   }
 #ifdef _TRACE
    if (master()) {
       indent(ply); cout << "window [" << node->alpha << ","
@@ -1590,15 +1902,11 @@ score_t Search::quiesce(int ply,int depth)
    // alter the copy
    result = controller->hashTable.searchHash(board,hash,
                                              ply,tt_depth,controller->age,hashEntry);
-#ifdef SEARCH_STATS
-   controller->stats->hash_searches++;
-#endif
+   SEARCH_COUNT(hash_searches);
    bool hashHit = (result != HashEntry::NoHit);
    if (hashHit) {
       // a valid hashtable entry was found
-#ifdef SEARCH_STATS
-      controller->stats->hash_hits++;
-#endif
+      SEARCH_COUNT(hash_hits);
       node->staticEval = hashEntry.staticValue();
       hashValue = hashEntry.getValue();
       // If this is a mate score, adjust it to reflect the
@@ -1688,7 +1996,7 @@ score_t Search::quiesce(int ply,int depth)
          return -Illegal;
       }
       score_t try_score;
-      MoveGenerator mg(board, &context, ply, hashMove, (node-1)->last_move, master());
+      MoveGenerator mg(board, &context, ply, hashMove, (node-1)->last_move, master(), &node->attacks);
       Move move;
       BoardState state = board.state;
       node->num_try = 0;
@@ -1718,7 +2026,7 @@ score_t Search::quiesce(int ply,int depth)
              !Scoring::mateScore(node->beta) &&
              //!IsForced(move) && !IsForced2(move) &&
              !CaptureOrPromotion(move) &&
-             board.wouldCheck(move) == NotInCheck) {
+             node->attacks.checkInfo(board).wouldCheck(board,move) == NotInCheck) {
             // We have searched one or more legal non-capture evasions
             // and failed to cutoff. So don't search any more.
 #ifdef _TRACE
@@ -1792,7 +2100,7 @@ score_t Search::quiesce(int ply,int depth)
           ASSERT(node->eval >= -Constants::MATE && node->eval <= Constants::MATE);
       }
       if (node->eval == Constants::INVALID_SCORE) {
-          node->eval = node->staticEval = scoring.evalu8(board);
+          node->eval = node->staticEval = scoring.evalu8(board,node->attacks);
       }
       if (hashHit) {
           // Use the transposition table entry to provide a better score
@@ -1844,7 +2152,8 @@ score_t Search::quiesce(int ply,int depth)
       score_t try_score;
       BoardState state(board.state);
       const ColorType oside = board.oppositeSide();
-      Bitboard disc(board.getPinned(board.kingSquare(oside),board.sideToMove(),board.sideToMove()));
+      const CheckInfo &checkInfo = node->attacks.checkInfo(board);
+      const Bitboard &disc(checkInfo.discoveredCheckCandidates());
       // Isn't really a loop: but we code this way so can use
       // break to exit the following block.
       while (!IsNull(hashMove) && validMove(board,hashMove)) {
@@ -1866,7 +2175,7 @@ score_t Search::quiesce(int ply,int depth)
             cout << endl;
          }
 #endif
-         if (!board.wouldCheck(hashMove) &&
+         if (!checkInfo.wouldCheck(board,hashMove) &&
              !passedPawnPush(board,hashMove) &&
              node->beta > -Constants::TABLEBASE_WIN &&
              (Capture(hashMove) == Pawn || board.getMaterial(oside).pieceCount() > 1)) {
@@ -1910,7 +2219,8 @@ score_t Search::quiesce(int ply,int depth)
       }
       {
          MoveGenerator mg(board, &context, ply,
-                          NullMove, (node-1)->last_move, master());
+                          NullMove, (node-1)->last_move, master(),
+                          &node->attacks);
          Move *moves = (Move*)node->done;
          // generate all the capture moves
          int move_count = mg.generateCaptures(moves,board.occupied[oside]);
@@ -1936,7 +2246,7 @@ score_t Search::quiesce(int ply,int depth)
             }
 #endif
             // Futility pruning
-            if (!board.wouldCheck(move) &&
+            if (!checkInfo.wouldCheck(board,move) &&
                 !passedPawnPush(board,move) &&
                 node->beta > -Constants::TABLEBASE_WIN &&
                 (Capture(move) == Pawn || board.getMaterial(oside).pieceCount() > 1)) {
@@ -1956,7 +2266,7 @@ score_t Search::quiesce(int ply,int depth)
                 node->beta > -Constants::TABLEBASE_WIN &&
                 !passedPawnPush(board,move) &&
                 !disc.isSet(StartSquare(move)) &&
-                !seeSign(board,move,std::max<score_t>(0,neededGain))) {
+                !mg.seeSign(move,std::max<score_t>(0,neededGain))) {
 #ifdef _TRACE
                if (master()) {
                   indent(ply); cout << "pruned (SEE)" << endl;
@@ -2029,7 +2339,7 @@ score_t Search::quiesce(int ply,int depth)
 #endif
                // prune checks that cause loss of the checking piece (but not
                // discovered checks)
-               if (!disc.isSet(StartSquare(move)) && !seeSign(board,move,0)) {
+               if (!disc.isSet(StartSquare(move)) && !mg.seeSign(move,0)) {
 #ifdef _TRACE
                   if (master()) {
                      indent(ply); cout << "pruned" << endl;
@@ -2169,14 +2479,13 @@ int Search::calcExtensions(const Board &board,
    int extend = 0;
    int pruneOk = board.checkStatus() != InCheck;
    score_t swap = Constants::INVALID_SCORE;
+   const AttackMap *attacks = node->attacks.isValid(board) ? &node->attacks : nullptr;
    if (in_check_after_move == InCheck) { // move is a checking move
       // extend if check does not lose material or is a discovered check
-      if ((swap = seeSign(board,move,0)) ||
-          board.isPinned(board.oppositeSide(),move)) {
+      if ((swap = seeSign(board,move,0,attacks)) ||
+          node->attacks.checkInfo(board).isDiscoveredCheck(move)) {
           node->extensions |= CHECK;
-#ifdef SEARCH_STATS
-          controller->stats->check_extensions++;
-#endif
+          SEARCH_COUNT(check_extensions);
           extend += node->PV() ? PV_CHECK_EXTENSION : NONPV_CHECK_EXTENSION;
       }
       else {
@@ -2187,9 +2496,7 @@ int Search::calcExtensions(const Board &board,
    if (passedPawnPush(board,move)) {
       node->extensions |= PAWN_PUSH;
       extend += PAWN_PUSH_EXTENSION;
-#ifdef SEARCH_STATS
-      controller->stats->pawn_extensions++;
-#endif
+      SEARCH_COUNT(pawn_extensions);
    }
    else if (TypeOfMove(move) == Normal &&
             Capture(move) != Empty && Capture(move) != Pawn &&
@@ -2198,9 +2505,7 @@ int Search::calcExtensions(const Board &board,
       // Capture of last piece in endgame.
       node->extensions |= CAPTURE;
       extend += CAPTURE_EXTENSION;
-#ifdef SEARCH_STATS
-      ++controller->stats->capture_extensions;
-#endif
+      SEARCH_COUNT(capture_extensions);
    }
    if (extend) {
       return std::min<int>(extend,DEPTH_INCREMENT);
@@ -2220,9 +2525,7 @@ int Search::calcExtensions(const Board &board,
            extend = std::max(extend,1-depth);
            if (extend <= -DEPTH_INCREMENT) {
                node->extensions |= LMR;
-#ifdef SEARCH_STATS
-               ++controller->stats->reduced;
-#endif
+               SEARCH_COUNT(reduced);
            } else {
                // do not reduce < 1 ply
                extend = 0;
@@ -2244,9 +2547,7 @@ int Search::calcExtensions(const Board &board,
       if(depth/DEPTH_INCREMENT <= LMP_DEPTH &&
          GetPhase(move) >= MoveGenerator::HISTORY_PHASE &&
          moveIndex >= LMP_MOVE_COUNT[depth/DEPTH_INCREMENT]) {
-#ifdef SEARCH_STATS
-         ++controller->stats->lmp;
-#endif
+         SEARCH_COUNT(lmp);
 #ifdef _TRACE
          indent(node->ply); cout << "LMP: pruned" << endl;
 #endif
@@ -2258,12 +2559,10 @@ int Search::calcExtensions(const Board &board,
          // but this tests worse now.
           score_t threshold = parentNode->beta - futilityMargin(predictedDepth);
          if (node->eval == Constants::INVALID_SCORE) {
-            node->eval = node->staticEval = scoring.evalu8(board);
+            node->eval = node->staticEval = scoring.evalu8(board,node->attacks);
          }
          if (node->eval < threshold) {
-#ifdef SEARCH_STATS
-            controller->stats->futility_pruning++;
-#endif
+            SEARCH_COUNT(futility_pruning);
 #ifdef _TRACE
             indent(node->ply); cout << "futility: pruned" << endl;
 #endif
@@ -2281,11 +2580,9 @@ int Search::calcExtensions(const Board &board,
        if (GetPhase(move) == MoveGenerator::LOSERS_PHASE) {
            swap = 0;
        }
-       if (swap == Constants::INVALID_SCORE) swap = seeSign(board,move,0);
+       if (swap == Constants::INVALID_SCORE) swap = seeSign(board,move,0,attacks);
        if (!swap) {
-#ifdef SEARCH_STATS
-          ++controller->stats->see_pruning;
-#endif
+          SEARCH_COUNT(see_pruning);
           return PRUNE;
        }
    }
@@ -2303,12 +2600,8 @@ score_t Search::search()
     int rep_count;
     int using_tb;
     int move_index = 0;
-#ifdef MOVE_ORDER_STATS
     node->best_count = 0;
-#endif
-#ifdef SEARCH_STATS
-    ++controller->stats->reg_nodes;
-#endif
+    SEARCH_COUNT(reg_nodes);
     int ply = node->ply;
     int depth = node->depth;
     ASSERT(ply < Constants::MaxPly);
@@ -2342,7 +2635,7 @@ score_t Search::search()
           return -Illegal;
        }
        node->flags |= EXACT;
-       return scoring.evalu8(board);
+       return scoring.evalu8(board,node->attacks);
     }
 
     if (Scoring::isDraw(board,rep_count,ply)) {
@@ -2357,6 +2650,9 @@ score_t Search::search()
 #endif
         return drawScore(board);
     }
+    if (upcomingRep(board,node,ply)) {
+        return node->alpha;
+    }
     Move hashMove = NullMove;
     using_tb = 0;
 #if defined(GAVIOTA_TBS) || defined(NALIMOV_TBS) || defined(SYZYGY_TBS)
@@ -2399,15 +2695,11 @@ score_t Search::search()
        // alter the copy
        result = controller->hashTable.searchHash(board,board.hashCode(rep_count),
                                                  ply,depth,controller->age,hashEntry);
-#ifdef SEARCH_STATS
-       controller->stats->hash_searches++;
-#endif
+       SEARCH_COUNT(hash_searches);
        hashHit = result != HashEntry::NoHit;
     }
     if (hashHit) {
-#ifdef SEARCH_STATS
-        controller->stats->hash_hits++;
-#endif
+        SEARCH_COUNT(hash_hits);
          // always accept a full-depth entry (cached tb hit)
          if (!hashEntry.tb()) {
             // if using TBs at this ply, do not pull a non-TB entry out of
@@ -2509,24 +2801,33 @@ score_t Search::search()
     if (using_tb && rep_count==0 && !(node->flags & (IID|VERIFY|SINGULAR|PROBCUT))) {
        int tb_hit = 0;
        controller->stats->tb_probes++;
-       score_t tb_score;
-#ifdef NALIMOV_TBS
-       if (srcOpts.tablebase_type == Options::TbType::NalimovTb) {
-          tb_hit = NalimovTb::probe_tb(board, tb_score, ply);
+       score_t tb_score = Constants::INVALID_SCORE;
+       const hash_t tbKey = tbCacheKey(board,srcOpts);
+       if (controller->tbCache.lookup(tbKey, ply, tb_hit, tb_score)) {
+          controller->stats->tb_cache_hits++;
        }
+       else {
+          EventTrace::record(ti->index,EventTrace::TbProbe,EventTrace::Begin,ply);
+#ifdef NALIMOV_TBS
+          if (srcOpts.tablebase_type == Options::TbType::NalimovTb) {
+             tb_hit = NalimovTb::probe_tb(board, tb_score, ply);
+          }
 #endif
 #ifdef GAVIOTA_TBS
-       if (srcOpts.tablebase_type == Options::TbType::GaviotaTb) {
-          // TBD: use soft probing at lower depths
-          tb_hit = GaviotaTb::probe_tb(board, tb_score, ply, true);
-       }
+          if (srcOpts.tablebase_type == Options::TbType::GaviotaTb) {
+             // TBD: use soft probing at lower depths
+             tb_hit = GaviotaTb::probe_tb(board, tb_score, ply, true);
+          }
 #endif
 #ifdef SYZYGY_TBS
-       if (srcOpts.tablebase_type == Options::TbType::SyzygyTb) {
-          tb_hit = SyzygyTb::probe_wdl(board, tb_score,
-                                       srcOpts.syzygy_50_move_rule != 0);
-       }
+          if (srcOpts.tablebase_type == Options::TbType::SyzygyTb) {
+             tb_hit = SyzygyTb::probe_wdl(board, tb_score,
+                                          srcOpts.syzygy_50_move_rule != 0);
+          }
 #endif
+          EventTrace::record(ti->index,EventTrace::TbProbe,EventTrace::End,ply);
+          controller->tbCache.store(tbKey, ply, tb_hit, tb_score);
+       }
        if (tb_hit) {
             controller->stats->tb_hits++;
 #ifdef _TRACE
@@ -2589,7 +2890,7 @@ score_t Search::search()
           node->eval = node->staticEval = hashEntry.staticValue();
        }
        if (node->eval == Constants::INVALID_SCORE) {
-          node->eval = node->staticEval = scoring.evalu8(board);
+          node->eval = node->staticEval = scoring.evalu8(board,node->attacks);
        }
        if (hashHit) {
           // Use the transposition table entry to provide a better score
@@ -2618,9 +2919,7 @@ score_t Search::search()
 #ifdef _TRACE
           indent(ply); cout << "static null pruned" << endl;
 #endif
-#ifdef SEARCH_STATS
-          ++controller->stats->static_null_pruning;
-#endif
+          SEARCH_COUNT(static_null_pruning);
           node->best_score = node->eval - margin;
           goto hash_insert;
        }
@@ -2641,9 +2940,7 @@ score_t Search::search()
 #ifdef _TRACE
                 indent(ply); cout << "razored node, score=" << v << endl;
 #endif
-#ifdef SEARCH_STATS
-                controller->stats->razored++;
-#endif
+                SEARCH_COUNT(razored);
                 node->best_score = v;
                 goto hash_insert;
             }
@@ -2729,9 +3026,7 @@ score_t Search::search()
                             cout << "**CUTOFF**" << endl;
                         }
 #endif
-#ifdef SEARCH_STATS
-                        controller->stats->null_cuts++;
-#endif
+                        SEARCH_COUNT(null_cuts);
                         // Do not return a mate score from the null move search.
                         node->best_score = nscore >= Constants::MATE-ply ? node->beta :
                             nscore;
@@ -2789,7 +3084,7 @@ score_t Search::search()
     probcut_search:
        {
           Move moves[40];
-          MoveGenerator mg(board, &context, ply, hashMove, (node-1)->last_move, master());
+          MoveGenerator mg(board, &context, ply, hashMove, (node-1)->last_move, master(), &node->attacks);
           // skip pawn captures because they will be below threshold
           int moveCount = mg.generateCaptures(moves,board.occupied[board.oppositeSide()] & ~board.pawn_bits[board.oppositeSide()]);
           for (int i = 0; i<moveCount; i++) {
@@ -2926,7 +3221,8 @@ score_t Search::search()
             !IsNull(hashMove) &&
             std::abs(hashValue) < Constants::MATE_RANGE &&
             result != HashEntry::UpperBound &&
-            calcExtensions(board,node,node,board.wouldCheck(hashMove),
+            calcExtensions(board,node,node,
+                           node->attacks.checkInfo(board).wouldCheck(board,hashMove),
                            0,hashMove) < DEPTH_INCREMENT &&
             validMove(board,hashMove)) {
            // Search all moves but the hash move at reduced depth. If all
@@ -2967,7 +3263,8 @@ score_t Search::search()
            node->pv_length = 0;
         }
 #endif
-        MoveGenerator mg(board, &context, ply, hashMove, (node-1)->last_move, master());
+        MoveGenerator mg(board, &context, ply, hashMove, (node-1)->last_move, master(), &node->attacks);
+        const CheckInfo &checkInfo = node->attacks.checkInfo(board);
         BoardState state = board.state;
         score_t try_score;
         // we do not split if in check because generally there will
@@ -2992,9 +3289,7 @@ score_t Search::search()
 #else
             if (IsUsed(move)) continue;
 #endif
-#ifdef SEARCH_STATS
-            ++controller->stats->moves_searched;
-#endif
+            SEARCH_COUNT(moves_searched);
             if (Capture(move)==King) {
                 return -Illegal;                  // previous move was illegal
             }
@@ -3011,15 +3306,13 @@ score_t Search::search()
             }
 #endif
             node->last_move = move;
-            CheckStatusType in_check_after_move = board.wouldCheck(move);
+            CheckStatusType in_check_after_move = checkInfo.wouldCheck(board,move);
             int extend;
             if (singularExtend &&
                 GetPhase(move) == MoveGenerator::HASH_MOVE_PHASE) {
                extend = DEPTH_INCREMENT;
                node->extensions |= SINGULAR_EXT;
-#ifdef SEARCH_STATS
-               ++controller->stats->singular_extensions;
-#endif
+               SEARCH_COUNT(singular_extensions);
             }
             else {
                extend = calcExtensions(board,node,node,in_check_after_move,
@@ -3246,15 +3539,13 @@ score_t Search::search()
                                         node->best);
     }
     search_end2:
-#ifdef MOVE_ORDER_STATS
-    if (node->num_try && node->best_score != node->alpha) {
-        controller->stats->move_order_count++;
+    if (srcOpts.search_stats && node->num_try && node->best_score != node->alpha) {
+        counters.move_order_count++;
         ASSERT(node->best_count>=0);
         if (node->best_count<4) {
-            controller->stats->move_order[node->best_count]++;
+            counters.move_order[node->best_count]++;
         }
     }
-#endif
     score_t score = node->best_score;
     ASSERT(score >= -Constants::MATE && score <= Constants::MATE);
     return score;
@@ -3267,9 +3558,7 @@ int Search::updateRootMove(const Board &board,
    if (score > parentNode->best_score)  {
       parentNode->best = move;
       parentNode->best_score = score;
-#ifdef MOVE_ORDER_STATS
       parentNode->best_count = node->num_try-1;
-#endif
       if (score >= parentNode->beta) {
 #ifdef _TRACE
          if (master())
@@ -3323,29 +3612,30 @@ void Search::searchSMP(ThreadInfo *ti)
     node->extensions = parentNode->extensions;
     node->eval = parentNode->eval;
     node->staticEval = parentNode->staticEval;
-#ifdef MOVE_ORDER_STATS
     node->best_count = parentNode->best_count;
-#endif
     node->ply = parentNode->ply;
     node->depth = parentNode->depth;
     node->cutoff = 0;
 
     score_t best_score = parentNode->best_score;
-#ifdef _THREAD_TRACE
-    log("searchSMP",ti->index);
-#endif
     MoveGenerator *mg = ti->work->split->mg;
     bool fhr = false;
     ASSERT(split);
     while (!terminate && !split->failHigh) {
-        move = in_check ?
-           mg->nextEvasion(split,moveIndex) :
-           mg->nextMove(split,moveIndex);
+        // the generator's functions are not virtual: the root
+        // generator is a RootMoveGenerator
+        if (ply == 0) {
+           move = ((RootMoveGenerator*)mg)->nextMove(split,moveIndex);
+        }
+        else {
+           move = in_check ?
+              mg->nextEvasion(split,moveIndex) :
+              mg->nextMove(split,moveIndex);
+        }
         if (IsNull(move)) break;
+        split->remaining--;
         if (IsUsed(move)) continue;
-#ifdef SEARCH_STATS
-        ++controller->stats->moves_searched;
-#endif
+        SEARCH_COUNT(moves_searched);
         if (ply == 0) {
             fhr = false;
         }
@@ -3360,7 +3650,7 @@ void Search::searchSMP(ThreadInfo *ti)
 
         node->extensions = 0;
         node->last_move = move;
-        CheckStatusType in_check_after_move = board.wouldCheck(move);
+        CheckStatusType in_check_after_move = node->attacks.checkInfo(board).wouldCheck(board,move);
         int extend = calcExtensions(board,node,parentNode,in_check_after_move,
                                     moveIndex,move);
         if (extend == PRUNE) {
@@ -3467,15 +3757,8 @@ void Search::searchSMP(ThreadInfo *ti)
             // update our window in case parent best score changed
             if (try_score > parentNode->best_score && !split->failHigh) {
                 // search produced a new best move or cutoff, update parent node
-#if defined (_THREAD_TRACE) || defined(_TRACE)
-              stringstream s;
-                s << "new best smp, thread=" << ti->index << " ply= " << ply << '\0';
 #ifdef _TRACE
-                cout << s.str() << endl;
-#endif
-#ifdef _THREAD_TRACE
-                log(s.str());
-#endif
+                cout << "new best smp, thread=" << ti->index << " ply= " << ply << endl;
 #endif
                 if (ply == 0) {
                     node->cutoff |= ((RootSearch*)(split->master->work))->updateRootMove(board,parentNode,node,move,try_score,parentNode->num_try);
@@ -3513,9 +3796,7 @@ int Search::updateMove(const Board &board, NodeInfo *parentNode, NodeInfo *node,
    int cutoff = 0;
    parentNode->best_score = score;
    parentNode->best = move;
-#ifdef MOVE_ORDER_STATS
    parentNode->best_count = parentNode->num_try-1;
-#endif
    if (score >= parentNode->beta) {
 #ifdef _TRACE
       if (master()) {
@@ -3595,179 +3876,99 @@ int Search::maybeSplit(const Board &board, NodeInfo *node,
 {
     // Now that we have searched at least one valid move, we can
     // consider using multiple threads to search the rest (YBWC).
-    int splits = 0;
-    if (!terminate && mg->more() &&
-        activeSplitPoints < SPLIT_STACK_MAX_DEPTH &&
+    // Threads are not assigned here: the split point is published on
+    // our split stack, and idle threads steal work from it.
+    if (terminate || !mg->more() ||
+        activeSplitPoints >= SPLIT_STACK_MAX_DEPTH ||
 #if defined(GAVIOTA_TBS) || defined(NALIMOV_TBS) || defined(SYZYGY_TBS)
-        (!srcOpts.use_tablebases ||
-        board.getMaterial(White).men() +
-        board.getMaterial(Black).men() > EGTBMenCount) &&
-#endif
-        controller->pool->checkAvailable()) {
-
-        ThreadInfo *slave_ti;
-        ThreadInfo *slaves[Constants::MaxCPUs];
-        int remaining = 100;
-        // Keep trying to get/assign threads until no threads are
-        // available or no more moves are available to search.
-        while (remaining>1 && (slave_ti = controller->pool->checkOut(this,node,ply,depth))!=nullptr) {
-            // A thread is available.
-            ASSERT(slave_ti != ti);
-            if (!splits) {
-               // Save the current split point if any (may be NULL)
-               SplitPoint *parent = split;
-               // We are about the change the parent's stack, so lock it
-               Lock(splitLock);
-               // create a split point for this search instance
-               split = &splitStack[activeSplitPoints++];
-#ifdef _THREAD_TRACE
-               ostringstream os;
-               os << "splitting from thread " << ti->index <<
-                   " split stack size now " << activeSplitPoints << '\0';
-               log(os.str());
-#endif
-               // initialize the new split point
-               split->master = ti;
-               split->parent = parent;
-               split->ply = ply;
-               split->depth = depth;
-               split->mg = mg;
-               split->splitNode = node;
-               // save master's current state
-               split->savedBoard = board;
-#ifndef _WIN32
-               // ensure parent thread will wait when back in idle loop
-               ti->reset();
-#endif
-               Unlock(splitLock);
-               // Force all remaining moves to be generated, since the
-               // MoveGenerator class is not thread-safe otherwise (it
-               // maintains a pointer to the board and when accessed by
-               // multiple threads this pointer may not always be at the
-               // current position). Also we want to know how many moves
-               // remain.
-               remaining = mg->generateAllMoves(node,split);
-            }
-            split->lock();
-            ASSERT(slave_ti != ti);
-            // Add new slave to the list of slaves in the parent split point
-            split->slaves.insert(slave_ti);
-            split->unlock();
-            // set new slave Search's "split" variable
-            slave_ti->work->split = split;
-            // Defer further initialization of slave Search until its
-            // thread runs, because we need access to its thread-specific
-            // search stack.
-#ifdef _THREAD_TRACE
-            log("adding slave thread ", slave_ti->index);
-#endif
-            slaves[splits++] = slave_ti;
-#ifdef SMP_STATS
-            controller->stats->splits++;
-#endif
-#ifdef _THREAD_TRACE
-            log("split ply",ply);
-            log("depth",depth);
-#endif
-            --remaining;
-        }
-        // now start the slave threads (if we allocated any)
-        if (splits) {
-           Lock(splitLock);
-           for (int i = 0; i < splits; i++) {
-              // Start searching in the new thread:
-              slaves[i]->start();
-           }
-           Unlock(splitLock);
-        }
-    }
-    if (splits) {
-        ASSERT(activeSplitPoints);
-        // Go ahead and try to grab/search moves in this thread, in parallel
-        // with its slaves:
-        searchSMP(ti);
-        // The master thread has completed its work. If any slave threads
-        // remain, be a "helpful master" and make this thread available to
-        // them. When all slave threads are done, the parent will be
-        // signalled and exit the idle loop.
-        //
-        // Important to lock here - otherwise there is a race condition with
-        // ThreadPool::checkIn.
-        Lock(splitLock);
-        split->lock();
-#ifdef _THREAD_TRACE
-        {
-            ostringstream os;
-            os << "search with master " << ti->index << " done, slaves count=" <<
-                split->slaves.size() << " active=";
-           for (auto it = split->slaves.begin();
-                it != split->slaves.end();
-                it++) {
-               os << (*it)->index << ' ';
-            }
-            os << '\0';
-            log(os.str());
-        }
-#endif
-        if (split->slaves.size()) {
-           ASSERT(split->slaves.count(ti) == 0);
-#ifdef _DEBUG
-           for (auto it = split->slaves.begin();
-                it != split->slaves.end();
-                it++) {
-                // If idle, thread must be master of a split point.
-                // If idle and not split, we will wait forever on it.
-              ASSERT((*it)->state == ThreadInfo::Working || (*it)->work->activeSplitPoints);
-            }
-#endif
-#ifdef _THREAD_TRACE
-            log("helpful master entering idle_loop, thread #",ti->index);
+        (srcOpts.use_tablebases &&
+         board.getMaterial(White).men() +
+         board.getMaterial(Black).men() <= EGTBMenCount) ||
 #endif
-            // ensure parent will wait when back in loop
-            ti->reset();
+        !controller->pool->checkAvailable()) {
+        return 0;
+    }
+    // Idle threads steal from the shallowest open split point. While
+    // the one this thread is working on still has moves left, a new
+    // split point here would not be taken, so do not pay for copying
+    // the board and generating the moves.
+    if (split && split->open && split->remaining > 0 && !split->failHigh) {
+        return 0;
+    }
+    // Save the current split point if any (may be NULL)
+    SplitPoint *parent = split;
+    // We are about the change the split stack, so lock it
+    Lock(splitLock);
+    SplitPoint *s = &splitStack[activeSplitPoints];
+    ASSERT(!s->open && !s->slaves);
+    // invalidate any stale reads of this split point by idle threads
+    s->generation++;
+    // initialize the new split point
+    s->master = ti;
+    s->parent = parent;
+    s->ply = ply;
+    s->depth = depth;
+    s->mg = mg;
+    s->splitNode = node;
+    s->failHigh = 0;
+    // save master's current state
+    s->savedBoard = board;
+    // Force all remaining moves to be generated, since the
+    // MoveGenerator class is not thread-safe otherwise (it
+    // maintains a pointer to the board and when accessed by
+    // multiple threads this pointer may not always be at the
+    // current position). Also we want to know how many moves
+    // remain.
+    const int count = ply == 0 ?
+       ((RootMoveGenerator*)mg)->generateAllMoves(node,s) :
+       mg->generateAllMoves(node,s);
+    s->remaining = count;
+    split = s;
+    ++activeSplitPoints;
+    // publish the split point
+    s->open = true;
+    Unlock(splitLock);
+    EventTrace::record(ti->index,EventTrace::Split,EventTrace::Instant,ply,count);
+    controller->pool->wakeIdle(ti,count);
+    // Go ahead and try to grab/search moves in this thread, in parallel
+    // with any slaves:
+    searchSMP(ti);
+    // The master thread has completed its work. Close the split point,
+    // so no more threads join it.
+    s->lock();
+    s->open = false;
+    const uint64_t slaves = s->slaves;
+    s->unlock();
+    if (slaves) {
+       ASSERT((slaves & (1ULL << ti->index)) == 0);
 #ifdef HELPFUL_MASTER
-            SplitPoint *currentSplit = split;
-            split->unlock();
-            Unlock(splitLock);
-            ThreadPool::idle_loop(ti, split);
-#ifdef _THREAD_TRACE
-            log("helpful master out of idle_loop, thread #",ti->index);
-#endif
-            Lock(splitLock);
-            ASSERT(ti->state == ThreadInfo::Working);
-            //ASSERT(split->slaves.size() == 0);
-            // The master returns to whatever split point it was previously
-            // working on.
-            split = currentSplit;
-            ASSERT(split->master == ti);
-            Unlock(splitLock);
+       // If any slave threads remain, be a "helpful master" and make
+       // this thread available to them. When all slave threads are
+       // done, the idle loop exits. Helping replaces this thread's
+       // board, so set it aside (with its full history, which a copy
+       // would not keep) until then.
+       Board masterBoard;
+       masterBoard.swap(this->board);
+       ThreadPool::idle_loop(ti, s);
+       this->board.swap(masterBoard);
+       ASSERT(ti->state == ThreadInfo::Working);
 #else
-            split->unlock();
-            Unlock(splitLock);
-            // wait to be signalled by last child thread exiting
-            ti->wait();
-#endif
-        } else {
-            // No additional work at this split point so no use being a helpful master
-            split->unlock();
-            Unlock(splitLock);
-        }
-        // Now all work at the split point is finished, so pop the stack
-        Lock(splitLock);
-        restoreFromSplit(split);
-        --activeSplitPoints;
-        split = split->parent;
-#ifdef _THREAD_TRACE
-        {
-            std::ostringstream s;
-            s << "split stack " << ti->index << " popped, active count now="
-              << activeSplitPoints << '\0';
-            log(s.str());
-        }
+       // wait to be signalled by last child thread exiting
+       ti->reset();
+       while (s->slaves) {
+          ti->wait();
+       }
 #endif
-        Unlock(splitLock);
     }
-    return splits;
+    // Now all work at the split point is finished, so pop the stack.
+    // The master returns to whatever split point it was previously
+    // working on.
+    Lock(splitLock);
+    restoreFromSplit(s);
+    --activeSplitPoints;
+    split = parent;
+    Unlock(splitLock);
+    return 1;
 }
 
 
@@ -3781,8 +3982,11 @@ void Search::init(NodeStack &ns, ThreadInfo *slave_ti) {
     // The split variable holds the split point to which this Search
     // instance is attached
     split = s;
-    split->failHigh = 0;
     nodeAccumulator = 0;
+#ifdef SMP_STATS
+    // count each thread joining a split point
+    splitsJoined.fetch_add(1,std::memory_order_relaxed);
+#endif
     ti = slave_ti;
     node->ply = s->ply;
     node->depth = s->depth;
@@ -10,12 +10,17 @@
 #include "movegen.h"
 #include "threadp.h"
 #include "options.h"
+#include "tbcache.h"
+#include "tbprefetch.h"
 extern "C" {
 #include <memory.h>
 #include <time.h>
 };
+#include <condition_variable>
+#include <mutex>
 #include <random>
 #include <set>
+#include <thread>
 using namespace std;
 
 class MoveGenerator;
@@ -24,7 +29,8 @@ struct NodeInfo;
 
 // Definition of a split point
 struct SplitPoint {
-    set<ThreadInfo *> slaves;
+    // slave threads, as a mask of thread indices
+    atomic<uint64_t> slaves;
     Move moves[Constants::MaxMoves];
     int ply;
     int depth;
@@ -40,20 +46,33 @@ struct SplitPoint {
     SplitPoint *parent;
     // Move Generator instance for split node
     MoveGenerator * mg;
-    lock_t mylock;
+    lock_t splitPointLock;
     atomic<int> failHigh;
+    // Work-stealing state. Idle threads read these without locking
+    // to choose a split point to join, then check them again under
+    // the lock (see ThreadPool::steal).
+    // Set while the master is still searching moves here
+    atomic<bool> open;
+    // Incremented each time the split point is reused
+    atomic<unsigned> generation;
+    // Number of moves not yet taken by a searcher (approximate)
+    atomic<int> remaining;
     SplitPoint() {
-        LockInit(mylock);
+        LockInit(splitPointLock);
+        slaves = 0ULL;
         failHigh = 0;
+        open = false;
+        generation = 0;
+        remaining = 0;
     }
     ~SplitPoint() {
-        LockFree(mylock);
+        LockFree(splitPointLock);
     }
     void lock() {
-        Lock(mylock);
+        Lock(splitPointLock);
     }
     void unlock() {
-        Unlock(mylock);
+        Unlock(splitPointLock);
     }
 };
 #define SPLIT_STACK_MAX_DEPTH 4
@@ -76,11 +95,9 @@ struct NodeInfo {
     Move pv[Constants::MaxPly];
     int pv_length;
     Move done[Constants::MaxMoves];
-#ifdef MOVE_ORDER_STATS
-    int best_count;
-#endif
+    int best_count; // for move ordering statistics
     int ply, depth;
-    char pad[110];
+    AttackMap attacks; // cached attack info for this node
 
     int PV() const {
         return (beta > alpha+1);
@@ -170,8 +187,17 @@ public:
 
     void clearHashTables();
 
+    // Resize the hash table. If a memory budget is set, the budget
+    // determines the size instead of "newSize".
     void resizeHash(size_t newSize);
 
+    // Resize the per-thread tables, the tablebase probe cache and
+    // the hash table after a change to the memory budget option. If
+    // the budget is set, the other tables are sized from it and the
+    // hash table gets the rest; otherwise all have their default
+    // sizes. Note: should not call this while searching
+    void applyMemoryBudget();
+
     void stopAllThreads();
 
     void clearStopFlags();
@@ -182,11 +208,9 @@ public:
         background = b;
     }
 
-    void setTimeLimit(uint64_t limit,uint64_t xtra) {
-        typeOfSearch = TimeLimit;
-        time_limit = time_target = limit;
-        xtra_time = xtra;
-    }
+    // Change the time limit (for example on ponderhit). May be called
+    // from another thread while a search is in progress.
+    void setTimeLimit(uint64_t limit,uint64_t xtra);
 
     int wasTerminated() const;
 
@@ -195,6 +219,9 @@ public:
     // Note: should not call this while searching
     void setThreadCount(int threads);
 
+    // apply a change in options.search.thread_spin_count
+    void updateSpinCount();
+
     int getIterationDepth() const;
 
     RootSearch *root() const {
@@ -207,13 +234,29 @@ public:
 
     void uciSendInfos(const Board &, Move move, int move_index, int depth);
 
+    // Sum the detailed statistics of all threads into the
+    // Statistics structure.
+    void updateSearchCounters();
+
+    // Update the detailed statistics and output them as JSON, to the
+    // file given by the search_stats_file option or else (in UCI
+    // mode) as an info string.
+    void reportSearchCounters();
+
+#ifdef SMP_STATS
+    // Sum the per-thread counts of split points joined into the
+    // Statistics structure.
+    void updateSplitCount();
+#endif
+
     bool isActive() const {
         return active;
     }
 
-    void stop() {
-        stopped = true;
-    }
+    // Request that the search stop. May be called from another
+    // thread; the search is terminated without waiting for it
+    // to poll for the request.
+    void stop();
 
     bool wasStopped() const {
         return stopped;
@@ -227,6 +270,10 @@ public:
 
     Hash hashTable;
 
+    TbCache tbCache;
+
+    TbPrefetcher tbPrefetcher;
+
 #ifdef NUMA
     void rebind() {
         pool->rebind();
@@ -239,6 +286,13 @@ public:
 
 private:
 
+    // Set the sizes of the per-thread tables and of the tablebase
+    // probe cache, from the memory budget if it is set.
+    void setTableSizes();
+
+    // Size for the hash table, in bytes.
+    size_t hashTableSize() const;
+
     // pointer to function, called to output status during
     // a search.
     void (CDECL *post_function)(const Statistics &);
@@ -251,20 +305,38 @@ private:
     void updateStats(NodeInfo *node,int iteration_depth,
 		     score_t score, score_t alpha, score_t beta);
 
+    // Return true if the time limit has been reached, after allowing
+    // extra time for a root fail high or fail low.
+    int timeUp(uint64_t elapsed);
+
+    // The timer thread lasts as long as the controller, and is armed
+    // for each search by startTimer. It sleeps until the time limit
+    // expires, or it is woken by a stop request or a change in the
+    // time limit, and terminates the search directly.
+    void startTimer();
+
+    void stopTimer();
+
+    void timerLoop();
+
+    // wake the timer thread after changing the time limit
+    void notifyTimer();
+
     int uci;
     int age;
     TalkLevel talkLevel;
     // time limit is nominal time limit in centiseconds
     // time target is actual time to search in centiseconds
-    uint64_t time_limit, time_target;
-    uint64_t time_added;
+    // (time_target and time_added are also read by the timer thread)
+    uint64_t time_limit;
+    atomic<uint64_t> time_target;
+    atomic<uint64_t> time_added;
     // Amount of time we can add if score is dropping:
     uint64_t xtra_time;
     int ply_limit;
     int background;
-    // flag for UCI. When set the search will terminate at the
-    // next time check interval:
-    bool stopped;
+    // flag for UCI. When set the timer thread terminates the search.
+    atomic<bool> stopped;
     SearchType typeOfSearch;
     int time_check_counter;
     int failLowFactor;
@@ -281,6 +353,18 @@ private:
     ThreadPool *pool;
     bool active;
     LockDefine(split_calc_lock);
+    std::thread timerThread;
+    // protects the timer state and time limit changes, including the
+    // time extensions for root fail high/fail low (time_added, the
+    // root search's fail_*_root_extend flags and stats->faillow)
+    std::mutex timerLock;
+    std::condition_variable timerCv;
+    // timerActive is set while a search is running, timerBusy while
+    // the timer thread is handling one, and timerExit to end the thread
+    bool timerActive, timerBusy, timerExit;
+    // bitbase memory counted when the hash table size was last set
+    // from the memory budget
+    size_t budgetedBitbaseBytes;
 };
 
 class Search : public ThreadControl {
@@ -343,7 +427,8 @@ public:
             // Restore state from prior split point. We are not quite
             // out of the search routine from which the split occurred,
             // so may still need to touch these variables before exiting.
-            board = split->savedBoard;
+            // (The board is already back at the split point: see
+            // maybeSplit.)
             node = split->splitNode;
         }
     }
@@ -353,8 +438,15 @@ public:
     // forces a reload of that cache from the global options:
     void setSearchOptions();
 
+    void clearCounters() {
+        counters.clear();
+        splitsJoined = 0;
+    }
+
     score_t drawScore(const Board &board) const;
 
+    int upcomingRep(const Board &board, NodeInfo *node, int ply);
+
 #ifdef TUNE
     static const int LEARNING_SEARCH_WINDOW;
     static double func( double x );
@@ -455,14 +547,19 @@ protected:
     SearchController *controller;
     Board board;
     SearchContext context;
-    int terminate;
+    // set by other threads (including the timer thread) to stop
+    // the search
+    atomic<int> terminate;
     uint64_t nodeCount;
     int nodeAccumulator;
     NodeInfo *node; // pointer into NodeStack array (external to class)
     // lock for the split stack
     LockDefine(splitLock);
+    // Split points this thread is master of. Idle threads steal work
+    // from the bottom (shallowest) end, while this thread pushes and
+    // pops at the top.
     SplitPoint splitStack[SPLIT_STACK_MAX_DEPTH];
-    int activeSplitPoints;
+    atomic<int> activeSplitPoints;
     // Split point to which this search instance is attached (may be null).
     // All slave nodes and the parent share a split point instance.
     SplitPoint *split;
@@ -476,6 +573,12 @@ protected:
     ColorType computerSide;
     score_t contempt;
     TalkLevel talkLevel;
+    // Detailed statistics for this thread (only collected if
+    // srcOpts.search_stats is set)
+    SearchCounters counters;
+    // Count of split points this thread has joined. Only this thread
+    // increments it; the controller sums the counts.
+    atomic<uint64_t> splitsJoined;
 };
 
 class RootSearch : public Search {
@@ -528,7 +631,7 @@ protected:
     Move easyMove;
     score_t easyScore;
     bool easy_adjust, fail_high_root_extend, fail_low_root_extend;
-    int fail_high_root;
+    atomic<int> fail_high_root;
     score_t last_score;
     int waitTime;
     int depth_adjust; // for strength feature
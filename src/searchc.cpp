@@ -2,14 +2,19 @@
 
 #include "searchc.h"
 #include "search.h"
+#include "memusage.h"
 
 SearchContext::SearchContext() {
    counterMoveHistory = new CmhMatrix;
+   MemoryUsage::add(MemoryUsage::History,sizeof(SearchContext));
+   MemoryUsage::add(MemoryUsage::CounterMoveHistory,sizeof(CmhMatrix));
    clear();
 }
 
 SearchContext::~SearchContext()
 {
+   MemoryUsage::remove(MemoryUsage::History,sizeof(SearchContext));
+   MemoryUsage::remove(MemoryUsage::CounterMoveHistory,sizeof(CmhMatrix));
    delete counterMoveHistory;
 }
 
@@ -51,9 +51,11 @@ public:
     }
 
 private:
-    struct CACHE_ALIGN HistoryEntry {
+    // Per-thread, so only the table as a whole needs alignment.
+    struct HistoryEntry {
         int32_t val;
-    } history[16][64];
+    };
+    CACHE_ALIGN HistoryEntry history[16][64];
 
     static const int REFUTATION_TABLE_SIZE = 16*64;
 
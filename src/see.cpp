@@ -57,7 +57,7 @@ static Square minAttacker(const Board &board, Bitboard atcks, ColorType side) {
    }    
 }
 
-score_t see( const Board &board, Move move ) {
+score_t see( const Board &board, Move move, const AttackMap *map ) {
    ASSERT(!IsNull(move));
 #ifdef ATTACK_TRACE
    cout << "see ";
@@ -72,7 +72,11 @@ score_t see( const Board &board, Move move ) {
    Piece attacker = board[attack_square];
    Piece on_square = (TypeOfMove(move) == EnPassant) ? 
        MakePiece(Pawn,oside) : board[square];
-   Bitboard opp_attacks(board.calcAttacks(square,oside));
+   ASSERT(map == nullptr || map->isValid(board));
+   Bitboard opp_attacks;
+   if (map == nullptr || map->attacked(square,oside)) {
+      opp_attacks = board.calcAttacks(square,oside);
+   }
    if (opp_attacks.isClear()) {
        // piece is undefended
 #ifdef ATTACK_TRACE
@@ -161,13 +165,12 @@ score_t see( const Board &board, Move move ) {
    return score_list[0];
 }
 
-score_t seeSign( const Board &board, Move move, score_t threshold ) {
-   ASSERT(!IsNull(move));
-#ifdef ATTACK_TRACE
-   cout << "see ";
-   MoveImage(move,cout);
-   cout << endl;
-#endif
+// Compute seeSign given the initial sets of attackers of the
+// destination square ("our_attacks" for the moving side,
+// "opp_attacks" for the other side).
+static score_t seeSign( const Board &board, Move move, score_t threshold,
+                        const Bitboard &our_attacks,
+                        const Bitboard &opp_attacks ) {
    ColorType my_side = PieceColor(board[StartSquare(move)]);
    ColorType side = my_side;
    ColorType oside = OppositeColor(side);
@@ -176,7 +179,6 @@ score_t seeSign( const Board &board, Move move, score_t threshold ) {
    Piece attacker = board[attack_square];
    Piece on_square = (TypeOfMove(move) == EnPassant) ? 
        MakePiece(Pawn,oside) : board[square];
-   Bitboard opp_attacks(board.calcAttacks(square,oside));
    if (opp_attacks.isClear()) {
        // piece is undefended
 #ifdef ATTACK_TRACE
@@ -189,7 +191,7 @@ score_t seeSign( const Board &board, Move move, score_t threshold ) {
    score_t gain;
    Bitboard attacks[2]; 
    Square last_attack_sq[2] = {InvalidSquare, InvalidSquare};
-   attacks[side] = board.calcAttacks(square,side);
+   attacks[side] = our_attacks;
    attacks[oside] = opp_attacks;
    int count = 0;
 
@@ -297,3 +299,80 @@ score_t seeSign( const Board &board, Move move, score_t threshold ) {
    return score_list[0] >= threshold;
 }
 
+score_t seeSign( const Board &board, Move move, score_t threshold, const AttackMap *map ) {
+   ASSERT(!IsNull(move));
+#ifdef ATTACK_TRACE
+   cout << "see ";
+   MoveImage(move,cout);
+   cout << endl;
+#endif
+   const ColorType side = PieceColor(board[StartSquare(move)]);
+   const ColorType oside = OppositeColor(side);
+   const Square square = DestSquare(move);
+   ASSERT(map == nullptr || map->isValid(board));
+   Bitboard opp_attacks;
+   if (map == nullptr || map->attacked(square,oside)) {
+      opp_attacks = board.calcAttacks(square,oside);
+   }
+   if (opp_attacks.isClear()) {
+      return seeSign(board,move,threshold,opp_attacks,opp_attacks);
+   }
+   return seeSign(board,move,threshold,board.calcAttacks(square,side),
+                  opp_attacks);
+}
+
+SeeBatch::SeeBatch(const Board &b)
+   : board(b), targetCount(0), cacheCount(0)
+{
+}
+
+score_t SeeBatch::seeSign(Move move, score_t threshold, const AttackMap *map)
+{
+   ASSERT(!IsNull(move));
+   ASSERT(map == nullptr || map->isValid(board));
+   // SEE is monotonic in the threshold, so a previous result for this
+   // move at a different threshold may already decide the answer.
+   for (int i = 0; i < cacheCount; i++) {
+      const Entry &e = cache[i];
+      if (MovesEqual(e.move,move)) {
+         if (e.result ? threshold <= e.threshold : threshold >= e.threshold) {
+            return e.result;
+         }
+      }
+   }
+   const ColorType side = PieceColor(board[StartSquare(move)]);
+   const ColorType oside = OppositeColor(side);
+   const Square square = DestSquare(move);
+   Bitboard attackers[2];
+   int i;
+   for (i = 0; i < targetCount && targets[i].square != square; i++) ;
+   if (i < targetCount) {
+      attackers[White] = targets[i].attackers[White];
+      attackers[Black] = targets[i].attackers[Black];
+   } else {
+      // compute attackers of this square, once per position
+      if (!map || map->attacked(square,oside)) {
+         attackers[oside] = board.calcAttacks(square,oside);
+      }
+      if (!attackers[oside].isClear()) {
+         attackers[side] = board.calcAttacks(square,side);
+      }
+      if (targetCount < MaxTargets) {
+         Target &t = targets[targetCount++];
+         t.square = square;
+         t.attackers[White] = attackers[White];
+         t.attackers[Black] = attackers[Black];
+      }
+   }
+   const score_t result = ::seeSign(board,move,threshold,
+                                    attackers[side],
+                                    attackers[oside]);
+   ASSERT(result == ::seeSign(board,move,threshold));
+   if (cacheCount < CacheSize) {
+      Entry &e = cache[cacheCount++];
+      e.move = move;
+      e.threshold = threshold;
+      e.result = result;
+   }
+   return result;
+}
@@ -4,15 +4,56 @@
 #define _SEE_H
 
 #include "board.h"
+#include "attackmap.h"
 
 // This function performs a static exchange evalution ("SEE") to
 // estimate the gain from making capture move "move" on board
-// "board".
-score_t see( const Board &board, Move move );
+// "board". If "attacks" is non-null it must be valid for "board"; it
+// is used to detect undefended captures without an attack scan.
+score_t see( const Board &board, Move move,
+             const AttackMap *attacks = nullptr );
 
 // return 0 if SEE value is below threshold, 1 if SEE value
 // is >= threshold
-score_t seeSign( const Board &board, Move move, score_t threshold);
+score_t seeSign( const Board &board, Move move, score_t threshold,
+                 const AttackMap *attacks = nullptr );
+
+// Evaluates seeSign for a series of moves from a single position.
+// The attackers of each target square are computed only once, and
+// results are cached per move, so that repeated tests at a node
+// (move ordering, then pruning) do not redo the exchange. One of
+// these is part of every MoveGenerator, so construction only clears
+// the counts: nothing else is touched until seeSign is called.
+class SeeBatch
+{
+ public:
+   SeeBatch(const Board &board);
+
+   // as seeSign above, for a move from the batch position.
+   score_t seeSign(Move move, score_t threshold,
+                   const AttackMap *attacks = nullptr);
+
+ private:
+   enum {CacheSize = 32, MaxTargets = 8};
+
+   struct Entry {
+      Move move;
+      score_t threshold;
+      score_t result;
+   };
+
+   struct Target {
+      Square square;
+      // attackers of the square, indexed by color. Raw values, so
+      // that the array is not initialized on construction.
+      uint64_t attackers[2];
+   };
+
+   const Board &board;
+   Target targets[MaxTargets]; // squares whose attackers are computed
+   Entry cache[CacheSize];
+   int targetCount, cacheCount;
+};
 
 #endif
 
@@ -5,6 +5,73 @@
 #include <algorithm>
 #include <iomanip>
 
+void SearchCounters::clear()
+{
+   num_qnodes = reg_nodes = moves_searched = static_null_pruning =
+       razored = reduced = (uint64_t)0;
+   hash_hits = hash_searches = futility_pruning = null_cuts = lmp = (uint64_t)0;
+   history_pruning = see_pruning = upcoming_reps = (uint64_t)0;
+   check_extensions = capture_extensions =
+     pawn_extensions = evasion_extensions = singular_extensions = (uint64_t)0;
+   for (int i = 0; i < 4; i++) move_order[i] = (uint64_t)0;
+   move_order_count = (uint64_t)0;
+}
+
+SearchCounters & SearchCounters::operator += (const SearchCounters &c)
+{
+   num_qnodes += c.num_qnodes;
+   reg_nodes += c.reg_nodes;
+   moves_searched += c.moves_searched;
+   futility_pruning += c.futility_pruning;
+   static_null_pruning += c.static_null_pruning;
+   null_cuts += c.null_cuts;
+   razored += c.razored;
+   check_extensions += c.check_extensions;
+   capture_extensions += c.capture_extensions;
+   pawn_extensions += c.pawn_extensions;
+   evasion_extensions += c.evasion_extensions;
+   singular_extensions += c.singular_extensions;
+   reduced += c.reduced;
+   lmp += c.lmp;
+   history_pruning += c.history_pruning;
+   see_pruning += c.see_pruning;
+   upcoming_reps += c.upcoming_reps;
+   hash_hits += c.hash_hits;
+   hash_searches += c.hash_searches;
+   for (int i = 0; i < 4; i++) move_order[i] += c.move_order[i];
+   move_order_count += c.move_order_count;
+   return *this;
+}
+
+void SearchCounters::printJSON(ostream &s) const
+{
+   s << "\"qnodes\":" << num_qnodes <<
+      ",\"reg_nodes\":" << reg_nodes <<
+      ",\"moves_searched\":" << moves_searched <<
+      ",\"hash_searches\":" << hash_searches <<
+      ",\"hash_hits\":" << hash_hits <<
+      ",\"razored\":" << razored <<
+      ",\"static_null_pruning\":" << static_null_pruning <<
+      ",\"null_cuts\":" << null_cuts <<
+      ",\"upcoming_reps\":" << upcoming_reps <<
+      ",\"futility_pruning\":" << futility_pruning <<
+      ",\"lmp\":" << lmp <<
+      ",\"history_pruning\":" << history_pruning <<
+      ",\"see_pruning\":" << see_pruning <<
+      ",\"reduced\":" << reduced <<
+      ",\"check_extensions\":" << check_extensions <<
+      ",\"capture_extensions\":" << capture_extensions <<
+      ",\"pawn_extensions\":" << pawn_extensions <<
+      ",\"evasion_extensions\":" << evasion_extensions <<
+      ",\"singular_extensions\":" << singular_extensions <<
+      ",\"move_order\":[";
+   for (int i = 0; i < 4; i++) {
+      if (i) s << ',';
+      s << move_order[i];
+   }
+   s << "],\"move_order_count\":" << move_order_count;
+}
+
 Statistics::Statistics()
 {
    clear();
@@ -33,21 +100,10 @@ void Statistics::clear()
    depth = 0;
    num_nodes = (uint64_t)0;
    display_value = Constants::INVALID_SCORE;
-#ifdef SEARCH_STATS
-   num_qnodes = reg_nodes = moves_searched = static_null_pruning =
-       razored = reduced = (uint64_t)0;
-   hash_hits = hash_searches = futility_pruning = null_cuts = lmp = (uint64_t)0;
-   history_pruning = lmp = see_pruning = (uint64_t)0;
-   check_extensions = capture_extensions =
-     pawn_extensions = evasion_extensions = singular_extensions = 0L;
-#endif
+   counters.clear();
    end_of_game = 0;
    mvleft = mvtot = 0;
-   tb_probes = tb_hits = (uint64_t)0;
-#ifdef MOVE_ORDER_STATS
-   move_order_count = 0;
-   for (i = 0; i < 4; i++) move_order[i]=0;
-#endif
+   tb_probes = tb_hits = tb_cache_hits = (uint64_t)0;
    last_split_time = getCurrentTime();
 #ifdef SMP_STATS
    splits = samples = threads = 0L;
@@ -12,6 +12,46 @@ using namespace std;
 enum StateType {NormalState,Terminated,Check,Checkmate,
                 Stalemate,Draw,Resigns};
 
+// Detailed search counters, collected only if the search_stats
+// option is set. Each search thread counts into its own instance,
+// and these are summed into Statistics at the end of each iteration.
+// The struct is cache aligned (so its size is also a whole number of
+// lines), keeping the counters off the lines of the frequently read
+// Search members around them.
+struct CACHE_ALIGN SearchCounters
+{
+   uint64_t num_qnodes;
+   uint64_t reg_nodes;
+   uint64_t moves_searched; // in regular search
+   uint64_t futility_pruning;
+   uint64_t static_null_pruning;
+   uint64_t null_cuts;
+   uint64_t razored;
+   uint64_t check_extensions, capture_extensions,
+     pawn_extensions, evasion_extensions, singular_extensions;
+   uint64_t reduced;
+   uint64_t lmp;
+   uint64_t history_pruning;
+   uint64_t see_pruning;
+   uint64_t upcoming_reps;
+   uint64_t hash_hits, hash_searches;
+   // count of nodes where the best move was the 1st, 2nd, .. move
+   // searched
+   uint64_t move_order[4];
+   uint64_t move_order_count;
+
+   SearchCounters() {
+      clear();
+   }
+
+   void clear();
+
+   SearchCounters & operator += (const SearchCounters &);
+
+   // output as the members of a JSON object (without the braces)
+   void printJSON(ostream &) const;
+};
+
 // This structure holds information about a search
 // during and after completion.
 struct Statistics
@@ -35,32 +75,14 @@ struct Statistics
    int mvleft; // moves left to analyze at current depth
    uint64_t tb_probes; // tablebase probes
    uint64_t tb_hits;   // tablebase hits
-#ifdef SEARCH_STATS
-   uint64_t num_qnodes;
-   uint64_t reg_nodes;
-   uint64_t moves_searched; // in regular search
-   uint64_t futility_pruning;
-   uint64_t static_null_pruning;
-   uint64_t null_cuts;
-   uint64_t razored;
-   uint64_t check_extensions, capture_extensions,
-     pawn_extensions, evasion_extensions, singular_extensions;
-   uint64_t reduced;
-   uint64_t lmp;
-   uint64_t history_pruning;
-   uint64_t see_pruning;
-   uint64_t hash_hits, hash_searches;
-#endif
+   uint64_t tb_cache_hits; // probes answered from the tablebase cache
+   SearchCounters counters;
    uint64_t num_nodes;
    uint64_t splits;
    uint64_t last_split_sample;
    CLOCK_TYPE last_split_time;
 #ifdef SMP_STATS
    uint64_t samples, threads;
-#endif
-#ifdef MOVE_ORDER_STATS
-   int move_order[4];
-   int move_order_count;
 #endif
    int end_of_game;
 
@@ -30,11 +30,14 @@ struct SyzygyTb {
     // If found and the score is winning or drawing then
     // "rootMoves" is filled with the moves that preserve
     // the draw or win.
+    // Not safe for concurrent use: only called by the main thread,
+    // at the root.
     static int probe_root(const Board &b, score_t &score, set<Move> &rootMoves);
 
     // Probe the wdl tablebases (not at root).
     // Return 1 if score was obtained,
     // 0 if not. "score" is the score for the position.
+    // May be called concurrently from multiple search threads.
     static int probe_wdl(const Board &b, score_t &score, bool use50MoveRule);
 
 };
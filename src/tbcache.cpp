@@ -0,0 +1,38 @@
+// Copyright 2017 by Jon Dart. All Rights Reserved.
+
+#include "tbcache.h"
+#include "debug.h"
+#include "memusage.h"
+#include <cstring>
+
+TbCache::TbCache()
+   : entries(new Entry[DEFAULT_SIZE]), size(DEFAULT_SIZE), mask(DEFAULT_SIZE-1)
+{
+   MemoryUsage::add(MemoryUsage::TbCache,bytes(size));
+   clear();
+}
+
+TbCache::~TbCache()
+{
+   MemoryUsage::remove(MemoryUsage::TbCache,bytes(size));
+   delete [] entries;
+}
+
+void TbCache::resize(unsigned newSize)
+{
+   ASSERT(newSize && (newSize & (newSize-1)) == 0);
+   if (newSize == size) return;
+   MemoryUsage::remove(MemoryUsage::TbCache,bytes(size));
+   delete [] entries;
+   entries = new Entry[newSize];
+   size = newSize;
+   mask = newSize-1;
+   MemoryUsage::add(MemoryUsage::TbCache,bytes(size));
+   clear();
+}
+
+void TbCache::clear()
+{
+   // all-zero entries fail the key test unless the key is zero
+   memset(entries,'\0',bytes(size));
+}
@@ -0,0 +1,95 @@
+// Copyright 2017 by Jon Dart. All Rights Reserved.
+
+#ifndef _TBCACHE_H
+#define _TBCACHE_H
+
+#include "types.h"
+#include "constant.h"
+
+// Cache of tablebase probe results, shared by all search threads, so
+// that positions probed recently (by any thread, or in an earlier
+// iteration) do not go back to the probing code and the tablebase
+// files. Failed probes are cached too.
+//
+// Like the main hash table, the cache is lockless: each entry stores
+// its key XORed with its data, so an entry torn by concurrent writes
+// fails the key test and is treated as a miss.
+class TbCache {
+
+ public:
+
+   // Default number of entries: must be a power of 2
+   static const unsigned DEFAULT_SIZE = 1<<16;
+
+   TbCache();
+
+   ~TbCache();
+
+   TbCache(const TbCache &) = delete;
+
+   TbCache &operator = (const TbCache &) = delete;
+
+   void clear();
+
+   // Reallocate and clear the cache, if its size (a power of 2)
+   // differs from "entries". Not safe during a search.
+   void resize(unsigned entries);
+
+   static size_t bytes(unsigned entries) {
+      return sizeof(Entry)*entries;
+   }
+
+   // Look up the position with hash code "key", probed at "ply".
+   // Returns 1 if it is in the cache, in which case "hit" is set to
+   // the result of the original probe (1 if the tablebases had the
+   // position, 0 if not) and "score" to its score.
+   int lookup(hash_t key, int ply, int &hit, score_t &score) const {
+      const Entry &e = entries[key & mask];
+      const uint64_t data = e.data;
+      if ((e.key ^ data) != key) {
+         return 0;
+      }
+      hit = (data & HIT_FLAG) != 0;
+      score = fromStored((score_t)(int32_t)(uint32_t)data,ply);
+      return 1;
+   }
+
+   // Store the result of a probe at "ply".
+   void store(hash_t key, int ply, int hit, score_t score) {
+      Entry &e = entries[key & mask];
+      const uint64_t data = (uint64_t)(uint32_t)(int32_t)toStored(score,ply) |
+         (hit ? HIT_FLAG : 0);
+      e.key = key ^ data;
+      e.data = data;
+   }
+
+ private:
+
+   struct Entry {
+      uint64_t key;
+      uint64_t data;
+   };
+
+   static const uint64_t HIT_FLAG = 1ULL<<32;
+
+   // Mate scores returned by probes are relative to the probe ply.
+   // Store them relative to the position instead, so entries can be
+   // used at any ply.
+   static score_t toStored(score_t score, int ply) {
+      if (score >= Constants::MATE_RANGE) return score + ply;
+      else if (score <= -Constants::MATE_RANGE) return score - ply;
+      else return score;
+   }
+
+   static score_t fromStored(score_t score, int ply) {
+      if (score >= Constants::MATE_RANGE) return score - ply;
+      else if (score <= -Constants::MATE_RANGE) return score + ply;
+      else return score;
+   }
+
+   Entry *entries;
+   unsigned size;
+   hash_t mask;
+};
+
+#endif
@@ -0,0 +1,274 @@
+// Copyright 2017 by Jon Dart. All Rights Reserved.
+
+#include "tbprefetch.h"
+#include "memusage.h"
+#include "threadc.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <iostream>
+
+static const char PIECE_CHARS[5] = {'Q','R','B','N','P'};
+
+#ifdef _WIN32
+static const char PATH_SEPARATOR = ';';
+#else
+static const char PATH_SEPARATOR = ':';
+#endif
+
+TbPrefetcher::TbPrefetcher()
+   : pendingLock(false),
+     hasRequest(false),
+     done(false),
+     currentLock(false),
+     lockWarned(false)
+{
+}
+
+TbPrefetcher::~TbPrefetcher()
+{
+   if (thread.joinable()) {
+      {
+         std::unique_lock<std::mutex> lock(mtx);
+         done = true;
+      }
+      cv.notify_one();
+      thread.join();
+   }
+   unlockAll();
+}
+
+static void addNames(const int *counts, int maxCounts[2][5], int side,
+                     int type, int men, set<string> &names)
+{
+   if (side == 2) {
+      if (men > 2) {
+         string name;
+         for (int s = 0; s < 2; s++) {
+            name += 'K';
+            for (int i = 0; i < 5; i++) {
+               name.append(counts[s*5+i],PIECE_CHARS[i]);
+            }
+            if (s == 0) name += 'v';
+         }
+         names.insert(name);
+      }
+      return;
+   }
+   int c[10];
+   for (int i = 0; i < 10; i++) c[i] = counts[i];
+   const int nextSide = type == 4 ? side+1 : side;
+   const int nextType = type == 4 ? 0 : type+1;
+   for (int n = 0; n <= maxCounts[side][type] && men + n <= 32; n++) {
+      c[side*5+type] = n;
+      addNames(c,maxCounts,nextSide,nextType,men+n,names);
+   }
+}
+
+void TbPrefetcher::tableNames(const Board &board, int maxMen,
+                              vector<string> &names)
+{
+   int maxCounts[2][5];
+   for (int side = 0; side < 2; side++) {
+      const Material &mat = board.getMaterial(side == 0 ? White : Black);
+      maxCounts[side][0] = mat.queenCount();
+      maxCounts[side][1] = mat.rookCount();
+      maxCounts[side][2] = mat.bishopCount();
+      maxCounts[side][3] = mat.knightCount();
+      maxCounts[side][4] = mat.pawnCount();
+   }
+   // Captures can remove any subset of the material, but only
+   // combinations with at most maxMen men have tables.
+   set<string> found;
+   int counts[10] = {0};
+   addNames(counts,maxCounts,0,0,2,found);
+   names.clear();
+   for (const string &name : found) {
+      if ((int)name.size()-1 <= maxMen) {
+         names.push_back(name);
+      }
+   }
+}
+
+void TbPrefetcher::update(const Board &board, const string &path,
+                          int maxMen, bool lock)
+{
+   const int men = board.getMaterial(White).men() +
+      board.getMaterial(Black).men();
+   if (maxMen <= 0 || path.empty() || men > maxMen + PREFETCH_CAPTURES) {
+      return;
+   }
+   vector<string> names;
+   tableNames(board,maxMen,names);
+   {
+      std::unique_lock<std::mutex> lck(mtx);
+      pendingNames.swap(names);
+      pendingPath = path;
+      pendingLock = lock;
+      hasRequest = true;
+      if (!thread.joinable()) {
+         thread = std::thread(&TbPrefetcher::threadLoop,this);
+      }
+   }
+   cv.notify_one();
+}
+
+void TbPrefetcher::threadLoop()
+{
+   // reading ahead only uses otherwise idle time
+   ThreadControl::lowerPriority();
+   for (;;) {
+      vector<string> names;
+      string path;
+      bool lock;
+      {
+         std::unique_lock<std::mutex> lck(mtx);
+         cv.wait(lck,[this]{return hasRequest || done;});
+         if (done) return;
+         names.swap(pendingNames);
+         path = pendingPath;
+         lock = pendingLock;
+         hasRequest = false;
+      }
+      if (path != currentPath || lock != currentLock) {
+         unlockAll();
+         fetched.clear();
+         currentPath = path;
+         currentLock = lock;
+      }
+      vector<string> dirs;
+      size_t start = 0;
+      for (;;) {
+         const size_t end = path.find(PATH_SEPARATOR,start);
+         const string dir(path.substr(start,end == string::npos ? string::npos : end-start));
+         if (!dir.empty()) dirs.push_back(dir);
+         if (end == string::npos) break;
+         start = end+1;
+      }
+      bool superseded = false;
+      for (const string &name : names) {
+         // A table is stored under only one of the two orders of its
+         // sides, so try both.
+         const size_t v = name.find('v');
+         const string swapped(name.substr(v+1) + "v" + name.substr(0,v));
+         for (const string &table : {name, swapped}) {
+            for (const string &dir : dirs) {
+               const string fileName(dir + "/" + table + ".rtbw");
+               if (fetched.count(fileName)) continue;
+               {
+                  std::unique_lock<std::mutex> lck(mtx);
+                  // stop early if exiting, or if a new search has
+                  // superseded this request
+                  superseded = done || hasRequest;
+               }
+               if (superseded) break;
+               if (prefetch(fileName,lock)) {
+                  fetched.insert(fileName);
+               }
+            }
+            if (superseded) break;
+         }
+         if (superseded) break;
+      }
+   }
+}
+
+int TbPrefetcher::prefetch(const string &fileName, bool lock)
+{
+#ifdef _WIN32
+   HANDLE file = CreateFileA(fileName.c_str(),GENERIC_READ,FILE_SHARE_READ,
+                             NULL,OPEN_EXISTING,FILE_ATTRIBUTE_NORMAL,NULL);
+   if (file == INVALID_HANDLE_VALUE) {
+      return 0;
+   }
+   LARGE_INTEGER fileSize;
+   if (!GetFileSizeEx(file,&fileSize) || fileSize.QuadPart == 0) {
+      CloseHandle(file);
+      return 0;
+   }
+   const size_t size = (size_t)fileSize.QuadPart;
+   HANDLE map = CreateFileMappingA(file,NULL,PAGE_READONLY,0,0,NULL);
+   CloseHandle(file);
+   if (map == NULL) {
+      return 0;
+   }
+   void *base = MapViewOfFile(map,FILE_MAP_READ,0,0,0);
+   CloseHandle(map);
+   if (base == NULL) {
+      return 0;
+   }
+   if (lock && VirtualLock(base,size)) {
+      Mapping m = {base,size};
+      locked.push_back(m);
+      MemoryUsage::add(MemoryUsage::Tablebases,size);
+      return 1;
+   }
+   else if (lock && !lockWarned) {
+      cerr << "warning: could not lock tablebase file " << fileName <<
+         " in memory" << endl;
+      lockWarned = true;
+   }
+   // No equivalent of MADV_WILLNEED: touch each page to read it in.
+   volatile const char *p = (const char*)base;
+   for (size_t i = 0; i < size; i += 4096) {
+      (void)p[i];
+   }
+   UnmapViewOfFile(base);
+   return 1;
+#else
+   const int fd = open(fileName.c_str(),O_RDONLY);
+   if (fd == -1) {
+      return 0;
+   }
+   struct stat st;
+   if (fstat(fd,&st) || st.st_size == 0) {
+      close(fd);
+      return 0;
+   }
+   const size_t size = (size_t)st.st_size;
+   void *base = mmap(NULL,size,PROT_READ,MAP_SHARED,fd,0);
+   close(fd);
+   if (base == MAP_FAILED) {
+      return 0;
+   }
+   madvise(base,size,MADV_WILLNEED);
+   if (lock) {
+      if (mlock(base,size) == 0) {
+         Mapping m = {base,size};
+         locked.push_back(m);
+         MemoryUsage::add(MemoryUsage::Tablebases,size);
+         return 1;
+      }
+      else if (!lockWarned) {
+         cerr << "warning: could not lock tablebase file " << fileName <<
+            " in memory" << endl;
+         lockWarned = true;
+      }
+   }
+   // The read-ahead continues after the mapping is gone: the pages
+   // stay in the page cache, where the tablebase code's own mapping
+   // of the file finds them.
+   munmap(base,size);
+   return 1;
+#endif
+}
+
+void TbPrefetcher::unlockAll()
+{
+   for (const Mapping &m : locked) {
+#ifdef _WIN32
+      VirtualUnlock(m.base,m.size);
+      UnmapViewOfFile(m.base);
+#else
+      munlock(m.base,m.size);
+      munmap(m.base,m.size);
+#endif
+      MemoryUsage::remove(MemoryUsage::Tablebases,m.size);
+   }
+   locked.clear();
+}
@@ -0,0 +1,79 @@
+// Copyright 2017 by Jon Dart. All Rights Reserved.
+
+#ifndef _TBPREFETCH_H
+#define _TBPREFETCH_H
+
+#include "board.h"
+#include <condition_variable>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Background prefetching of Syzygy tablebase files.
+//
+// When the root position comes within a few captures of tablebase
+// range, the WDL files for the material combinations that can arise
+// by captures are read ahead into the OS page cache by a low-priority
+// thread. The first probe into each table then does not stall the
+// search on disk reads. Optionally the files are also locked in RAM,
+// so that they are not evicted during the game.
+class TbPrefetcher {
+
+ public:
+
+   // Prefetch when the root is at most this many captures away from
+   // tablebase range.
+   static const int PREFETCH_CAPTURES = 2;
+
+   TbPrefetcher();
+
+   ~TbPrefetcher();
+
+   // Called at the start of a search. "path" is the tablebase path
+   // (directories separated by ':', or ';' on Windows), "maxMen" the
+   // largest number of men in the tablebases. Returns immediately;
+   // the files are read by the prefetch thread.
+   void update(const Board &board, const string &path, int maxMen,
+               bool lock);
+
+   // Compute the names (without extension, white pieces first) of the
+   // tables for "board" and the material combinations that can be
+   // reached from it by captures, with at most "maxMen" men.
+   static void tableNames(const Board &board, int maxMen,
+                          vector<string> &names);
+
+ private:
+
+   struct Mapping {
+      void *base;
+      size_t size;
+   };
+
+   void threadLoop();
+
+   // Read the file ahead, and lock it if requested. Returns 1 if the
+   // file exists.
+   int prefetch(const string &fileName, bool lock);
+
+   void unlockAll();
+
+   std::thread thread;
+   std::mutex mtx;
+   std::condition_variable cv;
+   // Request posted by update(), taken by the prefetch thread
+   vector<string> pendingNames;
+   string pendingPath;
+   bool pendingLock;
+   bool hasRequest;
+   bool done;
+   // State below is only used by the prefetch thread
+   set<string> fetched;
+   string currentPath;
+   bool currentLock;
+   vector<Mapping> locked;
+   bool lockWarned;
+};
+
+#endif
@@ -1,10 +1,18 @@
-// Copyright 2005-2010, 2012, 2013, 2016 by Jon Dart. All Rights Reserved.
+// Copyright 2005-2010, 2012, 2013, 2016, 2017 by Jon Dart. All Rights Reserved.
 
 #include "threadc.h"
 #include "debug.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
 #include <chrono>
 
-ThreadControl::ThreadControl() : state(0) /* locked */ {
+std::atomic<int> ThreadControl::spinCount(ThreadControl::DEFAULT_SPIN_COUNT);
+
+ThreadControl::ThreadControl() : state(0) /* locked */, parked(false) {
 }
 
 ThreadControl::~ThreadControl() {
@@ -12,32 +20,51 @@ ThreadControl::~ThreadControl() {
 
 void ThreadControl::signal() {
    // unblock the thread so it can execute
-   std::unique_lock<std::mutex> lk(mutex);
-   state = 1;
-   cond.notify_one();
+   state.store(1);
+   // Only take the lock if the waiter has (or may have) stopped
+   // spinning. Both this load and the waiter's store to "parked" are
+   // sequentially consistent, so either the waiter sees state set
+   // before it blocks, or we see it parked and notify it.
+   if (parked.load()) {
+      std::unique_lock<std::mutex> lk(mutex);
+      cond.notify_one();
+   }
 }
 
 
 void ThreadControl::reset() {
-   std::unique_lock<std::mutex> lk(mutex);
-   state = 0;
+   state.store(0);
 }
 
 int ThreadControl::wait() {
+   // spin first, in the hope the signal arrives shortly
+   for (int i = spinCount.load(std::memory_order_relaxed); i > 0; --i) {
+      if (state.load(std::memory_order_relaxed) &&
+          state.exchange(0,std::memory_order_acquire)) {
+         return 0;
+      }
+      cpuPause();
+   }
    // wait for condition variable > 0
    std::unique_lock<std::mutex> lk(mutex);
-   while (!state) {
+   parked.store(true);
+   while (!state.exchange(0)) {
       cond.wait(lk);
    }
-   // reset state
-   state = 0;
+   parked.store(false);
    return 0;
 }
 
-int ThreadControl::wouldWait() {
-   return state == 0;
-}
-
 void ThreadControl::sleep(time_t t) {
    std::this_thread::sleep_for (std::chrono::milliseconds(t));
 }
+
+void ThreadControl::lowerPriority() {
+#ifdef _WIN32
+   SetThreadPriority(GetCurrentThread(),THREAD_PRIORITY_IDLE);
+#elif defined(__linux__) && defined(SCHED_IDLE)
+   struct sched_param param;
+   param.sched_priority = 0;
+   pthread_setschedparam(pthread_self(),SCHED_IDLE,&param);
+#endif
+}
@@ -1,13 +1,19 @@
-// Copyright 2005-2007, 2012, 2013, 2016 by Jon Dart. All Rights Reserved.
+// Copyright 2005-2007, 2012, 2013, 2016, 2017 by Jon Dart. All Rights Reserved.
 #ifndef _THREAD_C_H
 #define _THREAD_C_H
 
 #include "types.h"
+#include <atomic>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
 
-// encapsulates an object usable for thread synchronization
+// encapsulates an object usable for thread synchronization.
+//
+// A waiting thread first spins for a short time on the signalled
+// state, and only blocks on the condition variable if it is not
+// signalled within that time. Wakeups that arrive while the waiter
+// is spinning then cost no system call and no scheduler latency.
 class ThreadControl {
  public:
    ThreadControl();
@@ -15,8 +21,6 @@ class ThreadControl {
 
    // wait for signal; return 1 if interrupted
    int wait();
-   // return non-zero if caller would wait (but don't actually wait)
-   int wouldWait();
    // wait for a fixed time interval (in milliseconds)
    void sleep(time_t t);
    // wake up a thread that is waiting
@@ -24,11 +28,32 @@ class ThreadControl {
    // reset the signalled state of the object
    void reset();
 
+   // Set the number of spin iterations before a waiting thread
+   // blocks (0 to block immediately).
+   static void setSpinCount(int count) {
+      spinCount = count;
+   }
+
+   static int getSpinCount() {
+      return spinCount;
+   }
+
+   // Run the calling thread below the search threads, so that
+   // background work only uses otherwise idle time.
+   static void lowerPriority();
+
+   // Default spin count: a few microseconds to a few tens of
+   // microseconds, depending on the cost of the pause instruction.
+   static const int DEFAULT_SPIN_COUNT = 1000;
+
  private:
    std::condition_variable cond;
    std::mutex mutex;
-   unsigned state;
+   std::atomic<unsigned> state;
+   // set while a thread is blocked (or about to block) on cond
+   std::atomic<bool> parked;
 
+   static std::atomic<int> spinCount;
 };
 
 #endif
@@ -3,12 +3,14 @@
 #include "threadp.h"
 #include "search.h"
 #include "globals.h"
+#include "memusage.h"
+#include "trace.h"
 #ifndef _WIN32
 #include <errno.h>
 #include <fcntl.h>
 #endif
 
-uint64_t ThreadPool::activeMask = 0ULL;
+atomic<uint64_t> ThreadPool::activeMask(0ULL);
 uint64_t ThreadPool::availableMask = 0ULL;
 #ifdef NUMA
 bitset<Constants::MaxCPUs> ThreadPool::rebindMask;
@@ -18,132 +20,69 @@ bitset<Constants::MaxCPUs> ThreadPool::rebindMask;
 static const size_t THREAD_STACK_SIZE = 8*1024*1024;
 #endif
 
-#ifdef _THREAD_TRACE
-static lock_t io_lock;
-
-void log(const string &s) {
-  Lock(io_lock);
-  puts(s.c_str());
-  fflush(stdout);
-  Unlock(io_lock);
-}
-void log(const string &s,int param) {
-  std::ostringstream out;
-  out << s;
-  out << ": ";
-  out << param << '\0';
-  log(out.str());
-}
-#endif
-
 void ThreadPool::idle_loop(ThreadInfo *ti, const SplitPoint *split) {
+   const uint64_t mask = 1ULL << ti->index;
+   bool idle = false;
    while (ti->state != ThreadInfo::Terminating) {
-#ifdef _THREAD_TRACE
-      {
-      std::ostringstream s;
-      s << "thread " << ti->index << " in idle loop" << '\0';
-      log(s.str());
-      }
-#endif
-      ti->pool->lock();
 #ifdef NUMA
+      ti->pool->lock();
       if (rebindMask.test(ti->index)) {
          if (ti->pool->bind(ti->index)) {
             cerr << "Warning: bind to CPU failed for thread " << ti->index << endl;
          }
          rebindMask.reset(ti->index);
       }
-#endif
-      if (ti->wouldWait()) {
-        ti->state = ThreadInfo::Idle; // mark thread available again
-        activeMask &= ~(1ULL << ti->index);
-        ti->pool->unlock();
-        int result;
-        if ((result = ti->wait()) != 0) {
-            if (result == -1) continue; // was interrupted
-            else break;
-        }
-      } else {
-#ifdef _THREAD_TRACE
-         {
-            std::ostringstream s;
-            s << "thread " << ti->index << " already signalled, skipping wait()" << '\0';
-            log(s.str());
-         }
-         
-#endif
-        // Avoid waiting if the thread state is already signalled. Also,
-        // in this case, do not even temporarily set the state to Idle.
-        ti->pool->unlock();
-      }
-#ifdef _THREAD_TRACE
-      log("unblocked",ti->index);
-#endif
-      // We've been woken up. There are three possible reasons:
-      // 1. This thread is terminating.
-      // 2. We are a master at a split point and all our slave threads
-      // are done.
-      // 3. This thread (a slave) has been assigned some work.
-      //
-      if (ti->state == ThreadInfo::Terminating) {
-          break;
-      }
-      else if (split && split->master == ti) {
-          // This thread is master of a split point, test for condition #2
-          Lock(split->master->work->splitLock);
-          if (split->slaves.size()==0) {
-#ifdef _THREAD_TRACE
-              log("helpful master exiting idle loop -  thread #",ti->index);
-#endif
-              ASSERT(ti->state == ThreadInfo::Working);
-              Unlock(split->master->work->splitLock);
-              // This thread exits the thread pool and returns to what it
-              // was previously doing.
-              return;
+      ti->pool->unlock();
+#endif
+      // Reset the signal before the checks below: a signal sent
+      // after they are done is then not lost.
+      ti->reset();
+      if (split && !split->slaves) {
+          // This thread is master of a split point, and all its slave
+          // threads are done.
+          ti->state = ThreadInfo::Working;
+          activeMask |= mask;
+          if (idle) {
+             EventTrace::record(ti->index,EventTrace::Idle,EventTrace::End);
           }
-#ifdef _THREAD_TRACE
-      {
-      std::ostringstream s;
-      s << "master thread " << ti->index << " woken" << '\0';
-      log(s.str());
+          // This thread exits the thread pool and returns to what it
+          // was previously doing.
+          return;
       }
-#endif
-          Unlock(split->master->work->splitLock);
+      // Mark the thread available. This is done before looking for
+      // work, so a split point published after the search below
+      // sees the thread as idle and wakes it.
+      ThreadInfo::State expected = ThreadInfo::Working;
+      ti->state.compare_exchange_strong(expected,ThreadInfo::Idle);
+      activeMask &= ~mask;
+      if (!idle) {
+         EventTrace::record(ti->index,EventTrace::Idle,EventTrace::Begin);
+         idle = true;
       }
-#ifdef _THREAD_TRACE
-      log("wakeup",ti->index);
-#endif
-      ASSERT(ti->work);
-#ifdef _DEBUG
-      int state = ti->state;
-#ifdef _THREAD_TRACE
-      if (state != ThreadInfo::Working) log("error ",ti->index);
-#endif
-      ASSERT(state == ThreadInfo::Working);
-#endif
-      // child should have its split point set
-      ASSERT(ti->work->split);
-      NodeStack childStack; // stack on which child will search
-      ti->work->init(childStack, ti);
-#ifdef _THREAD_TRACE
-      {
-      std::ostringstream s;
-      s << "search starting, thread " << ti->index << ", ply=" << ti->work->split->ply << '\0';
-      log(s.str());
+      if (ti->pool->steal(ti)) {
+         // child should have its split point set
+         ASSERT(ti->work->split);
+         EventTrace::record(ti->index,EventTrace::Idle,EventTrace::End);
+         idle = false;
+         const int ply = ti->work->split->ply;
+         EventTrace::record(ti->index,EventTrace::SplitSearch,EventTrace::Begin,ply);
+         NodeStack childStack; // stack on which child will search
+         ti->work->init(childStack, ti);
+         ti->work->searchSMP(ti);
+         EventTrace::record(ti->index,EventTrace::SplitSearch,EventTrace::End,ply);
+         ti->pool->checkIn(ti);
+         continue;
       }
-#endif
-      ti->work->searchSMP(ti);  
-#ifdef _THREAD_TRACE
-      {
-      std::ostringstream s;
-      s << "search completed, thread " << ti->index << ", ply=" << ti->work->split->ply << '\0';
-      log(s.str());
+      if (ti->state == ThreadInfo::Terminating) {
+         break;
       }
-#endif
-#ifdef _THREAD_TRACE
-      log("search completed ",ti->index);
-#endif
-      ti->pool->checkIn(ti);
+      // Nothing to do: wait until a split point is published, a slave
+      // finishes (if this thread is a master), or the thread is
+      // terminated.
+      ti->wait();
+   }
+   if (idle) {
+      EventTrace::record(ti->index,EventTrace::Idle,EventTrace::End);
    }
 }
 
@@ -161,21 +100,11 @@ static void * CDECL parkingLot(void *x)
    // Free Search instance
    delete ti->work;
    ti->work = nullptr;
-#ifdef _THREAD_TRACE
-   log("terminated, thread ",ti->index);
-#endif
    return 0;
 }
 
 ThreadInfo::~ThreadInfo() {
-}
-
-void ThreadInfo::start() {
-    ASSERT(index>=0);
-#ifdef _THREAD_TRACE
-    log("start",index);
-#endif
-    signal();
+   MemoryUsage::remove(MemoryUsage::ThreadStacks,stackSize);
 }
 
 ThreadInfo::ThreadInfo(ThreadPool *p, int i)
@@ -187,11 +116,9 @@ ThreadInfo::ThreadInfo(ThreadPool *p, int i)
    work(nullptr),
 #endif
    pool(p),
-   index(i)
+   index(i),
+   stackSize(0)
 {
-#ifdef _THREAD_TRACE
-  log("starting",i);
-#endif
 #ifdef _WIN32
       DWORD id;
       if (index == 0) {
@@ -210,13 +137,18 @@ ThreadInfo::ThreadInfo(ThreadPool *p, int i)
 	if (pthread_create(&thread_id, &(pool->stackSizeAttrib), parkingLot, this)) {
             perror("thread creation failed");
          }
+         else if (pthread_attr_getstacksize(&(pool->stackSizeAttrib), &stackSize)) {
+            stackSize = 0;
+         }
       }
+      MemoryUsage::add(MemoryUsage::ThreadStacks,stackSize);
 #endif
 }
 
  ThreadPool::ThreadPool(SearchController *ctrl, int n) :
     controller(ctrl), nThreads(n) {
    LockInit(poolLock);
+   updateSpinCount();
    for (int i = 0; i < Constants::MaxCPUs; i++) {
       data[i] = nullptr;
    }
@@ -244,9 +176,6 @@ ThreadInfo::ThreadInfo(ThreadPool *p, int i)
       cerr << "Warning: bind to CPU failed for thread 0" << endl;
    }
    rebindMask.set(0,0);
-#endif
-#ifdef _THREAD_TRACE
-  LockInit(io_lock);
 #endif
    LockInit(poolLock);
    for (int i = 0; i < n; i++) {
@@ -268,9 +197,6 @@ ThreadInfo::ThreadInfo(ThreadPool *p, int i)
 
 ThreadPool::~ThreadPool() {
    shutDown();
-#ifdef _THREAD_TRACE
-   LockFree(io_lock);
-#endif
 #ifndef _WIN32
    if (pthread_attr_destroy(&stackSizeAttrib)) {
       perror("pthread_attr_destroy");
@@ -309,47 +235,79 @@ void ThreadPool::shutDown() {
     Unlock(poolLock);
 }
 
-ThreadInfo * ThreadPool::checkOut(Search *parent, NodeInfo *forNode,
-  int ply, int depth) {
-    // lock against changes to the pool
-    Lock(poolLock);
-    // and aginst changes to the split stack in the parent
-    Lock(parent->splitLock);
-    // only loop over available threads
-    Bitboard b(~activeMask & availableMask);
-    b.clear(parent->ti->index);
-    int i;
-    while (b.iterate(i)) {
-       ThreadInfo *p = data[i];
-       ASSERT(p->state == ThreadInfo::Idle);
-       Search *child = p->work;
-       // lock the split stack in the child for the following test
-       Lock(child->splitLock);
-       // If this is a "master" thread it is not sufficient to just be
-       // idle - assign it only to one of its slave threads at the
-       // current top of the search stack.
-       bool ok;
-       if (child->activeSplitPoints) {
-          auto slaves = child->splitStack[child->activeSplitPoints-1].slaves;
-          ok = slaves.find(parent->ti) != slaves.end();
-       } else {
-          ok = true;
+int ThreadPool::steal(ThreadInfo *ti) {
+    Search *search = ti->work;
+    // If this thread is a "master" it is not sufficient to just be
+    // idle - it may only help one of its slave threads at the current
+    // top of its split stack ("helpful master").
+    const int own = search->activeSplitPoints;
+    const SplitPoint *ownSplit = own ? &search->splitStack[own-1] : nullptr;
+    for (;;) {
+       SplitPoint *best = nullptr;
+       unsigned bestGeneration = 0;
+       int bestPly = Constants::MaxPly, bestRemaining = 0;
+       // Only threads that are active can have open split points.
+       Bitboard b(activeMask & availableMask);
+       b.clear(ti->index);
+       if (ownSplit) {
+          b &= Bitboard(ownSplit->slaves);
        }
+       int i;
+       while (b.iterate(i)) {
+          Search *victim = data[i]->work;
+          const int n = std::min<int>(victim->activeSplitPoints,SPLIT_STACK_MAX_DEPTH);
+          for (int j = 0; j < n; j++) {
+             SplitPoint &sp = victim->splitStack[j];
+             if (!sp.open) continue;
+             const unsigned generation = sp.generation;
+             const int ply = sp.ply;
+             const int remaining = sp.remaining;
+             if (remaining <= 0 || sp.failHigh) continue;
+             if (ply < bestPly || (ply == bestPly && remaining > bestRemaining)) {
+                best = &sp;
+                bestGeneration = generation;
+                bestPly = ply;
+                bestRemaining = remaining;
+             }
+          }
+       }
+       if (!best) {
+          return 0;
+       }
+       // Check again under the lock: the master may have finished
+       // with the split point, or reused it, since it was examined.
+       int ok = 0;
+       best->lock();
+       if (best->open && best->generation == bestGeneration &&
+           best->remaining > 0 && !best->failHigh &&
+           (!ownSplit || (ownSplit->slaves & (1ULL << best->master->index)))) {
+          ThreadInfo::State expected = ThreadInfo::Idle;
+          // fails if the thread is being terminated
+          if (ti->state.compare_exchange_strong(expected,ThreadInfo::Working)) {
+             activeMask |= (1ULL << ti->index);
+             best->slaves |= (1ULL << ti->index);
+             search->split = best;
+             ok = 1;
+          }
+       }
+       best->unlock();
        if (ok) {
-         // We're working now - ensure we will not be allocated again
-         p->state = ThreadInfo::Working; 
-         activeMask |= (1ULL << p->index);
-         Unlock(child->splitLock);
-         Unlock(parent->splitLock);
-         Unlock(poolLock);
-         return p;
+          return 1;
+       }
+       else if (ti->state == ThreadInfo::Terminating) {
+          return 0;
        }
-       Unlock(child->splitLock);
+       // lost a race for this split point, look again
+    }
+}
+
+void ThreadPool::wakeIdle(ThreadInfo *ti, int n) {
+    Bitboard b(~activeMask & availableMask);
+    b.clear(ti->index);
+    int i;
+    while (n-- > 0 && b.iterate(i)) {
+       data[i]->signal();
     }
-    // no luck, no free threads
-    Unlock(parent->splitLock);
-    Unlock(poolLock);
-    return nullptr;
 }
 
 void ThreadPool::resize(unsigned n, SearchController *controller) {
@@ -369,20 +327,19 @@ void ThreadPool::resize(unsigned n, SearchController *controller) {
             // shrinking
             while (n < nThreads) {
                 ThreadInfo *p = data[nThreads-1];
+                // The thread is idle, since the pool is not resized
+                // during a search. Make it exit its idle loop, and
+                // wait for it before freeing its data.
                 p->state = ThreadInfo::Terminating;
-                if (p->state == ThreadInfo::Idle) {
-                    p->signal(); // unblock thread & exit thread proc
-                    // wait for thread exit
+                p->signal(); // unblock thread & exit thread proc
 #ifdef _WIN32
-                    WaitForSingleObject(p->thread_id,INFINITE);
+                WaitForSingleObject(p->thread_id,INFINITE);
 #else
-                    void *value_ptr;
-                    pthread_join(p->thread_id,&value_ptr);
+                void *value_ptr;
+                pthread_join(p->thread_id,&value_ptr);
 #endif
-                }
                 delete p;
-                data[nThreads] = nullptr;
-                --nThreads;
+                data[--nThreads] = nullptr;
             }
         }
         unlock();
@@ -390,75 +347,31 @@ void ThreadPool::resize(unsigned n, SearchController *controller) {
     ASSERT(nThreads == n);
     availableMask = (n == 64) ? 0xffffffffffffffffULL :
        (1ULL << n)-1;
+    updateSpinCount();
+}
+
+void ThreadPool::updateSpinCount() {
+    // hardware_concurrency may return 0 if unknown
+    const unsigned cores = std::thread::hardware_concurrency();
+    ThreadControl::setSpinCount(cores && nThreads > cores ? 0 :
+                                options.search.thread_spin_count);
 }
 
 void ThreadPool::checkIn(ThreadInfo *ti) {
-#ifdef _THREAD_TRACE
-    {
-        std::ostringstream s;
-        s << "checkIn: " << ti->index << " master=" <<
-            ti->work->split->master->index << '\0';
-        log(s.str());
-    }
-#endif
-    Lock(poolLock);
     SplitPoint *split = ti->work->split;
     ThreadInfo *parent = split->master;
-    Search *parentSearch = parent->work;
-    // lock parent's stack
-    Lock(parentSearch->splitLock);
+    ASSERT(parent->index != ti->index);
+    // remove ti from the slave threads of the split point
     split->lock();
-    // dissociate the thread from the parent
-    set<ThreadInfo *> &slaves = split->slaves;
-    // remove ti from the list of slave threads in the parent
-#ifdef _THREAD_TRACE
-    {
-        std::ostringstream s;
-        s << "removing slave thread " <<  ti->index << " from master "
-          << split->master->index << '\0';
-        log(s.str());
-    }
-#endif
-#ifdef _DEBUG
-    ASSERT(slaves.erase(ti)==1);
-#else
-    slaves.erase(ti);
-#endif
-    const unsigned remaining = (unsigned)slaves.size();
-    const bool top = split - parentSearch->splitStack + 1 == parentSearch->activeSplitPoints;
-#ifdef _THREAD_TRACE
-    {
-        std::ostringstream s;
-        s << "after checkIn: " << ti->index << " remaining: " << remaining << " top=" << top << '\0';
-        log(s.str());
-    }
-#endif
-    if (!remaining && top) {
-        // all slave threads are completed, so signal parent that it
-        // can exit its wait state and pop the split stack.
-        ASSERT(parent);
-        // Set parent state to Working before it even wakes up. This
-        // ensures it will not be allocated to another split point.
-        parent->state = ThreadInfo::Working;
-        activeMask |= (1ULL << parent->index);
-#ifdef _THREAD_TRACE
-        std::ostringstream s;
-        s << "thread " << ti->index <<  
-            " signaling parent (" << parent->index << ")" << 
-            " parent state=" << parent->state << '\0';
-        log(s.str());
-#endif
-        ASSERT(parent->index != ti->index);
-#ifdef _THREAD_TRACE
-        log("signal",parent->index);
-#endif
+    ASSERT(split->slaves & (1ULL << ti->index));
+    split->slaves &= ~(1ULL << ti->index);
+    const bool last = !split->slaves;
+    split->unlock();
+    if (last) {
+        // All slave threads are completed, so signal the master in
+        // case it is waiting for them.
         parent->signal();
     }
-    // ensure we we will wait when back in the idle loop
-    ti->reset();
-    split->unlock();
-    Unlock(parentSearch->splitLock);
-    Unlock(poolLock);
 }
 
 int ThreadPool::activeCount() const {
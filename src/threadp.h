@@ -27,12 +27,13 @@ struct ThreadInfo : public ThreadControl {
    enum State { Idle, Working, Terminating };
    ThreadInfo(ThreadPool *,int i);
    virtual ~ThreadInfo();
-   void start();
    atomic<State> state;
    Search *work;
    ThreadPool *pool;
    THREAD thread_id;
    int index;
+   // stack size of the thread, if created by the pool
+   size_t stackSize;
    int operator == (const ThreadInfo &ti) const {
        return index == ti.index;
    }
@@ -55,16 +56,19 @@ public:
      return data[0];
    }
 
-   // obtain an idle thread if possible, returns 
-   // non-null if successful
-   ThreadInfo *checkOut(Search *,NodeInfo *,int ply,int depth);
-
    // Do a quick check for thread availability (w/o locking)
    int checkAvailable() {
       return (activeMask & availableMask) != availableMask;
    }
 
-   // Threads that are waiting for work execute this function
+   // Wake up to n idle threads (other than ti), after ti has
+   // published a split point.
+   void wakeIdle(ThreadInfo *ti, int n);
+
+   // Threads that are waiting for work execute this function. Idle
+   // threads look for a split point to join, and sleep if there is
+   // none. If "split" is non-null, ti is the master of that split
+   // point, and the function returns when it has no more slaves.
    static void idle_loop(ThreadInfo *ti, const SplitPoint *split = nullptr);
 
    // return a thread to the pool
@@ -75,6 +79,12 @@ public:
    // resize the thread pool
    void resize(unsigned n, SearchController *);
 
+   // Set the spin count of waiting threads from the options.
+   // Spinning only pays if each thread has a processor to itself, so
+   // it is turned off when there are more threads than the hardware
+   // can run at once.
+   void updateSpinCount();
+
    template <void (Search::*fn)()>
       void forEachSearch() {
       lock();
@@ -86,6 +96,16 @@ public:
       unlock();
    }
 
+   void forEachSearch(const std::function<void(Search *)> &fn) {
+      lock();
+      for (unsigned i = 0; i < nThreads; i++) {
+          if (data[i] && data[i]->work) {
+              fn(data[i]->work);
+          }
+      }
+      unlock();
+   }
+
    SearchController *getController() const {
      return controller;
    }
@@ -118,6 +138,11 @@ public:
 private:
    void shutDown();
 
+   // Find the open split point with the most work (the lowest ply,
+   // then the most moves left) that ti can join, and attach ti to it.
+   // Returns 1 if successful.
+   int steal(ThreadInfo *ti);
+
    // lock for the class.
    LockDefine(poolLock);
    SearchController *controller;
@@ -125,7 +150,7 @@ private:
    std::array<ThreadInfo *,Constants::MaxCPUs> data;
 
    // mask of thread status - 0 if idle, 1 if active
-   static uint64_t activeMask;
+   static atomic<uint64_t> activeMask;
    static uint64_t availableMask;
 
 #ifndef _WIN32
@@ -138,8 +163,4 @@ private:
 #endif
 };
 
-#ifdef _THREAD_TRACE
-extern void log(const string &s);
-extern void log(const string &s,int param);
-#endif
 #endif
@@ -0,0 +1,118 @@
+// Copyright 2017 by Jon Dart. All Rights Reserved.
+
+#include "trace.h"
+#include "debug.h"
+#include <fstream>
+#include <iomanip>
+
+atomic<bool> EventTrace::active(false);
+
+atomic<uint32_t> EventTrace::generation(0);
+
+atomic<EventTrace::Buffer *> EventTrace::buffers[Constants::MaxCPUs+1];
+
+// Cycle count and clock time when tracing was enabled, used to
+// convert cycle counts to microseconds.
+static uint64_t startCycles;
+static std::chrono::steady_clock::time_point startTime;
+
+static const char *EVENT_NAMES[EventTrace::NumTypes] =
+   {"iteration", "idle", "split search", "split", "hash resize",
+    "tb probe"};
+
+static const char *ARG_NAMES[EventTrace::NumTypes] =
+   {"depth", nullptr, "ply", "ply", "MB", "ply"};
+
+void EventTrace::enable(bool on) {
+   if (on) {
+      active = false;
+      // buffers are cleared by their threads at their next event
+      ++generation;
+      startTime = std::chrono::steady_clock::now();
+      startCycles = getCycleCount();
+   }
+   active = on;
+}
+
+void EventTrace::add(int thread, Type type, Phase phase,
+                     uint32_t arg, uint16_t arg2) {
+   ASSERT(thread >= 0 && thread <= ControllerThread);
+   Buffer *b = buffers[thread].load(std::memory_order_acquire);
+   const uint32_t gen = generation.load(std::memory_order_relaxed);
+   if (b == nullptr) {
+      // first event for this thread
+      b = new Buffer;
+      b->count = 0;
+      b->generation = gen;
+      buffers[thread].store(b,std::memory_order_release);
+   }
+   else if (b->generation.load(std::memory_order_relaxed) != gen) {
+      // first event since tracing was restarted
+      b->count.store(0,std::memory_order_release);
+      b->generation.store(gen,std::memory_order_release);
+   }
+   const uint64_t n = b->count.load(std::memory_order_relaxed);
+   Event &e = b->events[n & (BUFFER_SIZE-1)];
+   e.time = getCycleCount();
+   e.arg = arg;
+   e.arg2 = arg2;
+   e.type = type;
+   e.phase = phase;
+   b->count.store(n+1,std::memory_order_release);
+}
+
+bool EventTrace::dump(const string &fileName) {
+   ofstream out(fileName.c_str(),ios::out | ios::trunc);
+   if (!out.good()) {
+      return false;
+   }
+   const double elapsedUs = std::chrono::duration<double,std::micro>(
+      std::chrono::steady_clock::now() - startTime).count();
+   const uint64_t elapsedCycles = getCycleCount() - startCycles;
+   const double cyclesPerUs = elapsedUs > 0.0 ?
+      elapsedCycles/elapsedUs : 1000.0;
+   out << "{\"traceEvents\":[" << endl;
+   out << setprecision(3) << std::fixed;
+   bool first = true;
+   for (int i = 0; i <= ControllerThread; i++) {
+      const Buffer *b = buffers[i].load(std::memory_order_acquire);
+      // skip threads with no events since tracing was last started
+      if (b == nullptr || b->generation.load(std::memory_order_acquire) !=
+          generation.load(std::memory_order_relaxed)) continue;
+      if (!first) out << ',' << endl;
+      first = false;
+      out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << i <<
+         ",\"args\":{\"name\":\"";
+      if (i == ControllerThread)
+         out << "controller";
+      else
+         out << "thread " << i;
+      out << "\"}}";
+      const uint64_t count = b->count.load(std::memory_order_acquire);
+      // if the buffer wrapped, only the newest events remain
+      const uint64_t start = count > BUFFER_SIZE ? count - BUFFER_SIZE : 0;
+      for (uint64_t n = start; n < count; n++) {
+         const Event &e = b->events[n & (BUFFER_SIZE-1)];
+         if (e.time < startCycles) continue;
+         static const char PHASES[] = {'B','E','i'};
+         out << ',' << endl;
+         out << "{\"name\":\"" << EVENT_NAMES[e.type] << "\",\"ph\":\"" <<
+            PHASES[e.phase] << "\",\"ts\":" <<
+            (e.time - startCycles)/cyclesPerUs <<
+            ",\"pid\":1,\"tid\":" << i;
+         if (e.phase == Instant) {
+            out << ",\"s\":\"t\"";
+         }
+         if (ARG_NAMES[e.type] && e.phase != End) {
+            out << ",\"args\":{\"" << ARG_NAMES[e.type] << "\":" << e.arg;
+            if (e.type == Split) {
+               out << ",\"moves\":" << e.arg2;
+            }
+            out << '}';
+         }
+         out << '}';
+      }
+   }
+   out << endl << "]}" << endl;
+   return out.good();
+}
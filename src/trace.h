@@ -0,0 +1,97 @@
+// Copyright 2017 by Jon Dart. All Rights Reserved.
+
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include "types.h"
+#include "constant.h"
+#include <string>
+
+// Low-overhead tracing of search events (iterations, split points,
+// idle time, tablebase probes, hash table resizing), for visualizing
+// how the search threads are used.
+//
+// Each thread records events into its own ring buffer, as fixed-size
+// binary records timestamped with the cycle counter, so recording
+// takes no locks and does no formatting. Tracing is off by default;
+// when it is off, recording an event costs a single test. The buffers
+// can be written out in Chrome trace format (JSON), which can be
+// loaded into chrome://tracing or Perfetto.
+class EventTrace {
+
+ public:
+
+   enum Type : uint8_t {
+      Iteration,    // root search iteration (arg = depth)
+      Idle,         // thread waiting for work
+      SplitSearch,  // thread searching at a split point (arg = ply)
+      Split,        // split point created (arg = ply, arg2 = moves)
+      HashResize,   // hash table resized (arg = size in MB)
+      TbProbe,      // tablebase probe (arg = ply)
+      NumTypes
+   };
+
+   enum Phase : uint8_t { Begin, End, Instant };
+
+   // Thread index for events recorded by the controlling (UI)
+   // thread, which has its own buffer after those of the search
+   // threads.
+   static const int ControllerThread = Constants::MaxCPUs;
+
+   // Start (clearing any events already recorded) or stop tracing.
+   static void enable(bool on);
+
+   static bool enabled() {
+      return active.load(std::memory_order_relaxed);
+   }
+
+   // Record an event for the thread with the given index (a search
+   // thread index, or ControllerThread). Only that thread may record
+   // events with that index.
+   static void record(int thread, Type type, Phase phase,
+                      uint32_t arg = 0, uint16_t arg2 = 0) {
+      if (enabled()) {
+         add(thread,type,phase,arg,arg2);
+      }
+   }
+
+   // Write the recorded events to a file, in Chrome trace format.
+   // Returns true if successful.
+   static bool dump(const string &fileName);
+
+ private:
+
+   struct Event {
+      uint64_t time;
+      uint32_t arg;
+      uint16_t arg2;
+      Type type;
+      Phase phase;
+   };
+
+   // per-thread buffer size (events): must be a power of 2
+   static const unsigned BUFFER_SIZE = 1<<15;
+
+   struct Buffer {
+      // count of events recorded: the newest is at
+      // events[(count-1) % BUFFER_SIZE]
+      atomic<uint64_t> count;
+      // value of "generation" when the events were recorded
+      atomic<uint32_t> generation;
+      Event events[BUFFER_SIZE];
+   };
+
+   static void add(int thread, Type type, Phase phase,
+                   uint32_t arg, uint16_t arg2);
+
+   static atomic<bool> active;
+
+   // Incremented each time tracing is started. A buffer is cleared
+   // by its own thread when it sees a new generation, so that no
+   // other thread writes to it while it may be recording.
+   static atomic<uint32_t> generation;
+
+   static atomic<Buffer *> buffers[Constants::MaxCPUs+1];
+};
+
+#endif
@@ -51,6 +51,11 @@ extern "C" {
 #include <atomic>
 #include <chrono>
 #include <thread>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#endif
 
 typedef uint8_t byte;
 typedef uint64_t hash_t;
@@ -79,6 +84,14 @@ enum {InvalidSquare = 127};
 #undef _64BIT
 #endif
 
+// A 64-bit x86 build that is not compiled for BMI2 includes both the
+// POPCNT/PEXT code and the portable code, and chooses between them at
+// startup according to the CPU features present (see Bitboard::init
+// and Attacks::init).
+#if defined(_64BIT) && !defined(BMI2) && ((defined(__x86_64__) && defined(USE_ASM)) || (defined(_MSC_VER) && defined(USE_INTRINSICS)))
+#define CPU_DISPATCH
+#endif
+
 #ifndef _GNUC_PREREQ
 #define _GNUC_PREREQ(major,minor) (__GNUC__ >= major || ( __GNUC__ == major && __GNUC_MINOR__ >= minor))
 #endif
@@ -180,40 +193,106 @@ inline uint64_t getRandomSeed() {
 #endif
 
 // multithreading support.
-#ifdef _WIN32
-#define LockDefine(x) CRITICAL_SECTION x
-#define lock_t CRITICAL_SECTION
-#define LockInit(x) InitializeCriticalSection(&x)
-#define Lock(x) EnterCriticalSection(&x);
-#define Unlock(x) LeaveCriticalSection(&x);
-#define LockFree(x) DeleteCriticalSection(&x)
-#define THREAD HANDLE
-#elif defined(USE_SPINLOCK)
+
+// Hint to the processor that the caller is in a spin-wait loop.
+FORCEINLINE void cpuPause() {
+#if defined(_MSC_VER) || defined(__SSE2__)
+   _mm_pause();
+#else
+   std::this_thread::yield();
+#endif
+}
+
+// Read the processor's cycle counter (or, if there is none available,
+// a nanosecond clock). Used for low-overhead timing.
+FORCEINLINE uint64_t getCycleCount() {
+#if defined(_MSC_VER) || defined(__i386__) || defined(__x86_64__)
+   return __rdtsc();
+#else
+   return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// Test-and-test-and-set lock. A thread that finds the lock held
+// spins reading it (which does not take the cache line away from the
+// holder), pausing for exponentially longer intervals, and yields
+// the processor if the lock stays held.
 class Spinlock {
-  atomic_flag locked = ATOMIC_FLAG_INIT;
-        
+  atomic<bool> locked;
+
+  static const int MAX_BACKOFF = 64;
+
  public:
-  Spinlock() {
+  Spinlock() : locked(false) {
   }
   virtual ~Spinlock() {
   }
   void lock()
   {
-    while (locked.test_and_set(std::memory_order_acquire)) { ; }
+    if (!locked.exchange(true,std::memory_order_acquire)) return;
+    int backoff = 1;
+    do {
+      while (locked.load(std::memory_order_relaxed)) {
+        if (backoff <= MAX_BACKOFF) {
+          for (int i = 0; i < backoff; i++) cpuPause();
+          backoff *= 2;
+        }
+        else {
+          std::this_thread::yield();
+        }
+      }
+    } while (locked.exchange(true,std::memory_order_acquire));
+  }
+
+  bool try_lock()
+  {
+    return !locked.load(std::memory_order_relaxed) &&
+      !locked.exchange(true,std::memory_order_acquire);
   }
-         
+
   void unlock()
   {
-    locked.clear(std::memory_order_release);
+    locked.store(false,std::memory_order_release);
   }
 };
+
+#ifdef _WIN32
+#define THREAD HANDLE
+#else
+#define THREAD pthread_t
+#endif
+
+#ifdef LOCK_STATS
+// Locks that record contention statistics (see lockstat.h), wrapping
+// the lock type used otherwise. Each lock is named after the variable
+// passed to LockInit.
+#include "lockstat.h"
+#if defined(_WIN32)
+#define lock_t InstrumentedLock<CriticalSectionLock>
+#elif defined(USE_SPINLOCK)
+#define lock_t InstrumentedLock<Spinlock>
+#else
+#define lock_t InstrumentedLock<std::mutex>
+#endif
+#define LockDefine(x) lock_t x
+#define LockInit(x) x.init(#x)
+#define Lock(x) x.lock()
+#define Unlock(x) x.unlock()
+#define LockFree(x)
+#elif defined(_WIN32)
+#define LockDefine(x) CRITICAL_SECTION x
+#define lock_t CRITICAL_SECTION
+#define LockInit(x) InitializeCriticalSection(&x)
+#define Lock(x) EnterCriticalSection(&x);
+#define Unlock(x) LeaveCriticalSection(&x);
+#define LockFree(x) DeleteCriticalSection(&x)
+#elif defined(USE_SPINLOCK)
 #define LockDefine(x) Spinlock x
 #define lock_t Spinlock
 #define LockInit(x)
 #define Lock(x) x.lock()
 #define Unlock(x) x.unlock()
 #define LockFree(x)
-#define THREAD pthread_t
 #else
 #define LockDefine(x) std::mutex *x
 #define lock_t std::mutex *
@@ -221,8 +300,6 @@ class Spinlock {
 #define Lock(x) x->lock()
 #define Unlock(x) x->unlock()
 #define LockFree(x) delete x
-#define THREAD pthread_t
-
 #endif
 
 #if _BYTE_ORDER == _BIG_ENDIAN
@@ -13,10 +13,18 @@
 #include "scoring.h"
 #include "search.h"
 #include "globals.h"
+#include "learn.h"
+#include "tbcache.h"
+#include "tbprefetch.h"
+#include "rbitbase.h"
+#include "bitprobe.h"
 
 #include <algorithm>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
 #include <set>
+#include <sstream>
 #include <string>
 #include <utility>
 
@@ -609,6 +617,101 @@ static int testDrawEval() {
     return errs;
 }
 
+static uint32_t materialKey(const Material &mat) {
+   return mat.pawnCount() + 9*mat.knightCount() + 27*mat.bishopCount() +
+      81*mat.rookCount() + 243*mat.queenCount();
+}
+
+// check the material keys of all positions reachable in "depth" moves
+static int testMaterialKeys(Board &board, int depth) {
+   int errs = 0;
+   for (int side = 0; side < 2; side++) {
+      const Material &mat = board.getMaterial((ColorType)side);
+      if (mat.keyInRange() && mat.key() != materialKey(mat)) {
+         cerr << "testMaterialTable: incorrect key, position:" << endl;
+         cerr << board << endl;
+         return ++errs;
+      }
+   }
+   if (depth == 0) return errs;
+   MoveGenerator mg(board);
+   Move moves[Constants::MaxMoves];
+   const int n = mg.generateAllMoves(moves,0);
+   for (int i = 0; i < n && !errs; i++) {
+      const BoardState state = board.state;
+      board.doMove(moves[i]);
+      // skip illegal moves (the generator's moves are pseudo-legal)
+      if (!board.anyAttacks(board.kingSquare(board.oppositeSide()),board.sideToMove())) {
+         errs += testMaterialKeys(board,depth-1);
+      }
+      board.undoMove(moves[i],state);
+   }
+   return errs;
+}
+
+static int testMaterialTable() {
+   int errs = 0;
+   // table entries must match the values computed directly
+   static const PieceType types[5] = {Pawn, Knight, Bishop, Rook, Queen};
+   static const uint32_t radix[5] = {9, 3, 3, 3, 2};
+   vector<Material> mats(Material::KeyRange);
+   for (uint32_t key = 0; key < Material::KeyRange; key++) {
+      mats[key].addPiece(King);
+      uint32_t k = key;
+      for (int i = 0; i < 5; i++) {
+         for (uint32_t n = k % radix[i]; n > 0; n--) {
+            mats[key].addPiece(types[i]);
+         }
+         k /= radix[i];
+      }
+      if (!mats[key].keyInRange() || mats[key].key() != key) {
+         cerr << "testMaterialTable: bad key " << key << endl;
+         return ++errs;
+      }
+   }
+   for (const Material &white : mats) {
+      for (const Material &black : mats) {
+         const Scoring::MaterialInfo info = Scoring::materialInfo(white,black);
+         Scoring::MaterialInfo direct;
+         Scoring::calcMaterialInfo(white,black,direct);
+         if (info.adjust != direct.adjust || info.flags != direct.flags ||
+             info.endgames != direct.endgames) {
+            cerr << "testMaterialTable: mismatch, keys " << white.key() <<
+               ' ' << black.key() << endl;
+            return ++errs;
+         }
+      }
+   }
+   // material draw flags must agree with Board::materialDraw
+   static const char *draw_fens[6] = {
+      "8/8/4k3/8/8/2K5/8/8 w - -",
+      "8/8/4k3/8/5b2/2K5/8/8 w - -",
+      "8/8/4k3/8/5n2/2K5/3N4/8 w - -",
+      "8/8/4k3/8/5b2/2K5/3B4/8 w - -",
+      "8/8/4k3/8/5b2/2K5/4B3/8 w - -",
+      "8/8/4k3/8/5b2/2K5/3N4/8 w - -"
+   };
+   for (int i = 0; i < 6; i++) {
+      Board board;
+      if (!BoardIO::readFEN(board,draw_fens[i])) {
+         cerr << "testMaterialTable: error in FEN " << i << endl;
+         ++errs;
+      }
+      else if (Scoring::materialDraw(board) != board.materialDraw()) {
+         cerr << "testMaterialTable: wrong material draw, case " << i << endl;
+         ++errs;
+      }
+   }
+   // keys must be maintained through captures and promotions
+   Board board;
+   if (!BoardIO::readFEN(board,"r1b1k2r/1P4P1/2n5/7q/3Q4/5N2/1p4p1/R1B1K2R w KQkq - 0 1")) {
+      cerr << "testMaterialTable: error in FEN" << endl;
+      return ++errs;
+   }
+   errs += testMaterialKeys(board,2);
+   return errs;
+}
+
 static int testWouldAttack() {
    static const struct TestCase
    {
@@ -715,6 +818,290 @@ static int testCheckStatus() {
    return errs;
 }
 
+static int testUpcomingRep() {
+   static const struct TestCase
+   {
+      string moves;
+      int ply;
+      int result;
+   } cases[4] = {
+      // Black can return to the start position (once repeated)
+      {"Nf3 Nf6 Ng1", 10, 1},
+      // but a first occurrence before the root does not count
+      {"Nf3 Nf6 Ng1", 1, 0},
+      {"Nf3 Nf6 Ng1 Ng8 Nf3 Nf6 Ng1", 1, 1},
+      // pawn move resets the history
+      {"Nf3 Nf6 Ng1 e5", 10, 0}
+   };
+   int errs = 0;
+   for (int i = 0; i < 4; i++) {
+      const TestCase &acase = cases[i];
+      Board board;
+      stringstream s(acase.moves);
+      string moveStr;
+      while (s >> moveStr) {
+         Move m = Notation::value(board,board.sideToMove(),Notation::InputFormat::SAN,moveStr);
+         if (IsNull(m)) {
+            cerr << "testUpcomingRep: error in test case " << i << " bad move" << endl;
+            ++errs;
+            break;
+         }
+         board.doMove(m);
+      }
+      if (board.upcomingRep(acase.ply) != acase.result) {
+         cerr << "testUpcomingRep: error in test case " << i << endl;
+         ++errs;
+      }
+   }
+   return errs;
+}
+
+static int doMoves(Board &board, const string &moves) {
+   stringstream s(moves);
+   string moveStr;
+   while (s >> moveStr) {
+      Move m = Notation::value(board,board.sideToMove(),Notation::InputFormat::SAN,moveStr);
+      if (IsNull(m)) return 0;
+      board.doMove(m);
+   }
+   return 1;
+}
+
+static int testBoardHistory() {
+   int errs = 0;
+   Board board;
+   doMoves(board,"Nf3 Nf6 Ng1 Ng8");
+   // a copy keeps its history while the original moves on
+   Board copy(board);
+   if (!doMoves(board,"Nc3 Nc6 Nb1 Nb8 Nc3") || !doMoves(copy,"Nf3 Nf6")) {
+      cerr << "testBoardHistory: bad move" << endl;
+      return ++errs;
+   }
+   if (board.repCount() != 1 || copy.repCount() != 1) {
+      cerr << "testBoardHistory: incorrect repetition count" << endl;
+      ++errs;
+   }
+   return errs;
+}
+
+static int testSliderAttacks() {
+   int errs = 0;
+#ifdef CPU_DISPATCH
+   // if both lookup methods are available, they must agree
+   if (Bitboard::cpuBmi2) {
+      uint64_t occ = 0x123456789abcdefULL;
+      for (int i = 0; i < 1000; i++) {
+         occ = occ*6364136223846793005ULL + 1442695040888963407ULL;
+         for (Square sq = 0; sq < 64; sq++) {
+            if (Attacks::rookAttacksPext(sq,occ) !=
+                Attacks::rookAttacksMagic(sq,occ) ||
+                Attacks::bishopAttacksPext(sq,occ) !=
+                Attacks::bishopAttacksMagic(sq,occ)) {
+               cerr << "testSliderAttacks: mismatch, square " << sq << endl;
+               return ++errs;
+            }
+         }
+      }
+   }
+#endif
+   return errs;
+}
+
+static int testTbCache() {
+   int errs = 0;
+   TbCache *cache = new TbCache();
+   const hash_t key = 0x123456789abcdef0ULL;
+   int hit;
+   score_t score;
+   if (cache->lookup(key,0,hit,score)) {
+      cerr << "testTbCache: unexpected hit" << endl;
+      ++errs;
+   }
+   // a mate score stored at one ply is adjusted when read at another
+   cache->store(key,4,1,Constants::MATE-10);
+   if (!cache->lookup(key,2,hit,score) || !hit ||
+       score != Constants::MATE-8) {
+      cerr << "testTbCache: error in mate score" << endl;
+      ++errs;
+   }
+   cache->store(key+1,3,0,Constants::INVALID_SCORE);
+   if (!cache->lookup(key+1,3,hit,score) || hit) {
+      cerr << "testTbCache: error in failed probe" << endl;
+      ++errs;
+   }
+   // resizing clears the cache
+   cache->resize(1024);
+   if (cache->lookup(key,2,hit,score)) {
+      cerr << "testTbCache: unexpected hit after resize" << endl;
+      ++errs;
+   }
+   cache->store(key,0,1,0);
+   if (!cache->lookup(key,0,hit,score) || !hit || score != 0) {
+      cerr << "testTbCache: error after resize" << endl;
+      ++errs;
+   }
+   delete cache;
+   return errs;
+}
+
+static int testTbPrefetchNames() {
+   int errs = 0;
+   Board board;
+   if (!BoardIO::readFEN(board,"8/8/4k3/8/2r5/4P3/4K3/3R4 w - -")) {
+      cerr << "testTbPrefetchNames: error in FEN" << endl;
+      return 1;
+   }
+   vector<string> names;
+   TbPrefetcher::tableNames(board,4,names);
+   const vector<string> expected = {"KPvK","KPvKR","KRPvK","KRvK","KRvKR","KvKR"};
+   if (names != expected) {
+      cerr << "testTbPrefetchNames: incorrect table names:";
+      for (const string &name : names) cerr << ' ' << name;
+      cerr << endl;
+      ++errs;
+   }
+   return errs;
+}
+
+static int testRuntimeBitbases() {
+   int errs = 0;
+   if (!RuntimeBitbases::generate("KPK",2)) {
+      cerr << "testRuntimeBitbases: generation failed" << endl;
+      return 1;
+   }
+   // the generated KPK table must agree with the built-in one
+   int mismatches = 0;
+   for (Square p = A2; p <= H7; p++) {
+      for (Square wk = 0; wk < 64; wk++) {
+         for (Square bk = 0; bk < 64; bk++) {
+            if (wk == p || bk == p || wk == bk ||
+                Attacks::king_attacks[wk].isSet(bk)) continue;
+            for (int side = White; side <= Black; side++) {
+               Board board;
+               board.makeEmpty();
+               board.setContents(WhitePawn,p);
+               board.setContents(WhiteKing,wk);
+               board.setContents(BlackKing,bk);
+               board.setSideToMove((ColorType)side);
+               board.setCastleStatus(CantCastleEitherSide,White);
+               board.setCastleStatus(CantCastleEitherSide,Black);
+               board.setSecondaryVars();
+               // skip positions where the side not to move is in check
+               if (board.anyAttacks(board.kingSquare(board.oppositeSide()),board.sideToMove())) continue;
+               const RuntimeBitbases::Result result = RuntimeBitbases::probe(board);
+               const bool whiteWins = lookupBitbase(wk,p,bk,White,(ColorType)side) != 0;
+               const RuntimeBitbases::Result expected = whiteWins ?
+                  (side == White ? RuntimeBitbases::Win : RuntimeBitbases::Loss) :
+                  RuntimeBitbases::Draw;
+               if (result != expected && mismatches++ < 5) {
+                  cerr << "testRuntimeBitbases: KPK mismatch: " << endl << board << endl;
+               }
+            }
+         }
+      }
+   }
+   if (mismatches) ++errs;
+   // known results in the other endgames
+   struct Case {
+      const char *table, *fen;
+      RuntimeBitbases::Result result;
+   };
+   const Case cases[] = {
+      {"KQKP","4k3/p7/8/8/8/8/8/3QK3 w - -",RuntimeBitbases::Win},
+      {"KQKP","4k3/p7/8/8/8/8/8/3QK3 b - -",RuntimeBitbases::Loss},
+      {"KRKP","4k3/p7/8/8/8/8/8/3RK3 w - -",RuntimeBitbases::Win},
+      {"KBNK","4k3/8/8/8/8/8/8/2BNK3 w - -",RuntimeBitbases::Win},
+      {"KBNK","8/8/8/8/8/8/2k5/1B1NK3 b - -",RuntimeBitbases::Draw},
+      {"KRKB","b3k3/8/8/8/8/8/8/R3K3 w - -",RuntimeBitbases::Win},
+      {"KRKB","4k3/8/8/8/4b3/8/8/R3K3 w - -",RuntimeBitbases::Draw},
+      {"KRKN","n3k3/8/8/8/8/8/8/R3K3 w - -",RuntimeBitbases::Win},
+      {"KRKN","4k3/8/8/8/4n3/8/8/R3K3 w - -",RuntimeBitbases::Draw},
+      {"KPKP","8/6P1/8/8/k7/8/p7/K7 w - -",RuntimeBitbases::Win},
+      {"KPKP","4k3/8/8/3p4/3P4/8/8/4K3 w - -",RuntimeBitbases::Draw}
+   };
+   for (const Case &c : cases) {
+      Board board;
+      if (!BoardIO::readFEN(board,c.fen)) {
+         cerr << "testRuntimeBitbases: error in FEN: " << c.fen << endl;
+         ++errs;
+         continue;
+      }
+      if (!RuntimeBitbases::generate(c.table,2)) {
+         cerr << "testRuntimeBitbases: generation of " << c.table << " failed" << endl;
+         ++errs;
+         continue;
+      }
+      const RuntimeBitbases::Result result = RuntimeBitbases::probe(board);
+      if (result != c.result) {
+         cerr << "testRuntimeBitbases: incorrect " << c.table << " result " <<
+            (int)result << " for " << c.fen << endl;
+         ++errs;
+      }
+   }
+   return errs;
+}
+
+// Path for a scratch file in the temporary directory
+static string tempFilePath(const string &name) {
+#ifdef _WIN32
+   const char *dir = getenv("TEMP");
+   return string(dir && *dir ? dir : ".") + "\\" + name;
+#else
+   const char *dir = getenv("TMPDIR");
+   return string(dir && *dir ? dir : "/tmp") + "/" + name;
+#endif
+}
+
+static int testLearnFile() {
+   int errs = 0;
+   const hash_t codes[4] = {0x3000ULL, 0x1000ULL, 0x3000ULL, 0x2000ULL};
+   vector<LearnRecord> records;
+   for (int i = 0; i < 4; i++) {
+      LearnRecord rec;
+      rec.hashcode = codes[i];
+      rec.in_check = 0;
+      rec.score = score_t(10*i);
+      rec.depth = 8+i;
+      rec.start = E2;
+      rec.dest = E4;
+      rec.promotion = Empty;
+      records.push_back(rec);
+   }
+   const string fileName(tempFilePath("arasan_unit_test.lrb"));
+   if (!writeLearnFile(fileName,records)) {
+      cerr << "testLearnFile: write failed" << endl;
+      return 1;
+   }
+   vector<LearnRecord> result;
+   if (!readLearnFile(fileName,result)) {
+      cerr << "testLearnFile: read failed" << endl;
+      ++errs;
+   }
+   // sorted by hash code, with the later duplicate kept
+   else if (result.size() != 3 ||
+       result[0].hashcode != 0x1000ULL ||
+       result[1].hashcode != 0x2000ULL ||
+       result[2].hashcode != 0x3000ULL ||
+       result[2].score != 20 || result[2].depth != 10 ||
+       result[2].start != E2 || result[2].dest != E4) {
+      cerr << "testLearnFile: incorrect records read" << endl;
+      ++errs;
+   }
+   // a header whose count exceeds the records present must be rejected
+   {
+      fstream f(fileName.c_str(),ios::in | ios::out | ios::binary);
+      const uint32_t count = 0x7fffffff;
+      f.seekp(12);
+      f.write((const char*)&count,sizeof(count));
+   }
+   if (readLearnFile(fileName,result)) {
+      cerr << "testLearnFile: corrupt file accepted" << endl;
+      ++errs;
+   }
+   remove(fileName.c_str());
+   return errs;
+}
+
 static int testRec(const EPDRecord &rec, vector < pair<string,string> > correct)
 {
    int errs = 0;
@@ -1035,7 +1422,15 @@ int doUnit() {
    errs += testEval();
    errs += testBitbases();
    errs += testDrawEval();
+   errs += testMaterialTable();
    errs += testCheckStatus();
+   errs += testUpcomingRep();
+   errs += testBoardHistory();
+   errs += testSliderAttacks();
+   errs += testTbCache();
+   errs += testTbPrefetchNames();
+   errs += testRuntimeBitbases();
+   errs += testLearnFile();
    errs += testEPD();
    errs += testHash();
    errs += testPerft();
@@ -0,0 +1,349 @@
+// Copyright 2017 by Jon Dart. All Rights Reserved.
+// Stand-alone console executable to build the "magicdata.cpp" file,
+// which contains the slider attack tables used by the Attacks class.
+// Usage: makemagic > magicdata.cpp
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace std;
+
+static const unsigned r_shift[64]=
+{
+	52, 53, 53, 53, 53, 53, 53, 52,
+	53, 54, 54, 54, 54, 54, 54, 53,
+	53, 54, 54, 54, 54, 54, 54, 53,
+	53, 54, 54, 54, 54, 54, 54, 53,
+	53, 54, 54, 54, 54, 54, 54, 53,
+	53, 54, 54, 54, 54, 54, 54, 53,
+	53, 54, 54, 54, 54, 54, 54, 53,
+	53, 54, 54, 53, 53, 53, 53, 53
+};
+
+static const uint64_t r_magic[64]=
+{
+   0x0080001020400080ULL, 0x0040001000200040ULL, 0x0080081000200080ULL, 0x0080040800100080ULL,
+	0x0080020400080080ULL, 0x0080010200040080ULL, 0x0080008001000200ULL, 0x0080002040800100ULL,
+	0x0000800020400080ULL, 0x0000400020005000ULL, 0x0000801000200080ULL, 0x0000800800100080ULL,
+	0x0000800400080080ULL, 0x0000800200040080ULL, 0x0000800100020080ULL, 0x0000800040800100ULL,
+	0x0000208000400080ULL, 0x0000404000201000ULL, 0x0000808010002000ULL, 0x0000808008001000ULL,
+	0x0000808004000800ULL, 0x0000808002000400ULL, 0x0000010100020004ULL, 0x0000020000408104ULL,
+	0x0000208080004000ULL, 0x0000200040005000ULL, 0x0000100080200080ULL, 0x0000080080100080ULL,
+	0x0000040080080080ULL, 0x0000020080040080ULL, 0x0000010080800200ULL, 0x0000800080004100ULL,
+	0x0000204000800080ULL, 0x0000200040401000ULL, 0x0000100080802000ULL, 0x0000080080801000ULL,
+	0x0000040080800800ULL, 0x0000020080800400ULL, 0x0000020001010004ULL, 0x0000800040800100ULL,
+	0x0000204000808000ULL, 0x0000200040008080ULL, 0x0000100020008080ULL, 0x0000080010008080ULL,
+	0x0000040008008080ULL, 0x0000020004008080ULL, 0x0000010002008080ULL, 0x0000004081020004ULL,
+	0x0000204000800080ULL, 0x0000200040008080ULL, 0x0000100020008080ULL, 0x0000080010008080ULL,
+	0x0000040008008080ULL, 0x0000020004008080ULL, 0x0000800100020080ULL, 0x0000800041000080ULL,
+	0x00FFFCDDFCED714AULL, 0x007FFCDDFCED714AULL, 0x003FFFCDFFD88096ULL, 0x0000040810002101ULL,
+	0x0001000204080011ULL, 0x0001000204000801ULL, 0x0001000082000401ULL, 0x0001FFFAABFAD1A2ULL
+};
+
+static const unsigned b_shift[64]=
+{
+	58, 59, 59, 59, 59, 59, 59, 58,
+	59, 59, 59, 59, 59, 59, 59, 59,
+	59, 59, 57, 57, 57, 57, 59, 59,
+	59, 59, 57, 55, 55, 57, 59, 59,
+	59, 59, 57, 55, 55, 57, 59, 59,
+	59, 59, 57, 57, 57, 57, 59, 59,
+	59, 59, 59, 59, 59, 59, 59, 59,
+	58, 59, 59, 59, 59, 59, 59, 58
+};
+
+static const uint64_t b_magic[64]=
+{
+	0x0002020202020200ULL, 0x0002020202020000ULL, 0x0004010202000000ULL, 0x0004040080000000ULL,
+	0x0001104000000000ULL, 0x0000821040000000ULL, 0x0000410410400000ULL, 0x0000104104104000ULL,
+	0x0000040404040400ULL, 0x0000020202020200ULL, 0x0000040102020000ULL, 0x0000040400800000ULL,
+	0x0000011040000000ULL, 0x0000008210400000ULL, 0x0000004104104000ULL, 0x0000002082082000ULL,
+	0x0004000808080800ULL, 0x0002000404040400ULL, 0x0001000202020200ULL, 0x0000800802004000ULL,
+	0x0000800400A00000ULL, 0x0000200100884000ULL, 0x0000400082082000ULL, 0x0000200041041000ULL,
+	0x0002080010101000ULL, 0x0001040008080800ULL, 0x0000208004010400ULL, 0x0000404004010200ULL,
+	0x0000840000802000ULL, 0x0000404002011000ULL, 0x0000808001041000ULL, 0x0000404000820800ULL,
+	0x0001041000202000ULL, 0x0000820800101000ULL, 0x0000104400080800ULL, 0x0000020080080080ULL,
+	0x0000404040040100ULL, 0x0000808100020100ULL, 0x0001010100020800ULL, 0x0000808080010400ULL,
+	0x0000820820004000ULL, 0x0000410410002000ULL, 0x0000082088001000ULL, 0x0000002011000800ULL,
+	0x0000080100400400ULL, 0x0001010101000200ULL, 0x0002020202000400ULL, 0x0001010101000200ULL,
+	0x0000410410400000ULL, 0x0000208208200000ULL, 0x0000002084100000ULL, 0x0000000020880000ULL,
+	0x0000001002020000ULL, 0x0000040408020000ULL, 0x0004040404040000ULL, 0x0002020202020000ULL,
+	0x0000104104104000ULL, 0x0000002082082000ULL, 0x0000000020841000ULL, 0x0000000000208800ULL,
+	0x0000000010020200ULL, 0x0000000404080200ULL, 0x0000040404040400ULL, 0x0002020202020200ULL
+};
+
+// Magics and shifts for 32-bit builds, which compute the index from
+// two 32-bit multiplies (see Attacks::rookAttacksMagic).
+
+static const unsigned r_shift32[64]=
+{
+	20, 21, 21, 21, 21, 21, 21, 20,
+	21, 22, 22, 22, 22, 22, 22, 21,
+	21, 22, 22, 22, 22, 22, 22, 21,
+	21, 22, 22, 22, 22, 22, 22, 21,
+	21, 22, 22, 22, 22, 22, 22, 21,
+	21, 22, 22, 22, 22, 22, 22, 21,
+	21, 22, 22, 22, 22, 22, 22, 21,
+	20, 21, 21, 21, 21, 21, 21, 20
+};
+
+static const uint64_t r_magic32[64]=
+{
+	0x00A0588002001205ULL, 0x2410004001400220ULL, 0x0110040220600408ULL, 0x1003100810080082ULL,
+	0x2200100220404204ULL, 0x0300088311000204ULL, 0x0121000401000092ULL, 0x0080308001800941ULL,
+	0x1024090000080208ULL, 0x30402C0000004010ULL, 0x044A200042004018ULL, 0x2008401200181001ULL,
+	0x0102001004020818ULL, 0x00100C0000420202ULL, 0x0005120008010201ULL, 0x410412E010020101ULL,
+	0x040314000A081002ULL, 0x0A12400400182020ULL, 0x4080110000B20208ULL, 0x0022004020080204ULL,
+	0x04A1408800040404ULL, 0x0200440010C80B01ULL, 0x2091080200240C02ULL, 0x2482024000800101ULL,
+	0x0480002010504501ULL, 0x48A2003020004582ULL, 0x0B02104404242282ULL, 0x0200421020445A22ULL,
+	0x341006000801280EULL, 0x02010C0200045096ULL, 0x0204210000200A81ULL, 0x4800408200000101ULL,
+	0x3804020048400880ULL, 0x040412C020204009ULL, 0x1004028209012095ULL, 0x0300082440032010ULL,
+	0x0100049040202A01ULL, 0x0040020008030144ULL, 0x0820204002812002ULL, 0x042040403408040BULL,
+	0x0040402901841062ULL, 0x2002101400004805ULL, 0x0010101200020064ULL, 0x0020201000802C82ULL,
+	0x4600480010010042ULL, 0x000A000C10101082ULL, 0x0441003400800803ULL, 0x0004010200406903ULL,
+	0x00C0204020862801ULL, 0x0C8202012480204FULL, 0x0090410004422001ULL, 0x002012005008444AULL,
+	0x0104004000004C0AULL, 0x0508200822045489ULL, 0x0922010100400C05ULL, 0x02800040010000C1ULL,
+	0x0180136100001045ULL, 0x0050208101010040ULL, 0x3092100A00502042ULL, 0x4010002100040409ULL,
+	0x1210040700490408ULL, 0x0844108101400803ULL, 0x105240010C1200C5ULL, 0x4010244701080481ULL
+};
+
+static const unsigned b_shift32[64]=
+{
+	26, 27, 27, 27, 27, 27, 27, 26,
+	27, 27, 27, 27, 27, 27, 27, 27,
+	27, 27, 25, 25, 25, 25, 27, 27,
+	27, 27, 25, 23, 23, 25, 27, 27,
+	27, 27, 25, 23, 23, 25, 27, 27,
+	27, 27, 25, 25, 25, 25, 27, 27,
+	27, 27, 27, 27, 27, 27, 27, 27,
+	26, 27, 27, 27, 27, 27, 27, 26
+};
+
+static const uint64_t b_magic32[64]=
+{
+	0x0041084004C2022EULL, 0x0101410160023014ULL, 0x0221010004900312ULL, 0x1000061800080E89ULL,
+	0x0043110020460610ULL, 0x4001110000110482ULL, 0x0610141004042402ULL, 0x1028440020011255ULL,
+	0x080A00C000031223ULL, 0x0104770010000803ULL, 0x0500286160204314ULL, 0x0088000508411904ULL,
+	0x0900000230001112ULL, 0x61D8480C01000481ULL, 0x08200C8200900086ULL, 0x0811041400840082ULL,
+	0x2444008100220240ULL, 0x040800C0400A0930ULL, 0x0020410008102C56ULL, 0x0108200000014198ULL,
+	0x1018002004852614ULL, 0x04200A0440002C01ULL, 0x009004D502420081ULL, 0x4405440000082125ULL,
+	0x2882522024201010ULL, 0x600801C008014840ULL, 0x3000208010414400ULL, 0x0C00420000120820ULL,
+	0x0010402100101100ULL, 0x3D90100100055441ULL, 0x0612110000412480ULL, 0x41404C1000210A00ULL,
+	0x09CB022304021090ULL, 0x1010420420085128ULL, 0x0631014018001406ULL, 0x0020220000002858ULL,
+	0x09A0101000084254ULL, 0x1081008014022442ULL, 0x0124441400162081ULL, 0x000058C300880101ULL,
+	0x6000649400021220ULL, 0x2082160000405202ULL, 0x2040148400020101ULL, 0x0C08008004230094ULL,
+	0x3400118000C00181ULL, 0x0A0018C005040488ULL, 0x5040610001A00204ULL, 0x0530008008502106ULL,
+	0x100800BC24004210ULL, 0x4224040109842104ULL, 0x0091080001110042ULL, 0x08484200100A0901ULL,
+	0x0242000D10002012ULL, 0x4A0A040004024518ULL, 0x0881040A10404508ULL, 0x0143140008080648ULL,
+	0x008228000482008AULL, 0x04822000400A18A2ULL, 0x008411002A601026ULL, 0x2084042000021508ULL,
+	0x1052020260021049ULL, 0x1004012012045040ULL, 0x1C2950C200001220ULL, 0x0820423001200484ULL
+};
+
+struct MoveInfo {
+    int dir;
+    uint64_t edges;
+};
+
+static const MoveInfo ROOK_INFO[4] = {
+    {1,0x8080808080808080ULL},
+    {-1,0x101010101010101ULL},
+    {8,0xff00000000000000ULL},
+    {-8,0xffULL}};
+
+static const MoveInfo BISHOP_INFO[4] = {
+    {7,0xff01010101010101ULL},
+    {-7,0x80808080808080ffULL},
+    {9,0xff80808080808080ULL},
+    {-9,0x1010101010101ffULL}};
+
+static inline uint64_t bit(int sq) {
+    return 1ULL << sq;
+}
+
+static int bitCount(uint64_t x) {
+    int n = 0;
+    for (; x; x &= x-1) n++;
+    return n;
+}
+
+static uint64_t generateSlidingMoves(int sq, uint64_t occ,
+                                     const MoveInfo * const limits,
+                                     bool excludeEdge = false) {
+    uint64_t moves = 0;
+    for (int i = 0; i < 4; i++) {
+        const int dir = limits[i].dir;
+        int dest = sq;
+        const uint64_t limit = occ | limits[i].edges;
+        if (!(limits[i].edges & bit(dest))) {
+            do {
+                dest += dir;
+                if (!excludeEdge || !(limits[i].edges & bit(dest)))
+                    moves |= bit(dest);
+            } while (!(limit & bit(dest)));
+        }
+    }
+    return moves;
+}
+
+// Select, out of the set of n (generaly non-contiguous) bits in "squares",
+// that subset that have their corresponding (0..n-1) bit set in "index".
+static uint64_t generateOccupancy(uint64_t squares, uint64_t index) {
+    uint64_t occ = 0;
+    int n = 0;
+    for (int sq = 0; sq < 64; sq++) {
+        if (squares & bit(sq)) {
+            if (index & bit(n)) occ |= bit(sq);
+            n++;
+        }
+    }
+    return occ;
+}
+
+// Inverse of generateOccupancy (same result as the PEXT instruction).
+static uint64_t extractBits(uint64_t x, uint64_t mask) {
+    uint64_t result = 0;
+    int n = 0;
+    for (int sq = 0; sq < 64; sq++) {
+        if (mask & bit(sq)) {
+            if (x & bit(sq)) result |= bit(n);
+            n++;
+        }
+    }
+    return result;
+}
+
+static void printArray(const char *decl, const vector<uint64_t> &data) {
+    printf("static const CACHE_ALIGN %s[%d] = {\n",decl,(int)data.size());
+    for (size_t i = 0; i < data.size(); i++) {
+        if (data[i]) {
+            printf("0x%llx",(unsigned long long)data[i]);
+        } else {
+            printf("0");
+        }
+        if (i+1 < data.size()) printf(",");
+        if (i % 8 == 7) printf("\n");
+    }
+    printf("};\n\n");
+}
+
+struct SliderInfo {
+    const char *name;
+    const MoveInfo *info;
+    const uint64_t *magic;
+    const unsigned *shift;
+};
+
+static const SliderInfo SLIDERS[2] = {
+    {"bishop",BISHOP_INFO,b_magic,b_shift},
+    {"rook",ROOK_INFO,r_magic,r_shift}};
+
+static const SliderInfo SLIDERS32[2] = {
+    {"bishop",BISHOP_INFO,b_magic32,b_shift32},
+    {"rook",ROOK_INFO,r_magic32,r_shift32}};
+
+// Index computed by Attacks::rookAttacksMagic/bishopAttacksMagic.
+static uint64_t magicIndex(uint64_t occ, uint64_t magic, unsigned shift,
+                           bool bits32) {
+    if (bits32) {
+        const uint32_t lo = (uint32_t)occ, hi = (uint32_t)(occ>>32);
+        return (uint32_t)((lo*(uint32_t)magic) ^ (hi*(uint32_t)(magic>>32)))
+            >> shift;
+    } else {
+        return (occ*magic) >> shift;
+    }
+}
+
+// Tables indexed by the "magic" multiplication, for 64-bit builds or
+// (if "bits32" is true) for 32-bit builds.
+static void generateMagic(bool bits32) {
+    vector<uint64_t> offsets[2];
+    for (int i = 0; i < 2; i++) {
+        const SliderInfo &slider = (bits32 ? SLIDERS32 : SLIDERS)[i];
+        vector<uint64_t> moves;
+        for (int sq = 0; sq < 64; sq++) {
+            const uint64_t mask = generateSlidingMoves(sq,0,slider.info,true);
+            const size_t base = moves.size();
+            offsets[i].push_back(base);
+            moves.resize(base + (1ULL << ((bits32 ? 32 : 64)-slider.shift[sq])));
+            vector<bool> used(moves.size()-base);
+            // iterate through each possible combination of squares
+            // that can be occupied and generate the attacks.
+            for (uint64_t occBits = 0; occBits < (1ULL<<bitCount(mask)); occBits++) {
+                const uint64_t occ = generateOccupancy(mask,occBits);
+                const uint64_t index = magicIndex(occ,slider.magic[sq],
+                                                  slider.shift[sq],bits32);
+                const uint64_t attacks = generateSlidingMoves(sq,occ,slider.info);
+                if (used[index] && moves[base+index] != attacks) {
+                    fprintf(stderr,"bad %s magic for square %d\n",slider.name,sq);
+                    exit(1);
+                }
+                used[index] = true;
+                moves[base+index] = attacks;
+            }
+        }
+        char decl[64];
+        sprintf(decl,"uint64_t %sMoves",slider.name);
+        printArray(decl,moves);
+    }
+    for (int i = 0; i < 2; i++) {
+        const SliderInfo &slider = (bits32 ? SLIDERS32 : SLIDERS)[i];
+        printf("const CACHE_ALIGN Attacks::MagicData Attacks::%sMagicData[64] = {\n",slider.name);
+        for (int sq = 0; sq < 64; sq++) {
+            printf("{0x%llx,0x%llx,%sMoves+%d,%u}%s\n",
+                   (unsigned long long)generateSlidingMoves(sq,0,slider.info,true),
+                   (unsigned long long)slider.magic[sq],
+                   slider.name,(int)offsets[i][sq],slider.shift[sq],
+                   sq < 63 ? "," : "");
+        }
+        printf("};\n\n");
+    }
+}
+
+// Tables indexed by PEXT. Entries are compressed with PEXT and
+// expanded by the lookup with PDEP.
+static void generatePext() {
+    vector<uint64_t> moves;
+    vector<uint64_t> offsets[2];
+    for (int i = 0; i < 2; i++) {
+        const SliderInfo &slider = SLIDERS[i];
+        for (int sq = 0; sq < 64; sq++) {
+            const uint64_t mask = generateSlidingMoves(sq,0,slider.info,true);
+            const uint64_t attacks = generateSlidingMoves(sq,0,slider.info);
+            offsets[i].push_back(moves.size());
+            for (uint64_t occBits = 0; occBits < (1ULL<<bitCount(mask)); occBits++) {
+                const uint64_t occ = generateOccupancy(mask,occBits);
+                moves.push_back(extractBits(generateSlidingMoves(sq,occ,slider.info),attacks));
+            }
+        }
+    }
+    printArray("uint16_t pextMoves",moves);
+    for (int i = 0; i < 2; i++) {
+        const SliderInfo &slider = SLIDERS[i];
+        printf("const CACHE_ALIGN Attacks::PextData Attacks::%sPextData[64] = {\n",slider.name);
+        for (int sq = 0; sq < 64; sq++) {
+            printf("{pextMoves+%d,0x%llx,0x%llx}%s\n",(int)offsets[i][sq],
+                   (unsigned long long)generateSlidingMoves(sq,0,slider.info,true),
+                   (unsigned long long)generateSlidingMoves(sq,0,slider.info),
+                   sq < 63 ? "," : "");
+        }
+        printf("};\n\n");
+    }
+}
+
+int main(int argc, char **argv) {
+    printf("// This is a machine-generated file (see util/makemagic.cpp).  Do not edit.\n\n");
+    printf("#include \"attacks.h\"\n\n");
+    printf("#ifndef BMI2\n\n");
+    printf("#ifdef _64BIT\n\n");
+    generateMagic(false);
+    printf("#else\n\n");
+    generateMagic(true);
+    printf("#endif\n\n");
+    printf("#endif\n\n");
+    printf("#if defined(BMI2) || defined(CPU_DISPATCH)\n\n");
+    generatePext();
+    printf("#endif\n");
+    return 0;
+}
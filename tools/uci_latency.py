@@ -0,0 +1,116 @@
+#!/usr/bin/python3
+# -*- coding: utf-8 -*-
+
+# Copyright 2017 by Jon Dart. All Rights Reserved.
+# This code is under the MIT license: see license directory.
+#
+# Measures how quickly a UCI engine responds to "stop" and "ponderhit",
+# and how closely it keeps to a fixed move time.
+# Usage:
+# python3 uci_latency.py [-e engine] [-n trials] [-t threads] [-o options]
+# where options is a list of name=value UCI options separated by commas.
+
+import getopt, sys, subprocess, threading, time, queue
+from subprocess import Popen, PIPE
+
+class Options:
+   engine = './arasanx-64'
+   trials = 20
+   threads = 1
+   uci_options = []
+   # time to let the search run before sending the command (seconds)
+   search_time = 0.5
+
+options = Options()
+
+class Engine:
+   def __init__(self,path):
+      self.proc = Popen([path],stdin=PIPE,stdout=PIPE,universal_newlines=True,bufsize=1)
+      self.lines = queue.Queue()
+      self.reader = threading.Thread(target=self.read,daemon=True)
+      self.reader.start()
+
+   def read(self):
+      for line in self.proc.stdout:
+         self.lines.put((time.perf_counter(),line.strip()))
+
+   def send(self,cmd):
+      self.proc.stdin.write(cmd + '\n')
+      self.proc.stdin.flush()
+      return time.perf_counter()
+
+   # wait for a line starting with "prefix" and return its arrival time
+   def wait_for(self,prefix,timeout=60):
+      while True:
+         (t,line) = self.lines.get(timeout=timeout)
+         if line.startswith(prefix):
+            return t
+
+   def close(self):
+      self.send('quit')
+      self.proc.wait()
+
+def report(name,samples):
+   samples = sorted(samples)
+   n = len(samples)
+   print("%-10s n=%d min=%.3f median=%.3f p90=%.3f max=%.3f (ms)" %
+         (name, n, samples[0], samples[n//2], samples[min(n-1,(9*n)//10)],
+          samples[-1]))
+
+def main(argv):
+   try:
+      opts, args = getopt.getopt(argv,"e:n:t:o:")
+   except getopt.GetoptError:
+      print("usage: uci_latency.py [-e engine] [-n trials] [-t threads] [-o name=value,...]")
+      sys.exit(2)
+   for opt, arg in opts:
+      if opt == '-e':
+         options.engine = arg
+      elif opt == '-n':
+         options.trials = int(arg)
+      elif opt == '-t':
+         options.threads = int(arg)
+      elif opt == '-o':
+         options.uci_options = arg.split(',')
+
+   engine = Engine(options.engine)
+   engine.send('uci')
+   engine.wait_for('uciok')
+   engine.send('setoption name Threads value ' + str(options.threads))
+   for opt in options.uci_options:
+      name, value = opt.split('=')
+      engine.send('setoption name ' + name + ' value ' + value)
+   engine.send('isready')
+   engine.wait_for('readyok')
+
+   stop_times = []
+   ponderhit_times = []
+   movetime_over = []
+   for i in range(options.trials):
+      # stop during an infinite search
+      engine.send('ucinewgame')
+      engine.send('position startpos')
+      engine.send('go infinite')
+      time.sleep(options.search_time)
+      sent = engine.send('stop')
+      stop_times.append(1000.0*(engine.wait_for('bestmove')-sent))
+
+      # ponderhit when the time for the move has already been used
+      engine.send('position startpos moves e2e4 e7e5')
+      engine.send('go ponder wtime 100 btime 100')
+      time.sleep(options.search_time)
+      sent = engine.send('ponderhit')
+      ponderhit_times.append(1000.0*(engine.wait_for('bestmove')-sent))
+
+      # overshoot of a fixed time search
+      engine.send('position startpos')
+      sent = engine.send('go movetime 200')
+      movetime_over.append(1000.0*(engine.wait_for('bestmove')-sent)-200.0)
+
+   engine.close()
+   report('stop',stop_times)
+   report('ponderhit',ponderhit_times)
+   report('movetime',movetime_over)
+
+if __name__ == "__main__":
+   main(sys.argv[1:])